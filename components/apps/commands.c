@@ -7,276 +7,476 @@
 
 /****************************** Includes  */
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
-#include <cJSON.h>
+#include <stddef.h>
 
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
 #include "freertos/queue.h"
+#include "freertos/semphr.h"
 
 #include "sdkconfig.h"
 
 #include "esp_system.h"
 #include "esp_event.h"
-#include "esp_ota_ops.h"
-#include "esp_app_format.h"
-#include "esp_flash_partitions.h"
 #include "esp_log.h"
-#include "esp_http_client.h"
-#include "esp_partition.h"
+#include "esp_random.h"
+#include "esp_timer.h"
 
 #include "../drivers/mqtt.h"
+#include "../drivers/codec.h"
+#include "../drivers/latency.h"
+#include "../drivers/namehash.h"
+#include "../drivers/settings.h"
+#include "../drivers/sysmem.h"
+#include "../drivers/ramalloc.h"
+#include "commands.h"
+#include "jobs.h"
+#include "ota.h"
+#include "perf.h"
 
 /****************************** Configuration */
 #define CMD_SUBTOPIC "cmd"          // Subtopic for commands
 #define CMD_FWUP     "fwupdate"     // JSON Command for a FW update
 #define CMD_RESTART  "restart"      // JSON Command for restart
-#define BUF_SIZE     1024           // Size of buffer for transfers
+#define CMD_CANCEL   "cancel"       // JSON Command to cancel a job
+#define CMD_SELFTEST "selftest"     // JSON Command for the round-trip check
+#define CMD_PERF     "perf"         // JSON Command to switch the perf telemetry on/off
+#define CMD_LATENCY  "latency"      // JSON Command to publish the latency percentiles
+#define CMD_PING     "ping"         // JSON Command to echo the payload for a round-trip time
+#define CMD_SET      "set"          // JSON Command to change a setting
+#define CMD_LATENCY_SUBTOPIC "latency"  // Subtopic of the latency percentiles
+#define CMD_PONG_SUBTOPIC "pong"    // Subtopic of the ping answer
+#define CMD_BATCHSIZE 8             // Commands handled before yielding
+#define CMD_MAXNAME  16             // Max length of a command name
+#define CMD_MAXPARAM 256            // Max length of the command payload
+#define CMD_ARENASIZE 2048          // Scratch memory of one command, freed after it
+#define CMD_LATENCY_BUFFER 768      // Max size of the latency report
 
 /****************************** Statics */
 static const char *TAG = "CMD";
-static QueueHandle_t * pRxQueue;
-char ota_data[BUF_SIZE + 1] = { 0 };
+static QueueHandle_t xCmdQueue = NULL;
+static TaskHandle_t xCmdTask = NULL;
+
+// A decoded command
+typedef struct CmdRequest {
+    char    Cmd[CMD_MAXNAME];           // Name of the command
+    char    Payload[CMD_MAXPARAM];      // Parameter of the command
+    char    Sha256[65];                 // fwupdate: SHA-256 of the image as hex, optional
+    uint32_t RxUs;                      // esp_timer time the message was received
+} CmdRequest;
+
+static const JsonDec_Field CmdFields[] = {
+    JSONDEC_FIELD_STRING(CmdRequest, Cmd, "cmd"),
+    JSONDEC_FIELD_STRING(CmdRequest, Payload, "payload"),
+    JSONDEC_FIELD_STRING(CmdRequest, Sha256, "sha256"),
+};
+#define CMD_FIELD_CMD BIT0          // Found-bit of the command name
+
+typedef void (*CmdHandler)(const CmdRequest * pRequest);
+
+typedef struct CmdEntry {
+    const char *    Name;           // Name of the command
+    CmdHandler      Handler;        // Function to execute
+} CmdEntry;
+
+static void cmd_fwupdate(const CmdRequest * pRequest);
+static void cmd_restart(const CmdRequest * pRequest);
+static void cmd_cancel(const CmdRequest * pRequest);
+static void cmd_selftest(const CmdRequest * pRequest);
+static void cmd_perf(const CmdRequest * pRequest);
+static void cmd_latency(const CmdRequest * pRequest);
+static void cmd_ping(const CmdRequest * pRequest);
+static void cmd_set(const CmdRequest * pRequest);
+
+static const CmdEntry Commands[] = {
+    { CMD_FWUP,     cmd_fwupdate },
+    { CMD_RESTART,  cmd_restart },
+    { CMD_CANCEL,   cmd_cancel },
+    { CMD_SELFTEST, cmd_selftest },
+    { CMD_PERF,     cmd_perf },
+    { CMD_LATENCY,  cmd_latency },
+    { CMD_PING,     cmd_ping },
+    { CMD_SET,      cmd_set },
+};
+#define CMD_COUNT (sizeof(Commands)/sizeof(Commands[0]))
+
+static uint32_t CmdProcessed = 0;      // Number of handled commands
+static NameHash CmdHash;                // Perfect hash of the command names
+static SemaphoreHandle_t xSelfTest = NULL; // Given when the self test command arrived
+static uint32_t SelfTestNonce = 0;      // Expected payload of the self test
+static RamArena CmdArena;               // Buffers of the handlers, reset after each command
+
+// Stages of a command, timestamps taken by the receive path and here
+typedef enum CmdStage {
+    CMD_STAGE_RX = 0,               // First fragment until passed to the queue
+    CMD_STAGE_QUEUE,                // Waiting in the command queue
+    CMD_STAGE_EXEC,                 // Decoding and executing
+    CMD_STAGE_TOTAL,                // First fragment until executed
+    CMD_STAGES
+} CmdStage;
+
+static const char * const CmdStageNames[CMD_STAGES] = { "rx", "queue", "exec", "total" };
+static Latency_Hist CmdLatency[CMD_STAGES];
 
 /****************************** Functions */
 
 /**
- * @brief Starts a FW update from URL (OTA update)
+ * @brief Find the entry of a command
  *
- * @param url
+ * @param Name The command name
+ * @return const CmdEntry* NULL if unknown
  */
-void cmd_fwupdate(char * url) {
-    esp_err_t err;
-    int file_length = 0; // length of bin file
-    bool was_checked = false;
-    esp_ota_handle_t update_hdl = 0;
+static const CmdEntry * cmd_lookup(const char * Name) {
+    const int Index = NameHash_Find(&CmdHash, Name);
 
-    ESP_LOGI(TAG, "FW Update: Starting with URL '%s'", url);
-
-    // Get partition data, print some info and check the prereqs
-    const esp_partition_t *part_run = esp_ota_get_running_partition();
-    const esp_partition_t *part_next = esp_ota_get_next_update_partition(NULL);
+    return ((Index >= 0) ? &Commands[Index] : NULL);
+}
 
-    ESP_LOGI(TAG, "Partition Infos:");
-    ESP_LOGI(TAG, "Running: type %d subtype %d (offset 0x%08lx, label '%s')", part_run->type, part_run->subtype, part_run->address, part_run->label);
-    ESP_LOGI(TAG, "Next:    type %d subtype %d (offset 0x%08lx, label '%s')", part_next->type, part_next->subtype, part_next->address, part_next->label);
+/**
+ * @brief Restart the system
+ *
+ * @param pRequest
+ */
+static void cmd_restart(const CmdRequest * pRequest) {
+    ESP_LOGW(TAG, "Restart!");
+    Settings_Flush();
+    vTaskDelay(250 / portTICK_PERIOD_MS); // 250ms delay
+    esp_restart();
+}
 
-    if (NULL == part_next) {
-        ESP_LOGE(TAG, "FW Update: Partition to write to is NULL! Aborting");
-        return;
+/**
+ * @brief Convert a hex string to binary
+ *
+ * @param Hex The string, must have exactly 2*Size digits
+ * @param pOut Output buffer
+ * @param Size Size of the output
+ * @return esp_err_t
+ */
+static esp_err_t cmd_parse_hex(const char * Hex, uint8_t * pOut, size_t Size) {
+    if (strlen(Hex) != (2 * Size)) {
+        return (ESP_ERR_INVALID_SIZE);
+    }
+    for (size_t i = 0; i < (2 * Size); i++) {
+        const char c = Hex[i];
+        uint8_t Digit;
+
+        if ((c >= '0') && (c <= '9')) {
+            Digit = c - '0';
+        } else if ((c >= 'a') && (c <= 'f')) {
+            Digit = c - 'a' + 10;
+        } else if ((c >= 'A') && (c <= 'F')) {
+            Digit = c - 'A' + 10;
+        } else {
+            return (ESP_ERR_INVALID_ARG);
+        }
+        pOut[i / 2] = (pOut[i / 2] << 4) | Digit;
     }
+    return (ESP_OK);
+}  // cmd_parse_hex
 
-    // Set up http(s) transfer of the fw file
-    esp_http_client_config_t config = {
-        .url = url,
-        .timeout_ms = 2000,     // 2s connection timeout
-        .keep_alive_enable = true,
-    };
+/**
+ * @brief Start a FW update job
+ *
+ * @param pRequest Payload is the URL, optional sha256 the digest of the image
+ */
+static void cmd_fwupdate(const CmdRequest * pRequest) {
+    OTA_Request Update;
 
-    esp_http_client_handle_t client = esp_http_client_init(&config);
-    if (client == NULL) {
-        ESP_LOGE(TAG, "FW Update: Cannot init HTTP connection!");
+    if (Jobs_IsActive(CMD_FWUP)) {
+        ESP_LOGW(TAG, "FW Update: Already running");
         return;
     }
-    err = esp_http_client_open(client, 0);
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "FW Update: Cannot open HTTP connection, err %s", esp_err_to_name(err));
-        esp_http_client_cleanup(client);
-        return;
+
+    memset(&Update, 0x00, sizeof(Update));
+    strlcpy(Update.Url, pRequest->Payload, sizeof(Update.Url));
+    if (0x00 != pRequest->Sha256[0]) {
+        if (ESP_OK != cmd_parse_hex(pRequest->Sha256, Update.Sha256, sizeof(Update.Sha256))) {
+            ESP_LOGW(TAG, "FW Update: Invalid sha256");
+            return;
+        }
+        Update.hasSha256 = true;
     }
-    esp_http_client_fetch_headers(client);
 
-    file_length = 0;
-    was_checked = false;
+    const uint32_t Id = Jobs_Submit(CMD_FWUP, OTA_Job, &Update, sizeof(Update), OTA_STACKSIZE, OTA_READER_CORE);
+    ESP_LOGI(TAG, "FW Update: Started as job %lu", (unsigned long)Id);
+}
 
-    // The loop for transfer and programming
-    while (1) {
-        int bytes_read = esp_http_client_read(client, ota_data, BUF_SIZE);
-        if (bytes_read == 0) {
-            // Connection closed due to error
-            if (errno == ECONNRESET || errno == ENOTCONN) {
-                ESP_LOGE(TAG, "FW Update: Connection closed, errno = %d", errno);
-                break;
-            }
-            // Connection closed due to complete
-            if (esp_http_client_is_complete_data_received(client) == true) {
-                ESP_LOGI(TAG, "FW Update: Connection closed");
-                break;
-            }
-        } else if (bytes_read < 0) { // Error
-            ESP_LOGE(TAG, "FW Update: SSL data read error");
-            esp_http_client_close(client);
-            esp_http_client_cleanup(client);
-            return;
-        } else if (bytes_read > 0) { // Data received
-
-            // Check the firmware header
-            if (was_checked == false) {
-                esp_app_desc_t new_fw_info;
-                if (bytes_read > sizeof(esp_image_header_t) + sizeof(esp_image_segment_header_t) + sizeof(esp_app_desc_t)) {
-
-                    // The current version
-                    esp_app_desc_t running_fw_info;
-                    if (esp_ota_get_partition_description(part_run, &running_fw_info) == ESP_OK) {
-                        ESP_LOGI(TAG, "FW Update: Running version: %s", running_fw_info.version);
-                    }
-
-                    // The new version
-                    memcpy(&new_fw_info, &ota_data[sizeof(esp_image_header_t) + sizeof(esp_image_segment_header_t)], sizeof(esp_app_desc_t));
-                    ESP_LOGI(TAG, "FW Update: New version: %s", new_fw_info.version);
-
-                    // Last invalid version
-                    const esp_partition_t* part_last_inv = esp_ota_get_last_invalid_partition();
-                    esp_app_desc_t invalid_app_info;
-                    if (esp_ota_get_partition_description(part_last_inv, &invalid_app_info) == ESP_OK) {
-                        ESP_LOGI(TAG, "FW Update: Invalid version: %s", invalid_app_info.version);
-                    }
-
-                    // Check before flashing: Invalid firmware
-                    if (part_last_inv != NULL) {
-                        if (memcmp(invalid_app_info.version, new_fw_info.version, sizeof(new_fw_info.version)) == 0) {
-                            ESP_LOGE(TAG, "FW Update: Trying to reflash a invalid FW. Aborting");
-                            esp_http_client_close(client);
-                            esp_http_client_cleanup(client);
-                            return;
-                        }
-                    }
-#if 0
-                    // Check before flashing: Same version
-                    if (memcmp(new_fw_info.version, running_fw_info.version, sizeof(new_fw_info.version)) == 0) {
-                        ESP_LOGE(TAG, "FW Update: Reflashing same FW. Aborting");
-                        esp_http_client_close(client);
-                        esp_http_client_cleanup(client);
-                        return;
-                    }
-#endif
-                    was_checked = true;
-
-                    err = esp_ota_begin(part_next, OTA_WITH_SEQUENTIAL_WRITES, &update_hdl);
-                    if (err != ESP_OK) {
-                        ESP_LOGE(TAG, "FW Update: esp_ota_begin failed (%s)", esp_err_to_name(err));
-                        esp_http_client_close(client);
-                        esp_http_client_cleanup(client);
-                        esp_ota_abort(update_hdl);
-                        return;
-                    }
-                } else {
-                    ESP_LOGE(TAG, "FW Update: Received package length error");
-                    esp_http_client_close(client);
-                    esp_http_client_cleanup(client);
-                    esp_ota_abort(update_hdl);
-                    return;
-                }
-            }  // was_checked
-
-            // Write the data
-            err = esp_ota_write(update_hdl, (const void *)ota_data, bytes_read);
-            if (err != ESP_OK) {
-                ESP_LOGE(TAG, "FW Update: Failed to write data");
-                esp_http_client_close(client);
-                esp_http_client_cleanup(client);
-                esp_ota_abort(update_hdl);
-                return;
-            }
-            file_length += bytes_read;
-            ESP_LOGI(TAG, "FW Update: Written image length = %d", file_length);
+/**
+ * @brief Cancel a running job
+ *
+ * @param pRequest Payload is the job id
+ */
+static void cmd_cancel(const CmdRequest * pRequest) {
+    const uint32_t Id = strtoul(pRequest->Payload, NULL, 10);
 
+    if (ESP_OK != Jobs_Cancel(Id)) {
+        ESP_LOGW(TAG, "Cancel: No job %lu", (unsigned long)Id);
+    }
+}
 
-        }  // bytes_read
-    }  // while 1
+/**
+ * @brief Self test command sent by Comm_SelfTest() has arrived
+ *
+ * @param pRequest Payload is the nonce
+ */
+static void cmd_selftest(const CmdRequest * pRequest) {
+    if (strtoul(pRequest->Payload, NULL, 10) == SelfTestNonce) {
+        xSemaphoreGive(xSelfTest);
+    }
+}
 
-    ESP_LOGI(TAG, "FW Update: Total FW size = %d", file_length);
+/**
+ * @brief Switch the perf telemetry on or off
+ *
+ * @param pRequest Payload is "on" or "off"
+ */
+static void cmd_perf(const CmdRequest * pRequest) {
+    if (0 == strcmp(pRequest->Payload, "on")) {
+        Perf_Enable(true);
+    } else if (0 == strcmp(pRequest->Payload, "off")) {
+        Perf_Enable(false);
+    } else {
+        ESP_LOGW(TAG, "Perf: Invalid payload '%s'", pRequest->Payload);
+    }
+}
 
-    // Check for complete transfer
-    if (esp_http_client_is_complete_data_received(client) != true) {
-        ESP_LOGE(TAG, "FW Update: Error, file incomplete");
-        esp_http_client_close(client);
-        esp_http_client_cleanup(client);
-        esp_ota_abort(update_hdl);
+/**
+ * @brief Publish the latency percentiles of all stages
+ *
+ * Members per stage: <stage>.n, .p50, .p95, .p99 and .max, in us. Also
+ * the queue counters cmd.proc, cmd.drop, cmd.hwm and, with run time
+ * stats, the CPU time of the command task in cmd.cpu (us since boot).
+ *
+ * @param pRequest Payload "reset" clears the histograms afterwards
+ */
+static void cmd_latency(const CmdRequest * pRequest) {
+    static const uint8_t Percentiles[] = { 50, 95, 99 };
+    uint8_t * pBuffer = RamArena_Alloc(&CmdArena, CMD_LATENCY_BUFFER);
+    char Key[24];
+    Codec_Writer Payload;
+    size_t Length;
+
+    if (NULL == pBuffer) {
         return;
     }
+    Codec_Begin(&Payload, Codec_GetFormat(CMD_LATENCY_SUBTOPIC), pBuffer, CMD_LATENCY_BUFFER);
+    for (int i = 0; i < CMD_STAGES; i++) {
+        snprintf(Key, sizeof(Key), "%s.n", CmdStageNames[i]);
+        Codec_AddInt(&Payload, Key, Latency_Count(&CmdLatency[i]));
+        for (int j = 0; j < sizeof(Percentiles); j++) {
+            snprintf(Key, sizeof(Key), "%s.p%u", CmdStageNames[i], Percentiles[j]);
+            Codec_AddInt(&Payload, Key, Latency_Percentile(&CmdLatency[i], Percentiles[j]));
+        }
+        snprintf(Key, sizeof(Key), "%s.max", CmdStageNames[i]);
+        Codec_AddInt(&Payload, Key, CmdLatency[i].MaxUs);
+    }
+
+    Comm_Stats Stats;
+    Comm_GetStats(&Stats);
+    Codec_AddInt(&Payload, "cmd.proc", Stats.Processed);
+    Codec_AddInt(&Payload, "cmd.drop", Stats.Dropped);
+    Codec_AddInt(&Payload, "cmd.hwm", Stats.HighWater);
+#if CONFIG_FREERTOS_USE_TRACE_FACILITY && CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+    TaskStatus_t Task;
+    vTaskGetInfo(xCmdTask, &Task, pdFALSE, eRunning);
+    Codec_AddInt(&Payload, "cmd.cpu", Task.ulRunTimeCounter);
+#endif
+
+    esp_err_t ret = Codec_End(&Payload, &Length);
+    if (ESP_OK == ret) {
+        ret = MQTT_Publish(CMD_LATENCY_SUBTOPIC, pBuffer, Length, NULL);
+    }
+    if (ESP_OK != ret) {
+        ESP_LOGW(TAG, "Latency: Cannot publish (%s)", esp_err_to_name(ret));
+    }
 
-    // Finalize and verify
-    err = esp_ota_end(update_hdl);
-    if (err != ESP_OK) {
-        if (err == ESP_ERR_OTA_VALIDATE_FAILED) {
-            ESP_LOGE(TAG, "FW Update: Error, fw corrupt");
+    if (0 == strcmp(pRequest->Payload, "reset")) {
+        for (int i = 0; i < CMD_STAGES; i++) {
+            Latency_Reset(&CmdLatency[i]);
         }
-        ESP_LOGE(TAG, "FW Update: Error, esp_ota_end failed (%s)!", esp_err_to_name(err));
-        esp_http_client_close(client);
-        esp_http_client_cleanup(client);
+    }
+}  // cmd_latency
+
+/**
+ * @brief Answer a ping on the pong subtopic
+ *
+ * The answer has the payload and the time the command spent in the
+ * device ("dwell", us). So the sender gets the round-trip time and can
+ * split it into network and device time.
+ *
+ * @param pRequest Payload is echoed, e.g. a sequence number or timestamp of the sender
+ */
+static void cmd_ping(const CmdRequest * pRequest) {
+    static const MQTT_TxOptions Options = { .Qos = 0 };
+    const size_t Size = CMD_MAXPARAM + 32;
+    uint8_t * pBuffer = RamArena_Alloc(&CmdArena, Size);
+    Codec_Writer Payload;
+    size_t Length;
+
+    if (NULL == pBuffer) {
         return;
     }
+    Codec_Begin(&Payload, Codec_GetFormat(CMD_PONG_SUBTOPIC), pBuffer, Size);
+    Codec_AddString(&Payload, "payload", pRequest->Payload);
+    Codec_AddInt(&Payload, "dwell", (uint32_t)esp_timer_get_time() - pRequest->RxUs);
+
+    esp_err_t ret = Codec_End(&Payload, &Length);
+    if (ESP_OK == ret) {
+        ret = MQTT_Publish(CMD_PONG_SUBTOPIC, pBuffer, Length, &Options);
+    }
+    if (ESP_OK != ret) {
+        ESP_LOGW(TAG, "Ping: Cannot answer (%s)", esp_err_to_name(ret));
+    }
+}  // cmd_ping
 
-    // Set new partition
-    err = esp_ota_set_boot_partition(part_next);
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "FW Update: Setting new boot partition failed (%s)!", esp_err_to_name(err));
-        esp_http_client_close(client);
-        esp_http_client_cleanup(client);
+/**
+ * @brief Change a setting
+ *
+ * @param pRequest Payload is "<namespace>.<key>=<value>", e.g. "TELEMETRY.PERIOD=30000"
+ */
+static void cmd_set(const CmdRequest * pRequest) {
+    char * Name = RamArena_Alloc(&CmdArena, CMD_MAXPARAM);
+
+    if (NULL == Name) {
+        return;
+    }
+    strlcpy(Name, pRequest->Payload, CMD_MAXPARAM);
+    char * pValue = strchr(Name, '=');
+    if (NULL == pValue) {
+        ESP_LOGW(TAG, "Set: Invalid payload '%s'", pRequest->Payload);
         return;
     }
+    *pValue++ = 0x00;
 
-    // Final delay (probably not necessary) ans reboot into new FW
-    vTaskDelay(250 / portTICK_PERIOD_MS);
-    esp_restart();
+    const esp_err_t ret = Settings_SetFromString(Name, pValue);
+    if (ESP_OK != ret) {
+        ESP_LOGW(TAG, "Set: Cannot set '%s' (%s)", Name, esp_err_to_name(ret));
+    } else {
+        ESP_LOGI(TAG, "Set: '%s' changed", Name);
+    }
+}  // cmd_set
+
+/**
+ * @brief Decode and execute one received command
+ *
+ * @param pRxMessage The message, is released here
+ */
+static void cmd_handle(MQTT_RXMessage * pRxMessage) {
+    const uint32_t DequeuedUs = (uint32_t)esp_timer_get_time();
+    const uint32_t QueuedUs = pRxMessage->QueuedUs;
+    CmdRequest Request;
+    uint32_t Found = 0;
+
+    // Check for correct subtopic
+    if (0 != strcmp(pRxMessage->SubTopic, CMD_SUBTOPIC)) {
+        ESP_LOGW(TAG, "Unknown subtopic '%s'!", pRxMessage->SubTopic);
+        MQTT_RxRelease(pRxMessage);
+        return;
+    }
+
+    // Decode (JSON or CBOR) and give back the message before executing
+    Request.Cmd[0] = 0x00;
+    Request.Payload[0] = 0x00;
+    Request.Sha256[0] = 0x00;
+    Request.RxUs = pRxMessage->RxUs;
+    esp_err_t ret = Codec_DecodeObject(pRxMessage->Payload, pRxMessage->PayloadLen,
+                                       CmdFields, sizeof(CmdFields)/sizeof(CmdFields[0]), &Request, &Found);
+    MQTT_RxRelease(pRxMessage);
+
+    if (ESP_OK != ret) {
+        ESP_LOGW(TAG, "Error parsing payload (%s)", esp_err_to_name(ret));
+    } else if (0 == (Found & CMD_FIELD_CMD)) {
+        ESP_LOGW(TAG, "Error slicing payload");
+    } else {
+        const CmdEntry * pEntry = cmd_lookup(Request.Cmd);
+        if (NULL != pEntry) {
+            pEntry->Handler(&Request);
+        } else {
+            ESP_LOGW(TAG, "Unknown command '%s'", Request.Cmd);
+        }
+    }
+    RamArena_Reset(&CmdArena);
+
+    const uint32_t DoneUs = (uint32_t)esp_timer_get_time();
+    Latency_Record(&CmdLatency[CMD_STAGE_RX], QueuedUs - Request.RxUs);
+    Latency_Record(&CmdLatency[CMD_STAGE_QUEUE], DequeuedUs - QueuedUs);
+    Latency_Record(&CmdLatency[CMD_STAGE_EXEC], DoneUs - DequeuedUs);
+    Latency_Record(&CmdLatency[CMD_STAGE_TOTAL], DoneUs - Request.RxUs);
+}  // cmd_handle
 
-    return;
-}
 /**
  * @brief Receive and handle incoming commands
  *
+ * Blocks until a command arrives, then drains everything pending.
+ * After every CMD_BATCHSIZE commands the task yields.
+ *
  * @param pvParameters
  */
 void TaskCommand(void* pvParameters) {
     while (1) {
-        MQTT_RXMessage RxMessage;
+        MQTT_RXMessage * pRxMessage;
+        int Batch = 0;
 
         // Wait blocking for a message
-        // TODO Check with peek to avoid removing other apps topics
-        if (pdTRUE == xQueueReceive(*pRxQueue, &RxMessage, portMAX_DELAY)) {
-
-            // Check for correct subtopic
-            if (0 == strcmp(RxMessage.SubTopic, CMD_SUBTOPIC)) {
-                cJSON *jsondata = cJSON_Parse(RxMessage.Payload);
-
-                if (NULL == jsondata) {
-                    ESP_LOGW(TAG, "Error parsing JSON payload");
-                } else {
-                    cJSON *cmd = cJSON_GetObjectItemCaseSensitive(jsondata, "cmd");
-                    cJSON *payload = cJSON_GetObjectItemCaseSensitive(jsondata, "payload");
-
-                    if (cJSON_IsString(cmd) && (cmd->valuestring != NULL)
-                     && cJSON_IsString(payload) && (payload->valuestring != NULL)) {
-
-                        // Command: FW Update
-                        if (0 == strcmp(cmd->valuestring, CMD_FWUP)) {
-                            cmd_fwupdate(payload->valuestring);
-                        }
-                        // Command: FW Update
-                        else if (0 == strcmp(cmd->valuestring, CMD_RESTART)) {
-                            ESP_LOGW(TAG, "Restart!");
-                            vTaskDelay(250 / portTICK_PERIOD_MS); // 250ms delay
-                            esp_restart();
-                        }
-                        // Command: Unknown command
-                        else {
-                            ESP_LOGW(TAG, "Unknown command '%s'", cmd->valuestring);
-                        }
-                    } else {
-                        ESP_LOGW(TAG, "Error slicing JSON payload");
-                    }
-                }
-                cJSON_Delete(jsondata);
-            } else {
-                ESP_LOGW(TAG, "Unknown subtopic '%s'!", RxMessage.SubTopic);
+        if (pdTRUE != xQueueReceive(xCmdQueue, &pRxMessage, portMAX_DELAY)) {
+            continue;
+        }
+
+        do {
+            cmd_handle(pRxMessage);
+            CmdProcessed++;
 
+            if (++Batch >= CMD_BATCHSIZE) {
+                taskYIELD();
+                Batch = 0;
             }
-        }
-        vTaskDelay(50 / portTICK_PERIOD_MS); // 50ms delay
+        } while (pdTRUE == xQueueReceive(xCmdQueue, &pRxMessage, 0));
     }
 }
 
+/**
+ * @brief Get the counters of the command interpreter
+ *
+ * @param pStats
+ * @return esp_err_t
+ */
+esp_err_t Comm_GetStats(Comm_Stats * pStats) {
+    MQTT_RxStats RxStats;
+
+    esp_err_t ret = MQTT_GetRxStats(xCmdQueue, &RxStats);
+    pStats->Processed = CmdProcessed;
+    pStats->Dropped = RxStats.Dropped;
+    pStats->HighWater = RxStats.HighWater;
+
+    return (ret);
+}
+
+/**
+ * @brief Send a command to ourselves and wait until it is executed
+ *
+ * The command goes through the broker, the receive path and the command
+ * task, so success means the device is remote controllable.
+ *
+ * @param Timeout Max time to wait for the command
+ * @return esp_err_t ESP_ERR_TIMEOUT
+ */
+esp_err_t Comm_SelfTest(TickType_t Timeout) {
+    char Payload[64];
+
+    SelfTestNonce = esp_random();
+    xSemaphoreTake(xSelfTest, 0);   // Forget an old answer
+
+    snprintf(Payload, sizeof(Payload), "{\"cmd\":\"%s\",\"payload\":\"%lu\"}", CMD_SELFTEST, (unsigned long)SelfTestNonce);
+    esp_err_t ret = MQTT_Transmit(CMD_SUBTOPIC, Payload);
+    if ((ESP_OK != ret) && (ESP_ERR_NOT_FINISHED != ret)) {    // Stored: Sent after older messages
+        return (ret);
+    }
+
+    return ((pdTRUE == xSemaphoreTake(xSelfTest, Timeout)) ? ESP_OK : ESP_ERR_TIMEOUT);
+}  // Comm_SelfTest
+
 /**
  * @brief Init Command interpreter
  *
@@ -284,10 +484,19 @@ void TaskCommand(void* pvParameters) {
  */
 esp_err_t Comm_Init(void) {
 
-    MQTT_Subscribe(CMD_SUBTOPIC);
-    pRxQueue = MQTT_GetRxQueue();
+    ESP_ERROR_CHECK(NameHash_Build(&CmdHash, Commands, CMD_COUNT, sizeof(CmdEntry)));
+    ESP_ERROR_CHECK(Jobs_Init());
+    ESP_ERROR_CHECK(RamArena_Init(&CmdArena, "cmd_arena", RAM_SYS_COMMAND, CMD_ARENASIZE));
 
-    xTaskCreate(TaskCommand, "Command Task", 4096, NULL, tskIDLE_PRIORITY, NULL);
+    xCmdQueue = SYSMEM_QUEUE("cmd", SYSMEM_QUEUE_COMMAND, sizeof(MQTT_RXMessage *));
+    xSelfTest = SYSMEM_SEMAPHORE("cmd_selftest", xSemaphoreCreateBinary);
+    if ((NULL == xCmdQueue) || (NULL == xSelfTest)) {
+        ESP_LOGE(TAG, "Failed to create command queue!");
+        return (ESP_ERR_NO_MEM);
+    }
+    // Queued commands are kept under load, a flood cannot push out e.g. a restart
+    static const MQTT_RxLane Lane = { .Priority = MQTT_RX_PRIO_HIGH, .Policy = MQTT_RX_DROP_NEWEST };
+    ESP_ERROR_CHECK(MQTT_SubscribeLane(CMD_SUBTOPIC, xCmdQueue, &Lane));
 
-    return (ESP_OK);
+    return (SYSMEM_TASK(TaskCommand, "Command Task", SYSMEM_STACK_COMMAND, NULL, tskIDLE_PRIORITY, &xCmdTask));
 }  // MQTT_Init
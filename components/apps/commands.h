@@ -12,7 +12,16 @@
 extern "C" {
 #endif
 
+// Counters of the command interpreter
+typedef struct Comm_Stats {
+    uint32_t    Processed;              // Handled commands
+    uint32_t    Dropped;                // Commands dropped before handling
+    uint32_t    HighWater;              // Max number of queued commands
+} Comm_Stats;
+
 esp_err_t       Comm_Init(void);
+esp_err_t       Comm_GetStats(Comm_Stats * pStats);
+esp_err_t       Comm_SelfTest(TickType_t Timeout);
 
 #ifdef __cplusplus
 }
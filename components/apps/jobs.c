@@ -0,0 +1,251 @@
+/**
+ ******************************************************************************
+ *  file           : jobs.c
+ *  brief          : Executor for long running jobs
+ *
+ *  Every job runs in its own task with its own stack, so slow commands
+ *  don't block the command interpreter. State and progress of a job are
+ *  published to the subtopic job/<id>.
+ ******************************************************************************
+ */
+
+/****************************** Includes  */
+#include <stdio.h>
+#include <string.h>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include "esp_log.h"
+
+#include "../drivers/mqtt.h"
+#include "../drivers/codec.h"
+#include "jobs.h"
+
+/****************************** Configuration */
+#define MAX_JOBS        4               // Max number of parallel jobs
+#define MAX_JOBNAME     16              // Max length of a job name
+#define MAX_JOBINFO     128             // Max length of progress info
+#define JOB_SUBTOPIC    "job"           // Subtopic for the job states
+#define JOB_PRIORITY    (tskIDLE_PRIORITY + 1)
+
+/****************************** Statics */
+static const char *TAG = "JOBS";
+
+struct Job {
+    uint32_t        Id;                     // Job id, 0 if the slot is free
+    char            Name[MAX_JOBNAME];      // Name of the job
+    JobFunction     Function;               // The function to execute
+    volatile bool   isCancelled;            // Cancel requested
+    uint32_t        Arg[(JOBS_MAXARG + 3) / 4]; // Copy of the argument
+};
+
+static Job Jobs[MAX_JOBS];
+static uint32_t NextId = 1;
+static portMUX_TYPE JobsLock = portMUX_INITIALIZER_UNLOCKED;
+
+/****************************** Functions */
+
+/**
+ * @brief Publish the state of a job
+ *
+ * @param pJob The job
+ * @param State Text of the state
+ * @param Percent Progress, <0 to omit
+ * @param Info Additional info, NULL to omit
+ */
+static void job_publish(const Job * pJob, const char * State, int Percent, const char * Info) {
+    char SubTopic[24];
+    uint8_t Buffer[(2 * MAX_JOBINFO) + 96];     // Room for escapes in the info
+    Codec_Writer Payload;
+    size_t Length;
+
+    snprintf(SubTopic, sizeof(SubTopic), "%s/%lu", JOB_SUBTOPIC, (unsigned long)pJob->Id);
+
+    Codec_Begin(&Payload, Codec_GetFormat(JOB_SUBTOPIC), Buffer, sizeof(Buffer));
+    Codec_AddInt(&Payload, "id", pJob->Id);
+    Codec_AddString(&Payload, "name", pJob->Name);
+    Codec_AddString(&Payload, "state", State);
+    if (Percent >= 0) {
+        Codec_AddInt(&Payload, "progress", Percent);
+    }
+    if (NULL != Info) {
+        char Text[MAX_JOBINFO];
+        strlcpy(Text, Info, sizeof(Text));
+        Codec_AddString(&Payload, "info", Text);
+    }
+
+    const esp_err_t ret = Codec_End(&Payload, &Length);
+    if (ESP_OK != ret) {
+        ESP_LOGW(TAG, "Job %lu: Cannot encode state (%s)", (unsigned long)pJob->Id, esp_err_to_name(ret));
+        return;
+    }
+    MQTT_TransmitData(SubTopic, Buffer, Length);
+}  // job_publish
+
+/**
+ * @brief Task running one job
+ *
+ * @param pvParameters The job
+ */
+static void TaskJob(void* pvParameters) {
+    Job * pJob = pvParameters;
+
+    ESP_LOGI(TAG, "Job %lu '%s' started", (unsigned long)pJob->Id, pJob->Name);
+    job_publish(pJob, "running", 0, NULL);
+
+    const esp_err_t ret = pJob->Function(pJob, pJob->Arg);
+
+    if (pJob->isCancelled) {
+        job_publish(pJob, "cancelled", -1, NULL);
+    } else if (ESP_OK == ret) {
+        job_publish(pJob, "done", 100, NULL);
+    } else {
+        job_publish(pJob, "failed", -1, esp_err_to_name(ret));
+    }
+    ESP_LOGI(TAG, "Job %lu '%s' finished (%s)", (unsigned long)pJob->Id, pJob->Name, esp_err_to_name(ret));
+
+    // Free the slot
+    taskENTER_CRITICAL(&JobsLock);
+    pJob->Id = 0;
+    taskEXIT_CRITICAL(&JobsLock);
+
+    vTaskDelete(NULL);
+}  // TaskJob
+
+/**
+ * @brief Init the job executor
+ *
+ * @return esp_err_t
+ */
+esp_err_t Jobs_Init(void) {
+    memset(Jobs, 0x00, sizeof(Jobs));
+    return (ESP_OK);
+}
+
+/**
+ * @brief Start a job in its own task
+ *
+ * @param Name Name of the job
+ * @param Function The job function
+ * @param pArg Argument, is copied
+ * @param ArgSize Size of the argument, max JOBS_MAXARG
+ * @param StackSize Stack size of the task
+ * @param CoreId Core to run on or tskNO_AFFINITY
+ * @return uint32_t The job id, 0 on error
+ */
+uint32_t Jobs_Submit(const char * Name, JobFunction Function, const void * pArg, size_t ArgSize, uint32_t StackSize, BaseType_t CoreId) {
+    Job * pJob = NULL;
+
+    if ((NULL == Function) || (ArgSize > JOBS_MAXARG)) {
+        return (0);
+    }
+
+    // Reserve a slot
+    taskENTER_CRITICAL(&JobsLock);
+    for (int i = 0; i < MAX_JOBS; i++) {
+        if (0 == Jobs[i].Id) {
+            pJob = &Jobs[i];
+            pJob->Id = NextId++;
+            break;
+        }
+    }
+    taskEXIT_CRITICAL(&JobsLock);
+
+    if (NULL == pJob) {
+        ESP_LOGW(TAG, "Cannot start '%s': Too many jobs", Name);
+        return (0);
+    }
+
+    strlcpy(pJob->Name, Name, sizeof(pJob->Name));
+    pJob->Function = Function;
+    pJob->isCancelled = false;
+    if (NULL != pArg) {
+        memcpy(pJob->Arg, pArg, ArgSize);
+    }
+
+    if (pdPASS != xTaskCreatePinnedToCore(TaskJob, pJob->Name, StackSize, pJob, JOB_PRIORITY, NULL, CoreId)) {
+        ESP_LOGE(TAG, "Cannot start '%s': Task creation failed", Name);
+        taskENTER_CRITICAL(&JobsLock);
+        pJob->Id = 0;
+        taskEXIT_CRITICAL(&JobsLock);
+        return (0);
+    }
+
+    return (pJob->Id);
+}  // Jobs_Submit
+
+/**
+ * @brief Request the cancellation of a job
+ *
+ * The job function has to check Jobs_IsCancelled() and stop itself.
+ *
+ * @param Id The job id
+ * @return esp_err_t ESP_ERR_NOT_FOUND if no such job is running
+ */
+esp_err_t Jobs_Cancel(uint32_t Id) {
+    esp_err_t ret = ESP_ERR_NOT_FOUND;
+
+    taskENTER_CRITICAL(&JobsLock);
+    for (int i = 0; (i < MAX_JOBS) && (0 != Id); i++) {
+        if (Jobs[i].Id == Id) {
+            Jobs[i].isCancelled = true;
+            ret = ESP_OK;
+        }
+    }
+    taskEXIT_CRITICAL(&JobsLock);
+
+    return (ret);
+}  // Jobs_Cancel
+
+/**
+ * @brief Check if a job with this name is running
+ *
+ * @param Name Name of the job
+ * @return true
+ * @return false
+ */
+bool Jobs_IsActive(const char * Name) {
+    bool isActive = false;
+
+    taskENTER_CRITICAL(&JobsLock);
+    for (int i = 0; i < MAX_JOBS; i++) {
+        if ((0 != Jobs[i].Id) && (0 == strcmp(Jobs[i].Name, Name))) {
+            isActive = true;
+        }
+    }
+    taskEXIT_CRITICAL(&JobsLock);
+
+    return (isActive);
+}  // Jobs_IsActive
+
+/**
+ * @brief To be polled by the job function
+ *
+ * @param pJob The job
+ * @return true Job should stop
+ */
+bool Jobs_IsCancelled(const Job * pJob) {
+    return (pJob->isCancelled);
+}
+
+/**
+ * @brief Get the id of a job
+ *
+ * @param pJob The job
+ * @return uint32_t
+ */
+uint32_t Jobs_GetId(const Job * pJob) {
+    return (pJob->Id);
+}
+
+/**
+ * @brief Publish the progress of a job
+ *
+ * @param pJob The job
+ * @param Percent Progress in percent
+ * @param Info Additional info, may be NULL
+ */
+void Jobs_Progress(Job * pJob, int Percent, const char * Info) {
+    job_publish(pJob, "running", Percent, Info);
+}
@@ -0,0 +1,39 @@
+/**
+ ******************************************************************************
+ *  file           : jobs.h
+ *  brief          : Executor for long running jobs
+ ******************************************************************************
+ */
+
+#ifndef COMPONENTS_APPS_JOBS_H_
+#define COMPONENTS_APPS_JOBS_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define JOBS_MAXARG 320                 // Max size of the job argument
+
+typedef struct Job Job;
+
+// The job function, runs in its own task. The return value is the result.
+typedef esp_err_t (*JobFunction)(Job * pJob, void * pArg);
+
+esp_err_t   Jobs_Init(void);
+uint32_t    Jobs_Submit(const char * Name, JobFunction Function, const void * pArg, size_t ArgSize, uint32_t StackSize, BaseType_t CoreId);
+esp_err_t   Jobs_Cancel(uint32_t Id);
+bool        Jobs_IsActive(const char * Name);
+bool        Jobs_IsCancelled(const Job * pJob);
+uint32_t    Jobs_GetId(const Job * pJob);
+void        Jobs_Progress(Job * pJob, int Percent, const char * Info);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // COMPONENTS_APPS_JOBS_H_
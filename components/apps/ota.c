@@ -0,0 +1,745 @@
+/**
+ ******************************************************************************
+ *  file           : ota.c
+ *  brief          : Pipelined OTA firmware update
+ *
+ *  The update is split in two tasks on different cores: The network
+ *  reader (the job task) fills chunks from HTTP, the flash writer checks
+ *  and writes them with esp_ota_write. Both are connected by a pool of
+ *  chunk buffers, so download and flash erase/write overlap.
+ *  Compressed and delta images are decoded by the writer on the fly (see
+ *  otadec.c), the decoded image is staged and flashed in OTA_STAGESIZE
+ *  blocks. After a connection loss the download is resumed with a HTTP
+ *  range request at the received offset, so the image is only appended.
+ *  The image is validated while it arrives: The segment headers by the
+ *  writer, a SHA-256 of the download against the digest of the request.
+ ******************************************************************************
+ */
+
+/****************************** Includes  */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+
+#include "sdkconfig.h"
+
+#include "esp_system.h"
+#include "esp_ota_ops.h"
+#include "esp_app_format.h"
+#include "esp_flash_partitions.h"
+#include "esp_log.h"
+#include "esp_http_client.h"
+#include "esp_partition.h"
+#include "esp_timer.h"
+#include "mbedtls/sha256.h"
+
+#include "../drivers/ramalloc.h"
+#include "otadec.h"
+#include "ota.h"
+
+/****************************** Configuration */
+#define OTA_CHUNKSIZE   8192            // Size of one chunk buffer
+#define OTA_CHUNKS      4               // Number of chunk buffers
+#define OTA_HTTP_BUFFER 4096            // Receive buffer of the HTTP client
+#define OTA_STAGESIZE   4096            // Decoded data per esp_ota_write
+#define OTA_BUFFERSIZE  ((OTA_CHUNKSIZE * OTA_CHUNKS) + OTA_STAGESIZE)
+#define OTA_WRITER_STACK 4096           // Stack size of the writer task
+#define OTA_WRITER_PRIO (tskIDLE_PRIORITY + 2)
+#define OTA_MAX_RETRIES 6               // Reconnects without progress
+#define OTA_BACKOFF_MS  500             // Delay before the first reconnect, doubled on each retry
+#define OTA_MAX_VALIDATOR 64            // Max length of ETag/Last-Modified
+
+/****************************** Statics */
+static const char *TAG = "OTA";
+static OTA_Stats LastStats;
+static uint32_t WastedBytes = 0;
+
+typedef struct OTA_Chunk {
+    uint8_t *   pData;                  // The buffer, NULL marks the end
+    size_t      Length;                 // Number of valid bytes
+} OTA_Chunk;
+
+typedef struct OTA_Context {
+    QueueHandle_t           xFree;      // Empty chunks
+    QueueHandle_t           xFilled;    // Chunks to write
+    SemaphoreHandle_t       xDone;      // Writer finished
+    const esp_partition_t * pPartRun;   // Running partition
+    const esp_partition_t * pPartNext;  // Partition to write
+    esp_ota_handle_t        Handle;     // OTA handle, valid if isBegun
+    bool                    isBegun;    // esp_ota_begin was called
+    volatile bool           isAborted;  // Set by reader or writer on errors
+    volatile bool           isRejected; // The image failed a validation, its data is wasted
+    bool                    isOutputFailed; // Error of ota_output(), not of the decoder
+    esp_err_t               Result;     // Result of the writer
+    int64_t                 FlashUs;    // Time in esp_ota_write
+    int64_t                 NetworkWaitUs; // Writer waiting for data
+    OtaDec                  Dec;        // Decoder for the received image
+    uint8_t *               pStage;     // Decoded data to flash
+    size_t                  StageLen;   // Bytes in pStage
+    uint32_t                ImageSize;  // Decoded image size
+    uint32_t                CheckOffset; // Bytes passed the segment check
+    uint32_t                NextHeader; // Offset of the next image/segment header
+    uint8_t                 Header[sizeof(esp_image_header_t)]; // Header being collected
+    size_t                  HeaderLen;  // Bytes in Header
+    int                     Segment;    // Next segment, -1 for the image header
+    int                     Segments;   // Number of segments of the image
+} OTA_Context;
+
+typedef struct OTA_Download {
+    const char *            Url;        // The image URL
+    esp_http_client_handle_t Client;    // Current connection, NULL if closed
+    int64_t                 TotalLength; // Length of the image from the first response
+    char                    Validator[OTA_MAX_VALIDATOR]; // ETag or Last-Modified for If-Range
+    bool                    hasETag;    // Validator is a strong ETag
+    int64_t                 RangeStart; // From Content-Range of the last response
+    int64_t                 RangeTotal; // From Content-Range of the last response
+    uint32_t                ResumeOffset; // Offset of the last resume
+    int                     Retries;    // Retries at ResumeOffset
+    uint32_t                Resumes;    // Successful resumes
+} OTA_Download;
+
+/****************************** Functions */
+
+#define MIN(x, y) (((x) < (y)) ? (x) : (y))
+
+/**
+ * @brief Check the image header before flashing
+ *
+ * @param pCtx The update
+ * @param pData Start of the image
+ * @param Length Available bytes
+ * @return esp_err_t
+ */
+static esp_err_t ota_check_header(OTA_Context * pCtx, const uint8_t * pData, size_t Length) {
+    esp_app_desc_t new_fw_info;
+
+    if (Length <= sizeof(esp_image_header_t) + sizeof(esp_image_segment_header_t) + sizeof(esp_app_desc_t)) {
+        ESP_LOGE(TAG, "FW Update: Received package length error");
+        return (ESP_ERR_INVALID_SIZE);
+    }
+
+    // The current version
+    esp_app_desc_t running_fw_info;
+    if (esp_ota_get_partition_description(pCtx->pPartRun, &running_fw_info) == ESP_OK) {
+        ESP_LOGI(TAG, "FW Update: Running version: %s", running_fw_info.version);
+    }
+
+    // The new version
+    memcpy(&new_fw_info, &pData[sizeof(esp_image_header_t) + sizeof(esp_image_segment_header_t)], sizeof(esp_app_desc_t));
+    if (ESP_APP_DESC_MAGIC_WORD != new_fw_info.magic_word) {
+        ESP_LOGE(TAG, "FW Update: No app description in the image");
+        return (ESP_ERR_INVALID_VERSION);
+    }
+    ESP_LOGI(TAG, "FW Update: New version: %s", new_fw_info.version);
+
+    // Last invalid version
+    const esp_partition_t* part_last_inv = esp_ota_get_last_invalid_partition();
+    esp_app_desc_t invalid_app_info;
+    if (esp_ota_get_partition_description(part_last_inv, &invalid_app_info) == ESP_OK) {
+        ESP_LOGI(TAG, "FW Update: Invalid version: %s", invalid_app_info.version);
+    }
+
+    // Check before flashing: Invalid firmware
+    if (part_last_inv != NULL) {
+        if (memcmp(invalid_app_info.version, new_fw_info.version, sizeof(new_fw_info.version)) == 0) {
+            ESP_LOGE(TAG, "FW Update: Trying to reflash a invalid FW. Aborting");
+            return (ESP_ERR_INVALID_VERSION);
+        }
+    }
+#if 0
+    // Check before flashing: Same version
+    if (memcmp(new_fw_info.version, running_fw_info.version, sizeof(new_fw_info.version)) == 0) {
+        ESP_LOGE(TAG, "FW Update: Reflashing same FW. Aborting");
+        return (ESP_ERR_INVALID_VERSION);
+    }
+#endif
+    return (ESP_OK);
+}  // ota_check_header
+
+/**
+ * @brief Check the image and segment headers as they arrive
+ *
+ * Rejects images for another chip and segments which exceed the
+ * partition, before they are flashed.
+ *
+ * @param pCtx The update
+ * @param pData Decoded image data
+ * @param Length Length of the data
+ * @return esp_err_t
+ */
+static esp_err_t ota_check_segments(OTA_Context * pCtx, const uint8_t * pData, size_t Length) {
+    while (Length > 0) {
+        size_t Part;
+
+        // All headers seen: Only the size is left to check
+        if ((pCtx->Segment >= pCtx->Segments) || (pCtx->CheckOffset < pCtx->NextHeader)) {
+            Part = (pCtx->Segment >= pCtx->Segments) ? Length : MIN(Length, pCtx->NextHeader - pCtx->CheckOffset);
+            pCtx->CheckOffset += Part;
+            pData += Part;
+            Length -= Part;
+            if (pCtx->CheckOffset > pCtx->pPartNext->size) {
+                ESP_LOGE(TAG, "FW Update: Image exceeds the partition");
+                return (ESP_ERR_INVALID_SIZE);
+            }
+            continue;
+        }
+
+        // Collect the next header
+        const size_t HeaderSize = (pCtx->Segment < 0) ? sizeof(esp_image_header_t) : sizeof(esp_image_segment_header_t);
+        Part = MIN(Length, HeaderSize - pCtx->HeaderLen);
+        memcpy(&pCtx->Header[pCtx->HeaderLen], pData, Part);
+        pCtx->HeaderLen += Part;
+        pCtx->CheckOffset += Part;
+        pData += Part;
+        Length -= Part;
+        if (pCtx->HeaderLen < HeaderSize) {
+            continue;
+        }
+        pCtx->HeaderLen = 0;
+
+        if (pCtx->Segment < 0) {
+            const esp_image_header_t * pImage = (const esp_image_header_t*)pCtx->Header;
+            if ((ESP_IMAGE_HEADER_MAGIC != pImage->magic) || (0 == pImage->segment_count) || (pImage->segment_count > ESP_IMAGE_MAX_SEGMENTS)) {
+                ESP_LOGE(TAG, "FW Update: Invalid image header");
+                return (ESP_ERR_INVALID_VERSION);
+            }
+            if (CONFIG_IDF_FIRMWARE_CHIP_ID != pImage->chip_id) {
+                ESP_LOGE(TAG, "FW Update: Image is for chip id %d", pImage->chip_id);
+                return (ESP_ERR_INVALID_VERSION);
+            }
+            pCtx->Segments = pImage->segment_count;
+        } else {
+            esp_image_segment_header_t Segment;
+            memcpy(&Segment, pCtx->Header, sizeof(Segment));
+            if ((0 != (Segment.data_len % 4)) || (Segment.data_len > (pCtx->pPartNext->size - pCtx->CheckOffset))) {
+                ESP_LOGE(TAG, "FW Update: Invalid segment %d, length %lu", pCtx->Segment, (unsigned long)Segment.data_len);
+                return (ESP_ERR_INVALID_SIZE);
+            }
+            pCtx->NextHeader = pCtx->CheckOffset + Segment.data_len;
+        }
+        pCtx->Segment++;
+    }
+    return (ESP_OK);
+}  // ota_check_segments
+
+/**
+ * @brief Flash the staged data
+ *
+ * The header is checked and the update is started with the first block
+ * of decoded data.
+ *
+ * @param pCtx The update
+ * @return esp_err_t
+ */
+static esp_err_t ota_flush(OTA_Context * pCtx) {
+    esp_err_t ret;
+
+    if (0 == pCtx->StageLen) {
+        return (ESP_OK);
+    }
+
+    if (!pCtx->isBegun) {
+        ret = ota_check_header(pCtx, pCtx->pStage, pCtx->StageLen);
+        if (ESP_OK != ret) {
+            pCtx->isRejected = true;
+            return (ret);
+        }
+        ret = esp_ota_begin(pCtx->pPartNext, OTA_WITH_SEQUENTIAL_WRITES, &pCtx->Handle);
+        if (ESP_OK != ret) {
+            ESP_LOGE(TAG, "FW Update: esp_ota_begin failed (%s)", esp_err_to_name(ret));
+            return (ret);
+        }
+        pCtx->isBegun = true;
+    }
+
+    const int64_t Start = esp_timer_get_time();
+    ret = esp_ota_write(pCtx->Handle, pCtx->pStage, pCtx->StageLen);
+    pCtx->FlashUs += esp_timer_get_time() - Start;
+    if (ESP_OK != ret) {
+        ESP_LOGE(TAG, "FW Update: Failed to write data");
+    }
+
+    pCtx->ImageSize += pCtx->StageLen;
+    pCtx->StageLen = 0;
+    return (ret);
+}  // ota_flush
+
+/**
+ * @brief Decoder output: Collect decoded data in the stage
+ */
+static esp_err_t ota_output(void * pArg, const uint8_t * pData, size_t Length) {
+    OTA_Context * pCtx = pArg;
+    esp_err_t ret = ota_check_segments(pCtx, pData, Length);
+
+    if (ESP_OK != ret) {
+        pCtx->isRejected = true;
+    }
+    while ((Length > 0) && (ESP_OK == ret)) {
+        const size_t Part = MIN(Length, OTA_STAGESIZE - pCtx->StageLen);
+        memcpy(&pCtx->pStage[pCtx->StageLen], pData, Part);
+        pCtx->StageLen += Part;
+        pData += Part;
+        Length -= Part;
+        if (OTA_STAGESIZE == pCtx->StageLen) {
+            ret = ota_flush(pCtx);
+        }
+    }
+    pCtx->isOutputFailed = (ESP_OK != ret);
+    return (ret);
+}  // ota_output
+
+/**
+ * @brief Flash writer task
+ *
+ * Takes filled chunks, decodes them and writes the image to the update
+ * partition. Chunks are always given back, also after an error, so the
+ * reader never blocks.
+ *
+ * @param pvParameters The OTA_Context
+ */
+static void TaskOtaWriter(void* pvParameters) {
+    OTA_Context * pCtx = pvParameters;
+    OTA_Chunk Chunk;
+
+    while (1) {
+        const int64_t Start = esp_timer_get_time();
+        xQueueReceive(pCtx->xFilled, &Chunk, portMAX_DELAY);
+        pCtx->NetworkWaitUs += esp_timer_get_time() - Start;
+
+        if (NULL == Chunk.pData) {
+            break;
+        }
+
+        if (!pCtx->isAborted) {
+            pCtx->Result = OtaDec_Write(&pCtx->Dec, Chunk.pData, Chunk.Length);
+            pCtx->isAborted = (ESP_OK != pCtx->Result);
+            // Errors of the decoder itself: Invalid container, delta base mismatch, corrupt data
+            if (pCtx->isAborted && !pCtx->isOutputFailed && (ESP_ERR_NO_MEM != pCtx->Result)) {
+                pCtx->isRejected = true;
+            }
+        }
+
+        xQueueSend(pCtx->xFree, &Chunk, portMAX_DELAY);
+    }
+
+    // Transfer complete: Check the decoder and flash the rest
+    if (!pCtx->isAborted) {
+        pCtx->Result = OtaDec_Finish(&pCtx->Dec);
+        if (ESP_OK != pCtx->Result) {
+            pCtx->isRejected = true;    // Truncated or corrupt container
+        } else {
+            pCtx->Result = ota_flush(pCtx);
+        }
+        pCtx->isAborted = (ESP_OK != pCtx->Result);
+    }
+
+    xSemaphoreGive(pCtx->xDone);
+    vTaskDelete(NULL);
+}  // TaskOtaWriter
+
+/**
+ * @brief HTTP events: Collect the headers needed for resuming
+ */
+static esp_err_t ota_http_event(esp_http_client_event_t * evt) {
+    OTA_Download * pDl = evt->user_data;
+
+    if (HTTP_EVENT_ON_HEADER != evt->event_id) {
+        return (ESP_OK);
+    }
+
+    if (0 == strcasecmp(evt->header_key, "ETag")) {
+        // Weak ETags are not allowed in If-Range
+        if (0 != strncmp(evt->header_value, "W/", 2)) {
+            strlcpy(pDl->Validator, evt->header_value, sizeof(pDl->Validator));
+            pDl->hasETag = true;
+        }
+    } else if ((0 == strcasecmp(evt->header_key, "Last-Modified")) && !pDl->hasETag) {
+        strlcpy(pDl->Validator, evt->header_value, sizeof(pDl->Validator));
+    } else if (0 == strcasecmp(evt->header_key, "Content-Range")) {
+        long long Start, End, Total;
+        if (3 == sscanf(evt->header_value, "bytes %lld-%lld/%lld", &Start, &End, &Total)) {
+            pDl->RangeStart = Start;
+            pDl->RangeTotal = Total;
+        }
+    }
+    return (ESP_OK);
+}  // ota_http_event
+
+/**
+ * @brief Close the HTTP connection, if open
+ */
+static void ota_close(OTA_Download * pDl) {
+    if (NULL != pDl->Client) {
+        esp_http_client_close(pDl->Client);
+        esp_http_client_cleanup(pDl->Client);
+        pDl->Client = NULL;
+    }
+}
+
+/**
+ * @brief Open the HTTP connection at an offset
+ *
+ * A resumed download must continue exactly at Offset of the same image,
+ * otherwise the partially written image would be corrupted.
+ *
+ * @param pDl The download
+ * @param Offset Start of the requested data
+ * @return esp_err_t ESP_ERR_INVALID_RESPONSE if a retry makes no sense
+ */
+static esp_err_t ota_open(OTA_Download * pDl, uint32_t Offset) {
+    esp_http_client_config_t config = {
+        .url = pDl->Url,
+        .timeout_ms = 2000,     // 2s connection timeout
+        .keep_alive_enable = true,
+        .buffer_size = OTA_HTTP_BUFFER,
+        .event_handler = ota_http_event,
+        .user_data = pDl,
+    };
+    char Range[24];
+
+    pDl->RangeStart = -1;
+    pDl->RangeTotal = -1;
+
+    pDl->Client = esp_http_client_init(&config);
+    if (NULL == pDl->Client) {
+        ESP_LOGE(TAG, "FW Update: Cannot init HTTP connection!");
+        return (ESP_FAIL);
+    }
+    if (Offset > 0) {
+        snprintf(Range, sizeof(Range), "bytes=%lu-", (unsigned long)Offset);
+        esp_http_client_set_header(pDl->Client, "Range", Range);
+        if (0x00 != pDl->Validator[0]) {
+            esp_http_client_set_header(pDl->Client, "If-Range", pDl->Validator);
+        }
+    }
+
+    esp_err_t err = esp_http_client_open(pDl->Client, 0);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "FW Update: Cannot open HTTP connection, err %s", esp_err_to_name(err));
+        ota_close(pDl);
+        return (err);
+    }
+
+    const int64_t Length = esp_http_client_fetch_headers(pDl->Client);
+    const int Status = esp_http_client_get_status_code(pDl->Client);
+
+    if (Status >= 500) {
+        ESP_LOGE(TAG, "FW Update: Server error %d", Status);
+        err = ESP_FAIL;
+    } else if (0 == Offset) {
+        if (200 != Status) {
+            ESP_LOGE(TAG, "FW Update: Download failed with status %d", Status);
+            err = ESP_ERR_INVALID_RESPONSE;
+        }
+        pDl->TotalLength = Length;
+    } else if ((206 != Status) || (pDl->RangeStart != Offset)
+            || ((pDl->TotalLength > 0) && (pDl->RangeTotal != pDl->TotalLength))) {
+        // No range support or the image has changed
+        ESP_LOGE(TAG, "FW Update: Cannot resume at %lu, status %d", (unsigned long)Offset, Status);
+        err = ESP_ERR_INVALID_RESPONSE;
+    }
+
+    if (ESP_OK != err) {
+        ota_close(pDl);
+    }
+    return (err);
+}  // ota_open
+
+/**
+ * @brief Reconnect with exponential backoff
+ *
+ * The retries are counted per offset, so a download making progress
+ * between connection losses is never given up.
+ *
+ * @param pDl The download
+ * @param pJob The job, checked for cancellation while waiting
+ * @param Offset Start of the requested data
+ * @return esp_err_t
+ */
+static esp_err_t ota_reconnect(OTA_Download * pDl, Job * pJob, uint32_t Offset) {
+    esp_err_t err = ESP_FAIL;
+
+    ota_close(pDl);
+
+    if (Offset != pDl->ResumeOffset) {
+        pDl->ResumeOffset = Offset;
+        pDl->Retries = 0;
+    }
+
+    while ((ESP_OK != err) && (ESP_ERR_INVALID_RESPONSE != err)) {
+        if (pDl->Retries >= OTA_MAX_RETRIES) {
+            ESP_LOGE(TAG, "FW Update: Giving up at %lu bytes", (unsigned long)Offset);
+            return (err);
+        }
+
+        const uint32_t DelayMs = OTA_BACKOFF_MS << pDl->Retries++;
+        ESP_LOGW(TAG, "FW Update: Reconnecting in %lu ms, resuming at %lu bytes", (unsigned long)DelayMs, (unsigned long)Offset);
+        for (uint32_t Waited = 0; Waited < DelayMs; Waited += 100) {
+            if (Jobs_IsCancelled(pJob)) {
+                return (ESP_ERR_INVALID_STATE);
+            }
+            vTaskDelay(100 / portTICK_PERIOD_MS);
+        }
+
+        err = ota_open(pDl, Offset);
+    }
+
+    if ((ESP_OK == err) && (Offset > 0)) {
+        pDl->Resumes++;
+    }
+    return (err);
+}  // ota_reconnect
+
+/**
+ * @brief Job: FW update from URL, the job task is the network reader
+ *
+ * @param pJob The job
+ * @param pArg The OTA_Request
+ * @return esp_err_t
+ */
+esp_err_t OTA_Job(Job * pJob, void * pArg) {
+    const OTA_Request * pRequest = pArg;
+    const char * url = pRequest->Url;
+    OTA_Context Ctx;
+    OTA_Download Dl;
+    OTA_Chunk Chunk;
+    mbedtls_sha256_context Sha256;
+    uint8_t Digest[32];
+    uint8_t * pBuffers = NULL;
+    esp_err_t err = ESP_OK;
+    uint32_t file_length = 0;       // received bytes
+    int last_percent = 0;
+    int64_t NetworkUs = 0;
+    int64_t FlashWaitUs = 0;
+    const int64_t StartUs = esp_timer_get_time();
+
+    ESP_LOGI(TAG, "FW Update: Starting with URL '%s'", url);
+
+    memset(&Ctx, 0x00, sizeof(Ctx));
+    memset(&Dl, 0x00, sizeof(Dl));
+    Dl.Url = url;
+    Ctx.Segment = -1;
+    mbedtls_sha256_init(&Sha256);
+    mbedtls_sha256_starts(&Sha256, 0);
+
+    // Get partition data, print some info and check the prereqs
+    Ctx.pPartRun = esp_ota_get_running_partition();
+    Ctx.pPartNext = esp_ota_get_next_update_partition(NULL);
+
+    if (NULL == Ctx.pPartNext) {
+        ESP_LOGE(TAG, "FW Update: Partition to write to is NULL! Aborting");
+        return (ESP_ERR_NOT_FOUND);
+    }
+
+    ESP_LOGI(TAG, "Partition Infos:");
+    ESP_LOGI(TAG, "Running: type %d subtype %d (offset 0x%08lx, label '%s')", Ctx.pPartRun->type, Ctx.pPartRun->subtype, Ctx.pPartRun->address, Ctx.pPartRun->label);
+    ESP_LOGI(TAG, "Next:    type %d subtype %d (offset 0x%08lx, label '%s')", Ctx.pPartNext->type, Ctx.pPartNext->subtype, Ctx.pPartNext->address, Ctx.pPartNext->label);
+
+    // Set up the chunk pool, the stage and the decoder
+    pBuffers = RamAlloc_Malloc(RAM_SYS_OTA, OTA_BUFFERSIZE);
+    Ctx.xFree = xQueueCreate(OTA_CHUNKS + 1, sizeof(OTA_Chunk));
+    Ctx.xFilled = xQueueCreate(OTA_CHUNKS + 1, sizeof(OTA_Chunk));
+    Ctx.xDone = xSemaphoreCreateBinary();
+    if ((NULL == pBuffers) || (NULL == Ctx.xFree) || (NULL == Ctx.xFilled) || (NULL == Ctx.xDone)) {
+        ESP_LOGE(TAG, "FW Update: Out of memory");
+        err = ESP_ERR_NO_MEM;
+        goto cleanup;
+    }
+    for (int i = 0; i < OTA_CHUNKS; i++) {
+        Chunk.pData = &pBuffers[i * OTA_CHUNKSIZE];
+        Chunk.Length = 0;
+        xQueueSend(Ctx.xFree, &Chunk, 0);
+    }
+    Ctx.pStage = &pBuffers[OTA_CHUNKSIZE * OTA_CHUNKS];
+    OtaDec_Init(&Ctx.Dec, Ctx.pPartRun, ota_output, &Ctx);
+
+    // Set up http(s) transfer of the fw file
+    err = ota_open(&Dl, 0);
+    if ((ESP_OK != err) && (ESP_ERR_INVALID_RESPONSE != err)) {
+        err = ota_reconnect(&Dl, pJob, 0);
+    }
+    if (ESP_OK != err) {
+        goto cleanup;
+    }
+
+    // Start the writer
+    if (pdPASS != xTaskCreatePinnedToCore(TaskOtaWriter, "OTA Writer", OTA_WRITER_STACK, &Ctx, OTA_WRITER_PRIO, NULL, OTA_WRITER_CORE)) {
+        ESP_LOGE(TAG, "FW Update: Cannot start writer");
+        err = ESP_ERR_NO_MEM;
+        goto cleanup;
+    }
+
+    // The loop for transfer, chunks are passed to the writer
+    bool isEnd = false;
+    while (!isEnd && !Ctx.isAborted && (ESP_OK == err)) {
+        if (Jobs_IsCancelled(pJob)) {
+            ESP_LOGW(TAG, "FW Update: Cancelled");
+            err = ESP_ERR_INVALID_STATE;
+            break;
+        }
+
+        int64_t Start = esp_timer_get_time();
+        xQueueReceive(Ctx.xFree, &Chunk, portMAX_DELAY);
+        FlashWaitUs += esp_timer_get_time() - Start;
+
+        // Fill the chunk, resume after connection losses
+        Chunk.Length = 0;
+        while ((Chunk.Length < OTA_CHUNKSIZE) && (ESP_OK == err)) {
+            Start = esp_timer_get_time();
+            int bytes_read = esp_http_client_read(Dl.Client, (char*)&Chunk.pData[Chunk.Length], OTA_CHUNKSIZE - Chunk.Length);
+            NetworkUs += esp_timer_get_time() - Start;
+
+            if (bytes_read > 0) {
+                Chunk.Length += bytes_read;
+            } else if ((bytes_read == 0) && (esp_http_client_is_complete_data_received(Dl.Client) == true)) {
+                // Connection closed due to complete
+                ESP_LOGI(TAG, "FW Update: Connection closed");
+                isEnd = true;
+                break;
+            } else if ((bytes_read < 0) || (errno == ECONNRESET) || (errno == ENOTCONN)) {
+                // Connection lost: Continue where it stopped
+                ESP_LOGW(TAG, "FW Update: Connection lost at %lu bytes, errno = %d", (unsigned long)(file_length + Chunk.Length), errno);
+                errno = 0;
+                err = ota_reconnect(&Dl, pJob, file_length + Chunk.Length);
+            }
+        }
+
+        if ((ESP_OK == err) && (Chunk.Length > 0)) {
+            file_length += Chunk.Length;
+            xQueueSend(Ctx.xFilled, &Chunk, portMAX_DELAY);
+            // Only the reader refills chunks, so hashing can overlap the flash write
+            mbedtls_sha256_update(&Sha256, Chunk.pData, Chunk.Length);
+        } else {
+            xQueueSend(Ctx.xFree, &Chunk, portMAX_DELAY);
+        }
+
+        // Report progress in 10% steps
+        if (Dl.TotalLength > 0) {
+            const int percent = (int)((file_length * 100LL) / Dl.TotalLength);
+            if (percent >= (last_percent + 10)) {
+                last_percent = percent - (percent % 10);
+                Jobs_Progress(pJob, last_percent, NULL);
+            }
+        }
+    }  // while !isEnd
+
+    // Stop the writer and wait for it, on errors without finishing the image
+    if (ESP_OK != err) {
+        Ctx.isAborted = true;
+    }
+    Chunk.pData = NULL;
+    Chunk.Length = 0;
+    xQueueSend(Ctx.xFilled, &Chunk, portMAX_DELAY);
+    xSemaphoreTake(Ctx.xDone, portMAX_DELAY);
+
+    ESP_LOGI(TAG, "FW Update: Received %lu bytes, FW size = %lu", (unsigned long)file_length, (unsigned long)Ctx.ImageSize);
+
+    // Statistics
+    LastStats.Bytes = file_length;
+    LastStats.TotalMs = (esp_timer_get_time() - StartUs) / 1000;
+    LastStats.NetworkMs = NetworkUs / 1000;
+    LastStats.FlashMs = Ctx.FlashUs / 1000;
+    LastStats.NetworkWaitMs = Ctx.NetworkWaitUs / 1000;
+    LastStats.FlashWaitMs = FlashWaitUs / 1000;
+    LastStats.Resumes = Dl.Resumes;
+    ESP_LOGI(TAG, "FW Update: %lu bytes in %lu ms (%lu kB/s), network %lu ms, flash %lu ms, writer idle %lu ms, reader idle %lu ms, %lu resumes",
+             (unsigned long)LastStats.Bytes, (unsigned long)LastStats.TotalMs,
+             (unsigned long)((LastStats.TotalMs > 0) ? (LastStats.Bytes / LastStats.TotalMs) : 0),
+             (unsigned long)LastStats.NetworkMs, (unsigned long)LastStats.FlashMs,
+             (unsigned long)LastStats.NetworkWaitMs, (unsigned long)LastStats.FlashWaitMs, (unsigned long)LastStats.Resumes);
+
+    if ((ESP_OK == err) && (ESP_OK != Ctx.Result)) {
+        err = Ctx.Result;
+    }
+
+    // Check for complete transfer
+    if ((ESP_OK == err) && ((esp_http_client_is_complete_data_received(Dl.Client) != true)
+                         || ((Dl.TotalLength > 0) && (file_length != Dl.TotalLength)))) {
+        ESP_LOGE(TAG, "FW Update: Error, file incomplete");
+        err = ESP_ERR_INVALID_SIZE;
+    }
+    if ((ESP_OK == err) && !Ctx.isBegun) {
+        ESP_LOGE(TAG, "FW Update: Error, no data received");
+        err = ESP_ERR_INVALID_SIZE;
+    }
+
+    // Check the digest of the download
+    mbedtls_sha256_finish(&Sha256, Digest);
+    if ((ESP_OK == err) && pRequest->hasSha256 && (0 != memcmp(Digest, pRequest->Sha256, sizeof(Digest)))) {
+        ESP_LOGE(TAG, "FW Update: Error, SHA-256 mismatch");
+        err = ESP_ERR_INVALID_CRC;
+        Ctx.isRejected = true;
+    }
+    ota_close(&Dl);
+
+    if (ESP_OK != err) {
+        if (Ctx.isBegun) {
+            esp_ota_abort(Ctx.Handle);
+        }
+        goto cleanup;
+    }
+
+    // Finalize and verify
+    err = esp_ota_end(Ctx.Handle);
+    if (err != ESP_OK) {
+        if (err == ESP_ERR_OTA_VALIDATE_FAILED) {
+            ESP_LOGE(TAG, "FW Update: Error, fw corrupt");
+            Ctx.isRejected = true;
+        }
+        ESP_LOGE(TAG, "FW Update: Error, esp_ota_end failed (%s)!", esp_err_to_name(err));
+        goto cleanup;
+    }
+
+    // Set new partition
+    err = esp_ota_set_boot_partition(Ctx.pPartNext);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "FW Update: Setting new boot partition failed (%s)!", esp_err_to_name(err));
+        goto cleanup;
+    }
+
+    // Final delay (probably not necessary) ans reboot into new FW
+    char Info[96];
+    snprintf(Info, sizeof(Info), "%lu bytes in %lu ms, network %lu ms, flash %lu ms, restarting",
+             (unsigned long)LastStats.Bytes, (unsigned long)LastStats.TotalMs,
+             (unsigned long)LastStats.NetworkMs, (unsigned long)LastStats.FlashMs);
+    Jobs_Progress(pJob, 100, Info);
+    vTaskDelay(250 / portTICK_PERIOD_MS);
+    esp_restart();
+
+cleanup:
+    // Received data of a rejected image is wasted, not that of network or memory errors
+    if (Ctx.isRejected) {
+        WastedBytes += file_length;
+    }
+    ota_close(&Dl);
+    mbedtls_sha256_free(&Sha256);
+    if (NULL != Ctx.xDone) {
+        vSemaphoreDelete(Ctx.xDone);
+    }
+    if (NULL != Ctx.xFilled) {
+        vQueueDelete(Ctx.xFilled);
+    }
+    if (NULL != Ctx.xFree) {
+        vQueueDelete(Ctx.xFree);
+    }
+    OtaDec_Free(&Ctx.Dec);
+    RamAlloc_Free(RAM_SYS_OTA, pBuffers, OTA_BUFFERSIZE);
+
+    return (err);
+}  // OTA_Job
+
+/**
+ * @brief Get the statistics of the last update
+ *
+ * @param pStats
+ */
+void OTA_GetStats(OTA_Stats * pStats) {
+    memcpy(pStats, &LastStats, sizeof(OTA_Stats));
+    pStats->WastedBytes = WastedBytes;
+}
@@ -0,0 +1,51 @@
+/**
+ ******************************************************************************
+ *  file           : ota.h
+ *  brief          : Pipelined OTA firmware update
+ ******************************************************************************
+ */
+
+#ifndef COMPONENTS_APPS_OTA_H_
+#define COMPONENTS_APPS_OTA_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "jobs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define OTA_STACKSIZE   6144            // Stack size of the update job
+#define OTA_READER_CORE 0               // Core of the network reader (job task)
+#define OTA_WRITER_CORE 1               // Core of the flash writer
+#define OTA_MAXURL      256             // Max length of the image URL
+
+// Parameters of an update, the argument of OTA_Job
+typedef struct OTA_Request {
+    char        Url[OTA_MAXURL];        // The image URL
+    bool        hasSha256;              // Sha256 is set
+    uint8_t     Sha256[32];             // Expected SHA-256 of the downloaded file
+} OTA_Request;
+
+// Statistics of the last update
+typedef struct OTA_Stats {
+    uint32_t    Bytes;                  // Received bytes
+    uint32_t    TotalMs;                // Duration of the update
+    uint32_t    NetworkMs;              // Time spent in reading from network
+    uint32_t    FlashMs;                // Time spent in writing to flash
+    uint32_t    NetworkWaitMs;          // Writer idle, waiting for network data
+    uint32_t    FlashWaitMs;            // Reader idle, waiting for free buffers
+    uint32_t    Resumes;                // Downloads resumed after a connection loss
+    uint32_t    WastedBytes;            // Received bytes of rejected images, since boot
+} OTA_Stats;
+
+esp_err_t   OTA_Job(Job * pJob, void * pArg);
+void        OTA_GetStats(OTA_Stats * pStats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // COMPONENTS_APPS_OTA_H_
@@ -0,0 +1,344 @@
+/**
+ ******************************************************************************
+ *  file           : otadec.c
+ *  brief          : Streaming decoder for compressed and delta OTA images
+ *
+ *  The image is decoded while it is received: Input chunks are inflated
+ *  into a small ring window (tinfl from ROM), the result is either the
+ *  app image or a stream of delta operations which copy ranges from the
+ *  running partition or insert literal data. See otadec.h for the format.
+ ******************************************************************************
+ */
+
+/****************************** Includes  */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_ota_ops.h"
+#include "esp_app_format.h"
+#include "rom/miniz.h"
+
+#include "../drivers/ramalloc.h"
+#include "otadec.h"
+
+/****************************** Configuration */
+#define COPY_BUFSIZE 512                // Buffer for copies from the base
+
+/****************************** Statics */
+static const char *TAG = "OTADEC";
+
+enum {
+    DELTA_OP = 0,                       // Expecting an operation
+    DELTA_ARGS,                         // Parsing varint arguments
+    DELTA_DATA,                         // Passing literal data
+    DELTA_END,                          // End operation seen
+};
+
+#define DELTA_OP_END  0x00
+#define DELTA_OP_COPY 0x01
+#define DELTA_OP_ADD  0x02
+
+/****************************** Functions */
+
+static uint32_t dec_get_u32(const uint8_t * pData) {
+    return ((uint32_t)pData[0] | ((uint32_t)pData[1] << 8) | ((uint32_t)pData[2] << 16) | ((uint32_t)pData[3] << 24));
+}
+
+/**
+ * @brief Pass decoded image data to the output
+ */
+static esp_err_t dec_output(OtaDec * pDec, const uint8_t * pData, size_t Length) {
+    if ((pDec->Decoded + Length) > pDec->ImageSize) {
+        ESP_LOGE(TAG, "Image larger than announced");
+        return (ESP_ERR_INVALID_SIZE);
+    }
+    pDec->Decoded += Length;
+    return (pDec->Output(pDec->pOutputArg, pData, Length));
+}
+
+/**
+ * @brief Copy a range of the base image to the output
+ */
+static esp_err_t dec_copy(OtaDec * pDec, uint32_t Offset, uint32_t Length) {
+    uint8_t Buffer[COPY_BUFSIZE];
+    esp_err_t ret = ESP_OK;
+
+    if ((Offset > pDec->pSource->size) || (Length > (pDec->pSource->size - Offset))) {
+        ESP_LOGE(TAG, "Copy outside of the base partition");
+        return (ESP_ERR_INVALID_ARG);
+    }
+
+    while ((Length > 0) && (ESP_OK == ret)) {
+        const size_t Part = (Length < COPY_BUFSIZE) ? Length : COPY_BUFSIZE;
+        ret = esp_partition_read(pDec->pSource, Offset, Buffer, Part);
+        if (ESP_OK == ret) {
+            ret = dec_output(pDec, Buffer, Part);
+        }
+        Offset += Part;
+        Length -= Part;
+    }
+    return (ret);
+}  // dec_copy
+
+/**
+ * @brief Parse delta operations
+ */
+static esp_err_t dec_delta(OtaDec * pDec, const uint8_t * pData, size_t Length) {
+    esp_err_t ret = ESP_OK;
+
+    while ((Length > 0) && (ESP_OK == ret)) {
+        switch (pDec->DeltaState) {
+            case DELTA_OP:
+                pDec->DeltaOp = *pData++;
+                Length--;
+                pDec->DeltaArgIdx = 0;
+                pDec->DeltaShift = 0;
+                pDec->DeltaArgs[0] = 0;
+                pDec->DeltaArgs[1] = 0;
+                if (DELTA_OP_END == pDec->DeltaOp) {
+                    pDec->DeltaState = DELTA_END;
+                } else if ((DELTA_OP_COPY == pDec->DeltaOp) || (DELTA_OP_ADD == pDec->DeltaOp)) {
+                    pDec->DeltaState = DELTA_ARGS;
+                } else {
+                    ESP_LOGE(TAG, "Invalid delta operation 0x%02x", pDec->DeltaOp);
+                    ret = ESP_ERR_INVALID_ARG;
+                }
+                break;
+
+            case DELTA_ARGS: {
+                const uint8_t Byte = *pData++;
+                Length--;
+                if (pDec->DeltaShift > 28) {
+                    ret = ESP_ERR_INVALID_SIZE;
+                    break;
+                }
+                pDec->DeltaArgs[pDec->DeltaArgIdx] |= (uint32_t)(Byte & 0x7F) << pDec->DeltaShift;
+                pDec->DeltaShift += 7;
+                if (Byte & 0x80) {
+                    break;
+                }
+
+                // Argument complete
+                pDec->DeltaShift = 0;
+                pDec->DeltaArgIdx++;
+                if (DELTA_OP_COPY == pDec->DeltaOp) {
+                    if (2 == pDec->DeltaArgIdx) {
+                        ret = dec_copy(pDec, pDec->DeltaArgs[0], pDec->DeltaArgs[1]);
+                        pDec->DeltaState = DELTA_OP;
+                    }
+                } else {
+                    pDec->DeltaRemaining = pDec->DeltaArgs[0];
+                    pDec->DeltaState = (pDec->DeltaRemaining > 0) ? DELTA_DATA : DELTA_OP;
+                }
+                break;
+            }
+
+            case DELTA_DATA: {
+                const size_t Part = (Length < pDec->DeltaRemaining) ? Length : pDec->DeltaRemaining;
+                ret = dec_output(pDec, pData, Part);
+                pData += Part;
+                Length -= Part;
+                pDec->DeltaRemaining -= Part;
+                if (0 == pDec->DeltaRemaining) {
+                    pDec->DeltaState = DELTA_OP;
+                }
+                break;
+            }
+
+            default:
+                ESP_LOGE(TAG, "Data after end of delta");
+                ret = ESP_ERR_INVALID_SIZE;
+                break;
+        }
+    }
+    return (ret);
+}  // dec_delta
+
+/**
+ * @brief Pass uncompressed payload to the next stage
+ */
+static esp_err_t dec_payload(OtaDec * pDec, const uint8_t * pData, size_t Length) {
+    if (pDec->Flags & OTADEC_FLAG_DELTA) {
+        return (dec_delta(pDec, pData, Length));
+    }
+    return (dec_output(pDec, pData, Length));
+}
+
+/**
+ * @brief Inflate compressed payload into the window
+ */
+static esp_err_t dec_inflate(OtaDec * pDec, const uint8_t * pData, size_t Length) {
+    tinfl_status Status;
+
+    do {
+        size_t InBytes = Length;
+        size_t OutBytes = pDec->WindowMask + 1 - pDec->WindowPos;
+
+        if (pDec->isInflated) {
+            ESP_LOGE(TAG, "Data after end of deflate stream");
+            return (ESP_ERR_INVALID_SIZE);
+        }
+
+        Status = tinfl_decompress(pDec->pInflator, pData, &InBytes, pDec->pWindow, &pDec->pWindow[pDec->WindowPos], &OutBytes, TINFL_FLAG_HAS_MORE_INPUT);
+        pData += InBytes;
+        Length -= InBytes;
+
+        if (Status < TINFL_STATUS_DONE) {
+            ESP_LOGE(TAG, "Inflate failed (%d)", Status);
+            return (ESP_ERR_INVALID_CRC);
+        }
+        if (OutBytes > 0) {
+            esp_err_t ret = dec_payload(pDec, &pDec->pWindow[pDec->WindowPos], OutBytes);
+            if (ESP_OK != ret) {
+                return (ret);
+            }
+            pDec->WindowPos = (pDec->WindowPos + OutBytes) & pDec->WindowMask;
+        }
+        if (TINFL_STATUS_DONE == Status) {
+            pDec->isInflated = true;
+        }
+    } while ((Length > 0) || (TINFL_STATUS_HAS_MORE_OUTPUT == Status));
+
+    return (ESP_OK);
+}  // dec_inflate
+
+/**
+ * @brief Evaluate the complete container header
+ */
+static esp_err_t dec_parse_header(OtaDec * pDec) {
+    const uint8_t * pHeader = pDec->Header;
+    const uint8_t WindowBits = pHeader[6];
+
+    if ((OTADEC_MAGIC != dec_get_u32(&pHeader[0])) || (OTADEC_VERSION != pHeader[4])) {
+        ESP_LOGE(TAG, "Unknown image format");
+        return (ESP_ERR_INVALID_VERSION);
+    }
+    pDec->Flags = pHeader[5];
+    pDec->ImageSize = dec_get_u32(&pHeader[8]);
+
+    ESP_LOGI(TAG, "Image: %s%s, %lu bytes", (pDec->Flags & OTADEC_FLAG_DELTA) ? "delta" : "full",
+             (pDec->Flags & OTADEC_FLAG_DEFLATE) ? ", compressed" : "", (unsigned long)pDec->ImageSize);
+
+    // Delta: The base must be the running app
+    if (pDec->Flags & OTADEC_FLAG_DELTA) {
+        esp_app_desc_t BaseDesc;
+        if ((NULL == pDec->pSource) || (ESP_OK != esp_ota_get_partition_description(pDec->pSource, &BaseDesc))
+         || (0 != memcmp(BaseDesc.app_elf_sha256, &pHeader[12], sizeof(BaseDesc.app_elf_sha256)))) {
+            ESP_LOGE(TAG, "Delta image does not match the running app");
+            return (ESP_ERR_INVALID_VERSION);
+        }
+    }
+
+    if (pDec->Flags & OTADEC_FLAG_DEFLATE) {
+        if ((WindowBits < 8) || (WindowBits > OTADEC_MAX_WINDOWBITS)) {
+            ESP_LOGE(TAG, "Unsupported deflate window (%d bits)", WindowBits);
+            return (ESP_ERR_NOT_SUPPORTED);
+        }
+        pDec->WindowMask = (1UL << WindowBits) - 1;
+        pDec->pWindow = RamAlloc_Malloc(RAM_SYS_OTA, pDec->WindowMask + 1);
+        pDec->pInflator = RamAlloc_Malloc(RAM_SYS_INFLATE, sizeof(tinfl_decompressor));
+        if ((NULL == pDec->pWindow) || (NULL == pDec->pInflator)) {
+            return (ESP_ERR_NO_MEM);
+        }
+        tinfl_init((tinfl_decompressor*)pDec->pInflator);
+    }
+    return (ESP_OK);
+}  // dec_parse_header
+
+/**
+ * @brief Init a decoder
+ *
+ * @param pDec The decoder
+ * @param pSource Base partition for delta images (running app)
+ * @param Output Receiver of the decoded image
+ * @param pArg Argument for Output
+ * @return esp_err_t
+ */
+esp_err_t OtaDec_Init(OtaDec * pDec, const esp_partition_t * pSource, OtaDec_Output Output, void * pArg) {
+    memset(pDec, 0x00, sizeof(OtaDec));
+    pDec->pSource = pSource;
+    pDec->Output = Output;
+    pDec->pOutputArg = pArg;
+    pDec->ImageSize = UINT32_MAX;
+    pDec->DeltaState = DELTA_OP;
+    return (ESP_OK);
+}
+
+/**
+ * @brief Decode the next piece of the received image
+ *
+ * @param pDec The decoder
+ * @param pData Received data
+ * @param Length Length of the data
+ * @return esp_err_t
+ */
+esp_err_t OtaDec_Write(OtaDec * pDec, const uint8_t * pData, size_t Length) {
+    // First byte decides: Plain app image or container
+    if ((0 == pDec->HeaderLen) && !pDec->isRaw && (Length > 0)) {
+        pDec->isRaw = (ESP_IMAGE_HEADER_MAGIC == pData[0]);
+    }
+    if (pDec->isRaw) {
+        return (dec_output(pDec, pData, Length));
+    }
+
+    // Collect the header
+    if (pDec->HeaderLen < OTADEC_HEADERSIZE) {
+        const size_t Part = (Length < (OTADEC_HEADERSIZE - pDec->HeaderLen)) ? Length : (OTADEC_HEADERSIZE - pDec->HeaderLen);
+        memcpy(&pDec->Header[pDec->HeaderLen], pData, Part);
+        pDec->HeaderLen += Part;
+        pData += Part;
+        Length -= Part;
+
+        if (pDec->HeaderLen < OTADEC_HEADERSIZE) {
+            return (ESP_OK);
+        }
+        esp_err_t ret = dec_parse_header(pDec);
+        if (ESP_OK != ret) {
+            return (ret);
+        }
+    }
+
+    if (0 == Length) {
+        return (ESP_OK);
+    }
+    if (pDec->Flags & OTADEC_FLAG_DEFLATE) {
+        return (dec_inflate(pDec, pData, Length));
+    }
+    return (dec_payload(pDec, pData, Length));
+}  // OtaDec_Write
+
+/**
+ * @brief Check that the image was decoded completely
+ *
+ * @param pDec The decoder
+ * @return esp_err_t
+ */
+esp_err_t OtaDec_Finish(OtaDec * pDec) {
+    if (pDec->isRaw) {
+        return (ESP_OK);
+    }
+    if ((pDec->HeaderLen < OTADEC_HEADERSIZE)
+     || ((pDec->Flags & OTADEC_FLAG_DEFLATE) && !pDec->isInflated)
+     || ((pDec->Flags & OTADEC_FLAG_DELTA) && (DELTA_END != pDec->DeltaState))
+     || (pDec->Decoded != pDec->ImageSize)) {
+        ESP_LOGE(TAG, "Image incomplete, %lu of %lu bytes", (unsigned long)pDec->Decoded, (unsigned long)pDec->ImageSize);
+        return (ESP_ERR_INVALID_SIZE);
+    }
+    return (ESP_OK);
+}  // OtaDec_Finish
+
+/**
+ * @brief Free the buffers of a decoder
+ *
+ * @param pDec The decoder
+ */
+void OtaDec_Free(OtaDec * pDec) {
+    RamAlloc_Free(RAM_SYS_INFLATE, pDec->pInflator, sizeof(tinfl_decompressor));
+    if (NULL != pDec->pWindow) {
+        RamAlloc_Free(RAM_SYS_OTA, pDec->pWindow, pDec->WindowMask + 1);
+    }
+    pDec->pInflator = NULL;
+    pDec->pWindow = NULL;
+}
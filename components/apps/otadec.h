@@ -0,0 +1,82 @@
+/**
+ ******************************************************************************
+ *  file           : otadec.h
+ *  brief          : Streaming decoder for compressed and delta OTA images
+ ******************************************************************************
+ */
+
+#ifndef COMPONENTS_APPS_OTADEC_H_
+#define COMPONENTS_APPS_OTADEC_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "esp_partition.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Container format, all values little endian. Created by tools/otaimage.py.
+ * Plain app images (starting with 0xE9) are passed through unchanged.
+ *
+ *  Offset  Size  Content
+ *  0       4     Magic "IOTU"
+ *  4       1     Format version (1)
+ *  5       1     Flags, OTADEC_FLAG_xxx
+ *  6       1     Window bits of the deflate stream (8..15)
+ *  7       1     Reserved
+ *  8       4     Size of the decoded app image
+ *  12      32    Delta: app_elf_sha256 of the base image (running app)
+ *  44      ...   Payload: Deflate stream and/or delta operations
+ *
+ * Delta operations:
+ *  0x00                        End
+ *  0x01 <offset> <length>      Copy from the running partition
+ *  0x02 <length> <data>        Literal data
+ *  Numbers are unsigned LEB128 varints.
+ */
+#define OTADEC_MAGIC            0x55544F49  // "IOTU"
+#define OTADEC_VERSION          1
+#define OTADEC_FLAG_DEFLATE     0x01        // Payload is a raw deflate stream
+#define OTADEC_FLAG_DELTA       0x02        // Payload are delta operations
+#define OTADEC_MAX_WINDOWBITS   13          // Max supported deflate window (8K)
+#define OTADEC_HEADERSIZE       44
+
+// Receives the decoded image data
+typedef esp_err_t (*OtaDec_Output)(void * pArg, const uint8_t * pData, size_t Length);
+
+typedef struct OtaDec {
+    const esp_partition_t * pSource;        // Base for delta images
+    OtaDec_Output   Output;                 // Receiver of decoded data
+    void *          pOutputArg;             // Argument for Output
+    uint8_t         Header[OTADEC_HEADERSIZE]; // Container header
+    size_t          HeaderLen;              // Received header bytes
+    bool            isRaw;                  // Plain app image
+    uint8_t         Flags;                  // OTADEC_FLAG_xxx
+    uint32_t        ImageSize;              // Expected decoded size
+    uint32_t        Decoded;                // Decoded bytes so far
+    void *          pInflator;              // tinfl state
+    uint8_t *       pWindow;                // Deflate window
+    size_t          WindowMask;             // Window size - 1
+    size_t          WindowPos;              // Next write position in the window
+    bool            isInflated;             // Deflate stream complete
+    int             DeltaState;             // State of the delta parser
+    uint8_t         DeltaOp;                // Current operation
+    uint32_t        DeltaArgs[2];           // Arguments of the operation
+    int             DeltaArgIdx;            // Argument being parsed
+    int             DeltaShift;             // Varint shift
+    uint32_t        DeltaRemaining;         // Remaining literal bytes
+} OtaDec;
+
+esp_err_t   OtaDec_Init(OtaDec * pDec, const esp_partition_t * pSource, OtaDec_Output Output, void * pArg);
+esp_err_t   OtaDec_Write(OtaDec * pDec, const uint8_t * pData, size_t Length);
+esp_err_t   OtaDec_Finish(OtaDec * pDec);
+void        OtaDec_Free(OtaDec * pDec);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // COMPONENTS_APPS_OTADEC_H_
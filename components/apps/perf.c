@@ -0,0 +1,255 @@
+/**
+ ******************************************************************************
+ *  file           : perf.c
+ *  brief          : Performance telemetry: Task CPU, stacks and heap
+ *
+ *  While enabled, a sample is published on <base>/perf every period:
+ *    cpu.<task>    CPU load of the task in the period, 0.1% of all cores
+ *    stk.<task>    Min. free stack of the task ever, bytes
+ *    <cap>.free    Free heap of a capability, bytes
+ *    <cap>.min     Min. free heap ever
+ *    <cap>.big     Largest free block
+ *    <cap>.frag    Fragmentation: 100 - big * 100 / free, %
+ *    mem.<sys>     Heap of a subsystem (see ramalloc.h), bytes
+ *    memx.<sys>    ...of it in PSRAM
+ *    memmax.<sys>  Max. heap of the subsystem ever
+ *    arena.<name>  Max. use of an arena ever, bytes
+ *    arenafail.<name> Failed allocations from the arena
+ *
+ *  Needs CONFIG_FREERTOS_USE_TRACE_FACILITY for the task values and
+ *  CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS for the CPU load, see
+ *  sdkconfig.defaults. Without them only the heap is sampled.
+ ******************************************************************************
+ */
+
+/****************************** Includes  */
+#include <stdio.h>
+#include <string.h>
+#include "sdkconfig.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+
+#include "../drivers/mqtt.h"
+#include "../drivers/codec.h"
+#include "../drivers/sysmem.h"
+#include "../drivers/ramalloc.h"
+#include "perf.h"
+
+/****************************** Configuration */
+#define PERF_PERIOD_MS 30000            // Sample period
+#define PERF_MAX_TASKS 32               // Max number of sampled tasks
+#define PERF_BUFFER 3072                // Max size of an encoded sample
+#define PERF_MAX_KEY (16 + configMAX_TASK_NAME_LEN) // Longest prefix ("arenafail.") plus a name
+
+/****************************** Statics */
+static const char *TAG = "PERF";
+static TaskHandle_t xPerfTask = NULL;
+static volatile bool isActive = false;
+static uint8_t * pBuffer = NULL;                // Encoded sample, from RAM_SYS_PERF
+
+#if CONFIG_FREERTOS_USE_TRACE_FACILITY
+static TaskStatus_t * Tasks = NULL;            // PERF_MAX_TASKS, from RAM_SYS_PERF
+
+// Run time counter of a task at the last sample
+typedef struct Perf_Counter {
+    TaskHandle_t    xHandle;
+    uint32_t        RunTime;
+} Perf_Counter;
+
+static Perf_Counter LastCounters[PERF_MAX_TASKS];
+static uint32_t LastTotal = 0;
+#endif
+
+// Sampled heap capabilities
+static const struct {
+    const char *    Name;
+    uint32_t        Caps;
+} HeapCaps[] = {
+    { "heap8",  MALLOC_CAP_8BIT },
+    { "heapi",  MALLOC_CAP_INTERNAL },
+    { "heapdma", MALLOC_CAP_DMA },
+    { "heaps",  MALLOC_CAP_SPIRAM },
+};
+#define PERF_HEAPCAPS (sizeof(HeapCaps)/sizeof(HeapCaps[0]))
+
+/****************************** Functions */
+
+/**
+ * @brief Add a member named <Prefix>.<Name>
+ *
+ * A truncated key could collide with another one, so it is skipped.
+ */
+static void perf_add(Codec_Writer * pWriter, const char * Prefix, const char * Name, int64_t Value) {
+    char Key[PERF_MAX_KEY];
+
+    if (snprintf(Key, sizeof(Key), "%s.%s", Prefix, Name) >= sizeof(Key)) {
+        ESP_LOGW(TAG, "Key '%s.%s' too long, skipped", Prefix, Name);
+        return;
+    }
+    Codec_AddInt(pWriter, Key, Value);
+}
+
+#if CONFIG_FREERTOS_USE_TRACE_FACILITY
+/**
+ * @brief Add CPU load and stack watermark of all tasks
+ */
+static void perf_sample_tasks(Codec_Writer * pWriter) {
+    uint32_t Total = 0;
+    Perf_Counter Counters[PERF_MAX_TASKS];
+
+    const UBaseType_t Count = uxTaskGetSystemState(Tasks, PERF_MAX_TASKS, &Total);
+    if (0 == Count) {
+        ESP_LOGW(TAG, "More than %d tasks", PERF_MAX_TASKS);
+        return;
+    }
+    // The total is the time of one core
+    const uint32_t Elapsed = (Total - LastTotal) * portNUM_PROCESSORS;
+
+    for (UBaseType_t i = 0; i < Count; i++) {
+        const TaskStatus_t * pTask = &Tasks[i];
+
+        Counters[i].xHandle = pTask->xHandle;
+        Counters[i].RunTime = pTask->ulRunTimeCounter;
+
+#if CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+        // Load since the last sample, a new task since its start
+        uint32_t Last = 0;
+        for (int j = 0; j < PERF_MAX_TASKS; j++) {
+            if (LastCounters[j].xHandle == pTask->xHandle) {
+                Last = LastCounters[j].RunTime;
+                break;
+            }
+        }
+        if (Elapsed > 0) {
+            perf_add(pWriter, "cpu", pTask->pcTaskName, ((uint64_t)(pTask->ulRunTimeCounter - Last) * 1000) / Elapsed);
+        }
+#endif
+        // Stack type is uint8_t, so this is in bytes
+        perf_add(pWriter, "stk", pTask->pcTaskName, pTask->usStackHighWaterMark);
+    }
+
+    memset(LastCounters, 0x00, sizeof(LastCounters));
+    memcpy(LastCounters, Counters, Count * sizeof(Perf_Counter));
+    LastTotal = Total;
+}  // perf_sample_tasks
+#endif
+
+/**
+ * @brief Add free, min. free and largest block of the heap capabilities
+ */
+static void perf_sample_heap(Codec_Writer * pWriter) {
+    multi_heap_info_t Info;
+
+    for (int i = 0; i < PERF_HEAPCAPS; i++) {
+        if (0 == heap_caps_get_total_size(HeapCaps[i].Caps)) {
+            continue;   // e.g. no PSRAM
+        }
+        heap_caps_get_info(&Info, HeapCaps[i].Caps);
+        perf_add(pWriter, HeapCaps[i].Name, "free", Info.total_free_bytes);
+        perf_add(pWriter, HeapCaps[i].Name, "min", Info.minimum_free_bytes);
+        perf_add(pWriter, HeapCaps[i].Name, "big", Info.largest_free_block);
+        perf_add(pWriter, HeapCaps[i].Name, "frag", (Info.total_free_bytes > 0)
+                 ? (100 - ((uint64_t)Info.largest_free_block * 100) / Info.total_free_bytes) : 0);
+    }
+}  // perf_sample_heap
+
+/**
+ * @brief Add the heap of the subsystems and the use of the arenas
+ */
+static void perf_sample_ram(Codec_Writer * pWriter) {
+    const RamArena * Arenas[RAMALLOC_MAX_ARENAS];
+    RamAlloc_Stats Stats;
+
+    for (int i = 0; i < RAM_SYS_COUNT; i++) {
+        RamAlloc_GetStats(i, &Stats);
+        perf_add(pWriter, "mem", RamAlloc_GetName(i), Stats.Used);
+        perf_add(pWriter, "memx", RamAlloc_GetName(i), Stats.External);
+        perf_add(pWriter, "memmax", RamAlloc_GetName(i), Stats.Peak);
+    }
+
+    const size_t Count = RamArena_GetAll(Arenas, RAMALLOC_MAX_ARENAS);
+    for (size_t i = 0; i < Count; i++) {
+        perf_add(pWriter, "arena", Arenas[i]->Name, Arenas[i]->Peak);
+        perf_add(pWriter, "arenafail", Arenas[i]->Name, Arenas[i]->Fails);
+    }
+}  // perf_sample_ram
+
+/**
+ * @brief Task: Sample and publish while enabled
+ *
+ * @param pvParameters
+ */
+static void TaskPerf(void* pvParameters) {
+    static const MQTT_TxOptions Options = { .Qos = 0 };
+    Codec_Writer Payload;
+    size_t Length;
+
+    while (1) {
+        // Enabling wakes up at once
+        ulTaskNotifyTake(pdTRUE, isActive ? pdMS_TO_TICKS(PERF_PERIOD_MS) : portMAX_DELAY);
+        if (!isActive) {
+            continue;
+        }
+
+        Codec_Begin(&Payload, Codec_GetFormat(PERF_SUBTOPIC), pBuffer, PERF_BUFFER);
+#if CONFIG_FREERTOS_USE_TRACE_FACILITY
+        perf_sample_tasks(&Payload);
+#endif
+        perf_sample_heap(&Payload);
+        perf_sample_ram(&Payload);
+
+        esp_err_t ret = Codec_End(&Payload, &Length);
+        if (ESP_OK == ret) {
+            ret = MQTT_Publish(PERF_SUBTOPIC, pBuffer, Length, &Options);
+        }
+        if (ESP_OK != ret) {
+            ESP_LOGW(TAG, "Cannot publish sample: %s", esp_err_to_name(ret));
+        }
+    }
+}  // TaskPerf
+
+/**
+ * @brief Init: Start the sampling task, disabled
+ *
+ * @return esp_err_t
+ */
+esp_err_t Perf_Init(void) {
+#if !CONFIG_FREERTOS_USE_TRACE_FACILITY || !CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+    ESP_LOGW(TAG, "FreeRTOS trace facility or run time stats disabled, task values incomplete");
+#endif
+#if CONFIG_FREERTOS_USE_TRACE_FACILITY
+    Tasks = RamAlloc_Malloc(RAM_SYS_PERF, PERF_MAX_TASKS * sizeof(TaskStatus_t));
+    if (NULL == Tasks) {
+        return (ESP_ERR_NO_MEM);
+    }
+#endif
+    pBuffer = RamAlloc_Malloc(RAM_SYS_PERF, PERF_BUFFER);
+    if (NULL == pBuffer) {
+        return (ESP_ERR_NO_MEM);
+    }
+    return (SYSMEM_TASK(TaskPerf, "perf", SYSMEM_STACK_PERF, NULL, tskIDLE_PRIORITY + 1, &xPerfTask));
+}
+
+/**
+ * @brief Switch the sampling on or off
+ *
+ * @param isEnabled
+ */
+void Perf_Enable(bool isEnabled) {
+    ESP_LOGI(TAG, "Sampling %s", isEnabled ? "on" : "off");
+    isActive = isEnabled;
+    if (NULL != xPerfTask) {
+        xTaskNotifyGive(xPerfTask);
+    }
+}
+
+/**
+ * @brief Check if sampling is on
+ *
+ * @return true
+ */
+bool Perf_isEnabled(void) {
+    return (isActive);
+}
@@ -0,0 +1,29 @@
+/**
+ ******************************************************************************
+ *  file           : perf.h
+ *  brief          : Performance telemetry: Task CPU, stacks and heap
+ ******************************************************************************
+ */
+
+#ifndef COMPONENTS_APPS_PERF_H_
+#define COMPONENTS_APPS_PERF_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PERF_SUBTOPIC "perf"            // Subtopic of the samples
+
+esp_err_t   Perf_Init(void);
+void        Perf_Enable(bool isEnabled);
+bool        Perf_isEnabled(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // COMPONENTS_APPS_PERF_H_
@@ -0,0 +1,306 @@
+/**
+ ******************************************************************************
+ *  file           : telemetry.c
+ *  brief          : Report-on-change telemetry with keyframes and jitter
+ *
+ *  The owner sets the current values of the fields and calls
+ *  Telemetry_Flush() once per period. Only fields which changed by more
+ *  than their threshold since they were last sent are published. Every
+ *  keyframe interval all fields are sent, marked with "full":true.
+ *
+ *  The phase of the period is derived from the MAC address, so a fleet
+ *  powered up at the same time doesn't report in lock-step.
+ *
+ *  Settings TELEMETRY.PERIOD and TELEMETRY.KEYFRAME in ms, changes apply
+ *  at once. NVS namespace TELEMETRY: A u32 threshold per field with the
+ *  field name as key.
+ ******************************************************************************
+ */
+
+/****************************** Includes  */
+#include <stdio.h>
+#include <string.h>
+#include "esp_log.h"
+#include "esp_mac.h"
+#include "esp_timer.h"
+#include "nvs_flash.h"
+
+#include "../drivers/mqtt.h"
+#include "../drivers/codec.h"
+#include "../drivers/settings.h"
+#include "../drivers/ramalloc.h"
+#include "telemetry.h"
+
+/****************************** Configuration */
+#define NVS_NAMESPACE "TELEMETRY"       // Namespace for the configuration
+#define DEFAULT_PERIOD 10000            // Sample period in ms, if the setting is 0
+#define TELEMETRY_BUFFER 1024           // Max size of an encoded message
+
+typedef struct Telemetry_Field {
+    const char *    Key;                // Name, must stay valid
+    int64_t         Value;              // Current value, hash for strings
+    int64_t         Sent;               // Last sent value
+    uint32_t        Threshold;          // Min change to be sent
+    bool            isString;
+    bool            isSet;              // Has a value
+    bool            isSent;             // Was sent at least once
+    bool            isPending;          // Part of the message in progress
+    char            String[TELEMETRY_MAX_STRING];
+} Telemetry_Field;
+
+/****************************** Statics */
+static const char *TAG = "TELEMETRY";
+static const char * pSubTopic = NULL;
+static Telemetry_Field * Fields = NULL;                 // TELEMETRY_MAX_FIELDS, from RAM_SYS_TELEMETRY
+static uint8_t * pBuffer = NULL;                        // Encoded message, from RAM_SYS_TELEMETRY
+static size_t FieldCount = 0;
+static uint32_t PeriodMs = DEFAULT_PERIOD;
+static uint32_t KeyframeMs = DEFAULT_PERIOD;
+static uint32_t PhaseMs = 0;                    // Offset of this device in the period
+static uint32_t MacHash = 0;                    // Hash of the MAC for the phase
+static int64_t NextKeyframeUs = 0;              // 0: Next flush is a keyframe
+
+/****************************** Functions */
+
+/**
+ * @brief FNV-1a hash
+ */
+static uint32_t telemetry_hash(const void * pData, size_t Length) {
+    const uint8_t * pByte = pData;
+    uint32_t Hash = 2166136261UL;
+
+    while (Length-- > 0) {
+        Hash = (Hash ^ *pByte++) * 16777619UL;
+    }
+    return (Hash);
+}
+
+/**
+ * @brief Find a field, create it if new
+ *
+ * @param Key Name of the field
+ * @return Telemetry_Field* NULL if the table is full
+ */
+static Telemetry_Field * telemetry_field(const char * Key) {
+    nvs_handle_t handle;
+
+    if (NULL == Fields) {
+        return (NULL);
+    }
+    for (size_t i = 0; i < FieldCount; i++) {
+        if ((Fields[i].Key == Key) || (0 == strcmp(Fields[i].Key, Key))) {
+            return (&Fields[i]);
+        }
+    }
+    if (FieldCount >= TELEMETRY_MAX_FIELDS) {
+        ESP_LOGW(TAG, "Too many fields, ignoring '%s'", Key);
+        return (NULL);
+    }
+
+    Telemetry_Field * pField = &Fields[FieldCount++];
+    memset(pField, 0x00, sizeof(Telemetry_Field));
+    pField->Key = Key;
+
+    // Threshold from NVS, else any change is sent
+    if (ESP_OK == nvs_open(NVS_NAMESPACE, NVS_READONLY, &handle)) {
+        nvs_get_u32(handle, Key, &pField->Threshold);
+        nvs_close(handle);
+    }
+    return (pField);
+}  // telemetry_field
+
+/**
+ * @brief Check if a field must be part of the next message
+ */
+static bool telemetry_is_due(const Telemetry_Field * pField, bool isKeyframe) {
+    if (!pField->isSet) {
+        return (false);
+    }
+    if (isKeyframe || !pField->isSent) {
+        return (true);
+    }
+    if (pField->isString) {
+        return ((pField->Value != pField->Sent) && (TELEMETRY_KEYFRAME_ONLY != pField->Threshold));
+    }
+
+    const uint64_t Change = (pField->Value > pField->Sent) ? (uint64_t)(pField->Value - pField->Sent) : (uint64_t)(pField->Sent - pField->Value);
+    return (Change > pField->Threshold);
+}  // telemetry_is_due
+
+/**
+ * @brief Take period and keyframe interval from the settings
+ */
+static void telemetry_apply_settings(Settings_Id Id, void * pArg) {
+    const uint32_t Period = Settings_GetU32(SETTING_TELEMETRY_PERIOD);
+    const uint32_t Keyframe = Settings_GetU32(SETTING_TELEMETRY_KEYFRAME);
+
+    // At least one tick, xTaskDelayUntil() asserts on a zero increment
+    PeriodMs = (0 != Period) ? Period : DEFAULT_PERIOD;
+    PeriodMs = (PeriodMs < portTICK_PERIOD_MS) ? portTICK_PERIOD_MS : PeriodMs;
+    KeyframeMs = (Keyframe > PeriodMs) ? Keyframe : PeriodMs;
+    PhaseMs = MacHash % PeriodMs;
+
+    ESP_LOGI(TAG, "Period %lu ms, keyframe %lu ms, phase %lu ms",
+             (unsigned long)PeriodMs, (unsigned long)KeyframeMs, (unsigned long)PhaseMs);
+}
+
+/**
+ * @brief Init: Read the configuration and derive the phase from the MAC
+ *
+ * @param SubTopic Subtopic to publish to, must stay valid
+ * @return esp_err_t
+ */
+esp_err_t Telemetry_Init(const char * SubTopic) {
+    uint8_t Mac[6];
+
+    // Not on a hot path, PSRAM if present
+    Fields = RamAlloc_Malloc(RAM_SYS_TELEMETRY, TELEMETRY_MAX_FIELDS * sizeof(Telemetry_Field));
+    pBuffer = RamAlloc_Malloc(RAM_SYS_TELEMETRY, TELEMETRY_BUFFER);
+    if ((NULL == Fields) || (NULL == pBuffer)) {
+        return (ESP_ERR_NO_MEM);
+    }
+
+    pSubTopic = SubTopic;
+    ESP_ERROR_CHECK(esp_efuse_mac_get_default(&Mac[0]));
+    MacHash = telemetry_hash(Mac, sizeof(Mac));
+
+    telemetry_apply_settings(SETTING_TELEMETRY_PERIOD, NULL);
+    Settings_OnChange(SETTING_TELEMETRY_PERIOD, telemetry_apply_settings, NULL);
+    return (Settings_OnChange(SETTING_TELEMETRY_KEYFRAME, telemetry_apply_settings, NULL));
+}  // Telemetry_Init
+
+/**
+ * @brief Set the default threshold of a field, NVS has precedence
+ *
+ * @param Key Name of the field, must stay valid
+ * @param Threshold Min change to be sent, TELEMETRY_KEYFRAME_ONLY
+ * @return esp_err_t
+ */
+esp_err_t Telemetry_Define(const char * Key, uint32_t Threshold) {
+    nvs_handle_t handle;
+
+    Telemetry_Field * pField = telemetry_field(Key);
+    if (NULL == pField) {
+        return (ESP_ERR_NO_MEM);
+    }
+    pField->Threshold = Threshold;
+    if (ESP_OK == nvs_open(NVS_NAMESPACE, NVS_READONLY, &handle)) {
+        nvs_get_u32(handle, Key, &pField->Threshold);
+        nvs_close(handle);
+    }
+    return (ESP_OK);
+}  // Telemetry_Define
+
+/**
+ * @brief Set the current value of an integer field
+ *
+ * @param Key Name of the field, must stay valid
+ * @param Value The value
+ */
+void Telemetry_SetInt(const char * Key, int64_t Value) {
+    Telemetry_Field * pField = telemetry_field(Key);
+
+    if (NULL != pField) {
+        pField->Value = Value;
+        pField->isSet = true;
+    }
+}
+
+/**
+ * @brief Set the current value of a string field
+ *
+ * @param Key Name of the field, must stay valid
+ * @param Value The value, truncated to TELEMETRY_MAX_STRING-1
+ */
+void Telemetry_SetString(const char * Key, const char * Value) {
+    Telemetry_Field * pField = telemetry_field(Key);
+
+    if (NULL != pField) {
+        strlcpy(pField->String, Value, sizeof(pField->String));
+        pField->Value = telemetry_hash(pField->String, strlen(pField->String));
+        pField->isString = true;
+        pField->isSet = true;
+    }
+}
+
+/**
+ * @brief Publish the changed fields, or all if a keyframe is due
+ *
+ * Fields are only marked as sent if the message was accepted, so
+ * nothing is lost on a failure.
+ *
+ * @return esp_err_t ESP_OK also if nothing changed, ESP_ERR_NOT_FINISHED if stored for later
+ */
+esp_err_t Telemetry_Flush(void) {
+    const int64_t Now = esp_timer_get_time();
+    const bool isKeyframe = (0 == NextKeyframeUs) || (Now >= NextKeyframeUs);
+    Codec_Writer Payload;
+    size_t Length;
+    uint32_t Count = 0;
+
+    if (NULL == pSubTopic) {
+        return (ESP_ERR_INVALID_STATE);
+    }
+
+    Codec_Begin(&Payload, Codec_GetFormat(pSubTopic), pBuffer, TELEMETRY_BUFFER);
+    for (size_t i = 0; i < FieldCount; i++) {
+        Telemetry_Field * pField = &Fields[i];
+
+        pField->isPending = telemetry_is_due(pField, isKeyframe);
+        if (!pField->isPending) {
+            continue;
+        }
+        if (pField->isString) {
+            Codec_AddString(&Payload, pField->Key, pField->String);
+        } else {
+            Codec_AddInt(&Payload, pField->Key, pField->Value);
+        }
+        Count++;
+    }
+    if (0 == Count) {
+        ESP_LOGD(TAG, "Nothing changed");
+        return (ESP_OK);
+    }
+    if (isKeyframe) {
+        Codec_AddBool(&Payload, "full", true);
+    }
+
+    esp_err_t ret = Codec_End(&Payload, &Length);
+    if (ESP_OK == ret) {
+        ret = MQTT_TransmitData(pSubTopic, pBuffer, Length);
+    }
+    if ((ESP_OK != ret) && (ESP_ERR_NOT_FINISHED != ret)) {
+        ESP_LOGW(TAG, "Cannot publish %lu fields: %s", (unsigned long)Count, esp_err_to_name(ret));
+        return (ret);
+    }
+
+    for (size_t i = 0; i < FieldCount; i++) {
+        if (Fields[i].isPending) {
+            Fields[i].Sent = Fields[i].Value;
+            Fields[i].isSent = true;
+        }
+    }
+    if (isKeyframe) {
+        NextKeyframeUs = Now + ((int64_t)KeyframeMs * 1000);
+    }
+    ESP_LOGD(TAG, "Published %lu fields%s", (unsigned long)Count, isKeyframe ? " (keyframe)" : "");
+    return (ret);
+}  // Telemetry_Flush
+
+/**
+ * @brief Get the sample period
+ *
+ * @return uint32_t Period in ms
+ */
+uint32_t Telemetry_GetPeriodMs(void) {
+    return (PeriodMs);
+}
+
+/**
+ * @brief Get the phase of this device, delay before the first sample
+ *
+ * @return uint32_t Phase in ms
+ */
+uint32_t Telemetry_GetPhaseMs(void) {
+    return (PhaseMs);
+}
@@ -0,0 +1,35 @@
+/**
+ ******************************************************************************
+ *  file           : telemetry.h
+ *  brief          : Report-on-change telemetry with keyframes and jitter
+ ******************************************************************************
+ */
+
+#ifndef COMPONENTS_APPS_TELEMETRY_H_
+#define COMPONENTS_APPS_TELEMETRY_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TELEMETRY_MAX_FIELDS 40         // Max number of fields
+#define TELEMETRY_MAX_STRING 24         // Max length of a string value
+#define TELEMETRY_KEYFRAME_ONLY UINT32_MAX  // Threshold: Only sent in keyframes
+
+esp_err_t   Telemetry_Init(const char * SubTopic);
+esp_err_t   Telemetry_Define(const char * Key, uint32_t Threshold);
+void        Telemetry_SetInt(const char * Key, int64_t Value);
+void        Telemetry_SetString(const char * Key, const char * Value);
+esp_err_t   Telemetry_Flush(void);
+uint32_t    Telemetry_GetPeriodMs(void);
+uint32_t    Telemetry_GetPhaseMs(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // COMPONENTS_APPS_TELEMETRY_H_
@@ -0,0 +1,70 @@
+/**
+ ******************************************************************************
+ *  file           : apcache.c
+ *  brief          : Directed connects to the cached AP with fallback to a scan
+ *
+ *  The station connects to the BSSID and channel of the last connection,
+ *  optionally with its lease as static IP. After a number of failed
+ *  connects it falls back to a scan with DHCP, until the next start.
+ *  The owner reports the events and carries out the returned action,
+ *  the state has no locks: It is only used by the WiFi event handler.
+ ******************************************************************************
+ */
+
+/****************************** Includes  */
+#include <string.h>
+#include "esp_log.h"
+
+#include "apcache.h"
+
+/****************************** Statics */
+static const char *TAG = "APCACHE";
+
+/****************************** Functions */
+
+/**
+ * @brief Init the state of the station
+ *
+ * @param pCache The state
+ * @param Tries Directed connects before falling back to a scan
+ * @param isCached Connecting with the cached AP
+ * @param isStaticIp The cached lease is set as static IP
+ */
+void ApCache_Init(ApCache * pCache, uint32_t Tries, bool isCached, bool isStaticIp) {
+    memset(pCache, 0x00, sizeof(ApCache));
+    pCache->Tries = Tries;
+    pCache->isCached = isCached;
+    pCache->isStaticIp = isCached && isStaticIp;
+}
+
+/**
+ * @brief A connect failed or the connection is lost
+ *
+ * Failures count while connecting with the cache, the last allowed one
+ * drops the cache and the static IP.
+ *
+ * @param pCache The state
+ * @return ApCache_Action
+ */
+ApCache_Action ApCache_Disconnected(ApCache * pCache) {
+    if (!pCache->isCached || (++pCache->Fails < pCache->Tries)) {
+        return (APCACHE_RETRY);
+    }
+
+    ESP_LOGW(TAG, "Cached AP not reachable after %lu tries, scanning", (unsigned long)pCache->Fails);
+    pCache->isCached = false;
+    if (pCache->isStaticIp) {
+        pCache->isStaticIp = false;
+        return (APCACHE_SCAN_DHCP);
+    }
+    return (APCACHE_SCAN);
+}  // ApCache_Disconnected
+
+/**
+ * @brief Got an IP: The connection works, failures start over
+ *
+ * @param pCache The state
+ */
+void ApCache_GotIp(ApCache * pCache) {
+    pCache->Fails = 0;
+}
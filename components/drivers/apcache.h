@@ -0,0 +1,50 @@
+/**
+ ******************************************************************************
+ *  file           : apcache.h
+ *  brief          : Directed connects to the cached AP with fallback to a scan
+ ******************************************************************************
+ */
+
+#ifndef COMPONENTS_DRIVERS_APCACHE_H_
+#define COMPONENTS_DRIVERS_APCACHE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_netif.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Data of the last good connection, stored in NVS
+typedef struct ApCache_Entry {
+    char                Ssid[33];       // Network the cache is valid for
+    uint8_t             Bssid[6];       // The AP
+    uint8_t             Channel;        // Channel of the AP
+    esp_netif_ip_info_t IpInfo;         // The DHCP lease
+    uint32_t            Dns;            // DNS server of the lease
+} ApCache_Entry;
+
+// What to do after a failed connect
+typedef enum ApCache_Action {
+    APCACHE_RETRY = 0,                  // Connect again after the backoff
+    APCACHE_SCAN,                       // Scan for the AP now
+    APCACHE_SCAN_DHCP,                  // Scan for the AP now, start DHCP instead of the static IP
+} ApCache_Action;
+
+typedef struct ApCache {
+    uint32_t    Tries;                  // Directed connects before falling back
+    uint32_t    Fails;                  // Failed connects with the cache since the last IP
+    bool        isCached;               // Connecting with the cache
+    bool        isStaticIp;             // Cached lease used as static IP
+} ApCache;
+
+void            ApCache_Init(ApCache * pCache, uint32_t Tries, bool isCached, bool isStaticIp);
+ApCache_Action  ApCache_Disconnected(ApCache * pCache);
+void            ApCache_GotIp(ApCache * pCache);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // COMPONENTS_DRIVERS_APCACHE_H_
@@ -0,0 +1,588 @@
+/**
+ ******************************************************************************
+ *  file           : codec.c
+ *  brief          : Payload codecs: Compact JSON and CBOR
+ *
+ *  Flat objects are encoded member by member straight into a caller
+ *  buffer, no tree and no heap. JSON is written without whitespace,
+ *  CBOR as an indefinite length map with text keys, so neither needs
+ *  the number of members in advance.
+ *
+ *  Received objects are decoded with the field tables of jsondec.h, the
+ *  format is detected from the first byte. So a receiver accepts both.
+ *
+ *  The format of a topic is the device default (setting CODEC, 0 = JSON,
+ *  1 = CBOR, applied at once when changed) unless set with Codec_SetFormat().
+ ******************************************************************************
+ */
+
+/****************************** Includes  */
+#include <stdio.h>
+#include <string.h>
+#include "esp_log.h"
+
+#include "codec.h"
+#include "settings.h"
+
+/****************************** Configuration */
+#define MAX_KEYLEN 32                   // Max length of a member name
+#define MAX_DEPTH  16                   // Max nesting of skipped values
+#define MAX_SUBTOPIC 32                 // Max length of a subtopic with own format
+
+#define CBOR_UINT   0                   // Major types
+#define CBOR_NINT   1
+#define CBOR_BYTES  2
+#define CBOR_TEXT   3
+#define CBOR_ARRAY  4
+#define CBOR_MAP    5
+#define CBOR_TAG    6
+#define CBOR_SIMPLE 7
+#define CBOR_FALSE  20                  // Simple values
+#define CBOR_TRUE   21
+#define CBOR_INDEF  31                  // Additional info: Indefinite length
+#define CBOR_BREAK  0xFF                // End of an indefinite length item
+
+/****************************** Statics */
+static const char *TAG = "CODEC";
+static Codec_Format DefaultFormat = CODEC_JSON;
+
+typedef struct Codec_Topic {
+    char            SubTopic[MAX_SUBTOPIC];
+    Codec_Format    Format;
+} Codec_Topic;
+
+static Codec_Topic Topics[CODEC_MAX_TOPICS];
+static size_t TopicCount = 0;
+
+typedef struct Cbor_Ctx {
+    const uint8_t * pPos;               // Current position
+    const uint8_t * pEnd;               // End of input
+} Cbor_Ctx;
+
+/****************************** Functions */
+
+/**
+ * @brief Append bytes to the output
+ */
+static void codec_put(Codec_Writer * pWriter, const void * pData, size_t Length) {
+    if (pWriter->isOverflow || (Length > (pWriter->Size - pWriter->Length))) {
+        pWriter->isOverflow = true;
+        return;
+    }
+    memcpy(&pWriter->pBuffer[pWriter->Length], pData, Length);
+    pWriter->Length += Length;
+}
+
+/**
+ * @brief Append one byte to the output
+ */
+static void codec_put_byte(Codec_Writer * pWriter, uint8_t Byte) {
+    codec_put(pWriter, &Byte, 1);
+}
+
+/**
+ * @brief Write a CBOR head with the shortest encoding of the value
+ */
+static void cbor_put_head(Codec_Writer * pWriter, uint8_t Major, uint64_t Value) {
+    uint8_t Head[9];
+    size_t Bytes;
+
+    if (Value < 24) {
+        codec_put_byte(pWriter, (Major << 5) | Value);
+        return;
+    }
+    if (Value <= UINT8_MAX) {
+        Head[0] = (Major << 5) | 24;
+        Bytes = 1;
+    } else if (Value <= UINT16_MAX) {
+        Head[0] = (Major << 5) | 25;
+        Bytes = 2;
+    } else if (Value <= UINT32_MAX) {
+        Head[0] = (Major << 5) | 26;
+        Bytes = 4;
+    } else {
+        Head[0] = (Major << 5) | 27;
+        Bytes = 8;
+    }
+    // Network byte order
+    for (size_t i = 0; i < Bytes; i++) {
+        Head[Bytes - i] = (uint8_t)(Value >> (8 * i));
+    }
+    codec_put(pWriter, Head, Bytes + 1);
+}  // cbor_put_head
+
+/**
+ * @brief Write a CBOR text string
+ */
+static void cbor_put_text(Codec_Writer * pWriter, const char * Text) {
+    const size_t Length = strlen(Text);
+
+    cbor_put_head(pWriter, CBOR_TEXT, Length);
+    codec_put(pWriter, Text, Length);
+}
+
+/**
+ * @brief Write a quoted and escaped JSON string
+ */
+static void json_put_string(Codec_Writer * pWriter, const char * Text) {
+    static const char Hex[] = "0123456789abcdef";
+    const char * pRun = Text;
+
+    codec_put_byte(pWriter, '"');
+    for (; 0x00 != *Text; Text++) {
+        const uint8_t c = *Text;
+        if ((c >= 0x20) && (c != '"') && (c != '\\')) {
+            continue;
+        }
+        // Copy the plain run, then the escape
+        codec_put(pWriter, pRun, Text - pRun);
+        pRun = Text + 1;
+        if ((c == '"') || (c == '\\')) {
+            const char Escape[2] = { '\\', c };
+            codec_put(pWriter, Escape, 2);
+        } else {
+            const char Escape[6] = { '\\', 'u', '0', '0', Hex[c >> 4], Hex[c & 0x0F] };
+            codec_put(pWriter, Escape, 6);
+        }
+    }
+    codec_put(pWriter, pRun, Text - pRun);
+    codec_put_byte(pWriter, '"');
+}  // json_put_string
+
+/**
+ * @brief Write the key of a member, incl. separators
+ */
+static void codec_put_key(Codec_Writer * pWriter, const char * Key) {
+    if (CODEC_CBOR == pWriter->Format) {
+        cbor_put_text(pWriter, Key);
+        return;
+    }
+    if (!pWriter->isFirst) {
+        codec_put_byte(pWriter, ',');
+    }
+    pWriter->isFirst = false;
+    json_put_string(pWriter, Key);
+    codec_put_byte(pWriter, ':');
+}  // codec_put_key
+
+/**
+ * @brief Take the device default format from the settings
+ */
+static void codec_apply_setting(Settings_Id Id, void * pArg) {
+    DefaultFormat = (CODEC_CBOR == Settings_GetU32(SETTING_CODEC)) ? CODEC_CBOR : CODEC_JSON;
+    ESP_LOGI(TAG, "Default format: %s", (CODEC_CBOR == DefaultFormat) ? "CBOR" : "JSON");
+}
+
+/**
+ * @brief Init: Read the device default format, needs the settings
+ *
+ * @return esp_err_t
+ */
+esp_err_t Codec_Init(void) {
+    codec_apply_setting(SETTING_CODEC, NULL);
+    return (Settings_OnChange(SETTING_CODEC, codec_apply_setting, NULL));
+}  // Codec_Init
+
+/**
+ * @brief Get the format for a subtopic
+ *
+ * @param SubTopic The subtopic
+ * @return Codec_Format
+ */
+Codec_Format Codec_GetFormat(const char * SubTopic) {
+    for (size_t i = 0; i < TopicCount; i++) {
+        if (0 == strcmp(Topics[i].SubTopic, SubTopic)) {
+            return (Topics[i].Format);
+        }
+    }
+    return (DefaultFormat);
+}
+
+/**
+ * @brief Set the format of a subtopic, overrides the device default
+ *
+ * Meant to be called during the init of the apps.
+ *
+ * @param SubTopic The subtopic, NULL to set the device default
+ * @param Format The format
+ * @return esp_err_t ESP_ERR_NO_MEM if the table is full
+ */
+esp_err_t Codec_SetFormat(const char * SubTopic, Codec_Format Format) {
+    size_t i;
+
+    if (NULL == SubTopic) {
+        DefaultFormat = Format;
+        return (ESP_OK);
+    }
+    if (strlen(SubTopic) >= MAX_SUBTOPIC) {
+        return (ESP_ERR_INVALID_ARG);
+    }
+    for (i = 0; (i < TopicCount) && (0 != strcmp(Topics[i].SubTopic, SubTopic)); i++) {}
+    if (i >= CODEC_MAX_TOPICS) {
+        return (ESP_ERR_NO_MEM);
+    }
+    strcpy(Topics[i].SubTopic, SubTopic);
+    Topics[i].Format = Format;
+    if (i == TopicCount) {
+        TopicCount++;
+    }
+    return (ESP_OK);
+}  // Codec_SetFormat
+
+/**
+ * @brief Start encoding an object
+ *
+ * @param pWriter The writer
+ * @param Format The format
+ * @param pBuffer Output buffer
+ * @param Size Size of the buffer
+ */
+void Codec_Begin(Codec_Writer * pWriter, Codec_Format Format, void * pBuffer, size_t Size) {
+    pWriter->pBuffer = pBuffer;
+    pWriter->Size = Size;
+    pWriter->Length = 0;
+    pWriter->Format = Format;
+    pWriter->isFirst = true;
+    pWriter->isOverflow = false;
+
+    if (CODEC_CBOR == Format) {
+        codec_put_byte(pWriter, (CBOR_MAP << 5) | CBOR_INDEF);
+    } else {
+        codec_put_byte(pWriter, '{');
+    }
+}  // Codec_Begin
+
+/**
+ * @brief Add an integer member
+ *
+ * @param pWriter The writer
+ * @param Key Name of the member
+ * @param Value The value
+ */
+void Codec_AddInt(Codec_Writer * pWriter, const char * Key, int64_t Value) {
+    codec_put_key(pWriter, Key);
+
+    if (CODEC_CBOR == pWriter->Format) {
+        if (Value >= 0) {
+            cbor_put_head(pWriter, CBOR_UINT, (uint64_t)Value);
+        } else {
+            cbor_put_head(pWriter, CBOR_NINT, (uint64_t)(-1 - Value));
+        }
+        return;
+    }
+
+    // Decimal, written backwards
+    char Digits[20];
+    size_t Pos = sizeof(Digits);
+    uint64_t Magnitude = (Value < 0) ? (0 - (uint64_t)Value) : (uint64_t)Value;
+    do {
+        Digits[--Pos] = '0' + (Magnitude % 10);
+        Magnitude /= 10;
+    } while (Magnitude > 0);
+    if (Value < 0) {
+        codec_put_byte(pWriter, '-');
+    }
+    codec_put(pWriter, &Digits[Pos], sizeof(Digits) - Pos);
+}  // Codec_AddInt
+
+/**
+ * @brief Add a string member
+ *
+ * @param pWriter The writer
+ * @param Key Name of the member
+ * @param Value The value, zero terminated
+ */
+void Codec_AddString(Codec_Writer * pWriter, const char * Key, const char * Value) {
+    codec_put_key(pWriter, Key);
+
+    if (CODEC_CBOR == pWriter->Format) {
+        cbor_put_text(pWriter, Value);
+    } else {
+        json_put_string(pWriter, Value);
+    }
+}
+
+/**
+ * @brief Add a boolean member
+ *
+ * @param pWriter The writer
+ * @param Key Name of the member
+ * @param Value The value
+ */
+void Codec_AddBool(Codec_Writer * pWriter, const char * Key, bool Value) {
+    codec_put_key(pWriter, Key);
+
+    if (CODEC_CBOR == pWriter->Format) {
+        codec_put_byte(pWriter, (CBOR_SIMPLE << 5) | (Value ? CBOR_TRUE : CBOR_FALSE));
+    } else if (Value) {
+        codec_put(pWriter, "true", 4);
+    } else {
+        codec_put(pWriter, "false", 5);
+    }
+}
+
+/**
+ * @brief Finish the object
+ *
+ * JSON output is zero terminated, the terminator is not counted.
+ *
+ * @param pWriter The writer
+ * @param pLength Length of the encoded object
+ * @return esp_err_t ESP_ERR_NO_MEM if the buffer was too small
+ */
+esp_err_t Codec_End(Codec_Writer * pWriter, size_t * pLength) {
+    if (CODEC_CBOR == pWriter->Format) {
+        codec_put_byte(pWriter, CBOR_BREAK);
+    } else {
+        codec_put(pWriter, "}", 2);
+        pWriter->Length -= pWriter->isOverflow ? 0 : 1;
+    }
+
+    *pLength = pWriter->isOverflow ? 0 : pWriter->Length;
+    return (pWriter->isOverflow ? ESP_ERR_NO_MEM : ESP_OK);
+}  // Codec_End
+
+/**
+ * @brief Detect the format of a received object
+ *
+ * @param pData The object
+ * @param Length Length of the object
+ * @return Codec_Format CODEC_CBOR if it starts with a CBOR map
+ */
+Codec_Format Codec_Detect(const void * pData, size_t Length) {
+    const uint8_t First = (Length > 0) ? *(const uint8_t*)pData : 0x00;
+    return (((First >> 5) == CBOR_MAP) ? CODEC_CBOR : CODEC_JSON);
+}
+
+/**
+ * @brief Read the head of a CBOR item
+ *
+ * @param pCtx The input
+ * @param pMajor Major type
+ * @param pValue Value or length, UINT64_MAX for indefinite length
+ * @param pInfo Additional info of the initial byte
+ * @return esp_err_t
+ */
+static esp_err_t cbor_get_head(Cbor_Ctx * pCtx, uint8_t * pMajor, uint64_t * pValue, uint8_t * pInfo) {
+    if (pCtx->pPos >= pCtx->pEnd) {
+        return (ESP_ERR_INVALID_ARG);
+    }
+    const uint8_t Initial = *pCtx->pPos++;
+    const uint8_t Info = Initial & 0x1F;
+    size_t Bytes;
+
+    *pMajor = Initial >> 5;
+    *pInfo = Info;
+    if (Info < 24) {
+        *pValue = Info;
+        return (ESP_OK);
+    }
+    if (CBOR_INDEF == Info) {
+        *pValue = UINT64_MAX;
+        return (((CBOR_UINT == *pMajor) || (CBOR_NINT == *pMajor) || (CBOR_TAG == *pMajor)) ? ESP_ERR_INVALID_ARG : ESP_OK);
+    }
+    if (Info > 27) {
+        return (ESP_ERR_INVALID_ARG);
+    }
+
+    Bytes = 1 << (Info - 24);
+    if ((size_t)(pCtx->pEnd - pCtx->pPos) < Bytes) {
+        return (ESP_ERR_INVALID_ARG);
+    }
+    *pValue = 0;
+    while (Bytes-- > 0) {
+        *pValue = (*pValue << 8) | *pCtx->pPos++;
+    }
+    return (ESP_OK);
+}  // cbor_get_head
+
+/**
+ * @brief Check for the break of an indefinite length item, consumes it
+ */
+static bool cbor_is_break(Cbor_Ctx * pCtx) {
+    if ((pCtx->pPos < pCtx->pEnd) && (CBOR_BREAK == *pCtx->pPos)) {
+        pCtx->pPos++;
+        return (true);
+    }
+    return (false);
+}
+
+/**
+ * @brief Skip any item at the current position, incl. nested ones
+ */
+static esp_err_t cbor_skip(Cbor_Ctx * pCtx, int Depth) {
+    uint8_t Major, Info;
+    uint64_t Value;
+
+    if (Depth > MAX_DEPTH) {
+        return (ESP_ERR_INVALID_SIZE);
+    }
+    esp_err_t ret = cbor_get_head(pCtx, &Major, &Value, &Info);
+    if (ESP_OK != ret) {
+        return (ret);
+    }
+
+    switch (Major) {
+        case CBOR_BYTES:
+        case CBOR_TEXT:
+            if (UINT64_MAX == Value) {
+                // Chunks until the break
+                while (!cbor_is_break(pCtx)) {
+                    if (ESP_OK != (ret = cbor_skip(pCtx, Depth + 1))) {
+                        return (ret);
+                    }
+                }
+                return (ESP_OK);
+            }
+            if (Value > (uint64_t)(pCtx->pEnd - pCtx->pPos)) {
+                return (ESP_ERR_INVALID_ARG);
+            }
+            pCtx->pPos += Value;
+            return (ESP_OK);
+        case CBOR_ARRAY:
+        case CBOR_MAP: {
+            const uint64_t Items = (UINT64_MAX == Value) ? UINT64_MAX : ((CBOR_MAP == Major) ? (Value * 2) : Value);
+            for (uint64_t i = 0; i < Items; i++) {
+                if ((UINT64_MAX == Items) && cbor_is_break(pCtx)) {
+                    break;
+                }
+                if (ESP_OK != (ret = cbor_skip(pCtx, Depth + 1))) {
+                    return (ret);
+                }
+            }
+            return (ESP_OK);
+        }
+        case CBOR_TAG:
+            return (cbor_skip(pCtx, Depth + 1));
+        case CBOR_SIMPLE:
+            // A break outside an indefinite length item
+            return ((CBOR_INDEF == Info) ? ESP_ERR_INVALID_ARG : ESP_OK);
+        default:
+            return (ESP_OK);
+    }
+}  // cbor_skip
+
+/**
+ * @brief Decode one value into its field
+ */
+static esp_err_t cbor_field(Cbor_Ctx * pCtx, const JsonDec_Field * pField, void * pTarget) {
+    uint8_t * pDest = (uint8_t*)pTarget + pField->Offset;
+    uint8_t Major, Info;
+    uint64_t Value;
+
+    esp_err_t ret = cbor_get_head(pCtx, &Major, &Value, &Info);
+    if (ESP_OK != ret) {
+        return (ret);
+    }
+
+    switch (pField->Type) {
+        case JSONDEC_STRING:
+            if ((CBOR_TEXT != Major) || (UINT64_MAX == Value) || (Value > (uint64_t)(pCtx->pEnd - pCtx->pPos))) {
+                return (ESP_ERR_INVALID_ARG);
+            }
+            if (Value >= pField->Size) {
+                return (ESP_ERR_INVALID_SIZE);
+            }
+            memcpy(pDest, pCtx->pPos, Value);
+            pDest[Value] = 0x00;
+            pCtx->pPos += Value;
+            return (ESP_OK);
+        case JSONDEC_INT:
+            if ((CBOR_UINT == Major) && (Value <= INT32_MAX)) {
+                *(int32_t*)pDest = (int32_t)Value;
+            } else if ((CBOR_NINT == Major) && (Value <= INT32_MAX)) {
+                *(int32_t*)pDest = -1 - (int32_t)Value;
+            } else {
+                return (((CBOR_UINT == Major) || (CBOR_NINT == Major)) ? ESP_ERR_INVALID_SIZE : ESP_ERR_INVALID_ARG);
+            }
+            return (ESP_OK);
+        case JSONDEC_BOOL:
+            if ((CBOR_SIMPLE != Major) || ((CBOR_TRUE != Info) && (CBOR_FALSE != Info))) {
+                return (ESP_ERR_INVALID_ARG);
+            }
+            *(bool*)pDest = (CBOR_TRUE == Info);
+            return (ESP_OK);
+        default:
+            return (ESP_ERR_INVALID_ARG);
+    }
+}  // cbor_field
+
+/**
+ * @brief Decode a CBOR map into a struct, see JsonDec_Object()
+ */
+static esp_err_t cbor_object(const uint8_t * pData, size_t Length, const JsonDec_Field * pFields, size_t Count, void * pTarget, uint32_t * pFound) {
+    Cbor_Ctx Ctx = { .pPos = pData, .pEnd = pData + Length };
+    uint32_t Found = 0;
+    char Key[MAX_KEYLEN];
+    uint8_t Major, Info;
+    uint64_t Members;
+
+    esp_err_t ret = cbor_get_head(&Ctx, &Major, &Members, &Info);
+    if ((ESP_OK != ret) || (CBOR_MAP != Major)) {
+        return (ESP_ERR_INVALID_ARG);
+    }
+
+    for (uint64_t Member = 0; Member < Members; Member++) {
+        uint64_t KeyLen;
+
+        if ((UINT64_MAX == Members) && cbor_is_break(&Ctx)) {
+            break;
+        }
+
+        // Member name, other keys and too long names can't be in the table
+        const uint8_t * pKey = Ctx.pPos;
+        Key[0] = 0x00;
+        if ((ESP_OK == cbor_get_head(&Ctx, &Major, &KeyLen, &Info)) && (CBOR_TEXT == Major)
+         && (KeyLen < sizeof(Key)) && (KeyLen <= (uint64_t)(Ctx.pEnd - Ctx.pPos))) {
+            memcpy(Key, Ctx.pPos, KeyLen);
+            Key[KeyLen] = 0x00;
+            Ctx.pPos += KeyLen;
+        } else {
+            Ctx.pPos = pKey;
+            if (ESP_OK != cbor_skip(&Ctx, 0)) {
+                return (ESP_ERR_INVALID_ARG);
+            }
+        }
+
+        // Value
+        size_t Field;
+        for (Field = 0; (Field < Count) && (0 != strcmp(Key, pFields[Field].Key)); Field++) {}
+        if (Field < Count) {
+            ret = cbor_field(&Ctx, &pFields[Field], pTarget);
+            Found |= (1UL << Field);
+        } else {
+            ret = cbor_skip(&Ctx, 0);
+        }
+        if (ESP_OK != ret) {
+            return (ret);
+        }
+    }
+
+    if (NULL != pFound) {
+        *pFound = Found;
+    }
+    return (ESP_OK);
+}  // cbor_object
+
+/**
+ * @brief Decode a JSON object or CBOR map into a struct
+ *
+ * The format is detected, see JsonDec_Object() for the field table.
+ *
+ * @param pData The input
+ * @param Length Length of the input
+ * @param pFields Table of the members to extract
+ * @param Count Number of entries in the table
+ * @param pTarget The struct to fill
+ * @param pFound Optional: Bit n is set if field n was found
+ * @return esp_err_t ESP_ERR_INVALID_ARG on syntax or type errors, ESP_ERR_INVALID_SIZE if a value does not fit
+ */
+esp_err_t Codec_DecodeObject(const void * pData, size_t Length, const JsonDec_Field * pFields, size_t Count, void * pTarget, uint32_t * pFound) {
+    if ((NULL == pData) || (Count > JSONDEC_MAX_FIELDS)) {
+        return (ESP_ERR_INVALID_ARG);
+    }
+    if (CODEC_CBOR == Codec_Detect(pData, Length)) {
+        return (cbor_object(pData, Length, pFields, Count, pTarget, pFound));
+    }
+    return (JsonDec_Object(pData, Length, pFields, Count, pTarget, pFound));
+}  // Codec_DecodeObject
@@ -0,0 +1,56 @@
+/**
+ ******************************************************************************
+ *  file           : codec.h
+ *  brief          : Payload codecs: Compact JSON and CBOR
+ ******************************************************************************
+ */
+
+#ifndef COMPONENTS_DRIVERS_CODEC_H_
+#define COMPONENTS_DRIVERS_CODEC_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+#include "jsondec.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CODEC_MAX_TOPICS 8              // Max number of per-topic formats
+
+typedef enum Codec_Format {
+    CODEC_JSON = 0,                     // Compact JSON, for humans
+    CODEC_CBOR = 1,                     // CBOR (RFC 8949), for the wire
+} Codec_Format;
+
+// Encodes a flat object straight into a caller buffer
+typedef struct Codec_Writer {
+    uint8_t *       pBuffer;            // Output buffer
+    size_t          Size;               // Size of the buffer
+    size_t          Length;             // Bytes written
+    Codec_Format    Format;
+    bool            isFirst;            // JSON: No separator before the next member
+    bool            isOverflow;         // Buffer too small, output is incomplete
+} Codec_Writer;
+
+esp_err_t       Codec_Init(void);
+Codec_Format    Codec_GetFormat(const char * SubTopic);
+esp_err_t       Codec_SetFormat(const char * SubTopic, Codec_Format Format);
+
+void            Codec_Begin(Codec_Writer * pWriter, Codec_Format Format, void * pBuffer, size_t Size);
+void            Codec_AddInt(Codec_Writer * pWriter, const char * Key, int64_t Value);
+void            Codec_AddString(Codec_Writer * pWriter, const char * Key, const char * Value);
+void            Codec_AddBool(Codec_Writer * pWriter, const char * Key, bool Value);
+esp_err_t       Codec_End(Codec_Writer * pWriter, size_t * pLength);
+
+Codec_Format    Codec_Detect(const void * pData, size_t Length);
+esp_err_t       Codec_DecodeObject(const void * pData, size_t Length, const JsonDec_Field * pFields, size_t Count, void * pTarget, uint32_t * pFound);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // COMPONENTS_DRIVERS_CODEC_H_
@@ -0,0 +1,162 @@
+/**
+ ******************************************************************************
+ *  file           : connlink.c
+ *  brief          : Reconnect backoff and outage statistics of a link
+ *
+ *  The owner of a link reports state changes with ConnLink_Up/Down and
+ *  requests reconnects with ConnLink_Retry. Retries are delayed by an
+ *  exponential backoff with jitter (between half and the full delay),
+ *  so many devices don't hammer the AP or broker in sync after an outage.
+ *  Links never give up.
+ ******************************************************************************
+ */
+
+/****************************** Includes  */
+#include <stdio.h>
+#include <string.h>
+#include "esp_log.h"
+#include "esp_random.h"
+
+#include "connlink.h"
+
+/****************************** Statics */
+static const char *TAG = "CONNLINK";
+
+/****************************** Functions */
+
+/**
+ * @brief Backoff timer expired
+ */
+static void connlink_timer(void * pArg) {
+    ConnLink * pLink = pArg;
+    pLink->Reconnect();
+}
+
+/**
+ * @brief Init a link
+ *
+ * @param pLink The link
+ * @param Name Name for logging
+ * @param Reconnect Function to start a reconnect
+ * @param BaseMs First backoff
+ * @param MaxMs Max backoff
+ * @return esp_err_t
+ */
+esp_err_t ConnLink_Init(ConnLink * pLink, const char * Name, ConnLink_Reconnect Reconnect, uint32_t BaseMs, uint32_t MaxMs) {
+    memset(pLink, 0x00, sizeof(ConnLink));
+    pLink->Name = Name;
+    pLink->Reconnect = Reconnect;
+    pLink->BaseMs = BaseMs;
+    pLink->MaxMs = MaxMs;
+    portMUX_INITIALIZE(&pLink->Lock);
+
+    const esp_timer_create_args_t TimerArgs = {
+        .callback = connlink_timer,
+        .arg = pLink,
+        .name = Name,
+    };
+    return (esp_timer_create(&TimerArgs, &pLink->Timer));
+}  // ConnLink_Init
+
+/**
+ * @brief The link is up: Ends the outage and resets the backoff
+ *
+ * @param pLink The link
+ */
+void ConnLink_Up(ConnLink * pLink) {
+    const int64_t Now = esp_timer_get_time();
+    uint32_t OutageMs = 0;
+
+    esp_timer_stop(pLink->Timer);
+
+    taskENTER_CRITICAL(&pLink->Lock);
+    if (0 != pLink->DownSinceUs) {
+        OutageMs = (Now - pLink->DownSinceUs) / 1000;
+        pLink->Stats.LastOutageMs = OutageMs;
+        pLink->Stats.TotalOutageMs += OutageMs;
+        if (OutageMs > pLink->Stats.MaxOutageMs) {
+            pLink->Stats.MaxOutageMs = OutageMs;
+        }
+        pLink->DownSinceUs = 0;
+    }
+    pLink->Attempt = 0;
+    pLink->Stats.isUp = true;
+    taskEXIT_CRITICAL(&pLink->Lock);
+
+    if (OutageMs > 0) {
+        ESP_LOGI(TAG, "%s: Recovered after %lu ms", pLink->Name, (unsigned long)OutageMs);
+    }
+}  // ConnLink_Up
+
+/**
+ * @brief The link is down: Starts an outage, if it was up
+ *
+ * @param pLink The link
+ */
+void ConnLink_Down(ConnLink * pLink) {
+    taskENTER_CRITICAL(&pLink->Lock);
+    if (pLink->Stats.isUp) {
+        pLink->DownSinceUs = esp_timer_get_time();
+        pLink->Stats.Outages++;
+        pLink->Stats.isUp = false;
+    }
+    taskEXIT_CRITICAL(&pLink->Lock);
+}
+
+/**
+ * @brief Schedule a reconnect after the next backoff
+ *
+ * @param pLink The link
+ */
+void ConnLink_Retry(ConnLink * pLink) {
+    uint32_t DelayMs = pLink->MaxMs;
+
+    if ((pLink->Attempt < 16) && ((pLink->BaseMs << pLink->Attempt) < pLink->MaxMs)) {
+        DelayMs = pLink->BaseMs << pLink->Attempt;
+    }
+    DelayMs = (DelayMs / 2) + (esp_random() % ((DelayMs / 2) + 1));
+
+    taskENTER_CRITICAL(&pLink->Lock);
+    pLink->Attempt++;
+    pLink->Stats.Attempts++;
+    taskEXIT_CRITICAL(&pLink->Lock);
+
+    ESP_LOGI(TAG, "%s: Reconnect %lu in %lu ms", pLink->Name, (unsigned long)pLink->Attempt, (unsigned long)DelayMs);
+    esp_timer_stop(pLink->Timer);
+    esp_timer_start_once(pLink->Timer, (uint64_t)DelayMs * 1000);
+}  // ConnLink_Retry
+
+/**
+ * @brief Reconnect now, e.g. when the link below is back
+ *
+ * @param pLink The link
+ */
+void ConnLink_Kick(ConnLink * pLink) {
+    esp_timer_stop(pLink->Timer);
+
+    taskENTER_CRITICAL(&pLink->Lock);
+    pLink->Attempt = 0;
+    pLink->Stats.Attempts++;
+    taskEXIT_CRITICAL(&pLink->Lock);
+
+    pLink->Reconnect();
+}
+
+/**
+ * @brief Get the outage statistics
+ *
+ * @param pLink The link
+ * @param pStats
+ */
+void ConnLink_GetStats(ConnLink * pLink, ConnLink_Stats * pStats) {
+    taskENTER_CRITICAL(&pLink->Lock);
+    memcpy(pStats, &pLink->Stats, sizeof(ConnLink_Stats));
+    taskEXIT_CRITICAL(&pLink->Lock);
+
+    // Include a running outage
+    if (!pStats->isUp && (0 != pLink->DownSinceUs)) {
+        const uint32_t OutageMs = (esp_timer_get_time() - pLink->DownSinceUs) / 1000;
+        pStats->TotalOutageMs += OutageMs;
+        pStats->MaxOutageMs = (OutageMs > pStats->MaxOutageMs) ? OutageMs : pStats->MaxOutageMs;
+    }
+}  // ConnLink_GetStats
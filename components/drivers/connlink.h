@@ -0,0 +1,57 @@
+/**
+ ******************************************************************************
+ *  file           : connlink.h
+ *  brief          : Reconnect backoff and outage statistics of a link
+ ******************************************************************************
+ */
+
+#ifndef COMPONENTS_DRIVERS_CONNLINK_H_
+#define COMPONENTS_DRIVERS_CONNLINK_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Outage statistics of a link
+typedef struct ConnLink_Stats {
+    uint32_t    Outages;                // Number of outages
+    uint32_t    LastOutageMs;           // Duration of the last outage, until recovered
+    uint32_t    MaxOutageMs;            // Longest outage
+    uint32_t    TotalOutageMs;          // Sum of all outages
+    uint32_t    Attempts;               // Reconnect attempts
+    bool        isUp;                   // Current state
+} ConnLink_Stats;
+
+// Starts a reconnect, called from the esp_timer task
+typedef void (*ConnLink_Reconnect)(void);
+
+typedef struct ConnLink {
+    const char *        Name;           // Name for logging
+    ConnLink_Reconnect  Reconnect;      // Reconnect function
+    esp_timer_handle_t  Timer;          // Backoff timer
+    uint32_t            BaseMs;         // First backoff
+    uint32_t            MaxMs;          // Max backoff
+    uint32_t            Attempt;        // Attempts since the link went down
+    int64_t             DownSinceUs;    // Start of the current outage, 0 if none
+    ConnLink_Stats      Stats;
+    portMUX_TYPE        Lock;
+} ConnLink;
+
+esp_err_t   ConnLink_Init(ConnLink * pLink, const char * Name, ConnLink_Reconnect Reconnect, uint32_t BaseMs, uint32_t MaxMs);
+void        ConnLink_Up(ConnLink * pLink);
+void        ConnLink_Down(ConnLink * pLink);
+void        ConnLink_Retry(ConnLink * pLink);
+void        ConnLink_Kick(ConnLink * pLink);
+void        ConnLink_GetStats(ConnLink * pLink, ConnLink_Stats * pStats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // COMPONENTS_DRIVERS_CONNLINK_H_
@@ -0,0 +1,341 @@
+/**
+ ******************************************************************************
+ *  file           : jsondec.c
+ *  brief          : Allocation free decoder for flat JSON objects
+ *
+ *  Single pass over the input, the members listed in a field table are
+ *  written directly into a caller provided struct. Unknown members,
+ *  nested objects and arrays are skipped. The input is not modified and
+ *  no memory is allocated.
+ ******************************************************************************
+ */
+
+/****************************** Includes  */
+#include <stdio.h>
+#include <string.h>
+
+#include "jsondec.h"
+
+/****************************** Configuration */
+#define MAX_KEYLEN 32                   // Max length of a member name
+#define MAX_DEPTH  16                   // Max nesting of skipped values
+
+/****************************** Statics */
+
+typedef struct JsonDec_Ctx {
+    const char *    pPos;               // Current position
+    const char *    pEnd;               // End of input
+} JsonDec_Ctx;
+
+/****************************** Functions */
+
+/**
+ * @brief Skip whitespace, returns the next character or 0 at the end
+ */
+static char dec_peek(JsonDec_Ctx * pCtx) {
+    while ((pCtx->pPos < pCtx->pEnd)
+        && ((*pCtx->pPos == ' ') || (*pCtx->pPos == '\t') || (*pCtx->pPos == '\r') || (*pCtx->pPos == '\n'))) {
+        pCtx->pPos++;
+    }
+    return ((pCtx->pPos < pCtx->pEnd) ? *pCtx->pPos : 0x00);
+}
+
+/**
+ * @brief Expect a character after optional whitespace
+ */
+static bool dec_expect(JsonDec_Ctx * pCtx, char c) {
+    if (dec_peek(pCtx) != c) {
+        return (false);
+    }
+    pCtx->pPos++;
+    return (true);
+}
+
+/**
+ * @brief Value of a hex digit, -1 if invalid
+ */
+static int dec_hex(char c) {
+    if ((c >= '0') && (c <= '9')) return (c - '0');
+    if ((c >= 'a') && (c <= 'f')) return (c - 'a' + 10);
+    if ((c >= 'A') && (c <= 'F')) return (c - 'A' + 10);
+    return (-1);
+}
+
+/**
+ * @brief Decode a string at the current position
+ *
+ * A string too long for the buffer is still read up to its end, so the
+ * decoder can go on behind it.
+ *
+ * @param pCtx The decoder
+ * @param pOut Output buffer, NULL to skip the string
+ * @param Size Size of the output buffer incl. terminating zero
+ * @return esp_err_t ESP_ERR_INVALID_SIZE if the output buffer is too small
+ */
+static esp_err_t dec_string(JsonDec_Ctx * pCtx, char * pOut, size_t Size) {
+    bool isTooLong = false;
+    size_t Length = 0;
+
+    if (!dec_expect(pCtx, '"')) {
+        return (ESP_ERR_INVALID_ARG);
+    }
+
+    while (pCtx->pPos < pCtx->pEnd) {
+        char c = *pCtx->pPos++;
+        uint32_t Code;
+
+        if (c == '"') {
+            if (NULL != pOut) {
+                pOut[Length] = 0x00;
+            }
+            return (isTooLong ? ESP_ERR_INVALID_SIZE : ESP_OK);
+        }
+        if ((uint8_t)c < 0x20) {
+            return (ESP_ERR_INVALID_ARG);
+        }
+
+        if (c != '\\') {
+            Code = (uint8_t)c;
+        } else {
+            if (pCtx->pPos >= pCtx->pEnd) {
+                return (ESP_ERR_INVALID_ARG);
+            }
+            switch (*pCtx->pPos++) {
+                case '"':  Code = '"';  break;
+                case '\\': Code = '\\'; break;
+                case '/':  Code = '/';  break;
+                case 'b':  Code = '\b'; break;
+                case 'f':  Code = '\f'; break;
+                case 'n':  Code = '\n'; break;
+                case 'r':  Code = '\r'; break;
+                case 't':  Code = '\t'; break;
+                case 'u':
+                    if ((pCtx->pEnd - pCtx->pPos) < 4) {
+                        return (ESP_ERR_INVALID_ARG);
+                    }
+                    Code = 0;
+                    for (int i = 0; i < 4; i++) {
+                        const int Digit = dec_hex(*pCtx->pPos++);
+                        if (Digit < 0) {
+                            return (ESP_ERR_INVALID_ARG);
+                        }
+                        Code = (Code << 4) | Digit;
+                    }
+                    break;
+                default:
+                    return (ESP_ERR_INVALID_ARG);
+            }
+        }
+
+        if (NULL == pOut) {
+            continue;
+        }
+
+        // Store as UTF-8, surrogates are replaced
+        uint8_t Bytes[3];
+        size_t  nBytes;
+        if ((Code < 0x80) || ('\\' != c)) {
+            Bytes[0] = Code;
+            nBytes = 1;
+        } else if (Code < 0x800) {
+            Bytes[0] = 0xC0 | (Code >> 6);
+            Bytes[1] = 0x80 | (Code & 0x3F);
+            nBytes = 2;
+        } else if ((Code >= 0xD800) && (Code <= 0xDFFF)) {
+            Bytes[0] = '?';
+            nBytes = 1;
+        } else {
+            Bytes[0] = 0xE0 | (Code >> 12);
+            Bytes[1] = 0x80 | ((Code >> 6) & 0x3F);
+            Bytes[2] = 0x80 | (Code & 0x3F);
+            nBytes = 3;
+        }
+        if ((Length + nBytes) >= Size) {
+            pOut = NULL;
+            isTooLong = true;
+            continue;
+        }
+        memcpy(&pOut[Length], Bytes, nBytes);
+        Length += nBytes;
+    }
+    return (ESP_ERR_INVALID_ARG);
+}  // dec_string
+
+/**
+ * @brief Decode an integer at the current position
+ */
+static esp_err_t dec_int(JsonDec_Ctx * pCtx, int32_t * pValue) {
+    bool isNegative = false;
+    int64_t Value = 0;
+
+    dec_peek(pCtx);
+    if ((pCtx->pPos < pCtx->pEnd) && (*pCtx->pPos == '-')) {
+        isNegative = true;
+        pCtx->pPos++;
+    }
+    if ((pCtx->pPos >= pCtx->pEnd) || (*pCtx->pPos < '0') || (*pCtx->pPos > '9')) {
+        return (ESP_ERR_INVALID_ARG);
+    }
+    while ((pCtx->pPos < pCtx->pEnd) && (*pCtx->pPos >= '0') && (*pCtx->pPos <= '9')) {
+        Value = Value * 10 + (*pCtx->pPos++ - '0');
+        if (Value > ((int64_t)INT32_MAX + 1)) {
+            return (ESP_ERR_INVALID_SIZE);
+        }
+    }
+    if ((pCtx->pPos < pCtx->pEnd) && ((*pCtx->pPos == '.') || (*pCtx->pPos == 'e') || (*pCtx->pPos == 'E'))) {
+        return (ESP_ERR_INVALID_ARG);
+    }
+    Value = isNegative ? -Value : Value;
+    if (Value > INT32_MAX) {
+        return (ESP_ERR_INVALID_SIZE);
+    }
+    *pValue = (int32_t)Value;
+    return (ESP_OK);
+}  // dec_int
+
+/**
+ * @brief Match a literal like true, false or null
+ */
+static bool dec_literal(JsonDec_Ctx * pCtx, const char * pLiteral) {
+    const size_t Length = strlen(pLiteral);
+
+    dec_peek(pCtx);
+    if (((size_t)(pCtx->pEnd - pCtx->pPos) < Length) || (0 != memcmp(pCtx->pPos, pLiteral, Length))) {
+        return (false);
+    }
+    pCtx->pPos += Length;
+    return (true);
+}
+
+/**
+ * @brief Skip any value at the current position, incl. nested ones
+ */
+static esp_err_t dec_skip(JsonDec_Ctx * pCtx) {
+    int Depth = 0;
+
+    do {
+        const char c = dec_peek(pCtx);
+
+        if (c == '"') {
+            if (ESP_OK != dec_string(pCtx, NULL, 0)) {
+                return (ESP_ERR_INVALID_ARG);
+            }
+        } else if ((c == '{') || (c == '[')) {
+            if (++Depth > MAX_DEPTH) {
+                return (ESP_ERR_INVALID_SIZE);
+            }
+            pCtx->pPos++;
+            continue;
+        } else if ((c == '}') || (c == ']')) {
+            if (Depth == 0) {
+                return (ESP_ERR_INVALID_ARG);
+            }
+            Depth--;
+            pCtx->pPos++;
+        } else if ((c == ',') || (c == ':')) {
+            if (Depth == 0) {
+                return (ESP_ERR_INVALID_ARG);
+            }
+            pCtx->pPos++;
+            continue;
+        } else if ((c == '-') || ((c >= '0') && (c <= '9'))) {
+            while ((pCtx->pPos < pCtx->pEnd) && (NULL != strchr("+-.eE0123456789", *pCtx->pPos)) && (*pCtx->pPos != 0x00)) {
+                pCtx->pPos++;
+            }
+        } else if (!dec_literal(pCtx, "true") && !dec_literal(pCtx, "false") && !dec_literal(pCtx, "null")) {
+            return (ESP_ERR_INVALID_ARG);
+        }
+    } while (Depth > 0);
+
+    return (ESP_OK);
+}  // dec_skip
+
+/**
+ * @brief Decode one value into its field
+ */
+static esp_err_t dec_field(JsonDec_Ctx * pCtx, const JsonDec_Field * pField, void * pTarget) {
+    uint8_t * pDest = (uint8_t*)pTarget + pField->Offset;
+
+    switch (pField->Type) {
+        case JSONDEC_STRING:
+            return (dec_string(pCtx, (char*)pDest, pField->Size));
+        case JSONDEC_INT:
+            return (dec_int(pCtx, (int32_t*)pDest));
+        case JSONDEC_BOOL:
+            if (dec_literal(pCtx, "true")) {
+                *(bool*)pDest = true;
+            } else if (dec_literal(pCtx, "false")) {
+                *(bool*)pDest = false;
+            } else {
+                return (ESP_ERR_INVALID_ARG);
+            }
+            return (ESP_OK);
+        default:
+            return (ESP_ERR_INVALID_ARG);
+    }
+}  // dec_field
+
+/**
+ * @brief Decode a JSON object into a struct
+ *
+ * Members not in the field table are skipped. Fields not present in the
+ * input keep their previous value in the target.
+ *
+ * @param pJson The input, needs not to be zero terminated
+ * @param Length Length of the input
+ * @param pFields Table of the members to extract
+ * @param Count Number of entries in the table
+ * @param pTarget The struct to fill
+ * @param pFound Optional: Bit n is set if field n was found
+ * @return esp_err_t ESP_ERR_INVALID_ARG on syntax or type errors, ESP_ERR_INVALID_SIZE if a value does not fit
+ */
+esp_err_t JsonDec_Object(const char * pJson, size_t Length, const JsonDec_Field * pFields, size_t Count, void * pTarget, uint32_t * pFound) {
+    JsonDec_Ctx Ctx = { .pPos = pJson, .pEnd = pJson + Length };
+    uint32_t Found = 0;
+    char Key[MAX_KEYLEN];
+    esp_err_t ret;
+
+    if ((NULL == pJson) || (Count > JSONDEC_MAX_FIELDS)) {
+        return (ESP_ERR_INVALID_ARG);
+    }
+
+    if (!dec_expect(&Ctx, '{')) {
+        return (ESP_ERR_INVALID_ARG);
+    }
+
+    if (!dec_expect(&Ctx, '}')) {
+        do {
+            // Member name, too long names can't be in the table
+            ret = dec_string(&Ctx, Key, sizeof(Key));
+            if (ESP_ERR_INVALID_SIZE == ret) {
+                Key[0] = 0x00;
+                ret = ESP_OK;
+            }
+            if ((ESP_OK != ret) || !dec_expect(&Ctx, ':')) {
+                return (ESP_ERR_INVALID_ARG);
+            }
+
+            // Value
+            size_t Field;
+            for (Field = 0; (Field < Count) && (0 != strcmp(Key, pFields[Field].Key)); Field++) {}
+            if (Field < Count) {
+                ret = dec_field(&Ctx, &pFields[Field], pTarget);
+                Found |= (1UL << Field);
+            } else {
+                ret = dec_skip(&Ctx);
+            }
+            if (ESP_OK != ret) {
+                return (ret);
+            }
+        } while (dec_expect(&Ctx, ','));
+
+        if (!dec_expect(&Ctx, '}')) {
+            return (ESP_ERR_INVALID_ARG);
+        }
+    }
+
+    if (NULL != pFound) {
+        *pFound = Found;
+    }
+    return (ESP_OK);
+}  // JsonDec_Object
@@ -0,0 +1,46 @@
+/**
+ ******************************************************************************
+ *  file           : jsondec.h
+ *  brief          : Allocation free decoder for flat JSON objects
+ ******************************************************************************
+ */
+
+#ifndef COMPONENTS_DRIVERS_JSONDEC_H_
+#define COMPONENTS_DRIVERS_JSONDEC_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define JSONDEC_MAX_FIELDS 32           // Max number of fields in a table
+
+typedef enum JsonDec_Type {
+    JSONDEC_STRING,                     // char[Size], zero terminated
+    JSONDEC_INT,                        // int32_t
+    JSONDEC_BOOL,                       // bool
+} JsonDec_Type;
+
+// Description of one member to extract into the target struct
+typedef struct JsonDec_Field {
+    const char *    Key;                // Name of the member
+    JsonDec_Type    Type;               // Expected type
+    size_t          Offset;             // offsetof() in the target struct
+    size_t          Size;               // Size of the target (strings only)
+} JsonDec_Field;
+
+#define JSONDEC_FIELD_STRING(type, member, key) { key, JSONDEC_STRING, offsetof(type, member), sizeof(((type*)0)->member) }
+#define JSONDEC_FIELD_INT(type, member, key)    { key, JSONDEC_INT, offsetof(type, member), sizeof(int32_t) }
+#define JSONDEC_FIELD_BOOL(type, member, key)   { key, JSONDEC_BOOL, offsetof(type, member), sizeof(bool) }
+
+esp_err_t   JsonDec_Object(const char * pJson, size_t Length, const JsonDec_Field * pFields, size_t Count, void * pTarget, uint32_t * pFound);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // COMPONENTS_DRIVERS_JSONDEC_H_
@@ -0,0 +1,112 @@
+/**
+ ******************************************************************************
+ *  file           : latency.c
+ *  brief          : Lock-free latency histograms
+ *
+ *  Buckets grow exponentially: 0..3 us have own buckets, above each
+ *  power of two is split into 4 buckets. So the relative error of a
+ *  percentile is at most 25%, with 400 bytes per histogram. Recording
+ *  is one atomic increment, no lock is taken.
+ ******************************************************************************
+ */
+
+/****************************** Includes  */
+#include <stdbool.h>
+
+#include "latency.h"
+
+/****************************** Functions */
+
+/**
+ * @brief Bucket of a value
+ */
+static uint32_t latency_bucket(uint32_t Us) {
+    if (Us < 4) {
+        return (Us);
+    }
+    const uint32_t Msb = 31 - __builtin_clz(Us);
+    if (Msb > LATENCY_MAX_BITS) {
+        return (LATENCY_BUCKETS - 1);
+    }
+    return ((4 * (Msb - 1)) + ((Us >> (Msb - 2)) & 3));
+}
+
+/**
+ * @brief Largest value of a bucket
+ */
+static uint32_t latency_upper(uint32_t Bucket) {
+    if (Bucket < 4) {
+        return (Bucket);
+    }
+    const uint32_t Msb = (Bucket / 4) + 1;
+    return ((((4 + (Bucket % 4)) << (Msb - 2)) + (1UL << (Msb - 2))) - 1);
+}
+
+/**
+ * @brief Record a latency
+ *
+ * @param pHist The histogram
+ * @param Us The latency in us
+ */
+void Latency_Record(Latency_Hist * pHist, uint32_t Us) {
+    uint32_t Max = __atomic_load_n(&pHist->MaxUs, __ATOMIC_RELAXED);
+
+    __atomic_add_fetch(&pHist->Buckets[latency_bucket(Us)], 1, __ATOMIC_RELAXED);
+    while ((Us > Max) && !__atomic_compare_exchange_n(&pHist->MaxUs, &Max, Us, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {}
+}
+
+/**
+ * @brief Get the number of recorded values
+ *
+ * @param pHist The histogram
+ * @return uint32_t
+ */
+uint32_t Latency_Count(const Latency_Hist * pHist) {
+    uint32_t Count = 0;
+
+    for (int i = 0; i < LATENCY_BUCKETS; i++) {
+        Count += __atomic_load_n(&pHist->Buckets[i], __ATOMIC_RELAXED);
+    }
+    return (Count);
+}
+
+/**
+ * @brief Get a percentile
+ *
+ * @param pHist The histogram
+ * @param Percent 1..100
+ * @return uint32_t Upper bound of the bucket holding the percentile in us, 0 if empty
+ */
+uint32_t Latency_Percentile(const Latency_Hist * pHist, uint32_t Percent) {
+    const uint32_t Count = Latency_Count(pHist);
+    const uint32_t Rank = (((uint64_t)Count * Percent) + 99) / 100;
+    uint32_t Sum = 0;
+
+    if (0 == Count) {
+        return (0);
+    }
+    for (int i = 0; i < LATENCY_BUCKETS; i++) {
+        Sum += __atomic_load_n(&pHist->Buckets[i], __ATOMIC_RELAXED);
+        if (Sum >= Rank) {
+            // Not more than the largest value seen
+            const uint32_t Upper = latency_upper(i);
+            const uint32_t Max = __atomic_load_n(&pHist->MaxUs, __ATOMIC_RELAXED);
+            return ((Upper < Max) ? Upper : Max);
+        }
+    }
+    return (__atomic_load_n(&pHist->MaxUs, __ATOMIC_RELAXED));
+}  // Latency_Percentile
+
+/**
+ * @brief Clear a histogram
+ *
+ * Values recorded at the same time may get lost.
+ *
+ * @param pHist The histogram
+ */
+void Latency_Reset(Latency_Hist * pHist) {
+    for (int i = 0; i < LATENCY_BUCKETS; i++) {
+        __atomic_store_n(&pHist->Buckets[i], 0, __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&pHist->MaxUs, 0, __ATOMIC_RELAXED);
+}
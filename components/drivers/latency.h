@@ -0,0 +1,35 @@
+/**
+ ******************************************************************************
+ *  file           : latency.h
+ *  brief          : Lock-free latency histograms
+ ******************************************************************************
+ */
+
+#ifndef COMPONENTS_DRIVERS_LATENCY_H_
+#define COMPONENTS_DRIVERS_LATENCY_H_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LATENCY_MAX_BITS 25             // Highest bit of a value: Buckets up to 2^26 us (67 s), larger values count in the last
+#define LATENCY_BUCKETS (4 * LATENCY_MAX_BITS)  // 4 buckets per power of two
+
+// Histogram of latencies in us, counters are updated atomically
+typedef struct Latency_Hist {
+    uint32_t    Buckets[LATENCY_BUCKETS];
+    uint32_t    MaxUs;                  // Largest recorded value
+} Latency_Hist;
+
+void        Latency_Record(Latency_Hist * pHist, uint32_t Us);
+uint32_t    Latency_Count(const Latency_Hist * pHist);
+uint32_t    Latency_Percentile(const Latency_Hist * pHist, uint32_t Percent);
+void        Latency_Reset(Latency_Hist * pHist);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // COMPONENTS_DRIVERS_LATENCY_H_
@@ -12,27 +12,590 @@
 #include "esp_system.h"
 #include "mqtt_client.h"
 #include "esp_log.h"
-#include "nvs_flash.h"
 #include "esp_mac.h"
+#include "esp_timer.h"
+#include "freertos/event_groups.h"
 
 #include "mqtt.h"
+#include "msgpool.h"
+#include "topictrie.h"
+#include "connlink.h"
+#include "txlog.h"
+#include "wifi.h"
+#include "settings.h"
+#include "sysmem.h"
 
 /****************************** Configuration */
-#define MAX_URLLEN  64                  // Max length of broker URL
-#define NVS_NAMESPACE "SETTINGS"        // Namespace for the Settings
 #define MQTT_ID "IoT"                   // Start of the base ID
-#define MAX_RXMSG 10                    // Number of received messages
+#define MAX_SUBSCRIPTIONS 16            // Max number of subscriptions
+#define MAX_FILTERLEN 64                // Max length of a subscription filter
+#define RXPOOL_SIZE (MAX_PAYLOAD + 8192)    // Pool for received messages: One of max size and the commands meanwhile
+#define RX_OVERSIZE_DROP 1              // Payloads > MAX_PAYLOAD: 1 = drop, 0 = truncate
+#define MQTT_CONNECTED_BIT BIT0         // Event: Connected to the broker
+#define MQTT_BACKOFF_MS 1000            // First reconnect delay
+#define MQTT_BACKOFF_MAX_MS 60000       // Max reconnect delay
+#define FORWARD_INTERVAL_MS 200         // Min time between two forwarded messages
+#define FORWARD_RETRY_MS 5000           // Delay after a failed forward
+#define TXPOOL_SIZE 8192                // Size of the pool for async publishes
+#define TX_WINDOW 8                     // Default in-flight window, see MQTT_SetTxWindow()
 
 /****************************** Statics */
 static const char *TAG = "MQTT";
 static esp_mqtt_client_handle_t client = NULL;
-static bool isConnected = false;
+static EventGroupHandle_t xMqttEvents = NULL;   // MQTT_CONNECTED_BIT
+static ConnLink Link;                           // Reconnect backoff and outages
+static bool isStarted = false;                  // MQTT_Start was called
+static bool isStoring = false;                  // Store-and-forward log available
+static TaskHandle_t xForwardTask = NULL;        // Forwards stored messages
 static char BaseTopic[MAX_BASE_LENGTH];
-static QueueHandle_t xRxQueue = NULL;
+static char TopicPrefix[MAX_BASE_LENGTH + 1];   // "BaseTopic/"
+static size_t TopicPrefixLen = 0;
+static MsgPool RxPool;
+static uint32_t RxPoolMem[RXPOOL_SIZE/sizeof(uint32_t)];
+static MQTT_RXMessage * pRxPending = NULL;      // Message in reassembly
+static size_t RxPendingOffset = 0;              // Next expected data offset
+
+typedef struct MQTT_Subscription {
+    char            Filter[MAX_FILTERLEN];  // Subtopic filter
+    QueueHandle_t   Queue;                  // Receiving queue or...
+    MQTT_RxCallback Callback;               // ...receiving callback
+    void *          pArg;                   // Argument for the callback
+    MQTT_RxLane     Lane;                   // Priority and drop policy of the queue
+    int16_t         Node;                   // Node in the trie, -1 if unused
+    int16_t         Next;                   // Next subscription on the same node
+    MQTT_RxStats    Stats;                  // Delivery counters
+} MQTT_Subscription;
+
+// An async publish. Stored in the TX pool, queues only hold pointers.
+typedef struct MQTT_TxMessage {
+    uint32_t        EnqueuedUs;         // Time of MQTT_Publish(), wraps
+    MQTT_TxCallback Callback;
+    void *          pArg;
+    char *          pData;              // Payload, behind the full topic
+    size_t          Length;             // Length of the payload
+    int             MsgId;              // Message ID while in flight
+    uint8_t         Qos;
+    bool            Retain;
+    char            Topic[];            // Full topic, zero terminated
+} MQTT_TxMessage;
+
+// Client event for the publisher task
+typedef struct MQTT_TxEvent {
+    esp_mqtt_event_id_t Id;             // PUBLISHED, DELETED or DISCONNECTED
+    int                 MsgId;
+} MQTT_TxEvent;
+
+static MsgPool TxPool;
+static uint32_t TxPoolMem[TXPOOL_SIZE/sizeof(uint32_t)];
+static QueueHandle_t xTxQueue = NULL;                   // Messages to send
+static QueueHandle_t xTxEvents = NULL;                  // Acknowledges from the client
+static TaskHandle_t xPublishTask = NULL;
+static MQTT_TxMessage * TxWindow[MQTT_TX_WINDOW_MAX];   // Messages in flight
+_Static_assert(SYSMEM_QUEUE_MQTT_EVENT >= (2 * MQTT_TX_WINDOW_MAX), "Event queue too short for the window");
+static uint32_t TxWindowSize = TX_WINDOW;
+static uint32_t TxInFlight = 0;
+static MQTT_TxStats TxStats;
+static uint64_t TxLatencySumUs = 0;
+static portMUX_TYPE TxStatsLock = portMUX_INITIALIZER_UNLOCKED;
+
+static TopicTrie Router;                                // Trie of all filters
+static int16_t RouterSubs[TRIE_MAX_NODES];              // First subscription per node
+static MQTT_Subscription Subscriptions[MAX_SUBSCRIPTIONS];
+static SemaphoreHandle_t xRouterLock = NULL;            // Recursive mutex for the router
+static uint32_t RouterReceivers = 0;                    // Receivers of the routed message, under the lock
 
 /****************************** Functions */
 
 #define MIN(x, y) (((x) < (y)) ? (x) : (y))
+#define MAX(x, y) (((x) > (y)) ? (x) : (y))
+
+/**
+ * @brief Connection state, usable from all tasks
+ */
+static bool mqtt_is_connected(void) {
+    return ((NULL != xMqttEvents) && (0 != (xEventGroupGetBits(xMqttEvents) & MQTT_CONNECTED_BIT)));
+}
+
+/**
+ * @brief Build the full topic from the precomputed prefix
+ *
+ * @param pTopic Buffer, at least MAX_TOPIC_LEN
+ * @param SubTopic The subtopic
+ * @param SubTopicLen Length of the subtopic
+ * @return esp_err_t ESP_ERR_INVALID_SIZE if too long
+ */
+static esp_err_t mqtt_full_topic(char * pTopic, const char * SubTopic, size_t SubTopicLen) {
+    if ((TopicPrefixLen + SubTopicLen) >= MAX_TOPIC_LEN) {
+        ESP_LOGW(TAG, "Subtopic too long: '%s'", SubTopic);
+        return (ESP_ERR_INVALID_SIZE);
+    }
+    memcpy(pTopic, TopicPrefix, TopicPrefixLen);
+    memcpy(pTopic + TopicPrefixLen, SubTopic, SubTopicLen + 1);
+    return (ESP_OK);
+}  // mqtt_full_topic
+
+/**
+ * @brief Drop the oldest message of the fullest queue with the lowest priority
+ *
+ * @return true A message was dropped
+ */
+static bool mqtt_rx_evict(void) {
+    MQTT_Subscription * pFullest = NULL;
+    UBaseType_t Waiting = 0;
+    MQTT_RXMessage * pOld;
+
+    xSemaphoreTakeRecursive(xRouterLock, portMAX_DELAY);
+    for (int i = 0; i < MAX_SUBSCRIPTIONS; i++) {
+        MQTT_Subscription * pSub = &Subscriptions[i];
+
+        if ((pSub->Node < 0) || (NULL == pSub->Queue)) {
+            continue;
+        }
+        const UBaseType_t SubWaiting = uxQueueMessagesWaiting(pSub->Queue);
+        if ((SubWaiting > 0) && ((NULL == pFullest) || (pSub->Lane.Priority < pFullest->Lane.Priority)
+         || ((pSub->Lane.Priority == pFullest->Lane.Priority) && (SubWaiting > Waiting)))) {
+            pFullest = pSub;
+            Waiting = SubWaiting;
+        }
+    }
+
+    const bool isDropped = (NULL != pFullest) && (pdTRUE == xQueueReceive(pFullest->Queue, &pOld, 0));
+    if (isDropped) {
+        pFullest->Stats.Dropped++;
+        pFullest->Stats.Evicted++;
+    }
+    xSemaphoreGiveRecursive(xRouterLock);
+
+    if (isDropped) {
+        MQTT_RxRelease(pOld);
+    }
+    return (isDropped);
+}  // mqtt_rx_evict
+
+/**
+ * @brief Allocate a message from the RX pool
+ *
+ * If the pool is exhausted, the oldest queued messages are dropped
+ * until the new message fits.
+ *
+ * @param Length Number of bytes needed
+ * @return MQTT_RXMessage* The message, NULL if no space is available
+ */
+static MQTT_RXMessage * mqtt_rx_alloc(size_t Length) {
+    MQTT_RXMessage * pMsg = MsgPool_Alloc(&RxPool, Length);
+
+    while ((NULL == pMsg) && mqtt_rx_evict()) {
+        ESP_LOGW(TAG, "RX pool exhausted, removed element!");
+        pMsg = MsgPool_Alloc(&RxPool, Length);
+    }
+    if (NULL != pMsg) {
+        pMsg->RefCount = 1;
+    }
+    return (pMsg);
+}  // mqtt_rx_alloc
+
+/**
+ * @brief Make room for a message in a subscription queue, by its drop policy
+ *
+ * Coalescing rotates the queue once to remove the queued message of the
+ * same subtopic. If the receiver takes messages meanwhile, the order of
+ * different subtopics may change, the order per subtopic is kept.
+ *
+ * @param pSub The subscription
+ * @param pMsg The new message
+ * @return false The new message must be dropped
+ */
+static bool mqtt_rx_admit(MQTT_Subscription * pSub, const MQTT_RXMessage * pMsg) {
+    MQTT_RXMessage * pOld;
+
+    if (MQTT_RX_COALESCE == pSub->Lane.Policy) {
+        for (UBaseType_t Count = uxQueueMessagesWaiting(pSub->Queue); Count > 0; Count--) {
+            if (pdTRUE != xQueueReceive(pSub->Queue, &pOld, 0)) {
+                break;
+            }
+            if (0 == strcmp(pOld->SubTopic, pMsg->SubTopic)) {
+                pSub->Stats.Coalesced++;
+                MQTT_RxRelease(pOld);
+            } else if (pdTRUE != xQueueSend(pSub->Queue, &pOld, 0)) {
+                pSub->Stats.Dropped++;
+                MQTT_RxRelease(pOld);
+            }
+        }
+    }
+
+    if (uxQueueSpacesAvailable(pSub->Queue) > 0) {
+        return (true);
+    }
+    if (MQTT_RX_DROP_NEWEST == pSub->Lane.Policy) {
+        ESP_LOGW(TAG, "RX queue for '%s' full, dropping new element!", pSub->Filter);
+        return (false);
+    }
+
+    ESP_LOGW(TAG, "RX queue for '%s' full, removing element!", pSub->Filter);
+    if (pdTRUE == xQueueReceive(pSub->Queue, &pOld, 0)) {
+        pSub->Stats.Dropped++;
+        MQTT_RxRelease(pOld);
+    }
+    return (true);
+}  // mqtt_rx_admit
+
+/**
+ * @brief Deliver a message to all subscriptions of a trie node
+ *
+ * @param Node The matching node
+ * @param pArg The message
+ */
+static void mqtt_rx_deliver(int Node, void * pArg) {
+    MQTT_RXMessage * pMsg = pArg;
+
+    for (int Sub = RouterSubs[Node]; Sub >= 0; Sub = Subscriptions[Sub].Next) {
+        MQTT_Subscription * pSub = &Subscriptions[Sub];
+
+        // Every receiver holds its own reference
+        __atomic_add_fetch(&pMsg->RefCount, 1, __ATOMIC_RELAXED);
+        RouterReceivers++;
+
+        if (NULL != pSub->Callback) {
+            pSub->Stats.Delivered++;
+            pSub->Callback(pMsg, pSub->pArg);
+            continue;
+        }
+
+        if (!mqtt_rx_admit(pSub, pMsg)) {
+            pSub->Stats.Dropped++;
+            MQTT_RxRelease(pMsg);
+            continue;
+        }
+        if (!xQueueSend(pSub->Queue, &pMsg, 0)) {
+            ESP_LOGW(TAG, "Failed to enqueue Rx message!");
+            pSub->Stats.Dropped++;
+            MQTT_RxRelease(pMsg);
+            continue;
+        }
+        pSub->Stats.Delivered++;
+
+        const UBaseType_t Waiting = uxQueueMessagesWaiting(pSub->Queue);
+        if (Waiting > pSub->Stats.HighWater) {
+            pSub->Stats.HighWater = Waiting;
+        }
+    }
+}  // mqtt_rx_deliver
+
+/**
+ * @brief Route a completely received message to its subscribers
+ *
+ * @param pMsg The message
+ */
+static void mqtt_rx_dispatch(MQTT_RXMessage * pMsg) {
+    ESP_LOGI(TAG, "Dispatching Rx message: Topic='%s' with %d bytes data", pMsg->SubTopic, pMsg->PayloadLen);
+
+    pMsg->QueuedUs = (uint32_t)esp_timer_get_time();
+    xSemaphoreTakeRecursive(xRouterLock, portMAX_DELAY);
+    RouterReceivers = 0;
+    TopicTrie_Match(&Router, pMsg->SubTopic, mqtt_rx_deliver, pMsg);
+    const uint32_t Receivers = RouterReceivers;
+    xSemaphoreGiveRecursive(xRouterLock);
+
+    // Not the reference count: Receivers may have released it already
+    if (0 == Receivers) {
+        ESP_LOGW(TAG, "No subscriber for '%s'", pMsg->SubTopic);
+    }
+    MQTT_RxRelease(pMsg);
+}  // mqtt_rx_dispatch
+
+/**
+ * @brief Subscribe a filter at the broker
+ *
+ * @param SubTopic The subtopic filter
+ * @return esp_err_t
+ */
+static esp_err_t mqtt_broker_subscribe(const char * SubTopic) {
+    char FullTopic[MAX_TOPIC_LEN];
+
+    if (ESP_OK != mqtt_full_topic(FullTopic, SubTopic, strlen(SubTopic))) {
+        return (ESP_ERR_INVALID_SIZE);
+    }
+
+    int msg_id = esp_mqtt_client_subscribe(client, FullTopic, 0);
+
+    if (0 > msg_id) {
+        ESP_LOGW(TAG, "Cannot subscribe: Code %d", msg_id);
+        return(ESP_FAIL);
+    }
+    ESP_LOGI(TAG, "Subscribe to '%s' successful, msg_id=%d", SubTopic, msg_id);
+    return (ESP_OK);
+}  // mqtt_broker_subscribe
+
+/**
+ * @brief Subscribe all registered filters at the broker (after connect)
+ */
+static void mqtt_broker_subscribe_all(void) {
+    xSemaphoreTakeRecursive(xRouterLock, portMAX_DELAY);
+    for (int Node = 0; Node < Router.Count; Node++) {
+        if (RouterSubs[Node] >= 0) {
+            mqtt_broker_subscribe(Subscriptions[RouterSubs[Node]].Filter);
+        }
+    }
+    xSemaphoreGiveRecursive(xRouterLock);
+}  // mqtt_broker_subscribe_all
+
+/**
+ * @brief Add a subscription to the router
+ *
+ * @return esp_err_t
+ */
+static esp_err_t mqtt_add_subscription(const char * SubTopic, QueueHandle_t Queue, const MQTT_RxLane * pLane,
+                                       MQTT_RxCallback Callback, void * pArg) {
+    int Sub;
+
+    if ((NULL == SubTopic) || (strlen(SubTopic) >= MAX_FILTERLEN)) {
+        return (ESP_ERR_INVALID_ARG);
+    }
+
+    xSemaphoreTakeRecursive(xRouterLock, portMAX_DELAY);
+
+    for (Sub = 0; (Sub < MAX_SUBSCRIPTIONS) && (Subscriptions[Sub].Node >= 0); Sub++) {}
+    if (Sub >= MAX_SUBSCRIPTIONS) {
+        xSemaphoreGiveRecursive(xRouterLock);
+        ESP_LOGE(TAG, "Cannot subscribe '%s': Too many subscriptions", SubTopic);
+        return (ESP_ERR_NO_MEM);
+    }
+
+    const int Node = TopicTrie_Insert(&Router, SubTopic);
+    if (Node < 0) {
+        xSemaphoreGiveRecursive(xRouterLock);
+        ESP_LOGE(TAG, "Cannot subscribe '%s': Invalid filter or router full", SubTopic);
+        return (ESP_ERR_INVALID_ARG);
+    }
+
+    const bool isNewFilter = (RouterSubs[Node] < 0);
+    MQTT_Subscription * pSub = &Subscriptions[Sub];
+    strcpy(pSub->Filter, SubTopic);
+    pSub->Queue = Queue;
+    pSub->Callback = Callback;
+    pSub->pArg = pArg;
+    pSub->Lane = *pLane;
+    pSub->Node = Node;
+    pSub->Next = RouterSubs[Node];
+    memset(&pSub->Stats, 0x00, sizeof(pSub->Stats));
+    RouterSubs[Node] = Sub;
+
+    xSemaphoreGiveRecursive(xRouterLock);
+
+    // Filters are (re-)subscribed at the broker on every connect. The
+    // connected bit is set before that snapshot, so a filter missing in it
+    // sees the bit here. Subscribing outside of the lock: The client holds
+    // its own lock while dispatching received data to the router.
+    if (isNewFilter && mqtt_is_connected()) {
+        return (mqtt_broker_subscribe(SubTopic));
+    }
+    return (ESP_OK);
+}  // mqtt_add_subscription
+
+/**
+ * @brief Store received data in the pool and enqueue complete messages
+ *
+ * Large messages are delivered by the client in several events. On the
+ * first fragment a pool slot for the whole message is allocated, the
+ * following fragments are copied into it at their offset. So consumers
+ * get one contiguous buffer with a single copy of the data.
+ *
+ * @param event The data event
+ */
+static void mqtt_receive(esp_mqtt_event_handle_t event) {
+    const size_t Offset = event->current_data_offset;
+
+    if (0 == Offset) {
+        // First fragment: Start a new message
+        if (NULL != pRxPending) {
+            ESP_LOGW(TAG, "Discarding incomplete Rx message '%s'", pRxPending->SubTopic);
+            MQTT_RxRelease(pRxPending);
+            pRxPending = NULL;
+        }
+
+        const size_t BaseTopic_len = strlen(BaseTopic);
+        if ((BaseTopic_len == 0) || (BaseTopic_len >= event->topic_len)) {
+            ESP_LOGE(TAG, "Cannot extract subtopic from '%.*s', BL=%d!", event->topic_len, event->topic, BaseTopic_len);
+            return;
+        }
+
+        // Everything after basetopic/
+        const char * pSubTopic = event->topic + BaseTopic_len + 1;
+        const size_t SubTopic_len = MIN(event->topic_len - BaseTopic_len - 1, MAX_TOPIC_LEN - MAX_BASE_LENGTH - 1);
+        size_t Payload_len = event->total_data_len;
+
+        if (Payload_len > MAX_PAYLOAD) {
+#if RX_OVERSIZE_DROP
+            ESP_LOGW(TAG, "Dropping Rx message '%.*s' with %d bytes data", SubTopic_len, pSubTopic, Payload_len);
+            return;
+#else
+            ESP_LOGW(TAG, "Truncating Rx message '%.*s' with %d bytes data", SubTopic_len, pSubTopic, Payload_len);
+            Payload_len = MAX_PAYLOAD;
+#endif
+        }
+
+        MQTT_RXMessage * pMsg = mqtt_rx_alloc(sizeof(MQTT_RXMessage) + SubTopic_len + 1 + Payload_len + 1);
+        if (NULL == pMsg) {
+            ESP_LOGW(TAG, "RX pool exhausted, dropping message!");
+            return;
+        }
+
+        pMsg->SubTopic = (char*)(pMsg + 1);
+        memcpy(pMsg->SubTopic, pSubTopic, SubTopic_len);
+        pMsg->SubTopic[SubTopic_len] = 0x00;
+
+        pMsg->Payload = pMsg->SubTopic + SubTopic_len + 1;
+        pMsg->PayloadLen = Payload_len;
+        pMsg->Payload[Payload_len] = 0x00;
+        pMsg->RxUs = (uint32_t)esp_timer_get_time();
+
+        pRxPending = pMsg;
+        RxPendingOffset = 0;
+    } else if ((NULL == pRxPending) || (Offset != RxPendingOffset)) {
+        // Rest of a dropped message
+        return;
+    }
+
+    // Copy the fragment to its place
+    if (Offset < pRxPending->PayloadLen) {
+        memcpy(pRxPending->Payload + Offset, event->data, MIN(event->data_len, pRxPending->PayloadLen - Offset));
+    }
+    RxPendingOffset = Offset + event->data_len;
+
+    // Complete?
+    if (RxPendingOffset >= event->total_data_len) {
+        mqtt_rx_dispatch(pRxPending);
+        pRxPending = NULL;
+    }
+}  // mqtt_receive
+
+/**
+ * @brief Pass a client event to the publisher task
+ *
+ * The window is only touched by the publisher task, so an acknowledge
+ * can't overtake the registration of its message ID.
+ */
+static void mqtt_tx_event(esp_mqtt_event_id_t Id, int MsgId) {
+    const MQTT_TxEvent Event = { .Id = Id, .MsgId = MsgId };
+
+    if (NULL == xTxEvents) {
+        return;
+    }
+    if (pdTRUE != xQueueSend(xTxEvents, &Event, 0)) {
+        ESP_LOGW(TAG, "TX event queue full, msg_id=%d", MsgId);
+    }
+    xTaskNotifyGive(xPublishTask);
+}  // mqtt_tx_event
+
+/**
+ * @brief An async publish is done: Update counters, call back and free it
+ *
+ * @param pMsg The message
+ * @param Result Passed to the callback
+ */
+static void mqtt_tx_complete(MQTT_TxMessage * pMsg, esp_err_t Result) {
+    const uint32_t LatencyUs = (uint32_t)esp_timer_get_time() - pMsg->EnqueuedUs;
+
+    taskENTER_CRITICAL(&TxStatsLock);
+    if (ESP_OK == Result) {
+        TxStats.Completed++;
+        TxLatencySumUs += LatencyUs;
+        TxStats.LatencyMaxUs = MAX(TxStats.LatencyMaxUs, LatencyUs);
+    } else {
+        TxStats.Failed++;
+    }
+    taskEXIT_CRITICAL(&TxStatsLock);
+
+    if (NULL != pMsg->Callback) {
+        pMsg->Callback(Result, pMsg->pArg);
+    }
+    MsgPool_Release(&TxPool, pMsg);
+}  // mqtt_tx_complete
+
+/**
+ * @brief Handle an event of the client in the publisher task
+ *
+ * @param pEvent The event
+ */
+static void mqtt_tx_handle(const MQTT_TxEvent * pEvent) {
+    if (MQTT_EVENT_DISCONNECTED == pEvent->Id) {
+        // The client sends them again after the reconnect
+        taskENTER_CRITICAL(&TxStatsLock);
+        TxStats.Retransmits += TxInFlight;
+        taskEXIT_CRITICAL(&TxStatsLock);
+        return;
+    }
+
+    for (int i = 0; i < MQTT_TX_WINDOW_MAX; i++) {
+        if ((NULL != TxWindow[i]) && (TxWindow[i]->MsgId == pEvent->MsgId)) {
+            MQTT_TxMessage * pMsg = TxWindow[i];
+            TxWindow[i] = NULL;
+            TxInFlight--;
+            mqtt_tx_complete(pMsg, (MQTT_EVENT_PUBLISHED == pEvent->Id) ? ESP_OK : ESP_ERR_TIMEOUT);
+            return;
+        }
+    }
+    // Else from MQTT_Transmit()
+}  // mqtt_tx_handle
+
+/**
+ * @brief Hand a message to the client
+ *
+ * QoS 0 messages are done when sent, others wait in the window for
+ * their acknowledge.
+ *
+ * @param pMsg The message
+ */
+static void mqtt_tx_send(MQTT_TxMessage * pMsg) {
+    const int MsgId = esp_mqtt_client_publish(client, pMsg->Topic, pMsg->pData, pMsg->Length, pMsg->Qos, pMsg->Retain);
+
+    if (0 > MsgId) {
+        // Lost the connection meanwhile? Then try again after the reconnect
+        if (!mqtt_is_connected() && (pdTRUE == xQueueSendToFront(xTxQueue, &pMsg, 0))) {
+            return;
+        }
+        ESP_LOGW(TAG, "Cannot publish '%s': Code %d", pMsg->Topic, MsgId);
+        mqtt_tx_complete(pMsg, ESP_FAIL);
+        return;
+    }
+    if (0 == pMsg->Qos) {
+        mqtt_tx_complete(pMsg, ESP_OK);
+        return;
+    }
+
+    pMsg->MsgId = MsgId;
+    for (int i = 0; i < MQTT_TX_WINDOW_MAX; i++) {
+        if (NULL == TxWindow[i]) {
+            TxWindow[i] = pMsg;
+            TxInFlight++;
+            return;
+        }
+    }
+}  // mqtt_tx_send
+
+/**
+ * @brief Task: Send queued async publishes while connected
+ *
+ * At most TxWindowSize messages wait for their acknowledge at a time.
+ */
+static void mqtt_publish_task(void * pvParameters) {
+    MQTT_TxMessage * pMsg;
+    MQTT_TxEvent Event;
+
+    while (1) {
+        while (pdTRUE == xQueueReceive(xTxEvents, &Event, 0)) {
+            mqtt_tx_handle(&Event);
+        }
+
+        if (mqtt_is_connected() && (TxInFlight < TxWindowSize) && (pdTRUE == xQueueReceive(xTxQueue, &pMsg, 0))) {
+            mqtt_tx_send(pMsg);
+            continue;
+        }
+
+        // Wait for a new message, an acknowledge or a connect
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    }
+}  // mqtt_publish_task
 
 /**
  * @brief Event handler registered to receive MQTT events
@@ -45,60 +608,45 @@ static QueueHandle_t xRxQueue = NULL;
 static void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_t event_id, void *event_data) {
     ESP_LOGD(TAG, "Event dispatched from event loop base=%s, event_id=%ld", base, event_id);
     esp_mqtt_event_handle_t event = event_data;
-    esp_mqtt_client_handle_t client = event->client;
-    int msg_id;
     switch ((esp_mqtt_event_id_t)event_id) {
         case MQTT_EVENT_CONNECTED:
             ESP_LOGI(TAG, "MQTT_EVENT_CONNECTED");
-            isConnected = true;
+            // Connected before the snapshot: A filter added later subscribes itself
+            xEventGroupSetBits(xMqttEvents, MQTT_CONNECTED_BIT);
+            mqtt_broker_subscribe_all();
+            ConnLink_Up(&Link);
+            if (NULL != xForwardTask) {
+                xTaskNotifyGive(xForwardTask);
+            }
+            xTaskNotifyGive(xPublishTask);
             break;
         case MQTT_EVENT_DISCONNECTED:
-            isConnected = false;
+            xEventGroupClearBits(xMqttEvents, MQTT_CONNECTED_BIT);
             ESP_LOGI(TAG, "MQTT_EVENT_DISCONNECTED");
+            ConnLink_Down(&Link);
+            mqtt_tx_event(MQTT_EVENT_DISCONNECTED, 0);
+            // Without network the reconnect waits for the IP event
+            if (WiFi_isConnected()) {
+                ConnLink_Retry(&Link);
+            }
             break;
         case MQTT_EVENT_SUBSCRIBED:
             ESP_LOGI(TAG, "MQTT_EVENT_SUBSCRIBED, msg_id=%d", event->msg_id);
-            msg_id = esp_mqtt_client_publish(client, "/topic/qos0", "data", 0, 0, 0);
-            ESP_LOGI(TAG, "sent publish successful, msg_id=%d", msg_id);
             break;
         case MQTT_EVENT_UNSUBSCRIBED:
             ESP_LOGI(TAG, "MQTT_EVENT_UNSUBSCRIBED, msg_id=%d", event->msg_id);
             break;
         case MQTT_EVENT_PUBLISHED:
-            ESP_LOGI(TAG, "MQTT_EVENT_PUBLISHED, msg_id=%d", event->msg_id);
+            ESP_LOGD(TAG, "MQTT_EVENT_PUBLISHED, msg_id=%d", event->msg_id);
+            mqtt_tx_event(MQTT_EVENT_PUBLISHED, event->msg_id);
+            break;
+        case MQTT_EVENT_DELETED:
+            ESP_LOGW(TAG, "MQTT_EVENT_DELETED, msg_id=%d", event->msg_id);
+            mqtt_tx_event(MQTT_EVENT_DELETED, event->msg_id);
             break;
         case MQTT_EVENT_DATA:
-            MQTT_RXMessage RxMsg;
-            char cBuffer[MAX_TOPIC_LEN];
-
             ESP_LOGI(TAG, "MQTT_EVENT_DATA");
-
-            // Queue full? Remove element
-            if (uxQueueSpacesAvailable(xRxQueue) == 0) {
-                ESP_LOGW(TAG, "RX queue full, removing element!");
-                xQueueReceive(xRxQueue, &RxMsg, 0);
-            }
-
-            const size_t BaseTopic_len = strlen(BaseTopic);
-
-            if ((BaseTopic_len > 0) && (BaseTopic_len < event->topic_len)) {
-                // Copy everything after basetopic/
-                memset(&cBuffer[0], 0x00, MAX_TOPIC_LEN);
-                memcpy(&cBuffer[0], event->topic+BaseTopic_len+1, event->topic_len-BaseTopic_len-1 );
-
-                // Copy into struct
-                memset(&RxMsg, 0x00, sizeof(RxMsg));
-                memcpy(&RxMsg.SubTopic[0], &cBuffer[0], MIN((MAX_TOPIC_LEN-MAX_BASE_LENGTH),strlen(cBuffer)));
-                memcpy(&RxMsg.Payload, event->data, MIN(event->data_len,(MAX_PAYLOAD)));
-
-                ESP_LOGI(TAG, "Enqueueing Rx message: Topic='%s' with %d bytes data", RxMsg.SubTopic, strlen(RxMsg.Payload));
-
-                if (!xQueueSend(xRxQueue, &RxMsg, 0)) {
-                    ESP_LOGW(TAG, "Failed to enqueue Rx message!");
-                }
-            } else {
-                ESP_LOGE(TAG, "Cannot extract subtopic from '%.*s', BL=%d!", event->topic_len, event->topic, BaseTopic_len);
-            }
+            mqtt_receive(event);
             break;
         case MQTT_EVENT_BEFORE_CONNECT:
             ESP_LOGI(TAG, "MQTT_EVENT_BEFORE_CONNECT");
@@ -112,99 +660,375 @@ static void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_
     }
 } // mqtt_event_handler
 
+/**
+ * @brief Publish a message to the broker
+ *
+ * @param SubTopic The subtopic to send to
+ * @param pData The payload to send
+ * @param Length Length of the payload
+ * @return esp_err_t
+ */
+static esp_err_t mqtt_publish(const char * SubTopic, const void * pData, size_t Length) {
+    char FullTopic[MAX_TOPIC_LEN];
+
+    if (ESP_OK != mqtt_full_topic(FullTopic, SubTopic, strlen(SubTopic))) {
+        return (ESP_ERR_INVALID_SIZE);
+    }
+
+    // Transmit, QoS always 1 and no retaining. Length 0 would mean strlen().
+    int msg_id = esp_mqtt_client_publish(client, FullTopic, (Length > 0) ? pData : "", Length, 1, 0);
+
+    if (0 > msg_id) {
+        ESP_LOGW(TAG, "Cannot transmit: Code %d", msg_id);
+        return(ESP_FAIL);
+    }
+    return (ESP_OK);
+}  // mqtt_publish
+
+/**
+ * @brief Store a message which cannot be sent now
+ *
+ * @return esp_err_t ESP_ERR_NOT_FINISHED if stored for later
+ */
+static esp_err_t mqtt_store(const char * SubTopic, const void * pData, size_t Length) {
+    if (!isStoring) {
+        ESP_LOGW(TAG, "Cannot transmit: Not connected");
+        return (ESP_FAIL);
+    }
+
+    esp_err_t ret = TxLog_Append(SubTopic, pData, Length);
+    if (ESP_OK != ret) {
+        ESP_LOGW(TAG, "Cannot store '%s': %s", SubTopic, esp_err_to_name(ret));
+        return (ret);
+    }
+    xTaskNotifyGive(xForwardTask);
+    return (ESP_ERR_NOT_FINISHED);
+}  // mqtt_store
+
+/**
+ * @brief Task: Forward stored messages in order while connected
+ *
+ * Messages are sent with FORWARD_INTERVAL_MS in between, so the broker
+ * isn't flooded after a long outage.
+ */
+static void mqtt_forward_task(void * pvParameters) {
+    static char Buffer[TXLOG_MAX_RECORD];
+    const char * pSubTopic;
+    const char * pPayload;
+    size_t PayloadLen;
+
+    while (1) {
+        if (!mqtt_is_connected() || (ESP_OK != TxLog_Peek(Buffer, sizeof(Buffer), &pSubTopic, &pPayload, &PayloadLen))) {
+            // Wait for a connect or a new message
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            continue;
+        }
+
+        if (ESP_OK == mqtt_publish(pSubTopic, pPayload, PayloadLen)) {
+            TxLog_Pop();
+            vTaskDelay(pdMS_TO_TICKS(FORWARD_INTERVAL_MS));
+        } else {
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(FORWARD_RETRY_MS));
+        }
+    }
+}  // mqtt_forward_task
+
+/**
+ * @brief Backoff expired or network is back: Start the client again
+ *
+ * The client is configured without auto reconnect, its task ends after a
+ * disconnect and is started again here.
+ */
+static void mqtt_reconnect(void) {
+    if (mqtt_is_connected() || !WiFi_isConnected()) {
+        return;
+    }
+    if (ESP_OK != esp_mqtt_client_start(client)) {
+        // Client task not yet finished
+        ConnLink_Retry(&Link);
+    }
+}
+
+/**
+ * @brief Got an IP: Reconnect without waiting for the backoff
+ */
+static void mqtt_ip_handler(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data) {
+    if (isStarted && !mqtt_is_connected()) {
+        ConnLink_Kick(&Link);
+    }
+}
+
 /**
  * @brief Init MQTT
  *
+ * Subscriptions can be made after the init, the connection is started
+ * by MQTT_Start().
+ *
  * @return esp_err_t
  */
 esp_err_t MQTT_Init(void) {
-    size_t          url_length = MAX_URLLEN;
-    esp_err_t       ret = ESP_OK;
-    nvs_handle_t    handle;
-    char            cBuffer[MAX_URLLEN];
+    char            Url[128];
     uint8_t         Mac[6];
 
-    // Read in broker URL
-    ret = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle);
-    ESP_ERROR_CHECK(ret);
-    ret = nvs_get_str(handle, "MQTT_URL", &cBuffer[0], &url_length);
-    ESP_ERROR_CHECK(ret);
-    nvs_close(handle);
+    // Broker URL, changes need a restart
+    ESP_ERROR_CHECK(Settings_GetStr(SETTING_MQTT_URL, Url, sizeof(Url)));
     esp_mqtt_client_config_t mqtt_cfg = {
-        .broker.address.uri = cBuffer,
+        .broker.address.uri = Url,
+        .network.disable_auto_reconnect = true,     // See mqtt_reconnect()
     };
     ESP_LOGI(TAG, "Broker address is: %s", mqtt_cfg.broker.address.uri);
 
-    // Setup MQTT client
-    client = esp_mqtt_client_init(&mqtt_cfg);
-    esp_mqtt_client_register_event(client, ESP_EVENT_ANY_ID, mqtt_event_handler, NULL);
-    esp_mqtt_client_start(client);
-
     // Generate base topic with id and mac address
     ESP_ERROR_CHECK(esp_efuse_mac_get_default(&Mac[0]));
     snprintf(&BaseTopic[0], MAX_BASE_LENGTH, "%s_%02x%02x%02x%02x%02x%02x", MQTT_ID, Mac[0], Mac[1], Mac[2], Mac[3], Mac[4], Mac[5]);
+    TopicPrefixLen = snprintf(&TopicPrefix[0], sizeof(TopicPrefix), "%s/", BaseTopic);
 
-    // Create queue for received data
-    xRxQueue = xQueueCreate(MAX_RXMSG, sizeof(MQTT_RXMessage));
-    if (NULL == xRxQueue) {
-        ESP_LOGE(TAG, "Failed to create RX queue!");
+    // Create pool and router for received data
+    ESP_ERROR_CHECK(MsgPool_Init(&RxPool, &RxPoolMem[0], sizeof(RxPoolMem)));
+    TopicTrie_Init(&Router);
+    for (int i = 0; i < TRIE_MAX_NODES; i++) {
+        RouterSubs[i] = -1;
     }
+    for (int i = 0; i < MAX_SUBSCRIPTIONS; i++) {
+        Subscriptions[i].Node = -1;
+    }
+    xRouterLock = SYSMEM_SEMAPHORE("mqtt_router", xSemaphoreCreateRecursiveMutex);
+    xMqttEvents = SYSMEM_EVENTGROUP("mqtt_events");
+    SysMem_AddBuffer("mqtt_rxpool", sizeof(RxPoolMem), &RxPool.Peak, true);
+    if ((NULL == xRouterLock) || (NULL == xMqttEvents) || (ESP_OK != ConnLink_Init(&Link, "MQTT", mqtt_reconnect, MQTT_BACKOFF_MS, MQTT_BACKOFF_MAX_MS))) {
+        ESP_LOGE(TAG, "Failed to create router lock!");
+        return (ESP_ERR_NO_MEM);
+    }
+
+    // Async publish pipeline
+    ESP_ERROR_CHECK(MsgPool_Init(&TxPool, &TxPoolMem[0], sizeof(TxPoolMem)));
+    SysMem_AddBuffer("mqtt_txpool", sizeof(TxPoolMem), &TxPool.Peak, true);
+    xTxQueue = SYSMEM_QUEUE("mqtt_tx", SYSMEM_QUEUE_MQTT_TX, sizeof(MQTT_TxMessage *));
+    xTxEvents = SYSMEM_QUEUE("mqtt_event", SYSMEM_QUEUE_MQTT_EVENT, sizeof(MQTT_TxEvent));
+    if ((NULL == xTxQueue) || (NULL == xTxEvents)
+     || (ESP_OK != SYSMEM_TASK(mqtt_publish_task, "mqtt_pub", SYSMEM_STACK_MQTT_PUB, NULL, 5, &xPublishTask))) {
+        ESP_LOGE(TAG, "Failed to create publisher!");
+        return (ESP_ERR_NO_MEM);
+    }
+
+    // Messages sent while offline are stored and forwarded later
+    isStoring = (ESP_OK == TxLog_Init())
+             && (ESP_OK == SYSMEM_TASK(mqtt_forward_task, "mqtt_fwd", SYSMEM_STACK_MQTT_FWD, NULL, 4, &xForwardTask));
+    if (!isStoring) {
+        ESP_LOGW(TAG, "No store-and-forward, messages are lost while offline");
+    }
+
+    // Setup MQTT client
+    client = esp_mqtt_client_init(&mqtt_cfg);
+    esp_mqtt_client_register_event(client, ESP_EVENT_ANY_ID, mqtt_event_handler, NULL);
 
     return (ESP_OK);
 }  // MQTT_Init
 
+/**
+ * @brief Connect to the broker, needs the network
+ *
+ * @return esp_err_t
+ */
+esp_err_t MQTT_Start(void) {
+    ESP_ERROR_CHECK(esp_event_handler_register(IP_EVENT, IP_EVENT_STA_GOT_IP, mqtt_ip_handler, NULL));
+    isStarted = true;
+    return (esp_mqtt_client_start(client));
+}
 
 /**
- * @brief Transmit Data to MQTT
+ * @brief Wait until the broker is connected
+ *
+ * @param Timeout Max time to wait
+ * @return esp_err_t ESP_ERR_TIMEOUT
+ */
+esp_err_t MQTT_WaitConnected(TickType_t Timeout) {
+    const EventBits_t Bits = xEventGroupWaitBits(xMqttEvents, MQTT_CONNECTED_BIT, pdFALSE, pdFALSE, Timeout);
+    return ((Bits & MQTT_CONNECTED_BIT) ? ESP_OK : ESP_ERR_TIMEOUT);
+}
+
+
+/**
+ * @brief Transmit a text payload to MQTT, see MQTT_TransmitData()
  *
  * @param SubTopic The subtopic to send to
- * @param Payload The payload to send
- * @return esp_err_t
+ * @param Payload The payload to send, zero terminated
+ * @return esp_err_t ESP_ERR_NOT_FINISHED if stored for later
  */
 esp_err_t MQTT_Transmit(const char * SubTopic, const char * Payload) {
-    char FullTopic[MAX_TOPIC_LEN];
+    return (MQTT_TransmitData(SubTopic, Payload, strlen(Payload)));
+}
 
-    if (!isConnected) {
-        ESP_LOGW(TAG, "Cannot transmit: Not connected");
-        return(ESP_FAIL);
+/**
+ * @brief Transmit Data to MQTT
+ *
+ * While offline, or while older messages are waiting, the message is
+ * stored and forwarded in order after the reconnect.
+ *
+ * @param SubTopic The subtopic to send to
+ * @param pData The payload to send, may be binary
+ * @param Length Length of the payload
+ * @return esp_err_t ESP_ERR_NOT_FINISHED if stored for later
+ */
+esp_err_t MQTT_TransmitData(const char * SubTopic, const void * pData, size_t Length) {
+    if (!mqtt_is_connected() || !TxLog_isEmpty()) {
+        return (mqtt_store(SubTopic, pData, Length));
+    }
+    if (ESP_OK != mqtt_publish(SubTopic, pData, Length)) {
+        return (mqtt_store(SubTopic, pData, Length));
     }
+    return (ESP_OK);
+}
 
-    // generate full topic: Bae Topic / Subtopic(s)
-    snprintf(&FullTopic[0], MAX_TOPIC_LEN, "%s/%s", BaseTopic, SubTopic );
+/**
+ * @brief Publish a message asynchronously
+ *
+ * The message is copied and queued, the call never blocks. It is sent
+ * when connected and the in-flight window has space, the callback is
+ * called when it is done.
+ *
+ * @param SubTopic The subtopic to send to
+ * @param pData The payload
+ * @param Length Length of the payload
+ * @param pOptions QoS, retain and callback, NULL for QoS 1
+ * @return esp_err_t ESP_ERR_NO_MEM if the queue is full
+ */
+esp_err_t MQTT_Publish(const char * SubTopic, const void * pData, size_t Length, const MQTT_TxOptions * pOptions) {
+    static const MQTT_TxOptions Defaults = { .Qos = 1 };
 
-    // Transmit, QoS always 1 and no retaining
-    int msg_id = esp_mqtt_client_publish(client, FullTopic, Payload, 0, 1, 0);
+    if (NULL == pOptions) {
+        pOptions = &Defaults;
+    }
+    if ((NULL == SubTopic) || ((NULL == pData) && (Length > 0)) || (pOptions->Qos > 2) || (NULL == xTxQueue)) {
+        return (ESP_ERR_INVALID_ARG);
+    }
 
-    if (0 > msg_id) {
-        ESP_LOGW(TAG, "Cannot transmit: Code %d", msg_id);
-        return(ESP_FAIL);
+    const size_t SubTopicLen = strlen(SubTopic);
+    if ((TopicPrefixLen + SubTopicLen) >= MAX_TOPIC_LEN) {
+        return (ESP_ERR_INVALID_SIZE);
+    }
+
+    MQTT_TxMessage * pMsg = MsgPool_Alloc(&TxPool, sizeof(MQTT_TxMessage) + TopicPrefixLen + SubTopicLen + 1 + Length);
+    if (NULL == pMsg) {
+        return (ESP_ERR_NO_MEM);
+    }
+    pMsg->EnqueuedUs = (uint32_t)esp_timer_get_time();
+    pMsg->Callback = pOptions->Callback;
+    pMsg->pArg = pOptions->pArg;
+    pMsg->Qos = pOptions->Qos;
+    pMsg->Retain = pOptions->Retain;
+    pMsg->MsgId = -1;
+    mqtt_full_topic(pMsg->Topic, SubTopic, SubTopicLen);
+    pMsg->pData = pMsg->Topic + TopicPrefixLen + SubTopicLen + 1;
+    pMsg->Length = Length;
+    memcpy(pMsg->pData, pData, Length);
+
+    if (pdTRUE != xQueueSend(xTxQueue, &pMsg, 0)) {
+        MsgPool_Release(&TxPool, pMsg);
+        return (ESP_ERR_NO_MEM);
+    }
+
+    const uint32_t Waiting = uxQueueMessagesWaiting(xTxQueue);
+    taskENTER_CRITICAL(&TxStatsLock);
+    TxStats.Queued++;
+    TxStats.QueueHighWater = MAX(TxStats.QueueHighWater, Waiting);
+    taskEXIT_CRITICAL(&TxStatsLock);
+
+    xTaskNotifyGive(xPublishTask);
+    return (ESP_OK);
+}  // MQTT_Publish
+
+/**
+ * @brief Set the number of async publishes waiting for their acknowledge
+ *
+ * @param Window 1..MQTT_TX_WINDOW_MAX
+ * @return esp_err_t
+ */
+esp_err_t MQTT_SetTxWindow(uint32_t Window) {
+    if ((Window < 1) || (Window > MQTT_TX_WINDOW_MAX)) {
+        return (ESP_ERR_INVALID_ARG);
+    }
+    TxWindowSize = Window;
+    if (NULL != xPublishTask) {
+        xTaskNotifyGive(xPublishTask);
     }
     return (ESP_OK);
 }
 
 /**
- * @brief Subscribe to a subtopic
+ * @brief Get the counters of the async publish pipeline
  *
- * @param SubTopic
+ * @param pStats
+ */
+void MQTT_GetTxStats(MQTT_TxStats * pStats) {
+    taskENTER_CRITICAL(&TxStatsLock);
+    memcpy(pStats, &TxStats, sizeof(MQTT_TxStats));
+    pStats->LatencyAvgUs = (TxStats.Completed > 0) ? (TxLatencySumUs / TxStats.Completed) : 0;
+    taskEXIT_CRITICAL(&TxStatsLock);
+
+    pStats->InFlight = TxInFlight;
+    pStats->QueueDepth = (NULL != xTxQueue) ? uxQueueMessagesWaiting(xTxQueue) : 0;
+}  // MQTT_GetTxStats
+
+/**
+ * @brief Subscribe to a subtopic filter, messages are sent to a queue
+ *
+ * The filter may contain the wildcards '+' and '#'. The queue receives
+ * pointers to MQTT_RXMessage, see MQTT_CreateRxQueue(). Every received
+ * message must be given back with MQTT_RxRelease().
+ *
+ * The queue has normal priority and drops the oldest message when full.
+ *
+ * @param SubTopic The subtopic filter
+ * @param Queue The receiving queue
  * @return esp_err_t
  */
-esp_err_t MQTT_Subscribe(const char * SubTopic) {
-    char FullTopic[MAX_TOPIC_LEN];
+esp_err_t MQTT_Subscribe(const char * SubTopic, QueueHandle_t Queue) {
+    static const MQTT_RxLane Lane = { .Priority = MQTT_RX_PRIO_NORMAL, .Policy = MQTT_RX_DROP_OLDEST };
 
-    snprintf(&FullTopic[0], MAX_TOPIC_LEN, "%s/%s", BaseTopic, SubTopic);
+    return (MQTT_SubscribeLane(SubTopic, Queue, &Lane));
+}
 
-    int msg_id = esp_mqtt_client_subscribe(client, FullTopic, 0);
+/**
+ * @brief Subscribe to a subtopic filter, messages are sent to a queue with own admission
+ *
+ * Like MQTT_Subscribe(), with the priority and drop policy of the queue.
+ * A queue should be used by one lane only.
+ *
+ * @param SubTopic The subtopic filter
+ * @param Queue The receiving queue
+ * @param pLane Priority and drop policy
+ * @return esp_err_t
+ */
+esp_err_t MQTT_SubscribeLane(const char * SubTopic, QueueHandle_t Queue, const MQTT_RxLane * pLane) {
+    if ((NULL == Queue) || (NULL == pLane)) {
+        return (ESP_ERR_INVALID_ARG);
+    }
+    return (mqtt_add_subscription(SubTopic, Queue, pLane, NULL, NULL));
+}
 
-    if (0 > msg_id) {
-        ESP_LOGW(TAG, "Cannot subscribe: Code %d", msg_id);
-        return(ESP_FAIL);
+/**
+ * @brief Subscribe to a subtopic filter, messages are passed to a callback
+ *
+ * The callback runs in the context of the MQTT task and must not block.
+ * It owns the message and must give it back with MQTT_RxRelease().
+ *
+ * @param SubTopic The subtopic filter
+ * @param Callback The receiving callback
+ * @param pArg User argument for the callback
+ * @return esp_err_t
+ */
+esp_err_t MQTT_SubscribeCallback(const char * SubTopic, MQTT_RxCallback Callback, void * pArg) {
+    static const MQTT_RxLane Lane = { .Priority = MQTT_RX_PRIO_NORMAL, .Policy = MQTT_RX_DROP_OLDEST };
+
+    if (NULL == Callback) {
+        return (ESP_ERR_INVALID_ARG);
     }
-    ESP_LOGI(TAG, "Subscribe successful, msg_id=%d", msg_id);
-    return (ESP_OK);
+    return (mqtt_add_subscription(SubTopic, NULL, &Lane, Callback, pArg));
 }
 
 /**
- * @brief Unsubscribe from a topic
+ * @brief Unsubscribe all subscriptions of a subtopic filter
  *
  * @param SubTopic
  * @return esp_err_t
@@ -212,7 +1036,25 @@ esp_err_t MQTT_Subscribe(const char * SubTopic) {
 esp_err_t MQTT_Unsubscribe(const char * SubTopic) {
     char FullTopic[MAX_TOPIC_LEN];
 
-    snprintf(&FullTopic[0], MAX_TOPIC_LEN, "%s/%s", BaseTopic, SubTopic);
+    xSemaphoreTakeRecursive(xRouterLock, portMAX_DELAY);
+    const int Node = TopicTrie_Find(&Router, SubTopic);
+    if ((Node < 0) || (RouterSubs[Node] < 0)) {
+        xSemaphoreGiveRecursive(xRouterLock);
+        return (ESP_ERR_NOT_FOUND);
+    }
+    for (int Sub = RouterSubs[Node]; Sub >= 0; Sub = Subscriptions[Sub].Next) {
+        Subscriptions[Sub].Node = -1;
+    }
+    RouterSubs[Node] = -1;
+    xSemaphoreGiveRecursive(xRouterLock);
+
+    if (!mqtt_is_connected()) {
+        return (ESP_OK);
+    }
+
+    if (ESP_OK != mqtt_full_topic(FullTopic, SubTopic, strlen(SubTopic))) {
+        return (ESP_ERR_INVALID_SIZE);
+    }
 
     int msg_id = esp_mqtt_client_unsubscribe(client, FullTopic);
 
@@ -224,12 +1066,62 @@ esp_err_t MQTT_Unsubscribe(const char * SubTopic) {
     return (ESP_OK);
 }
 
+/**
+ * @brief Get the delivery counters of a subscription queue
+ *
+ * Counters of all subscriptions using this queue are summed up.
+ *
+ * @param Queue The receiving queue
+ * @param pStats The counters
+ * @return esp_err_t ESP_ERR_NOT_FOUND if the queue has no subscription
+ */
+esp_err_t MQTT_GetRxStats(QueueHandle_t Queue, MQTT_RxStats * pStats) {
+    esp_err_t ret = ESP_ERR_NOT_FOUND;
+
+    memset(pStats, 0x00, sizeof(MQTT_RxStats));
+
+    xSemaphoreTakeRecursive(xRouterLock, portMAX_DELAY);
+    for (int i = 0; i < MAX_SUBSCRIPTIONS; i++) {
+        if ((Subscriptions[i].Node >= 0) && (Subscriptions[i].Queue == Queue)) {
+            pStats->Delivered += Subscriptions[i].Stats.Delivered;
+            pStats->Dropped += Subscriptions[i].Stats.Dropped;
+            pStats->Evicted += Subscriptions[i].Stats.Evicted;
+            pStats->Coalesced += Subscriptions[i].Stats.Coalesced;
+            pStats->HighWater = MAX(pStats->HighWater, Subscriptions[i].Stats.HighWater);
+            ret = ESP_OK;
+        }
+    }
+    xSemaphoreGiveRecursive(xRouterLock);
+
+    return (ret);
+}  // MQTT_GetRxStats
+
+/**
+ * @brief Create a queue suitable for MQTT_Subscribe()
+ *
+ * @param Length Max number of queued messages
+ * @return QueueHandle_t
+ */
+QueueHandle_t MQTT_CreateRxQueue(UBaseType_t Length) {
+    return (xQueueCreate(Length, sizeof(MQTT_RXMessage *)));
+}
+
+/**
+ * @brief Give back a received message
+ *
+ * @param pMsg The message from the RX queue or callback
+ */
+void MQTT_RxRelease(MQTT_RXMessage * pMsg) {
+    if (0 == __atomic_sub_fetch(&pMsg->RefCount, 1, __ATOMIC_ACQ_REL)) {
+        MsgPool_Release(&RxPool, pMsg);
+    }
+}
 
 /**
- * @brief Get the handle to the RX queue
+ * @brief Get the outage statistics of the broker connection
  *
- * @return QueueHandle_t*
+ * @param pStats
  */
-QueueHandle_t * MQTT_GetRxQueue() {
-    return(&xRxQueue);
-}
\ No newline at end of file
+void MQTT_GetLinkStats(ConnLink_Stats * pStats) {
+    ConnLink_GetStats(&Link, pStats);
+}
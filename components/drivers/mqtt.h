@@ -8,24 +8,106 @@
 #ifndef COMPONENTS_DRIVERS_MQTT_H_
 #define COMPONENTS_DRIVERS_MQTT_H_
 
+#include "sdkconfig.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "connlink.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 #define MAX_TOPIC_LEN 250               // Max length of full topic
 #define MAX_BASE_LENGTH 128             // Max length base topic
-#define MAX_PAYLOAD 128                 // Max size of payload
+#define MAX_PAYLOAD CONFIG_IOTBASE_MQTT_MAX_PAYLOAD // Max size of a (reassembled) payload
+#define MQTT_TX_WINDOW_MAX 16           // Max publishes waiting for their acknowledge
 
+// A received message. Stored in the RX pool, queues only hold pointers.
+// Must be given back with MQTT_RxRelease() when done.
 typedef struct MQTT_RXMessage {
-    char SubTopic[MAX_TOPIC_LEN-MAX_BASE_LENGTH];
-    char Payload[MAX_PAYLOAD];
+    char *      SubTopic;               // Subtopic, zero terminated
+    char *      Payload;                // Payload, zero terminated
+    size_t      PayloadLen;             // Length of the payload
+    uint32_t    RefCount;               // Number of receivers holding the message
+    uint32_t    RxUs;                   // esp_timer time of the first fragment
+    uint32_t    QueuedUs;               // esp_timer time when passed to the receivers
 } MQTT_RXMessage;
 
+// Delivery counters of a subscription
+typedef struct MQTT_RxStats {
+    uint32_t    Delivered;              // Messages passed to the receiver
+    uint32_t    Dropped;                // Messages dropped, e.g. queue full
+    uint32_t    Evicted;                // ...of them dropped to free the RX pool
+    uint32_t    Coalesced;              // Replaced by a newer message of the same subtopic
+    uint32_t    HighWater;              // Max number of queued messages
+} MQTT_RxStats;
+
+// Priority of a subscription queue. If the RX pool is exhausted, messages
+// of the lowest priority are dropped first.
+typedef enum MQTT_RxPriority {
+    MQTT_RX_PRIO_LOW = 0,
+    MQTT_RX_PRIO_NORMAL,
+    MQTT_RX_PRIO_HIGH,
+} MQTT_RxPriority;
+
+// What to drop if a subscription queue is full
+typedef enum MQTT_RxPolicy {
+    MQTT_RX_DROP_OLDEST = 0,            // The oldest queued message
+    MQTT_RX_DROP_NEWEST,                // The new message, queued ones are kept
+    MQTT_RX_COALESCE,                   // Only the latest message per subtopic is queued, then oldest
+} MQTT_RxPolicy;
+
+// Admission of a subscription queue, see MQTT_SubscribeLane()
+typedef struct MQTT_RxLane {
+    MQTT_RxPriority Priority;
+    MQTT_RxPolicy   Policy;
+} MQTT_RxLane;
+
+// Receiving callback, see MQTT_SubscribeCallback()
+typedef void (*MQTT_RxCallback)(MQTT_RXMessage * pMsg, void * pArg);
+
+// Completion of MQTT_Publish(), called from the publisher task. Result is
+// ESP_OK when acknowledged (QoS 0: when sent), ESP_ERR_TIMEOUT if the
+// client gave up, ESP_FAIL if the publish was rejected.
+typedef void (*MQTT_TxCallback)(esp_err_t Result, void * pArg);
+
+// Options of an async publish, NULL for QoS 1 without callback
+typedef struct MQTT_TxOptions {
+    uint8_t         Qos;                // 0..2
+    bool            Retain;             // Retain at the broker
+    MQTT_TxCallback Callback;           // Completion callback or NULL
+    void *          pArg;               // Argument for the callback
+} MQTT_TxOptions;
+
+// Counters of the async publish pipeline
+typedef struct MQTT_TxStats {
+    uint32_t    Queued;                 // Accepted by MQTT_Publish()
+    uint32_t    Completed;              // Acknowledged (QoS 0: sent)
+    uint32_t    Failed;                 // Rejected or given up
+    uint32_t    Retransmits;            // In flight at a disconnect, sent again
+    uint32_t    QueueDepth;             // Messages waiting to be sent
+    uint32_t    QueueHighWater;         // Max messages waiting
+    uint32_t    InFlight;               // Messages waiting for the acknowledge
+    uint32_t    LatencyAvgUs;           // Enqueue to acknowledge, average
+    uint32_t    LatencyMaxUs;           // Enqueue to acknowledge, max
+} MQTT_TxStats;
+
 esp_err_t       MQTT_Init(void);
+esp_err_t       MQTT_Start(void);
+esp_err_t       MQTT_WaitConnected(TickType_t Timeout);
 esp_err_t       MQTT_Transmit(const char * SubTopic, const char * Payload);
-esp_err_t       MQTT_Subscribe(const char * SubTopic);
+esp_err_t       MQTT_TransmitData(const char * SubTopic, const void * pData, size_t Length);
+esp_err_t       MQTT_Publish(const char * SubTopic, const void * pData, size_t Length, const MQTT_TxOptions * pOptions);
+esp_err_t       MQTT_SetTxWindow(uint32_t Window);
+void            MQTT_GetTxStats(MQTT_TxStats * pStats);
+esp_err_t       MQTT_Subscribe(const char * SubTopic, QueueHandle_t Queue);
+esp_err_t       MQTT_SubscribeLane(const char * SubTopic, QueueHandle_t Queue, const MQTT_RxLane * pLane);
+esp_err_t       MQTT_SubscribeCallback(const char * SubTopic, MQTT_RxCallback Callback, void * pArg);
 esp_err_t       MQTT_Unsubscribe(const char * SubTopic);
-QueueHandle_t * MQTT_GetRxQueue();
+QueueHandle_t   MQTT_CreateRxQueue(UBaseType_t Length);
+esp_err_t       MQTT_GetRxStats(QueueHandle_t Queue, MQTT_RxStats * pStats);
+void            MQTT_RxRelease(MQTT_RXMessage * pMsg);
+void            MQTT_GetLinkStats(ConnLink_Stats * pStats);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,163 @@
+/**
+ ******************************************************************************
+ *  file           : msgpool.c
+ *  brief          : Ring buffer pool for variable length messages
+ *
+ *  Slots are carved from a preallocated buffer in FIFO order. Releasing a
+ *  slot only marks it as free, the space is reclaimed as soon as all older
+ *  slots are released too. This allows out-of-order release without any
+ *  fragmentation of the heap.
+ ******************************************************************************
+ */
+
+/****************************** Includes  */
+#include <stdio.h>
+#include <string.h>
+#include "esp_log.h"
+
+#include "msgpool.h"
+
+/****************************** Configuration */
+#define SLOT_ALIGN 4                    // Alignment of the slots
+#define SLOT_FREE  0x00                 // Slot is released
+#define SLOT_USED  0x01                 // Slot is allocated
+#define SLOT_WRAP  0x02                 // Marker: Continue at offset 0
+
+/****************************** Statics */
+static const char *TAG = "MSGPOOL";
+
+typedef struct SlotHeader {
+    uint32_t    Length;                 // Length of the slot incl. header
+    uint32_t    State;                  // SLOT_xxx
+} SlotHeader;
+
+/****************************** Functions */
+
+#define ALIGN_UP(x) (((x) + (SLOT_ALIGN-1)) & ~(SLOT_ALIGN-1))
+
+/**
+ * @brief Moves the tail over wrap markers
+ *
+ * @param pPool
+ */
+static void pool_normalize_tail(MsgPool * pPool) {
+    if ((pPool->Tail + sizeof(SlotHeader)) > pPool->Size) {
+        pPool->Tail = 0;
+    } else if (((SlotHeader*)&pPool->pBuffer[pPool->Tail])->State == SLOT_WRAP) {
+        pPool->Tail = 0;
+    }
+}
+
+/**
+ * @brief Init a pool on a preallocated buffer
+ *
+ * @param pPool The pool
+ * @param pBuffer The storage, must be 4-byte aligned
+ * @param Size Size of the storage
+ * @return esp_err_t
+ */
+esp_err_t MsgPool_Init(MsgPool * pPool, void * pBuffer, size_t Size) {
+    if ((NULL == pPool) || (NULL == pBuffer) || (Size < 2*sizeof(SlotHeader))) {
+        return (ESP_ERR_INVALID_ARG);
+    }
+
+    memset(pPool, 0x00, sizeof(MsgPool));
+    pPool->pBuffer = pBuffer;
+    pPool->Size = Size & ~(SLOT_ALIGN-1);
+    portMUX_INITIALIZE(&pPool->Lock);
+
+    return (ESP_OK);
+}  // MsgPool_Init
+
+/**
+ * @brief Allocate a slot from the pool
+ *
+ * @param pPool The pool
+ * @param Length Number of bytes needed
+ * @return void* Pointer to the data area, NULL if the pool is exhausted
+ */
+void * MsgPool_Alloc(MsgPool * pPool, size_t Length) {
+    const size_t Needed = ALIGN_UP(sizeof(SlotHeader) + Length);
+    size_t Offset = SIZE_MAX;
+
+    taskENTER_CRITICAL(&pPool->Lock);
+
+    if (0 == pPool->Slots) {
+        // Empty: Start from the beginning
+        pPool->Head = 0;
+        pPool->Tail = 0;
+        if (Needed <= pPool->Size) {
+            Offset = 0;
+        }
+    } else if (pPool->Head > pPool->Tail) {
+        // Free space is at the end and before the tail
+        if ((pPool->Size - pPool->Head) >= Needed) {
+            Offset = pPool->Head;
+        } else if (pPool->Tail >= Needed) {
+            if ((pPool->Size - pPool->Head) >= sizeof(SlotHeader)) {
+                ((SlotHeader*)&pPool->pBuffer[pPool->Head])->State = SLOT_WRAP;
+            }
+            Offset = 0;
+        }
+    } else if ((pPool->Tail - pPool->Head) >= Needed) {
+        // Free space is between head and tail
+        Offset = pPool->Head;
+    }
+
+    if (SIZE_MAX == Offset) {
+        pPool->Fails++;
+        taskEXIT_CRITICAL(&pPool->Lock);
+        return (NULL);
+    }
+
+    SlotHeader * pSlot = (SlotHeader*)&pPool->pBuffer[Offset];
+    pSlot->Length = Needed;
+    pSlot->State = SLOT_USED;
+    pPool->Head = Offset + Needed;
+    pPool->Slots++;
+    pPool->Used += Needed;
+    if (pPool->Used > pPool->Peak) {
+        pPool->Peak = pPool->Used;
+    }
+
+    taskEXIT_CRITICAL(&pPool->Lock);
+
+    return ((void*)(pSlot + 1));
+}  // MsgPool_Alloc
+
+/**
+ * @brief Release a slot
+ *
+ * @param pPool The pool
+ * @param pData The pointer returned by MsgPool_Alloc
+ */
+void MsgPool_Release(MsgPool * pPool, void * pData) {
+    if (NULL == pData) {
+        return;
+    }
+
+    SlotHeader * pSlot = ((SlotHeader*)pData) - 1;
+
+    taskENTER_CRITICAL(&pPool->Lock);
+
+    if (SLOT_USED != pSlot->State) {
+        taskEXIT_CRITICAL(&pPool->Lock);
+        ESP_LOGE(TAG, "Releasing invalid slot %p!", pData);
+        return;
+    }
+    pSlot->State = SLOT_FREE;
+    pPool->Used -= pSlot->Length;
+
+    // Reclaim all released slots at the tail
+    while (pPool->Slots > 0) {
+        pool_normalize_tail(pPool);
+        SlotHeader * pTail = (SlotHeader*)&pPool->pBuffer[pPool->Tail];
+        if (SLOT_FREE != pTail->State) {
+            break;
+        }
+        pPool->Tail += pTail->Length;
+        pPool->Slots--;
+    }
+
+    taskEXIT_CRITICAL(&pPool->Lock);
+}  // MsgPool_Release
@@ -0,0 +1,40 @@
+/**
+ ******************************************************************************
+ *  file           : msgpool.h
+ *  brief          : Ring buffer pool for variable length messages
+ ******************************************************************************
+ */
+
+#ifndef COMPONENTS_DRIVERS_MSGPOOL_H_
+#define COMPONENTS_DRIVERS_MSGPOOL_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct MsgPool {
+    uint8_t *       pBuffer;            // Preallocated storage
+    size_t          Size;               // Size of the storage
+    size_t          Head;               // Offset of the next allocation
+    size_t          Tail;               // Offset of the oldest slot
+    size_t          Slots;              // Number of slots between tail and head
+    size_t          Used;               // Bytes currently allocated (incl. headers)
+    size_t          Peak;               // Highest value of Used
+    uint32_t        Fails;              // Number of failed allocations
+    portMUX_TYPE    Lock;
+} MsgPool;
+
+esp_err_t   MsgPool_Init(MsgPool * pPool, void * pBuffer, size_t Size);
+void *      MsgPool_Alloc(MsgPool * pPool, size_t Length);
+void        MsgPool_Release(MsgPool * pPool, void * pData);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // COMPONENTS_DRIVERS_MSGPOOL_H_
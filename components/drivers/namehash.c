@@ -0,0 +1,102 @@
+/**
+ ******************************************************************************
+ *  file           : namehash.c
+ *  brief          : Perfect hash over the names of a constant table
+ *
+ *  Seeds are tried until all names land in different slots, so a lookup
+ *  needs one hash and one string compare.
+ ******************************************************************************
+ */
+
+/****************************** Includes  */
+#include <stdbool.h>
+#include <string.h>
+
+#include "esp_log.h"
+
+#include "namehash.h"
+
+/****************************** Configuration */
+#define NAMEHASH_SEEDS 1024             // Seeds tried before giving up
+
+/****************************** Statics */
+static const char *TAG = "NAMEHASH";
+
+/****************************** Functions */
+
+/**
+ * @brief Seeded FNV-1a hash of a name
+ *
+ * @param Name The name
+ * @param Seed The seed
+ * @return uint32_t
+ */
+static uint32_t namehash_hash(const char * Name, uint32_t Seed) {
+    uint32_t Hash = 2166136261UL ^ Seed;
+
+    while (0x00 != *Name) {
+        Hash = (Hash ^ (uint8_t)*Name++) * 16777619UL;
+    }
+    return (Hash);
+}
+
+/**
+ * @brief Name of a table entry
+ */
+static const char * namehash_name(const NameHash * pHash, int Index) {
+    return (*(const char * const *)(pHash->pTable + (Index * pHash->Stride)));
+}
+
+/**
+ * @brief Build a perfect hash table for the names of a table
+ *
+ * @param pHash The hash table
+ * @param pTable First entry, its first member is the name
+ * @param Count Number of entries
+ * @param Stride Size of one entry
+ * @return esp_err_t ESP_FAIL if no seed is collision free
+ */
+esp_err_t NameHash_Build(NameHash * pHash, const void * pTable, size_t Count, size_t Stride) {
+    if ((NULL == pHash) || (NULL == pTable) || (Count > NAMEHASH_SIZE)) {
+        return (ESP_ERR_INVALID_ARG);
+    }
+    pHash->pTable = pTable;
+    pHash->Stride = Stride;
+
+    for (uint32_t Seed = 0; Seed < NAMEHASH_SEEDS; Seed++) {
+        bool isPerfect = true;
+
+        memset(pHash->Slots, -1, sizeof(pHash->Slots));
+        for (int i = 0; (i < Count) && isPerfect; i++) {
+            const uint32_t Slot = namehash_hash(namehash_name(pHash, i), Seed) & (NAMEHASH_SIZE-1);
+            if (pHash->Slots[Slot] >= 0) {
+                isPerfect = false;
+            } else {
+                pHash->Slots[Slot] = i;
+            }
+        }
+        if (isPerfect) {
+            pHash->Seed = Seed;
+            return (ESP_OK);
+        }
+    }
+    memset(pHash->Slots, -1, sizeof(pHash->Slots));
+    ESP_LOGE(TAG, "No perfect hash for %u names, increase NAMEHASH_SIZE!", (unsigned int)Count);
+    return (ESP_FAIL);
+}  // NameHash_Build
+
+/**
+ * @brief Find the entry of a name
+ *
+ * @param pHash The hash table
+ * @param Name The name
+ * @return int Index into the table, -1 if unknown
+ */
+int NameHash_Find(const NameHash * pHash, const char * Name) {
+    const int8_t Index = pHash->Slots[namehash_hash(Name, pHash->Seed) & (NAMEHASH_SIZE-1)];
+
+    if ((Index >= 0) && (0 == strcmp(namehash_name(pHash, Index), Name))) {
+        return (Index);
+    }
+    return (-1);
+}
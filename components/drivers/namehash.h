@@ -0,0 +1,36 @@
+/**
+ ******************************************************************************
+ *  file           : namehash.h
+ *  brief          : Perfect hash over the names of a constant table
+ ******************************************************************************
+ */
+
+#ifndef COMPONENTS_DRIVERS_NAMEHASH_H_
+#define COMPONENTS_DRIVERS_NAMEHASH_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define NAMEHASH_SIZE 16                // Slots of a hash table, power of 2
+
+// Hash table over a table of structs whose first member is "const char * Name"
+typedef struct NameHash {
+    const uint8_t * pTable;             // First entry of the table
+    size_t          Stride;             // Size of one entry
+    uint32_t        Seed;               // Seed giving a collision free table
+    int8_t          Slots[NAMEHASH_SIZE];   // Index into the table, -1 if empty
+} NameHash;
+
+esp_err_t   NameHash_Build(NameHash * pHash, const void * pTable, size_t Count, size_t Stride);
+int         NameHash_Find(const NameHash * pHash, const char * Name);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // COMPONENTS_DRIVERS_NAMEHASH_H_
@@ -0,0 +1,212 @@
+/**
+ ******************************************************************************
+ *  file           : ramalloc.c
+ *  brief          : Heap placement per subsystem, PSRAM aware, and bump arenas
+ *
+ *  The WiFi stack needs internal RAM. Large buffers which are not on a hot
+ *  path go to PSRAM if there is one (RAM_BULK), hot and DMA data stays in
+ *  internal RAM (RAM_FAST). The placement is given by the subsystem, see
+ *  RAMALLOC_TABLE. Each subsystem counts its bytes, the perf telemetry
+ *  publishes them.
+ *
+ *  Arenas are one block per owner, e.g. the command task. Allocations only
+ *  move a pointer, a reset frees everything at once.
+ ******************************************************************************
+ */
+
+/****************************** Includes  */
+#include <string.h>
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "esp_memory_utils.h"
+#include "freertos/FreeRTOS.h"
+
+#include "sysmem.h"
+#include "ramalloc.h"
+
+/****************************** Configuration */
+#define ARENA_ALIGN 4                   // Alignment of arena allocations, as the heap
+
+/****************************** Statics */
+static const char *TAG = "RAMALLOC";
+
+typedef struct RamAlloc_Sys_Def {
+    const char *        Name;
+    RamAlloc_Placement  Placement;
+} RamAlloc_Sys_Def;
+
+#define RAMALLOC_DEF(Id, Name, Placement) { Name, Placement },
+static const RamAlloc_Sys_Def Subsystems[RAM_SYS_COUNT] = {
+    RAMALLOC_TABLE(RAMALLOC_DEF)
+};
+#undef RAMALLOC_DEF
+
+static RamAlloc_Stats Stats[RAM_SYS_COUNT];
+static const RamArena * Arenas[RAMALLOC_MAX_ARENAS];
+static size_t ArenaCount = 0;
+static portMUX_TYPE RamLock = portMUX_INITIALIZER_UNLOCKED;
+
+/****************************** Functions */
+
+#define ALIGN_UP(x) (((x) + (ARENA_ALIGN-1)) & ~(ARENA_ALIGN-1))
+
+/**
+ * @brief Allocate for a subsystem at its placement
+ *
+ * RAM_BULK falls back to internal RAM without PSRAM or if it is full.
+ *
+ * @param Sys The subsystem
+ * @param Size Bytes
+ * @return void* NULL if out of memory
+ */
+void * RamAlloc_Malloc(RamAlloc_Sys Sys, size_t Size) {
+    void * pData = NULL;
+
+    if (RAM_BULK == Subsystems[Sys].Placement) {
+        pData = heap_caps_malloc(Size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    }
+    if (NULL == pData) {
+        pData = heap_caps_malloc(Size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    }
+
+    taskENTER_CRITICAL(&RamLock);
+    if (NULL == pData) {
+        Stats[Sys].Fails++;
+    } else {
+        Stats[Sys].Used += Size;
+        if (esp_ptr_external_ram(pData)) {
+            Stats[Sys].External += Size;
+        }
+        if (Stats[Sys].Used > Stats[Sys].Peak) {
+            Stats[Sys].Peak = Stats[Sys].Used;
+        }
+    }
+    taskEXIT_CRITICAL(&RamLock);
+
+    if (NULL == pData) {
+        ESP_LOGW(TAG, "%s: Cannot allocate %u bytes", Subsystems[Sys].Name, (unsigned)Size);
+    }
+    return (pData);
+}  // RamAlloc_Malloc
+
+/**
+ * @brief Free memory of RamAlloc_Malloc()
+ *
+ * @param Sys The subsystem
+ * @param pData The memory, may be NULL
+ * @param Size Bytes, as allocated
+ */
+void RamAlloc_Free(RamAlloc_Sys Sys, void * pData, size_t Size) {
+    if (NULL == pData) {
+        return;
+    }
+
+    taskENTER_CRITICAL(&RamLock);
+    Stats[Sys].Used -= Size;
+    if (esp_ptr_external_ram(pData)) {
+        Stats[Sys].External -= Size;
+    }
+    taskEXIT_CRITICAL(&RamLock);
+
+    heap_caps_free(pData);
+}  // RamAlloc_Free
+
+/**
+ * @brief Get the name of a subsystem
+ */
+const char * RamAlloc_GetName(RamAlloc_Sys Sys) {
+    return (Subsystems[Sys].Name);
+}
+
+/**
+ * @brief Get the heap use of a subsystem
+ *
+ * @param Sys The subsystem
+ * @param pStats
+ */
+void RamAlloc_GetStats(RamAlloc_Sys Sys, RamAlloc_Stats * pStats) {
+    taskENTER_CRITICAL(&RamLock);
+    memcpy(pStats, &Stats[Sys], sizeof(RamAlloc_Stats));
+    taskEXIT_CRITICAL(&RamLock);
+}
+
+/**
+ * @brief Init an arena with a block of a subsystem
+ *
+ * The arena lives forever, it is listed in the RAM report and the perf
+ * telemetry.
+ *
+ * @param pArena The arena
+ * @param Name Name of the arena, must stay valid
+ * @param Sys Subsystem of the storage
+ * @param Size Bytes
+ * @return esp_err_t
+ */
+esp_err_t RamArena_Init(RamArena * pArena, const char * Name, RamAlloc_Sys Sys, size_t Size) {
+    memset(pArena, 0x00, sizeof(RamArena));
+    pArena->Name = Name;
+    pArena->pBase = RamAlloc_Malloc(Sys, Size);
+    if (NULL == pArena->pBase) {
+        return (ESP_ERR_NO_MEM);
+    }
+    pArena->Size = Size;
+
+    taskENTER_CRITICAL(&RamLock);
+    if (ArenaCount < RAMALLOC_MAX_ARENAS) {
+        Arenas[ArenaCount++] = pArena;
+    }
+    taskEXIT_CRITICAL(&RamLock);
+    SysMem_AddBuffer(Name, Size, &pArena->Peak, false);
+
+    return (ESP_OK);
+}  // RamArena_Init
+
+/**
+ * @brief Allocate from an arena
+ *
+ * @param pArena The arena
+ * @param Size Bytes
+ * @return void* NULL if the arena is exhausted
+ */
+void * RamArena_Alloc(RamArena * pArena, size_t Size) {
+    const size_t Needed = ALIGN_UP(Size);
+
+    if (Needed > (pArena->Size - pArena->Used)) {
+        pArena->Fails++;
+        ESP_LOGW(TAG, "%s: Arena exhausted, %u of %u bytes used", pArena->Name, (unsigned)pArena->Used, (unsigned)pArena->Size);
+        return (NULL);
+    }
+
+    void * pData = &pArena->pBase[pArena->Used];
+    pArena->Used += Needed;
+    if (pArena->Used > pArena->Peak) {
+        pArena->Peak = pArena->Used;
+    }
+    return (pData);
+}  // RamArena_Alloc
+
+/**
+ * @brief Free all allocations of an arena
+ *
+ * @param pArena The arena
+ */
+void RamArena_Reset(RamArena * pArena) {
+    pArena->Used = 0;
+}
+
+/**
+ * @brief Get all arenas
+ *
+ * @param ppArenas Gets the arenas
+ * @param Max Size of ppArenas
+ * @return size_t Number of arenas
+ */
+size_t RamArena_GetAll(const RamArena ** ppArenas, size_t Max) {
+    size_t Count;
+
+    taskENTER_CRITICAL(&RamLock);
+    Count = (ArenaCount < Max) ? ArenaCount : Max;
+    memcpy(ppArenas, Arenas, Count * sizeof(RamArena *));
+    taskEXIT_CRITICAL(&RamLock);
+    return (Count);
+}  // RamArena_GetAll
@@ -0,0 +1,73 @@
+/**
+ ******************************************************************************
+ *  file           : ramalloc.h
+ *  brief          : Heap placement per subsystem, PSRAM aware, and bump arenas
+ ******************************************************************************
+ */
+
+#ifndef COMPONENTS_DRIVERS_RAMALLOC_H_
+#define COMPONENTS_DRIVERS_RAMALLOC_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Where the memory of a subsystem is placed
+typedef enum RamAlloc_Placement {
+    RAM_FAST = 0,                       // Internal RAM: Hot paths and DMA buffers
+    RAM_BULK,                           // PSRAM if present, else internal RAM
+} RamAlloc_Placement;
+
+// Subsystems with their own accounting: X(Id, Name, Placement)
+#define RAMALLOC_TABLE(X) \
+    X(OTA,       "ota",   RAM_BULK)     /* Chunks, stage and deflate window of an update */ \
+    X(INFLATE,   "infl",  RAM_FAST)     /* Inflater state, used for every input symbol */ \
+    X(TELEMETRY, "telem", RAM_BULK)     /* Fields and encode buffer of the status */ \
+    X(PERF,      "perf",  RAM_BULK)     /* Task table and encode buffer of the perf sample */ \
+    X(COMMAND,   "cmd",   RAM_BULK)     /* Arena of the command handlers */
+
+#define RAMALLOC_ID(Id, Name, Placement) RAM_SYS_##Id,
+typedef enum RamAlloc_Sys {
+    RAMALLOC_TABLE(RAMALLOC_ID)
+    RAM_SYS_COUNT
+} RamAlloc_Sys;
+#undef RAMALLOC_ID
+
+#define RAMALLOC_MAX_ARENAS 4           // Max number of arenas
+
+// Heap use of a subsystem
+typedef struct RamAlloc_Stats {
+    size_t      Used;                   // Bytes allocated
+    size_t      External;               // ...of Used in PSRAM
+    size_t      Peak;                   // Highest value of Used
+    uint32_t    Fails;                  // Failed allocations
+} RamAlloc_Stats;
+
+// Bump allocator on one block, freed all at once. Not thread safe, one owner.
+typedef struct RamArena {
+    const char *    Name;               // Name, must stay valid
+    uint8_t *       pBase;              // Storage
+    size_t          Size;               // Size of the storage
+    size_t          Used;               // Bytes allocated since the last reset
+    size_t          Peak;               // Highest value of Used
+    uint32_t        Fails;              // Failed allocations
+} RamArena;
+
+void *          RamAlloc_Malloc(RamAlloc_Sys Sys, size_t Size);
+void            RamAlloc_Free(RamAlloc_Sys Sys, void * pData, size_t Size);
+const char *    RamAlloc_GetName(RamAlloc_Sys Sys);
+void            RamAlloc_GetStats(RamAlloc_Sys Sys, RamAlloc_Stats * pStats);
+esp_err_t       RamArena_Init(RamArena * pArena, const char * Name, RamAlloc_Sys Sys, size_t Size);
+void *          RamArena_Alloc(RamArena * pArena, size_t Size);
+void            RamArena_Reset(RamArena * pArena);
+size_t          RamArena_GetAll(const RamArena ** ppArenas, size_t Max);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // COMPONENTS_DRIVERS_RAMALLOC_H_
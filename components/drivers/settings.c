@@ -0,0 +1,510 @@
+/**
+ ******************************************************************************
+ *  file           : settings.c
+ *  brief          : Typed settings, cached in RAM with NVS write-back
+ *
+ *  All settings of SETTINGS_TABLE are read once by Settings_Init() into
+ *  one struct, numbers first and strings behind. The getters only copy
+ *  from RAM. Changed values are marked dirty and written by a task when
+ *  no change came for SETTINGS_DEBOUNCE_MS, all dirty keys of a
+ *  namespace with one commit. Settings_Flush() writes at once.
+ ******************************************************************************
+ */
+
+/****************************** Includes  */
+#include <ctype.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_bit_defs.h"
+#include "esp_log.h"
+#include "nvs_flash.h"
+
+#include "settings.h"
+#include "sysmem.h"
+
+/****************************** Configuration */
+#define SETTINGS_DEBOUNCE_MS 5000       // Write when no change came for this time...
+#define SETTINGS_MAX_DELAY_MS 30000     // ...but not later than this after the first change
+#define SETTINGS_MAX_CALLBACKS 8        // Max number of change callbacks
+
+typedef enum Settings_Type {
+    SETTINGS_U8 = 0,
+    SETTINGS_U32,
+    SETTINGS_STR,
+} Settings_Type;
+
+// The values: numbers packed in front, strings behind
+#define SETTINGS_NUMBER_U8(Id, Size)    uint8_t Id;
+#define SETTINGS_NUMBER_U32(Id, Size)   uint32_t Id;
+#define SETTINGS_NUMBER_STR(Id, Size)
+#define SETTINGS_STRING_U8(Id, Size)
+#define SETTINGS_STRING_U32(Id, Size)
+#define SETTINGS_STRING_STR(Id, Size)   char Id[Size];
+#define SETTINGS_NUMBER(Id, Ns, Key, Type, Default, Size, Min, Max, Remote) SETTINGS_NUMBER_##Type(Id, Size)
+#define SETTINGS_STRING(Id, Ns, Key, Type, Default, Size, Min, Max, Remote) SETTINGS_STRING_##Type(Id, Size)
+
+typedef struct Settings_Values {
+    SETTINGS_TABLE(SETTINGS_NUMBER)
+    SETTINGS_TABLE(SETTINGS_STRING)
+} Settings_Values;
+
+// Where and how a setting is stored
+typedef struct Settings_Desc {
+    const char *    Namespace;
+    const char *    Key;
+    Settings_Type   Type;
+    uint16_t        Offset;             // In Settings_Values
+    uint16_t        Size;               // Bytes, strings incl. terminator
+    uint32_t        Default;            // Numbers
+    uint32_t        Min;                // Numbers, valid range
+    uint32_t        Max;
+    const char *    DefaultStr;         // Strings
+    bool            isRemote;           // May be changed by Settings_SetFromString()
+} Settings_Desc;
+
+#define SETTINGS_DESC_U8(Id, Ns, Key, Default, Size, Min, Max, Remote) \
+    { Ns, Key, SETTINGS_U8, offsetof(Settings_Values, Id), sizeof(uint8_t), Default, Min, Max, NULL, Remote },
+#define SETTINGS_DESC_U32(Id, Ns, Key, Default, Size, Min, Max, Remote) \
+    { Ns, Key, SETTINGS_U32, offsetof(Settings_Values, Id), sizeof(uint32_t), Default, Min, Max, NULL, Remote },
+#define SETTINGS_DESC_STR(Id, Ns, Key, Default, Size, Min, Max, Remote) \
+    { Ns, Key, SETTINGS_STR, offsetof(Settings_Values, Id), Size, 0, 0, 0, Default, Remote },
+#define SETTINGS_DESC(Id, Ns, Key, Type, Default, Size, Min, Max, Remote) \
+    SETTINGS_DESC_##Type(Id, Ns, Key, Default, Size, Min, Max, Remote)
+
+// Checked at compile time, a default must be in its own range
+#define SETTINGS_RANGE_U8(Id, Default, Min, Max) \
+    _Static_assert(((Min) <= (Default)) && ((Default) <= (Max)) && ((Max) <= UINT8_MAX), #Id " out of range");
+#define SETTINGS_RANGE_U32(Id, Default, Min, Max) \
+    _Static_assert(((Min) <= (Default)) && ((Default) <= (Max)), #Id " out of range");
+#define SETTINGS_RANGE_STR(Id, Default, Min, Max)
+#define SETTINGS_RANGE(Id, Ns, Key, Type, Default, Size, Min, Max, Remote) SETTINGS_RANGE_##Type(Id, Default, Min, Max)
+SETTINGS_TABLE(SETTINGS_RANGE)
+
+_Static_assert(SETTING_COUNT <= 32, "Dirty mask has 32 bits");
+
+/****************************** Statics */
+static const char *TAG = "SETTINGS";
+
+static const Settings_Desc Descs[SETTING_COUNT] = {
+    SETTINGS_TABLE(SETTINGS_DESC)
+};
+
+static Settings_Values Values;
+static uint32_t Dirty = 0;                      // Bit per setting not yet written
+static portMUX_TYPE SettingsLock = portMUX_INITIALIZER_UNLOCKED;
+static SemaphoreHandle_t xWriteLock = NULL;     // One write-back at a time
+static TaskHandle_t xWriteTask = NULL;
+
+static struct {
+    Settings_Id         Id;
+    Settings_Callback   Callback;
+    void *              pArg;
+} Callbacks[SETTINGS_MAX_CALLBACKS];
+static size_t CallbackCount = 0;
+
+/****************************** Functions */
+
+/**
+ * @brief Address of the value of a setting
+ */
+static uint8_t * settings_value(Settings_Id Id) {
+    return ((uint8_t*)&Values + Descs[Id].Offset);
+}
+
+/**
+ * @brief Read a number, U8 or U32
+ */
+static uint32_t settings_number(Settings_Id Id) {
+    const uint8_t * pValue = settings_value(Id);
+
+    return ((SETTINGS_U8 == Descs[Id].Type) ? *pValue : *(const uint32_t*)pValue);
+}
+
+/**
+ * @brief Check a number against the range of its setting
+ */
+static bool settings_in_range(Settings_Id Id, uint32_t Value) {
+    return ((Value >= Descs[Id].Min) && (Value <= Descs[Id].Max));
+}
+
+/**
+ * @brief Load a setting from an opened namespace, the default stays if not stored
+ */
+static void settings_load(nvs_handle_t handle, Settings_Id Id) {
+    const Settings_Desc * pDesc = &Descs[Id];
+    uint8_t * pValue = settings_value(Id);
+    size_t Length = pDesc->Size;
+    esp_err_t ret;
+
+    switch (pDesc->Type) {
+        case SETTINGS_U8:
+            ret = nvs_get_u8(handle, pDesc->Key, pValue);
+            if ((ESP_OK == ret) && !settings_in_range(Id, *pValue)) {
+                *pValue = pDesc->Default;
+                ret = ESP_ERR_INVALID_ARG;
+            }
+            break;
+        case SETTINGS_U32:
+            ret = nvs_get_u32(handle, pDesc->Key, (uint32_t*)pValue);
+            if ((ESP_OK == ret) && !settings_in_range(Id, *(uint32_t*)pValue)) {
+                *(uint32_t*)pValue = pDesc->Default;
+                ret = ESP_ERR_INVALID_ARG;
+            }
+            break;
+        default:
+            ret = nvs_get_str(handle, pDesc->Key, (char*)pValue, &Length);
+            if (ESP_OK != ret) {
+                strlcpy((char*)pValue, pDesc->DefaultStr, pDesc->Size);
+            }
+            break;
+    }
+    if ((ESP_OK != ret) && (ESP_ERR_NVS_NOT_FOUND != ret)) {
+        ESP_LOGW(TAG, "Cannot read %s.%s (%s), using the default", pDesc->Namespace, pDesc->Key, esp_err_to_name(ret));
+    }
+}  // settings_load
+
+/**
+ * @brief Write a value to an opened namespace
+ */
+static esp_err_t settings_store(nvs_handle_t handle, Settings_Id Id, const uint8_t * pValue) {
+    const Settings_Desc * pDesc = &Descs[Id];
+
+    switch (pDesc->Type) {
+        case SETTINGS_U8:
+            return (nvs_set_u8(handle, pDesc->Key, *pValue));
+        case SETTINGS_U32:
+            return (nvs_set_u32(handle, pDesc->Key, *(const uint32_t*)pValue));
+        default:
+            return (nvs_set_str(handle, pDesc->Key, (const char*)pValue));
+    }
+}
+
+/**
+ * @brief Write all dirty settings, one commit per namespace
+ *
+ * Failed settings stay dirty.
+ *
+ * @return esp_err_t
+ */
+static esp_err_t settings_write_back(void) {
+    uint8_t Value[sizeof(Settings_Values)];
+    esp_err_t ret = ESP_OK;
+
+    xSemaphoreTake(xWriteLock, portMAX_DELAY);
+    for (int i = 0; i < SETTING_COUNT; i++) {
+        nvs_handle_t handle;
+        bool isOpen = false;
+        esp_err_t err = ESP_OK;
+
+        // Every namespace once, at its first setting
+        bool isFirst = true;
+        for (int j = 0; (j < i) && isFirst; j++) {
+            isFirst = (0 != strcmp(Descs[j].Namespace, Descs[i].Namespace));
+        }
+        if (!isFirst) {
+            continue;
+        }
+
+        for (int j = i; j < SETTING_COUNT; j++) {
+            if (0 != strcmp(Descs[j].Namespace, Descs[i].Namespace)) {
+                continue;
+            }
+
+            taskENTER_CRITICAL(&SettingsLock);
+            const bool isDirty = (0 != (Dirty & BIT(j)));
+            Dirty &= ~BIT(j);
+            memcpy(Value, settings_value(j), Descs[j].Size);
+            taskEXIT_CRITICAL(&SettingsLock);
+            if (!isDirty) {
+                continue;
+            }
+
+            if (!isOpen && (ESP_OK == err)) {
+                err = nvs_open(Descs[i].Namespace, NVS_READWRITE, &handle);
+                isOpen = (ESP_OK == err);
+            }
+            if (ESP_OK == err) {
+                err = settings_store(handle, j, Value);
+            }
+            if (ESP_OK != err) {
+                ESP_LOGW(TAG, "Cannot write %s.%s (%s)", Descs[j].Namespace, Descs[j].Key, esp_err_to_name(err));
+                taskENTER_CRITICAL(&SettingsLock);
+                Dirty |= BIT(j);
+                taskEXIT_CRITICAL(&SettingsLock);
+                ret = err;
+                err = ESP_OK;   // Try the others
+            }
+        }
+
+        if (isOpen) {
+            err = nvs_commit(handle);
+            nvs_close(handle);
+            if (ESP_OK != err) {
+                ESP_LOGW(TAG, "Cannot commit %s (%s)", Descs[i].Namespace, esp_err_to_name(err));
+                ret = err;
+            }
+        }
+    }
+    xSemaphoreGive(xWriteLock);
+
+    return (ret);
+}  // settings_write_back
+
+/**
+ * @brief Task: Write back changed settings, debounced
+ *
+ * @param pvParameters
+ */
+static void TaskSettings(void* pvParameters) {
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        // Wait for a pause in the changes
+        const TickType_t Start = xTaskGetTickCount();
+        while ((ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(SETTINGS_DEBOUNCE_MS)) > 0)
+            && ((xTaskGetTickCount() - Start) < pdMS_TO_TICKS(SETTINGS_MAX_DELAY_MS))) {}
+
+        if (ESP_OK == settings_write_back()) {
+            ESP_LOGI(TAG, "Written");
+        }
+    }
+}  // TaskSettings
+
+/**
+ * @brief A setting was changed: Call the callbacks, schedule the write-back
+ */
+static void settings_changed(Settings_Id Id) {
+    for (size_t i = 0; i < CallbackCount; i++) {
+        if (Callbacks[i].Id == Id) {
+            Callbacks[i].Callback(Id, Callbacks[i].pArg);
+        }
+    }
+    if (NULL != xWriteTask) {
+        xTaskNotifyGive(xWriteTask);
+    }
+}
+
+/**
+ * @brief Init: Load all settings, needs the initialized NVS
+ *
+ * @return esp_err_t
+ */
+esp_err_t Settings_Init(void) {
+    nvs_handle_t handle;
+
+    memset(&Values, 0x00, sizeof(Values));
+    for (int i = 0; i < SETTING_COUNT; i++) {
+        if (SETTINGS_U8 == Descs[i].Type) {
+            *settings_value(i) = Descs[i].Default;
+        } else if (SETTINGS_U32 == Descs[i].Type) {
+            *(uint32_t*)settings_value(i) = Descs[i].Default;
+        } else {
+            strlcpy((char*)settings_value(i), Descs[i].DefaultStr, Descs[i].Size);
+        }
+    }
+
+    // Namespace by namespace, missing ones have only defaults
+    for (int i = 0; i < SETTING_COUNT; i++) {
+        bool isFirst = true;
+        for (int j = 0; (j < i) && isFirst; j++) {
+            isFirst = (0 != strcmp(Descs[j].Namespace, Descs[i].Namespace));
+        }
+        if (!isFirst || (ESP_OK != nvs_open(Descs[i].Namespace, NVS_READONLY, &handle))) {
+            continue;
+        }
+        for (int j = i; j < SETTING_COUNT; j++) {
+            if (0 == strcmp(Descs[j].Namespace, Descs[i].Namespace)) {
+                settings_load(handle, j);
+            }
+        }
+        nvs_close(handle);
+    }
+
+    xWriteLock = SYSMEM_SEMAPHORE("settings", xSemaphoreCreateMutex);
+    if ((NULL == xWriteLock)
+     || (ESP_OK != SYSMEM_TASK(TaskSettings, "settings", SYSMEM_STACK_SETTINGS, NULL, tskIDLE_PRIORITY + 1, &xWriteTask))) {
+        return (ESP_ERR_NO_MEM);
+    }
+    ESP_LOGI(TAG, "%d settings loaded", SETTING_COUNT);
+    return (ESP_OK);
+}  // Settings_Init
+
+/**
+ * @brief Get a number setting
+ *
+ * @param Id The setting, U8 or U32
+ * @return uint32_t 0 if not a number
+ */
+uint32_t Settings_GetU32(Settings_Id Id) {
+    if ((Id >= SETTING_COUNT) || (SETTINGS_STR == Descs[Id].Type)) {
+        return (0);
+    }
+    return (settings_number(Id));
+}
+
+/**
+ * @brief Get a string setting
+ *
+ * @param Id The setting
+ * @param pBuffer Buffer for the value
+ * @param Size Size of the buffer
+ * @return esp_err_t ESP_ERR_NOT_FOUND if empty, ESP_ERR_INVALID_SIZE if the buffer is too small
+ */
+esp_err_t Settings_GetStr(Settings_Id Id, char * pBuffer, size_t Size) {
+    esp_err_t ret = ESP_OK;
+
+    if ((Id >= SETTING_COUNT) || (SETTINGS_STR != Descs[Id].Type)) {
+        return (ESP_ERR_INVALID_ARG);
+    }
+
+    taskENTER_CRITICAL(&SettingsLock);
+    const char * pValue = (const char*)settings_value(Id);
+    if (0x00 == pValue[0]) {
+        ret = ESP_ERR_NOT_FOUND;
+    } else if (strlcpy(pBuffer, pValue, Size) >= Size) {
+        ret = ESP_ERR_INVALID_SIZE;
+    }
+    taskEXIT_CRITICAL(&SettingsLock);
+
+    return (ret);
+}  // Settings_GetStr
+
+/**
+ * @brief Change a number setting
+ *
+ * @param Id The setting, U8 or U32
+ * @param Value The new value, Min..Max of SETTINGS_TABLE
+ * @return esp_err_t ESP_ERR_INVALID_ARG if out of range
+ */
+esp_err_t Settings_SetU32(Settings_Id Id, uint32_t Value) {
+    if ((Id >= SETTING_COUNT) || (SETTINGS_STR == Descs[Id].Type) || !settings_in_range(Id, Value)) {
+        return (ESP_ERR_INVALID_ARG);
+    }
+
+    taskENTER_CRITICAL(&SettingsLock);
+    const bool isChanged = (settings_number(Id) != Value);
+    if (isChanged) {
+        if (SETTINGS_U8 == Descs[Id].Type) {
+            *settings_value(Id) = Value;
+        } else {
+            *(uint32_t*)settings_value(Id) = Value;
+        }
+        Dirty |= BIT(Id);
+    }
+    taskEXIT_CRITICAL(&SettingsLock);
+
+    if (isChanged) {
+        settings_changed(Id);
+    }
+    return (ESP_OK);
+}  // Settings_SetU32
+
+/**
+ * @brief Change a string setting
+ *
+ * @param Id The setting
+ * @param Value The new value
+ * @return esp_err_t ESP_ERR_INVALID_SIZE if too long
+ */
+esp_err_t Settings_SetStr(Settings_Id Id, const char * Value) {
+    if ((Id >= SETTING_COUNT) || (SETTINGS_STR != Descs[Id].Type) || (NULL == Value)) {
+        return (ESP_ERR_INVALID_ARG);
+    }
+    if (strlen(Value) >= Descs[Id].Size) {
+        return (ESP_ERR_INVALID_SIZE);
+    }
+
+    taskENTER_CRITICAL(&SettingsLock);
+    char * pValue = (char*)settings_value(Id);
+    const bool isChanged = (0 != strcmp(pValue, Value));
+    if (isChanged) {
+        strcpy(pValue, Value);
+        Dirty |= BIT(Id);
+    }
+    taskEXIT_CRITICAL(&SettingsLock);
+
+    if (isChanged) {
+        settings_changed(Id);
+    }
+    return (ESP_OK);
+}  // Settings_SetStr
+
+/**
+ * @brief Change a setting by its name, e.g. from a command
+ *
+ * Only settings marked as remote in SETTINGS_TABLE can be changed here.
+ *
+ * @param Name "<namespace>.<key>", e.g. "TELEMETRY.PERIOD"
+ * @param Value The new value as text, numbers decimal or 0x hex
+ * @return esp_err_t ESP_ERR_NOT_FOUND if unknown, ESP_ERR_NOT_ALLOWED if local only,
+ *                   ESP_ERR_INVALID_ARG if not a number in range
+ */
+esp_err_t Settings_SetFromString(const char * Name, const char * Value) {
+    const char * pDot = strchr(Name, '.');
+
+    if (NULL == pDot) {
+        return (ESP_ERR_INVALID_ARG);
+    }
+    for (int i = 0; i < SETTING_COUNT; i++) {
+        const size_t NsLen = strlen(Descs[i].Namespace);
+
+        if ((NsLen != (size_t)(pDot - Name)) || (0 != strncmp(Descs[i].Namespace, Name, NsLen))
+         || (0 != strcmp(Descs[i].Key, pDot + 1))) {
+            continue;
+        }
+        if (!Descs[i].isRemote) {
+            return (ESP_ERR_NOT_ALLOWED);
+        }
+        if (SETTINGS_STR == Descs[i].Type) {
+            return (Settings_SetStr(i, Value));
+        }
+
+        // strtoul() takes "-1" as ULONG_MAX, only plain digits are numbers
+        char * pEnd;
+        errno = 0;
+        const unsigned long Number = strtoul(Value, &pEnd, 0);
+        if (!isdigit((unsigned char)Value[0]) || (0x00 != *pEnd) || (0 != errno) || (Number > UINT32_MAX)) {
+            return (ESP_ERR_INVALID_ARG);
+        }
+        return (Settings_SetU32(i, Number));
+    }
+    return (ESP_ERR_NOT_FOUND);
+}  // Settings_SetFromString
+
+/**
+ * @brief Register a change callback, during the init
+ *
+ * @param Id The setting
+ * @param Callback Called after each change
+ * @param pArg User argument
+ * @return esp_err_t
+ */
+esp_err_t Settings_OnChange(Settings_Id Id, Settings_Callback Callback, void * pArg) {
+    if ((Id >= SETTING_COUNT) || (NULL == Callback)) {
+        return (ESP_ERR_INVALID_ARG);
+    }
+    if (CallbackCount >= SETTINGS_MAX_CALLBACKS) {
+        return (ESP_ERR_NO_MEM);
+    }
+    Callbacks[CallbackCount].Id = Id;
+    Callbacks[CallbackCount].Callback = Callback;
+    Callbacks[CallbackCount].pArg = pArg;
+    CallbackCount++;
+    return (ESP_OK);
+}
+
+/**
+ * @brief Write all changed settings now, e.g. before a restart
+ *
+ * @return esp_err_t
+ */
+esp_err_t Settings_Flush(void) {
+    if (NULL == xWriteLock) {
+        return (ESP_ERR_INVALID_STATE);
+    }
+    return (settings_write_back());
+}
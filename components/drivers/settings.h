@@ -0,0 +1,57 @@
+/**
+ ******************************************************************************
+ *  file           : settings.h
+ *  brief          : Typed settings, cached in RAM with NVS write-back
+ ******************************************************************************
+ */
+
+#ifndef COMPONENTS_DRIVERS_SETTINGS_H_
+#define COMPONENTS_DRIVERS_SETTINGS_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// All settings: X(Id, NVS namespace, NVS key, Type, Default, Size of strings, Min, Max, Remote)
+// Types are U8, U32 and STR. Existing keys keep their namespace, so the
+// settings of deployed devices stay valid. Numbers outside Min..Max are
+// rejected, strings have 0, 0. Remote 1: May be changed by
+// Settings_SetFromString(), e.g. the set command. Connection settings are
+// local only, a wrong value would lock the device off the network.
+#define SETTINGS_TABLE(X) \
+    X(WIFI_SSID,          "SETTINGS",  "WIFI_SSID",   STR, "",     33,  0,    0,        0) /* SSID of the AP */ \
+    X(WIFI_PASS,          "SETTINGS",  "WIFI_PASS",   STR, "",     65,  0,    0,        0) /* Password of the AP */ \
+    X(WIFI_FASTIP,        "SETTINGS",  "WIFI_FASTIP", U8,  0,      0,   0,    1,        1) /* 1 = Cached lease as static IP */ \
+    X(MQTT_URL,           "SETTINGS",  "MQTT_URL",    STR, "",     128, 0,    0,        0) /* Broker URL */ \
+    X(CODEC,              "SETTINGS",  "CODEC",       U8,  0,      0,   0,    1,        1) /* Default codec, 0 = JSON, 1 = CBOR */ \
+    X(TELEMETRY_PERIOD,   "TELEMETRY", "PERIOD",      U32, 10000,  0,   1000, 86400000, 1) /* Status period in ms */ \
+    X(TELEMETRY_KEYFRAME, "TELEMETRY", "KEYFRAME",    U32, 300000, 0,   1000, 86400000, 1) /* Keyframe interval in ms */
+
+#define SETTINGS_ID(Id, Ns, Key, Type, Default, Size, Min, Max, Remote) SETTING_##Id,
+typedef enum Settings_Id {
+    SETTINGS_TABLE(SETTINGS_ID)
+    SETTING_COUNT
+} Settings_Id;
+#undef SETTINGS_ID
+
+// Called after a setting was changed, in the context of the setter
+typedef void (*Settings_Callback)(Settings_Id Id, void * pArg);
+
+esp_err_t   Settings_Init(void);
+uint32_t    Settings_GetU32(Settings_Id Id);
+esp_err_t   Settings_GetStr(Settings_Id Id, char * pBuffer, size_t Size);
+esp_err_t   Settings_SetU32(Settings_Id Id, uint32_t Value);
+esp_err_t   Settings_SetStr(Settings_Id Id, const char * Value);
+esp_err_t   Settings_SetFromString(const char * Name, const char * Value);
+esp_err_t   Settings_OnChange(Settings_Id Id, Settings_Callback Callback, void * pArg);
+esp_err_t   Settings_Flush(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // COMPONENTS_DRIVERS_SETTINGS_H_
@@ -0,0 +1,161 @@
+/**
+ ******************************************************************************
+ *  file           : sysmem.c
+ *  brief          : Long living RTOS objects, static or heap, with RAM report
+ *
+ *  All long living tasks, queues, event groups, semaphores and pools are
+ *  registered here. The report compares the reserved RAM with the peak
+ *  use: stacks by their watermark, pools by their peak, everything else
+ *  counts as fully used.
+ ******************************************************************************
+ */
+
+/****************************** Includes  */
+#include <string.h>
+#include "esp_log.h"
+#include "esp_system.h"
+
+#include "sysmem.h"
+
+/****************************** Statics */
+static const char *TAG = "SYSMEM";
+
+typedef struct SysMem_Task {
+    TaskHandle_t    xTask;
+    const char *    Name;
+    uint32_t        StackSize;
+} SysMem_Task;
+
+typedef struct SysMem_Buffer {
+    const char *    Name;
+    size_t          Size;
+    const size_t *  pPeak;              // Peak use, NULL if always fully used
+} SysMem_Buffer;
+
+static SysMem_Task Tasks[SYSMEM_MAX_TASKS];
+static SysMem_Buffer Buffers[SYSMEM_MAX_BUFFERS];
+static size_t TaskCount = 0;
+static size_t BufferCount = 0;
+static uint32_t StaticBytes = 0;
+static portMUX_TYPE SysMemLock = portMUX_INITIALIZER_UNLOCKED;
+
+/****************************** Functions */
+
+/**
+ * @brief Peak stack use of a task, bytes
+ */
+static uint32_t sysmem_stack_used(const SysMem_Task * pTask) {
+    // Stack type is uint8_t, so the watermark is in bytes
+    return (pTask->StackSize - uxTaskGetStackHighWaterMark(pTask->xTask));
+}
+
+/**
+ * @brief Register a created task, use SYSMEM_TASK()
+ *
+ * @param xTask The task, NULL if the creation failed
+ * @param Name Name of the task, must stay valid
+ * @param StackSize Stack in bytes
+ * @param isStatic Storage is not on the heap
+ * @param pHandle Gets the handle, may be NULL
+ * @return esp_err_t ESP_ERR_NO_MEM if not created
+ */
+esp_err_t SysMem_AddTask(TaskHandle_t xTask, const char * Name, uint32_t StackSize, bool isStatic, TaskHandle_t * pHandle) {
+    if (NULL != pHandle) {
+        *pHandle = xTask;
+    }
+    if (NULL == xTask) {
+        ESP_LOGE(TAG, "Cannot create task '%s'", Name);
+        return (ESP_ERR_NO_MEM);
+    }
+
+    taskENTER_CRITICAL(&SysMemLock);
+    if (TaskCount < SYSMEM_MAX_TASKS) {
+        Tasks[TaskCount].xTask = xTask;
+        Tasks[TaskCount].Name = Name;
+        Tasks[TaskCount].StackSize = StackSize;
+        TaskCount++;
+    }
+    if (isStatic) {
+        StaticBytes += StackSize + sizeof(StaticTask_t);
+    }
+    taskEXIT_CRITICAL(&SysMemLock);
+    return (ESP_OK);
+}  // SysMem_AddTask
+
+/**
+ * @brief Register a buffer, e.g. a pool, or a queue by SYSMEM_QUEUE()
+ *
+ * @param Name Name of the buffer, must stay valid
+ * @param Size Bytes
+ * @param pPeak Peak use in bytes, NULL if fully used
+ * @param isStatic Storage is not on the heap
+ */
+void SysMem_AddBuffer(const char * Name, size_t Size, const size_t * pPeak, bool isStatic) {
+    taskENTER_CRITICAL(&SysMemLock);
+    if (BufferCount < SYSMEM_MAX_BUFFERS) {
+        Buffers[BufferCount].Name = Name;
+        Buffers[BufferCount].Size = Size;
+        Buffers[BufferCount].pPeak = pPeak;
+        BufferCount++;
+    }
+    if (isStatic) {
+        StaticBytes += Size;
+    }
+    taskEXIT_CRITICAL(&SysMemLock);
+}  // SysMem_AddBuffer
+
+/**
+ * @brief Get reserved and used RAM of all registered objects
+ *
+ * @param pStats
+ */
+void SysMem_GetStats(SysMem_Stats * pStats) {
+    memset(pStats, 0x00, sizeof(SysMem_Stats));
+
+    for (size_t i = 0; i < TaskCount; i++) {
+        pStats->Reserved += Tasks[i].StackSize + sizeof(StaticTask_t);
+        pStats->Used += sysmem_stack_used(&Tasks[i]) + sizeof(StaticTask_t);
+    }
+    for (size_t i = 0; i < BufferCount; i++) {
+        pStats->Reserved += Buffers[i].Size;
+        pStats->Used += (NULL != Buffers[i].pPeak) ? *Buffers[i].pPeak : Buffers[i].Size;
+    }
+    pStats->Static = StaticBytes;
+}  // SysMem_GetStats
+
+/**
+ * @brief Get the peak use of a registered buffer
+ *
+ * @param Name Name of the buffer
+ * @return size_t Bytes, its size if it has no peak, 0 if unknown
+ */
+size_t SysMem_GetPeak(const char * Name) {
+    for (size_t i = 0; i < BufferCount; i++) {
+        if (0 == strcmp(Buffers[i].Name, Name)) {
+            return ((NULL != Buffers[i].pPeak) ? *Buffers[i].pPeak : Buffers[i].Size);
+        }
+    }
+    return (0);
+}
+
+/**
+ * @brief Log reserved and used RAM of every object
+ */
+void SysMem_Report(void) {
+    SysMem_Stats Stats;
+
+    ESP_LOGI(TAG, "%-16s %8s %8s", "Object", "Reserved", "Used");
+    for (size_t i = 0; i < TaskCount; i++) {
+        ESP_LOGI(TAG, "%-16s %8lu %8lu", Tasks[i].Name, (unsigned long)Tasks[i].StackSize,
+                 (unsigned long)sysmem_stack_used(&Tasks[i]));
+    }
+    for (size_t i = 0; i < BufferCount; i++) {
+        ESP_LOGI(TAG, "%-16s %8lu %8lu", Buffers[i].Name, (unsigned long)Buffers[i].Size,
+                 (unsigned long)((NULL != Buffers[i].pPeak) ? *Buffers[i].pPeak : Buffers[i].Size));
+    }
+
+    SysMem_GetStats(&Stats);
+    ESP_LOGI(TAG, "Total %lu bytes reserved (%lu static), %lu used, heap free %lu",
+             (unsigned long)Stats.Reserved, (unsigned long)Stats.Static, (unsigned long)Stats.Used,
+             (unsigned long)esp_get_free_heap_size());
+}  // SysMem_Report
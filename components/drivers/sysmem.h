@@ -0,0 +1,97 @@
+/**
+ ******************************************************************************
+ *  file           : sysmem.h
+ *  brief          : Long living RTOS objects, static or heap, with RAM report
+ ******************************************************************************
+ */
+
+#ifndef COMPONENTS_DRIVERS_SYSMEM_H_
+#define COMPONENTS_DRIVERS_SYSMEM_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "sdkconfig.h"
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/event_groups.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Stacks of the long living tasks, bytes
+#define SYSMEM_STACK_COMMAND    4096    // Command interpreter
+#define SYSMEM_STACK_SYSSTATS   4096    // Status telemetry
+#define SYSMEM_STACK_MQTT_PUB   3072    // MQTT publisher
+#define SYSMEM_STACK_MQTT_FWD   4096    // Store-and-forward
+#define SYSMEM_STACK_SETTINGS   3072    // Settings write-back
+#define SYSMEM_STACK_PERF       3072    // Perf telemetry
+
+// Lengths of the long living queues
+#define SYSMEM_QUEUE_COMMAND    32      // Received commands
+#define SYSMEM_QUEUE_MQTT_TX    32      // Async publishes
+#define SYSMEM_QUEUE_MQTT_EVENT 32      // Client events for the publisher, 2x the max window
+
+#define SYSMEM_MAX_TASKS 12             // Max number of reported tasks
+#define SYSMEM_MAX_BUFFERS 24           // Max number of reported queues, pools, ...
+
+// RAM of the registered objects
+typedef struct SysMem_Stats {
+    uint32_t    Reserved;               // Bytes of all objects
+    uint32_t    Used;                   // Peak use: stacks and pools by watermark, others fully
+    uint32_t    Static;                 // ...of Reserved not on the heap
+} SysMem_Stats;
+
+// Long living objects are created with these macros. With
+// CONFIG_IOTBASE_STATIC_ALLOC the storage is a static buffer per call
+// site, else the heap. Sizes must be constants. Each returns the handle,
+// tasks an esp_err_t.
+#if CONFIG_IOTBASE_STATIC_ALLOC
+#define SYSMEM_TASK(Func, Name, StackSize, pArg, Prio, pHandle) ({ \
+    static StackType_t Stack_[StackSize]; \
+    static StaticTask_t Task_; \
+    SysMem_AddTask(xTaskCreateStatic(Func, Name, StackSize, pArg, Prio, Stack_, &Task_), Name, StackSize, true, pHandle); })
+#define SYSMEM_QUEUE(Name, Length, ItemSize) ({ \
+    static uint8_t Storage_[(Length) * (ItemSize)]; \
+    static StaticQueue_t Queue_; \
+    SysMem_AddBuffer(Name, sizeof(Storage_) + sizeof(Queue_), NULL, true); \
+    xQueueCreateStatic(Length, ItemSize, Storage_, &Queue_); })
+#define SYSMEM_EVENTGROUP(Name) ({ \
+    static StaticEventGroup_t Group_; \
+    SysMem_AddBuffer(Name, sizeof(Group_), NULL, true); \
+    xEventGroupCreateStatic(&Group_); })
+#define SYSMEM_SEMAPHORE(Name, Create) ({ \
+    static StaticSemaphore_t Semaphore_; \
+    SysMem_AddBuffer(Name, sizeof(Semaphore_), NULL, true); \
+    Create##Static(&Semaphore_); })
+#else
+#define SYSMEM_TASK(Func, Name, StackSize, pArg, Prio, pHandle) ({ \
+    TaskHandle_t xTask_ = NULL; \
+    xTaskCreate(Func, Name, StackSize, pArg, Prio, &xTask_); \
+    SysMem_AddTask(xTask_, Name, StackSize, false, pHandle); })
+#define SYSMEM_QUEUE(Name, Length, ItemSize) ({ \
+    SysMem_AddBuffer(Name, ((Length) * (ItemSize)) + sizeof(StaticQueue_t), NULL, false); \
+    xQueueCreate(Length, ItemSize); })
+#define SYSMEM_EVENTGROUP(Name) ({ \
+    SysMem_AddBuffer(Name, sizeof(StaticEventGroup_t), NULL, false); \
+    xEventGroupCreate(); })
+#define SYSMEM_SEMAPHORE(Name, Create) ({ \
+    SysMem_AddBuffer(Name, sizeof(StaticSemaphore_t), NULL, false); \
+    Create(); })
+#endif
+
+esp_err_t   SysMem_AddTask(TaskHandle_t xTask, const char * Name, uint32_t StackSize, bool isStatic, TaskHandle_t * pHandle);
+void        SysMem_AddBuffer(const char * Name, size_t Size, const size_t * pPeak, bool isStatic);
+void        SysMem_GetStats(SysMem_Stats * pStats);
+size_t      SysMem_GetPeak(const char * Name);
+void        SysMem_Report(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // COMPONENTS_DRIVERS_SYSMEM_H_
@@ -0,0 +1,184 @@
+/**
+ ******************************************************************************
+ *  file           : topictrie.c
+ *  brief          : Prefix trie for MQTT topic filters
+ *
+ *  Every node is one topic level. A filter is identified by the node of
+ *  its last level. Matching walks the topic level by level, so the cost
+ *  depends on the topic length and not on the number of filters.
+ *  Wildcards: "+" matches exactly one level, "#" (only as last level)
+ *  matches the parent level and any number of following levels.
+ ******************************************************************************
+ */
+
+/****************************** Includes  */
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "topictrie.h"
+
+/****************************** Functions */
+
+/**
+ * @brief Length of the topic level starting at pLevel
+ */
+static size_t trie_level_len(const char * pLevel) {
+    const char * pEnd = strchr(pLevel, '/');
+    return ((NULL == pEnd) ? strlen(pLevel) : (size_t)(pEnd - pLevel));
+}
+
+/**
+ * @brief Find the child of a node with the given level name
+ *
+ * @return int The child node, -1 if not found
+ */
+static int trie_child(const TopicTrie * pTrie, int Node, const char * pLevel, size_t Length) {
+    for (int Child = pTrie->Nodes[Node].Child; Child >= 0; Child = pTrie->Nodes[Child].Sibling) {
+        const char * pName = pTrie->Nodes[Child].Level;
+        if ((0 == strncmp(pName, pLevel, Length)) && (0x00 == pName[Length])) {
+            return (Child);
+        }
+    }
+    return (-1);
+}
+
+/**
+ * @brief Check the levels and wildcards of a filter
+ *
+ * @return true Filter is valid
+ */
+static bool trie_valid_filter(const char * Filter) {
+    const char * pLevel = Filter;
+
+    while (1) {
+        const size_t Length = trie_level_len(pLevel);
+        const bool isLast = (0x00 == pLevel[Length]);
+
+        if ((Length >= TRIE_MAX_LEVEL) || ((Length > 1) && (NULL != memchr(pLevel, '+', Length)))
+         || ((NULL != memchr(pLevel, '#', Length)) && ((Length > 1) || !isLast))) {
+            return (false);
+        }
+        if (isLast) {
+            return (true);
+        }
+        pLevel += Length + 1;
+    }
+}  // trie_valid_filter
+
+/**
+ * @brief Walk the trie along a filter
+ *
+ * @param pTrie The trie
+ * @param Filter The topic filter
+ * @param Create Create missing nodes
+ * @return int The node of the last level, -1 if not found or the trie is full
+ */
+static int trie_walk(TopicTrie * pTrie, const char * Filter, bool Create) {
+    const char * pLevel = Filter;
+    int Node = 0;
+
+    while (1) {
+        const size_t Length = trie_level_len(pLevel);
+        const bool isLast = (0x00 == pLevel[Length]);
+
+        int Child = trie_child(pTrie, Node, pLevel, Length);
+        if (Child < 0) {
+            if (!Create || (pTrie->Count >= TRIE_MAX_NODES)) {
+                return (-1);
+            }
+            Child = pTrie->Count++;
+            memcpy(pTrie->Nodes[Child].Level, pLevel, Length);
+            pTrie->Nodes[Child].Level[Length] = 0x00;
+            pTrie->Nodes[Child].Child = -1;
+            pTrie->Nodes[Child].Sibling = pTrie->Nodes[Node].Child;
+            pTrie->Nodes[Node].Child = Child;
+        }
+        Node = Child;
+
+        if (isLast) {
+            return (Node);
+        }
+        pLevel += Length + 1;
+    }
+}  // trie_walk
+
+/**
+ * @brief Recursive matching of the topic levels starting at pLevel
+ *
+ * @param pLevel Remaining topic levels, NULL if the topic is consumed
+ */
+static void trie_match(const TopicTrie * pTrie, int Node, const char * pLevel, TopicTrie_MatchCb Callback, void * pArg) {
+    if (NULL == pLevel) {
+        // End of topic: This node and a trailing "#" match
+        Callback(Node, pArg);
+        const int Multi = trie_child(pTrie, Node, "#", 1);
+        if (Multi >= 0) {
+            Callback(Multi, pArg);
+        }
+        return;
+    }
+
+    const size_t Length = trie_level_len(pLevel);
+    const char * pNext = (0x00 == pLevel[Length]) ? NULL : (pLevel + Length + 1);
+
+    for (int Child = pTrie->Nodes[Node].Child; Child >= 0; Child = pTrie->Nodes[Child].Sibling) {
+        const char * pName = pTrie->Nodes[Child].Level;
+
+        if (0 == strcmp(pName, "#")) {
+            Callback(Child, pArg);
+        } else if ((0 == strcmp(pName, "+"))
+               || ((0 == strncmp(pName, pLevel, Length)) && (0x00 == pName[Length]))) {
+            trie_match(pTrie, Child, pNext, Callback, pArg);
+        }
+    }
+}  // trie_match
+
+/**
+ * @brief Init an empty trie
+ *
+ * @param pTrie
+ */
+void TopicTrie_Init(TopicTrie * pTrie) {
+    memset(pTrie, 0x00, sizeof(TopicTrie));
+    pTrie->Nodes[0].Child = -1;
+    pTrie->Nodes[0].Sibling = -1;
+    pTrie->Count = 1;
+}
+
+/**
+ * @brief Insert a filter, existing levels are shared
+ *
+ * @param pTrie The trie
+ * @param Filter The topic filter
+ * @return int Node id of the filter, -1 if invalid or the trie is full
+ */
+int TopicTrie_Insert(TopicTrie * pTrie, const char * Filter) {
+    if (!trie_valid_filter(Filter)) {
+        return (-1);
+    }
+    return (trie_walk(pTrie, Filter, true));
+}
+
+/**
+ * @brief Find the node of a filter
+ *
+ * @param pTrie The trie
+ * @param Filter The topic filter
+ * @return int Node id of the filter, -1 if not found
+ */
+int TopicTrie_Find(const TopicTrie * pTrie, const char * Filter) {
+    return (trie_walk((TopicTrie*)pTrie, Filter, false));
+}
+
+/**
+ * @brief Call Callback for every filter node matching the topic
+ *
+ * @param pTrie The trie
+ * @param Topic The topic, without wildcards
+ * @param Callback Called with the node id of each matching filter
+ * @param pArg User argument for the callback
+ */
+void TopicTrie_Match(const TopicTrie * pTrie, const char * Topic, TopicTrie_MatchCb Callback, void * pArg) {
+    trie_match(pTrie, 0, Topic, Callback, pArg);
+}
@@ -0,0 +1,43 @@
+/**
+ ******************************************************************************
+ *  file           : topictrie.h
+ *  brief          : Prefix trie for MQTT topic filters
+ ******************************************************************************
+ */
+
+#ifndef COMPONENTS_DRIVERS_TOPICTRIE_H_
+#define COMPONENTS_DRIVERS_TOPICTRIE_H_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TRIE_MAX_NODES 48               // Max number of nodes incl. root
+#define TRIE_MAX_LEVEL 24               // Max length of one topic level incl. 0
+
+typedef struct TopicTrieNode {
+    char        Level[TRIE_MAX_LEVEL];  // Name of the level, "+" or "#"
+    int16_t     Child;                  // First child, -1 if none
+    int16_t     Sibling;                // Next sibling, -1 if none
+} TopicTrieNode;
+
+typedef struct TopicTrie {
+    TopicTrieNode   Nodes[TRIE_MAX_NODES];  // Node 0 is the root
+    int16_t         Count;                  // Number of used nodes
+} TopicTrie;
+
+// Called for every node whose filter matches a topic
+typedef void (*TopicTrie_MatchCb)(int Node, void * pArg);
+
+void    TopicTrie_Init(TopicTrie * pTrie);
+int     TopicTrie_Insert(TopicTrie * pTrie, const char * Filter);
+int     TopicTrie_Find(const TopicTrie * pTrie, const char * Filter);
+void    TopicTrie_Match(const TopicTrie * pTrie, const char * Topic, TopicTrie_MatchCb Callback, void * pArg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // COMPONENTS_DRIVERS_TOPICTRIE_H_
@@ -0,0 +1,465 @@
+/**
+ ******************************************************************************
+ *  file           : txlog.c
+ *  brief          : Store-and-forward log for outbound messages in flash
+ *
+ *  The partition is used as a ring of 4K sectors. Each sector starts with
+ *  a header holding a sequence number, the one with the highest number is
+ *  the head. Records are only appended, a forwarded record is marked by
+ *  clearing its state byte, so no erase is needed. A sector is erased
+ *  when the ring wraps around to it, which spreads the wear evenly over
+ *  the whole partition. If the ring is full, the oldest sector is dropped.
+ *
+ *  The data of a record is written before its header, a record cut by a
+ *  power loss is detected by its CRC or by the non-blank rest of the head.
+ ******************************************************************************
+ */
+
+/****************************** Includes  */
+#include <stdio.h>
+#include <stddef.h>
+#include <string.h>
+#include "esp_log.h"
+#include "esp_partition.h"
+#include "esp_rom_crc.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#include "sysmem.h"
+#include "txlog.h"
+
+/****************************** Configuration */
+#define TXLOG_SECTOR 4096               // Erase unit
+#define TXLOG_MAGIC 0x474F4C54          // "TLOG"
+#define TXLOG_FREE 0xFFFF               // Length of an unwritten record
+#define TXLOG_PENDING 0xFF              // Record state: Not yet forwarded
+#define TXLOG_DONE 0x00                 // Record state: Forwarded or dropped
+
+typedef struct TxLog_Sector {
+    uint32_t    Magic;
+    uint32_t    Seq;                    // Increases with every started sector
+} TxLog_Sector;
+
+typedef struct TxLog_Record {
+    uint16_t    Length;                 // Length of the data
+    uint16_t    Crc;                    // CRC16 of the data
+    uint8_t     State;                  // TXLOG_PENDING or TXLOG_DONE
+    uint8_t     Reserved[3];
+} TxLog_Record;                         // Followed by "subtopic\0" and the payload
+
+/****************************** Statics */
+static const char *TAG = "TXLOG";
+static const esp_partition_t * pPart = NULL;
+static SemaphoreHandle_t xLock = NULL;
+static uint32_t NumSectors = 0;
+static uint32_t HeadSector = 0;         // Sector written to
+static uint32_t HeadOffset = 0;         // Next record in the head sector
+static uint32_t HeadSeq = 0;            // Sequence number of the head sector
+static uint32_t TailSector = 0;         // Oldest pending record
+static uint32_t TailOffset = 0;
+static bool isPeeked = false;           // Tail was returned by TxLog_Peek()
+static TxLog_Stats Stats;
+
+/****************************** Functions */
+
+#define ALIGN4(x) (((x) + 3) & ~3)
+
+/**
+ * @brief Flash size of a record
+ */
+static uint32_t txlog_record_size(uint32_t Length) {
+    return (sizeof(TxLog_Record) + ALIGN4(Length));
+}
+
+/**
+ * @brief Next sector in the ring
+ */
+static uint32_t txlog_next(uint32_t Sector) {
+    return ((Sector + 1) % NumSectors);
+}
+
+/**
+ * @brief Read a record header
+ *
+ * @return true A written record which fits into the sector
+ */
+static bool txlog_read_record(uint32_t Sector, uint32_t Offset, TxLog_Record * pRec) {
+    if ((Offset + sizeof(TxLog_Record)) > TXLOG_SECTOR) {
+        return (false);
+    }
+    if (ESP_OK != esp_partition_read(pPart, (Sector * TXLOG_SECTOR) + Offset, pRec, sizeof(TxLog_Record))) {
+        return (false);
+    }
+    return ((TXLOG_FREE != pRec->Length) && ((Offset + txlog_record_size(pRec->Length)) <= TXLOG_SECTOR));
+}  // txlog_read_record
+
+/**
+ * @brief Check if a flash area is erased
+ */
+static bool txlog_is_blank(uint32_t Address, uint32_t Length) {
+    uint32_t Buffer[64];
+
+    while (Length > 0) {
+        const uint32_t Chunk = (Length > sizeof(Buffer)) ? sizeof(Buffer) : Length;
+        if (ESP_OK != esp_partition_read(pPart, Address, Buffer, Chunk)) {
+            return (false);
+        }
+        for (uint32_t i = 0; i < Chunk; i++) {
+            if (0xFF != ((uint8_t*)Buffer)[i]) {
+                return (false);
+            }
+        }
+        Address += Chunk;
+        Length -= Chunk;
+    }
+    return (true);
+}  // txlog_is_blank
+
+/**
+ * @brief Erase a sector and make it the head
+ */
+static esp_err_t txlog_start_sector(uint32_t Sector) {
+    const TxLog_Sector Header = { .Magic = TXLOG_MAGIC, .Seq = HeadSeq + 1 };
+
+    esp_err_t ret = esp_partition_erase_range(pPart, Sector * TXLOG_SECTOR, TXLOG_SECTOR);
+    Stats.Erases++;
+    if (ESP_OK == ret) {
+        ret = esp_partition_write(pPart, Sector * TXLOG_SECTOR, &Header, sizeof(Header));
+        Stats.BytesWritten += sizeof(Header);
+    }
+    if (ESP_OK != ret) {
+        ESP_LOGE(TAG, "Cannot start sector %lu: %s", (unsigned long)Sector, esp_err_to_name(ret));
+        return (ret);
+    }
+
+    HeadSector = Sector;
+    HeadOffset = sizeof(TxLog_Sector);
+    HeadSeq = Header.Seq;
+    return (ESP_OK);
+}  // txlog_start_sector
+
+/**
+ * @brief Count the pending records of a sector
+ *
+ * @param Sector The sector
+ * @param Offset First record to check
+ * @param pFirst Offset of the first pending record, unchanged if none
+ * @return uint32_t Number of pending records
+ */
+static uint32_t txlog_count_pending(uint32_t Sector, uint32_t Offset, uint32_t * pFirst) {
+    const uint32_t End = (Sector == HeadSector) ? HeadOffset : TXLOG_SECTOR;
+    TxLog_Record Rec;
+    uint32_t Count = 0;
+
+    while ((Offset < End) && txlog_read_record(Sector, Offset, &Rec)) {
+        if (TXLOG_PENDING == Rec.State) {
+            if (0 == Count) {
+                *pFirst = Offset;
+            }
+            Count++;
+        }
+        Offset += txlog_record_size(Rec.Length);
+    }
+    return (Count);
+}  // txlog_count_pending
+
+/**
+ * @brief Nothing pending: The tail follows the head
+ */
+static void txlog_tail_to_head(void) {
+    if (0 == Stats.Pending) {
+        TailSector = HeadSector;
+        TailOffset = HeadOffset;
+    }
+}
+
+/**
+ * @brief Head sector is full: Continue in the next one
+ *
+ * If the ring is full, the pending records of the oldest sector are lost.
+ *
+ * @return esp_err_t
+ */
+static esp_err_t txlog_advance(void) {
+    const uint32_t Next = txlog_next(HeadSector);
+
+    if ((Stats.Pending > 0) && (Next == TailSector)) {
+        uint32_t First;
+        const uint32_t Lost = txlog_count_pending(TailSector, TailOffset, &First);
+
+        ESP_LOGW(TAG, "Log full, dropping %lu messages", (unsigned long)Lost);
+        Stats.Dropped += Lost;
+        Stats.Pending -= Lost;
+        TailSector = txlog_next(Next);
+        TailOffset = sizeof(TxLog_Sector);
+        isPeeked = false;
+    }
+
+    esp_err_t ret = txlog_start_sector(Next);
+    txlog_tail_to_head();
+    return (ret);
+}  // txlog_advance
+
+/**
+ * @brief Mark the tail record as done and move to the next
+ *
+ * @param Length Data length of the tail record
+ */
+static void txlog_mark_done(uint32_t Length) {
+    const uint8_t State = TXLOG_DONE;
+
+    esp_partition_write(pPart, (TailSector * TXLOG_SECTOR) + TailOffset + offsetof(TxLog_Record, State), &State, sizeof(State));
+    Stats.BytesWritten += sizeof(State);
+    TailOffset += txlog_record_size(Length);
+    Stats.Pending--;
+    txlog_tail_to_head();
+}  // txlog_mark_done
+
+/**
+ * @brief Init the log: Find head and tail in the partition
+ *
+ * @return esp_err_t ESP_ERR_NOT_FOUND if there is no log partition
+ */
+esp_err_t TxLog_Init(void) {
+    TxLog_Sector Header;
+    TxLog_Record Rec;
+    bool isFound = false;
+
+    pPart = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, TXLOG_PARTITION);
+    if (NULL == pPart) {
+        ESP_LOGW(TAG, "No partition '%s'", TXLOG_PARTITION);
+        return (ESP_ERR_NOT_FOUND);
+    }
+    NumSectors = pPart->size / TXLOG_SECTOR;
+    if (NumSectors < 2) {
+        pPart = NULL;
+        return (ESP_ERR_INVALID_SIZE);
+    }
+    xLock = SYSMEM_SEMAPHORE("txlog", xSemaphoreCreateMutex);
+    if (NULL == xLock) {
+        pPart = NULL;
+        return (ESP_ERR_NO_MEM);
+    }
+    memset(&Stats, 0x00, sizeof(Stats));
+
+    // Head: The sector with the newest sequence number
+    for (uint32_t Sector = 0; Sector < NumSectors; Sector++) {
+        esp_partition_read(pPart, Sector * TXLOG_SECTOR, &Header, sizeof(Header));
+        if ((TXLOG_MAGIC == Header.Magic) && (!isFound || ((int32_t)(Header.Seq - HeadSeq) > 0))) {
+            HeadSector = Sector;
+            HeadSeq = Header.Seq;
+            isFound = true;
+        }
+    }
+    if (!isFound) {
+        ESP_LOGI(TAG, "Empty log, %lu sectors", (unsigned long)NumSectors);
+        HeadSeq = 0;
+        esp_err_t ret = txlog_start_sector(0);
+        txlog_tail_to_head();
+        return (ret);
+    }
+
+    // Write position in the head. The rest must be blank, else a write was cut.
+    HeadOffset = sizeof(TxLog_Sector);
+    while (txlog_read_record(HeadSector, HeadOffset, &Rec)) {
+        HeadOffset += txlog_record_size(Rec.Length);
+    }
+    if ((HeadOffset < TXLOG_SECTOR) && !txlog_is_blank((HeadSector * TXLOG_SECTOR) + HeadOffset, TXLOG_SECTOR - HeadOffset)) {
+        ESP_LOGW(TAG, "Interrupted write in sector %lu", (unsigned long)HeadSector);
+        HeadOffset = TXLOG_SECTOR;
+    }
+
+    // Tail: The oldest pending record, starting at the sector after the head
+    TailSector = HeadSector;
+    TailOffset = HeadOffset;
+    for (uint32_t i = 1; i <= NumSectors; i++) {
+        const uint32_t Sector = (HeadSector + i) % NumSectors;
+        uint32_t First = 0;
+
+        esp_partition_read(pPart, Sector * TXLOG_SECTOR, &Header, sizeof(Header));
+        if (TXLOG_MAGIC != Header.Magic) {
+            continue;
+        }
+        const uint32_t Count = txlog_count_pending(Sector, sizeof(TxLog_Sector), &First);
+        if ((Count > 0) && (0 == Stats.Pending)) {
+            TailSector = Sector;
+            TailOffset = First;
+        }
+        Stats.Pending += Count;
+    }
+
+    ESP_LOGI(TAG, "%lu pending messages, head %lu/%lu", (unsigned long)Stats.Pending, (unsigned long)HeadSector, (unsigned long)HeadOffset);
+    return (ESP_OK);
+}  // TxLog_Init
+
+/**
+ * @brief Check if messages are waiting to be forwarded
+ *
+ * @return true Nothing pending or no log
+ */
+bool TxLog_isEmpty(void) {
+    return ((NULL == pPart) || (0 == Stats.Pending));
+}
+
+/**
+ * @brief Append a message
+ *
+ * @param SubTopic The subtopic
+ * @param pPayload The payload
+ * @param PayloadLen Length of the payload
+ * @return esp_err_t ESP_ERR_INVALID_SIZE if too large for a record
+ */
+esp_err_t TxLog_Append(const char * SubTopic, const void * pPayload, size_t PayloadLen) {
+    const size_t TopicLen = strlen(SubTopic) + 1;
+    const size_t Length = TopicLen + PayloadLen;
+    esp_err_t ret = ESP_OK;
+
+    if (NULL == pPart) {
+        return (ESP_ERR_INVALID_STATE);
+    }
+    if (Length > TXLOG_MAX_RECORD) {
+        return (ESP_ERR_INVALID_SIZE);
+    }
+
+    xSemaphoreTake(xLock, portMAX_DELAY);
+
+    if ((HeadOffset + txlog_record_size(Length)) > TXLOG_SECTOR) {
+        ret = txlog_advance();
+    }
+
+    const uint32_t Address = (HeadSector * TXLOG_SECTOR) + HeadOffset;
+    TxLog_Record Rec = {
+        .Length = Length,
+        .Crc = esp_rom_crc16_le(esp_rom_crc16_le(0, (const uint8_t*)SubTopic, TopicLen), (const uint8_t*)pPayload, PayloadLen),
+        .State = TXLOG_PENDING,
+        .Reserved = { 0xFF, 0xFF, 0xFF },
+    };
+
+    // Data first, the header makes the record valid
+    if (ESP_OK == ret) {
+        ret = esp_partition_write(pPart, Address + sizeof(Rec), SubTopic, TopicLen);
+    }
+    if (ESP_OK == ret) {
+        ret = esp_partition_write(pPart, Address + sizeof(Rec) + TopicLen, pPayload, PayloadLen);
+    }
+    if (ESP_OK == ret) {
+        ret = esp_partition_write(pPart, Address, &Rec, sizeof(Rec));
+    }
+
+    // Even if failed, the space is skipped
+    HeadOffset += txlog_record_size(Length);
+    Stats.BytesWritten += sizeof(Rec) + Length;
+    if (ESP_OK == ret) {
+        Stats.Stored++;
+        Stats.Pending++;
+    } else {
+        ESP_LOGE(TAG, "Cannot store message: %s", esp_err_to_name(ret));
+        txlog_tail_to_head();
+    }
+
+    xSemaphoreGive(xLock);
+    return (ret);
+}  // TxLog_Append
+
+/**
+ * @brief Get the oldest pending message, without removing it
+ *
+ * Records which are corrupt or don't fit into the buffer are dropped.
+ *
+ * @param pBuffer Buffer for the message, TXLOG_MAX_RECORD is always enough
+ * @param Size Size of the buffer
+ * @param ppSubTopic The subtopic in the buffer
+ * @param ppPayload The payload in the buffer
+ * @param pPayloadLen Length of the payload
+ * @return esp_err_t ESP_ERR_NOT_FOUND if nothing is pending
+ */
+esp_err_t TxLog_Peek(char * pBuffer, size_t Size, const char ** ppSubTopic, const char ** ppPayload, size_t * pPayloadLen) {
+    TxLog_Record Rec;
+    esp_err_t ret = ESP_ERR_NOT_FOUND;
+
+    if (NULL == pPart) {
+        return (ESP_ERR_NOT_FOUND);
+    }
+
+    xSemaphoreTake(xLock, portMAX_DELAY);
+
+    while (Stats.Pending > 0) {
+        if ((TailSector == HeadSector) && (TailOffset >= HeadOffset)) {
+            ESP_LOGE(TAG, "Lost %lu pending messages", (unsigned long)Stats.Pending);
+            Stats.Pending = 0;
+            break;
+        }
+        if (!txlog_read_record(TailSector, TailOffset, &Rec)) {
+            // End of the sector
+            TailSector = txlog_next(TailSector);
+            TailOffset = sizeof(TxLog_Sector);
+            continue;
+        }
+        if (TXLOG_PENDING != Rec.State) {
+            TailOffset += txlog_record_size(Rec.Length);
+            continue;
+        }
+
+        const bool isRead = (Rec.Length <= Size)
+            && (ESP_OK == esp_partition_read(pPart, (TailSector * TXLOG_SECTOR) + TailOffset + sizeof(Rec), pBuffer, Rec.Length));
+        const size_t TopicLen = isRead ? strnlen(pBuffer, Rec.Length) + 1 : 0;
+        if (!isRead || (Rec.Crc != esp_rom_crc16_le(0, (const uint8_t*)pBuffer, Rec.Length))
+         || (TopicLen > Rec.Length)) {
+            ESP_LOGW(TAG, "Dropping invalid record at %lu/%lu", (unsigned long)TailSector, (unsigned long)TailOffset);
+            Stats.Dropped++;
+            txlog_mark_done(Rec.Length);
+            continue;
+        }
+
+        *ppSubTopic = pBuffer;
+        *ppPayload = pBuffer + TopicLen;
+        *pPayloadLen = Rec.Length - TopicLen;
+        isPeeked = true;
+        ret = ESP_OK;
+        break;
+    }
+    txlog_tail_to_head();
+
+    xSemaphoreGive(xLock);
+    return (ret);
+}  // TxLog_Peek
+
+/**
+ * @brief Remove the message returned by TxLog_Peek(), it was forwarded
+ *
+ * @return esp_err_t ESP_ERR_INVALID_STATE if it was dropped meanwhile
+ */
+esp_err_t TxLog_Pop(void) {
+    TxLog_Record Rec;
+    esp_err_t ret = ESP_ERR_INVALID_STATE;
+
+    if (NULL == pPart) {
+        return (ESP_ERR_INVALID_STATE);
+    }
+
+    xSemaphoreTake(xLock, portMAX_DELAY);
+    if (isPeeked && txlog_read_record(TailSector, TailOffset, &Rec)) {
+        txlog_mark_done(Rec.Length);
+        Stats.Forwarded++;
+        ret = ESP_OK;
+    }
+    isPeeked = false;
+    xSemaphoreGive(xLock);
+
+    return (ret);
+}  // TxLog_Pop
+
+/**
+ * @brief Get the counters
+ *
+ * @param pStats
+ */
+void TxLog_GetStats(TxLog_Stats * pStats) {
+    if (NULL == xLock) {
+        memset(pStats, 0x00, sizeof(TxLog_Stats));
+        return;
+    }
+    xSemaphoreTake(xLock, portMAX_DELAY);
+    memcpy(pStats, &Stats, sizeof(TxLog_Stats));
+    xSemaphoreGive(xLock);
+}  // TxLog_GetStats
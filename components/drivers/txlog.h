@@ -0,0 +1,43 @@
+/**
+ ******************************************************************************
+ *  file           : txlog.h
+ *  brief          : Store-and-forward log for outbound messages in flash
+ ******************************************************************************
+ */
+
+#ifndef COMPONENTS_DRIVERS_TXLOG_H_
+#define COMPONENTS_DRIVERS_TXLOG_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TXLOG_PARTITION "txlog"         // Label of the data partition
+#define TXLOG_MAX_RECORD 4080           // Max size of subtopic incl. terminator + payload
+
+// Counters of the log
+typedef struct TxLog_Stats {
+    uint32_t    Pending;                // Stored, not yet forwarded messages
+    uint32_t    Stored;                 // Messages appended since boot
+    uint32_t    Forwarded;              // Messages forwarded since boot
+    uint32_t    Dropped;                // Messages overwritten before forwarded
+    uint32_t    Erases;                 // Sector erases since boot
+    uint32_t    BytesWritten;           // Bytes written to flash since boot
+} TxLog_Stats;
+
+esp_err_t   TxLog_Init(void);
+bool        TxLog_isEmpty(void);
+esp_err_t   TxLog_Append(const char * SubTopic, const void * pPayload, size_t PayloadLen);
+esp_err_t   TxLog_Peek(char * pBuffer, size_t Size, const char ** ppSubTopic, const char ** ppPayload, size_t * pPayloadLen);
+esp_err_t   TxLog_Pop(void);
+void        TxLog_GetStats(TxLog_Stats * pStats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // COMPONENTS_DRIVERS_TXLOG_H_
@@ -2,6 +2,12 @@
  ******************************************************************************
  *  file           : wifi.c
  *  brief          : WiFi Functions, based on espressifs WiFi station example
+ *
+ *  BSSID, channel and DHCP lease of the last connection are cached in
+ *  NVS. On the next start the AP is connected directly without a full
+ *  scan, optionally with the cached lease as static IP. If that fails,
+ *  the connection falls back to a normal scan with DHCP, see apcache.c.
+ *  Lost connections are retried forever with a jittered backoff.
  ******************************************************************************
  */
 
@@ -15,123 +21,250 @@
 #include "esp_wifi.h"
 #include "esp_log.h"
 #include "nvs_flash.h"
+#include "esp_timer.h"
+
+#include "wifi.h"
+#include "connlink.h"
+#include "apcache.h"
+#include "settings.h"
+#include "sysmem.h"
 
 /****************************** Configuration */
 #define WIFI_CONNECTED_BIT BIT0                 // Event: Connected
-#define WIFI_FAIL_BIT BIT1                      // Event: Fail
-#define WIFI_MAXIMUM_RETRY 10                   // Max number of retries
-#define MAX_SSIDLEN 128                         // Max length of the SSID String
-#define MAX_PASSLEN 128                         // Max length of the Password String
-#define NVS_NAMESPACE "SETTINGS"                // Namespace for the Settings
+#define WIFI_BACKOFF_MS 500                     // First reconnect delay
+#define WIFI_BACKOFF_MAX_MS 30000               // Max reconnect delay
+#define NVS_NAMESPACE "SETTINGS"                // Namespace of the connection cache
+#define NVS_KEY_CACHE "WIFI_CACHE"              // Key of the connection cache
+#define WIFI_CACHE_TRIES 2                      // Directed connects before falling back to a scan
 
 /****************************** Statics */
 static const char *TAG = "WIFI";
 static EventGroupHandle_t s_wifi_event_group;   // FreeRTOS event group to signal when we are connected
-static int s_retry_num = 0;                     // Reconnect counter
 static esp_netif_t * wifi_NetIf;                // The network interface
-static bool isConnected = false;                // Current connection state
+static ConnLink Link;                           // Reconnect backoff and outages
+static wifi_config_t wifi_config;               // The station config
+static ApCache_Entry Cache;                     // Loaded or last saved cache
+static ApCache CacheState;                      // Directed connects and fallback
+static int64_t ConnectStartUs = 0;              // Start of the connect
+static int64_t AssocUs = 0;                     // Associated and authenticated
+static uint8_t ConnBssid[6];                    // AP of the current connection
+static uint8_t ConnChannel = 0;                 // Channel of the current connection
 
 /****************************** Functions */
 
+/**
+ * @brief Load the connection cache, must match the configured SSID
+ *
+ * @param handle Opened NVS
+ * @return true Cache is valid
+ */
+static bool wifi_load_cache(nvs_handle_t handle) {
+    size_t Length = sizeof(Cache);
+
+    if ((ESP_OK != nvs_get_blob(handle, NVS_KEY_CACHE, &Cache, &Length)) || (sizeof(Cache) != Length)) {
+        memset(&Cache, 0x00, sizeof(Cache));
+        return (false);
+    }
+    return (0 == strncmp(Cache.Ssid, (char*)wifi_config.sta.ssid, sizeof(wifi_config.sta.ssid)));
+}
+
+/**
+ * @brief Store the connection data if it has changed
+ *
+ * @param pNew The new data
+ */
+static void wifi_save_cache(const ApCache_Entry * pNew) {
+    nvs_handle_t handle;
+
+    if (0 == memcmp(pNew, &Cache, sizeof(Cache))) {
+        return;
+    }
+    memcpy(&Cache, pNew, sizeof(Cache));
+
+    if (ESP_OK == nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle)) {
+        if ((ESP_OK != nvs_set_blob(handle, NVS_KEY_CACHE, &Cache, sizeof(Cache))) || (ESP_OK != nvs_commit(handle))) {
+            ESP_LOGW(TAG, "Cannot store connection cache");
+        }
+        nvs_close(handle);
+    }
+}  // wifi_save_cache
+
+/**
+ * @brief Set the static IP from the cache
+ */
+static void wifi_set_static_ip(void) {
+    esp_netif_dns_info_t Dns = { 0 };
+
+    esp_netif_dhcpc_stop(wifi_NetIf);
+    esp_netif_set_ip_info(wifi_NetIf, &Cache.IpInfo);
+    Dns.ip.type = ESP_IPADDR_TYPE_V4;
+    Dns.ip.u_addr.ip4.addr = Cache.Dns;
+    esp_netif_set_dns_info(wifi_NetIf, ESP_NETIF_DNS_MAIN, &Dns);
+}
+
+/**
+ * @brief Directed connect failed: Scan for the AP, optionally with DHCP again
+ *
+ * @param isDhcp Start DHCP, the static IP is dropped
+ */
+static void wifi_fallback(bool isDhcp) {
+    wifi_config.sta.bssid_set = false;
+    wifi_config.sta.channel = 0;
+    esp_wifi_set_config(ESP_IF_WIFI_STA, &wifi_config);
+    if (isDhcp) {
+        esp_netif_dhcpc_start(wifi_NetIf);
+    }
+    ConnectStartUs = esp_timer_get_time();
+    esp_wifi_connect();
+}  // wifi_fallback
+
+/**
+ * @brief Backoff expired: Connect again
+ */
+static void wifi_reconnect(void) {
+    ConnectStartUs = esp_timer_get_time();
+    esp_wifi_connect();
+}
+
 /**
  * @brief The Wifi-Event-Handler
  */
 static void event_handler(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data) {
     if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_START) {
+        ConnectStartUs = esp_timer_get_time();
         esp_wifi_connect();
-        isConnected = false;
+    } else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_CONNECTED) {
+        wifi_event_sta_connected_t* event = (wifi_event_sta_connected_t*) event_data;
+        AssocUs = esp_timer_get_time();
+        ESP_LOGI(TAG, "Associated to %02x:%02x:%02x:%02x:%02x:%02x, channel %d, after %lu ms",
+                 event->bssid[0], event->bssid[1], event->bssid[2], event->bssid[3], event->bssid[4], event->bssid[5],
+                 event->channel, (unsigned long)((AssocUs - ConnectStartUs) / 1000));
+        memcpy(ConnBssid, event->bssid, sizeof(ConnBssid));
+        ConnChannel = event->channel;
     } else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_DISCONNECTED) {
-        if (s_retry_num < WIFI_MAXIMUM_RETRY) {
-            esp_wifi_connect();
-            s_retry_num++;
-            ESP_LOGI(TAG, "retry to connect to the AP");
+        ESP_LOGI(TAG,"connect to the AP fail");
+        xEventGroupClearBits(s_wifi_event_group, WIFI_CONNECTED_BIT);
+        ConnLink_Down(&Link);
+
+        const ApCache_Action Action = ApCache_Disconnected(&CacheState);
+        if (APCACHE_RETRY == Action) {
+            ConnLink_Retry(&Link);
         } else {
-            xEventGroupSetBits(s_wifi_event_group, WIFI_FAIL_BIT);
+            wifi_fallback(APCACHE_SCAN_DHCP == Action);
         }
-        ESP_LOGI(TAG,"connect to the AP fail");
-        isConnected = false;
     } else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP) {
         ip_event_got_ip_t* event = (ip_event_got_ip_t*) event_data;
+        const int64_t Now = esp_timer_get_time();
         ESP_LOGI(TAG, "got ip:" IPSTR, IP2STR(&event->ip_info.ip));
-        s_retry_num = 0;
+        ESP_LOGI(TAG, "Connected after %lu ms: assoc/auth %lu ms, ip %lu ms (%s%s)",
+                 (unsigned long)((Now - ConnectStartUs) / 1000), (unsigned long)((AssocUs - ConnectStartUs) / 1000),
+                 (unsigned long)((Now - AssocUs) / 1000), CacheState.isCached ? "cached AP" : "scan", CacheState.isStaticIp ? ", static ip" : "");
+
+        // Remember the connection for the next start
+        ApCache_Entry NewCache;
+        esp_netif_dns_info_t Dns;
+        memcpy(&NewCache, &Cache, sizeof(NewCache));
+        strlcpy(NewCache.Ssid, (char*)wifi_config.sta.ssid, sizeof(NewCache.Ssid));
+        memcpy(NewCache.Bssid, ConnBssid, sizeof(NewCache.Bssid));
+        NewCache.Channel = ConnChannel;
+        if (!CacheState.isStaticIp) {
+            NewCache.IpInfo = event->ip_info;
+            if (ESP_OK == esp_netif_get_dns_info(wifi_NetIf, ESP_NETIF_DNS_MAIN, &Dns)) {
+                NewCache.Dns = Dns.ip.u_addr.ip4.addr;
+            }
+        }
+        wifi_save_cache(&NewCache);
+
+        ApCache_GotIp(&CacheState);
         xEventGroupSetBits(s_wifi_event_group, WIFI_CONNECTED_BIT);
-        isConnected = true;
+        ConnLink_Up(&Link);
     }
 }
 
 /**
  * @brief Init WiFi in station mode
  *
+ * Does not wait for the connection, see WiFi_WaitConnected().
+ *
  * @return esp_err_t
  */
 esp_err_t WiFi_Init(void) {
-    size_t    ssid_length = MAX_SSIDLEN;
-    size_t    password_length = MAX_PASSLEN;
-    esp_err_t ret = ESP_OK;
+    char      Ssid[sizeof(wifi_config.sta.ssid) + 1];
+    char      Password[sizeof(wifi_config.sta.password) + 1] = "";
     nvs_handle_t handle;
+    bool      isCached = false;
 
-    wifi_config_t wifi_config = {
-        .sta = {
-            .ssid = "",
-            .password = "",
-            .threshold.authmode = WIFI_AUTH_OPEN,
-            .sae_pwe_h2e = WPA3_SAE_PWE_BOTH,
-        },
-    };
-
-    // Read in settings from NVS
-    ret = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle);
-    ESP_ERROR_CHECK(ret);
-    ret = nvs_get_str(handle, "WIFI_SSID", (char*)&wifi_config.sta.ssid[0], &ssid_length);
-    ESP_ERROR_CHECK(ret);
-    ret = nvs_get_str(handle, "WIFI_PASS", (char*)&wifi_config.sta.password[0], &password_length);
-    ESP_ERROR_CHECK(ret);
-    nvs_close(handle);
-
-    s_wifi_event_group = xEventGroupCreate();
+    memset(&wifi_config, 0x00, sizeof(wifi_config));
+    wifi_config.sta.threshold.authmode = WIFI_AUTH_OPEN;
+    wifi_config.sta.sae_pwe_h2e = WPA3_SAE_PWE_BOTH;
+
+    // SSID is needed, the password may be empty
+    ESP_ERROR_CHECK(Settings_GetStr(SETTING_WIFI_SSID, Ssid, sizeof(Ssid)));
+    memcpy(wifi_config.sta.ssid, Ssid, sizeof(wifi_config.sta.ssid));
+    Settings_GetStr(SETTING_WIFI_PASS, Password, sizeof(Password));
+    memcpy(wifi_config.sta.password, Password, sizeof(wifi_config.sta.password));
+    const bool isFastIp = (0 != Settings_GetU32(SETTING_WIFI_FASTIP));
+
+    if (ESP_OK == nvs_open(NVS_NAMESPACE, NVS_READONLY, &handle)) {
+        isCached = wifi_load_cache(handle);
+        nvs_close(handle);
+    }
+
+    // Directed connect to the last AP
+    if (isCached) {
+        ESP_LOGI(TAG, "Using cached AP %02x:%02x:%02x:%02x:%02x:%02x, channel %d",
+                 Cache.Bssid[0], Cache.Bssid[1], Cache.Bssid[2], Cache.Bssid[3], Cache.Bssid[4], Cache.Bssid[5], Cache.Channel);
+        wifi_config.sta.bssid_set = true;
+        memcpy(wifi_config.sta.bssid, Cache.Bssid, sizeof(wifi_config.sta.bssid));
+        wifi_config.sta.channel = Cache.Channel;
+    }
+
+    s_wifi_event_group = SYSMEM_EVENTGROUP("wifi_events");
+    ESP_ERROR_CHECK(ConnLink_Init(&Link, "WiFi", wifi_reconnect, WIFI_BACKOFF_MS, WIFI_BACKOFF_MAX_MS));
 
     ESP_ERROR_CHECK(esp_netif_init());
 
     ESP_ERROR_CHECK(esp_event_loop_create_default());
     wifi_NetIf = esp_netif_create_default_wifi_sta();
+    const bool isStaticIp = isCached && isFastIp && (0 != Cache.IpInfo.ip.addr);
+    if (isStaticIp) {
+        wifi_set_static_ip();
+    }
+    ApCache_Init(&CacheState, WIFI_CACHE_TRIES, isCached, isStaticIp);
 
     wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
     ESP_ERROR_CHECK(esp_wifi_init(&cfg));
 
-    esp_event_handler_instance_t instance_any_id;
-    esp_event_handler_instance_t instance_got_ip;
-    ESP_ERROR_CHECK(esp_event_handler_instance_register(WIFI_EVENT, ESP_EVENT_ANY_ID, &event_handler, NULL, &instance_any_id));
-    ESP_ERROR_CHECK(esp_event_handler_instance_register(IP_EVENT, IP_EVENT_STA_GOT_IP, &event_handler, NULL, &instance_got_ip));
+    ESP_ERROR_CHECK(esp_event_handler_instance_register(WIFI_EVENT, ESP_EVENT_ANY_ID, &event_handler, NULL, NULL));
+    ESP_ERROR_CHECK(esp_event_handler_instance_register(IP_EVENT, IP_EVENT_STA_GOT_IP, &event_handler, NULL, NULL));
 
     ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
     ESP_ERROR_CHECK(esp_wifi_set_config(ESP_IF_WIFI_STA, &wifi_config));
     ESP_ERROR_CHECK(esp_wifi_start());
     ESP_LOGI(TAG, "Init finished");
 
-    /* Waiting until either the connection is established (WIFI_CONNECTED_BIT)
-       or connection failed for the maximum number of re-tries (WIFI_FAIL_BIT).
-       The bits are set by event_handler() (see above) */
-    EventBits_t bits = xEventGroupWaitBits(s_wifi_event_group, WIFI_CONNECTED_BIT | WIFI_FAIL_BIT, pdFALSE, pdFALSE, portMAX_DELAY);
+    return (ESP_OK);
+}  // wifi_init
+
+/**
+ * @brief Wait until the connection is established
+ *
+ * Failed connects are retried forever, so this only returns when
+ * connected or after the timeout.
+ *
+ * @param Timeout Max time to wait
+ * @return esp_err_t ESP_ERR_TIMEOUT
+ */
+esp_err_t WiFi_WaitConnected(TickType_t Timeout) {
+    // The bit is set by event_handler() (see above)
+    EventBits_t bits = xEventGroupWaitBits(s_wifi_event_group, WIFI_CONNECTED_BIT, pdFALSE, pdFALSE, Timeout);
 
-    /* xEventGroupWaitBits() returns the bits before the call returned, hence we can test which event actually happened. */
     if (bits & WIFI_CONNECTED_BIT) {
-        ESP_LOGI(TAG, "Connected to AP, SSID: %s", wifi_config.sta.ssid);
-        isConnected = true;
-    } else if (bits & WIFI_FAIL_BIT) {
-        ESP_LOGI(TAG, "Failed to connect to SSID: %s", wifi_config.sta.ssid);
-        isConnected = false;
-    } else {
-        ESP_LOGE(TAG, "UNEXPECTED EVENT");
-        isConnected = false;
+        ESP_LOGI(TAG, "Connected to AP");
+        return (ESP_OK);
     }
-
-    /* The event will not be processed after unregister */
-    ESP_ERROR_CHECK(esp_event_handler_instance_unregister(IP_EVENT, IP_EVENT_STA_GOT_IP, instance_got_ip));
-    ESP_ERROR_CHECK(esp_event_handler_instance_unregister(WIFI_EVENT, ESP_EVENT_ANY_ID, instance_any_id));
-    vEventGroupDelete(s_wifi_event_group);
-
-    return (ESP_OK);
-}  // wifi_init
+    return (ESP_ERR_TIMEOUT);
+}  // WiFi_WaitConnected
 
 /**
  * @brief Returns a pointer to the network interface
@@ -149,5 +282,17 @@ esp_netif_t * WiFi_GetNetIf() {
  * @return false
  */
 bool WiFi_isConnected() {
-    return(isConnected);
+    if (NULL == s_wifi_event_group) {
+        return (false);
+    }
+    return (0 != (xEventGroupGetBits(s_wifi_event_group) & WIFI_CONNECTED_BIT));
+}
+
+/**
+ * @brief Get the outage statistics
+ *
+ * @param pStats
+ */
+void WiFi_GetStats(ConnLink_Stats * pStats) {
+    ConnLink_GetStats(&Link, pStats);
 }
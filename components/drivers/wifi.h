@@ -8,15 +8,19 @@
 #ifndef COMPONENTS_DRIVERS_WIFI_H_
 #define COMPONENTS_DRIVERS_WIFI_H_
 
+#include "freertos/FreeRTOS.h"
 #include "esp_wifi.h"
+#include "connlink.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 esp_err_t       WiFi_Init(void);
+esp_err_t       WiFi_WaitConnected(TickType_t Timeout);
 esp_netif_t *   WiFi_GetNetIf();
 bool            WiFi_isConnected();
+void            WiFi_GetStats(ConnLink_Stats * pStats);
 
 #ifdef __cplusplus
 }
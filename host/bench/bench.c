@@ -0,0 +1,751 @@
+/**
+ ******************************************************************************
+ *  file           : bench.c
+ *  brief          : Host benchmarks of the RX path, command decode, status
+ *                   encoding, topic routing, OTA decoding, the OTA pipeline and the
+ *                   store-and-forward log
+ *
+ *  The RX path runs through mqtt_event_handler of mqtt.c, connected to the
+ *  broker stand-in of the client mocks. With BENCH_CJSON the decoders and
+ *  encoders are compared with cJSON, which the firmware used before.
+ *  Heap allocations of the bench thread are counted, malloc() and friends
+ *  are wrapped by the linker. The OTA pipeline downloads from the HTTP
+ *  stand-in, throttled, into flash with the erase and write times of a chip.
+ *
+ *  Usage: bench [scale], scale 1 is a short smoke run, default 10.
+ *  The numbers compare firmware revisions on the same machine, they are
+ *  not the times of the ESP32.
+ ******************************************************************************
+ */
+
+/****************************** Includes  */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/param.h>
+#include <zlib.h>
+#include "esp_log.h"
+#include "esp_event.h"
+#include "esp_partition.h"
+#include "esp_app_format.h"
+#include "esp_ota_ops.h"
+#include "nvs.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "host.h"
+
+#include "msgpool.h"
+#include "jsondec.h"
+#include "namehash.h"
+#include "codec.h"
+#include "topictrie.h"
+#include "latency.h"
+#include "txlog.h"
+#include "otadec.h"
+#include "ota.h"
+#include "jobs.h"
+#include "settings.h"
+#include "mqtt.h"
+#include "sysmem.h"
+#ifdef BENCH_CJSON
+#include "cJSON.h"
+#endif
+
+/****************************** Configuration */
+#define BENCH_TOPIC     "iotbase/30aea4010203/cmd"
+#define BENCH_BASE      "IoT_240ac4123456"  // Base topic of mqtt.c with the host MAC
+#define BENCH_RXQUEUE   16              // Length of the RX queue of the bench subscriptions
+#define BENCH_FRAGMENT  1024            // Data per client event, the default buffer of esp-mqtt
+#define BENCH_COMMAND   "{\"cmd\":\"set\",\"payload\":\"TELEMETRY.PERIOD=30000\"}"
+#define BENCH_RXPOOL    4096            // Size of the RX pool
+#define BENCH_OTA_SIZE  (512 * 1024)    // Size of the OTA test image
+#define BENCH_OTA_CHUNK 4096            // Received bytes per OtaDec_Write()
+#define BENCH_TXLOG_SIZE (448 * 1024)   // Size of the txlog partition, as partitions.csv
+#define BENCH_PIPE_SIZE (64 * 1024)     // Image of the OTA pipeline per scale, max 512 KB
+#define BENCH_PIPE_MS   60000           // Max duration of one update
+#define BENCH_ERASE_US  20000           // Sector erase of the flash chip
+#define BENCH_WRITE_US  1500            // Writing 1 kB to the flash chip
+
+/****************************** Statics */
+static uint32_t Scale = 10;
+static __thread bool isCounting = false;    // Count the allocations of this thread
+static __thread uint32_t Allocs = 0;
+
+void * __real_malloc(size_t Size);
+void * __real_calloc(size_t Count, size_t Size);
+void * __real_realloc(void * pData, size_t Size);
+
+// The RX message before the pool: Fixed size, copied into the queue
+typedef struct OldRxMessage {
+    char    Topic[250];
+    char    Payload[128];
+} OldRxMessage;
+
+typedef struct BenchCommand {
+    char    Cmd[16];
+    char    Payload[256];
+    char    Sha256[65];
+} BenchCommand;
+
+static const JsonDec_Field CommandFields[] = {
+    JSONDEC_FIELD_STRING(BenchCommand, Cmd, "cmd"),
+    JSONDEC_FIELD_STRING(BenchCommand, Payload, "payload"),
+    JSONDEC_FIELD_STRING(BenchCommand, Sha256, "sha256"),
+};
+
+// The names of the command table
+static const char * const CommandNames[] = {
+    "fwupdate", "restart", "cancel", "selftest", "perf", "latency", "ping", "set",
+};
+#define BENCH_COMMANDS (sizeof(CommandNames)/sizeof(CommandNames[0]))
+
+// Receiver of the decoded OTA image
+typedef struct BenchOtaOutput {
+    const esp_partition_t * pPart;
+    size_t      Offset;
+} BenchOtaOutput;
+
+// A setup of the OTA pipeline: Network rate and flash timing
+typedef struct BenchPipe {
+    const char * Name;
+    uint32_t    RateKBs;                // Network in kB/s, 0 unlimited
+    uint32_t    EraseUs;                // Sector erase, 0 none
+    uint32_t    WriteUsKb;              // Writing 1 kB, 0 none
+} BenchPipe;
+
+static const BenchPipe Pipes[] = {
+    { "ota: pipe network",  400,  0,              0 },
+    { "ota: pipe flash",    0,    BENCH_ERASE_US, BENCH_WRITE_US },
+    { "ota: pipe both",     150,  BENCH_ERASE_US, BENCH_WRITE_US },
+};
+
+static SemaphoreHandle_t xRestarted = NULL;    // Given by esp_restart() at the end of an update
+
+/****************************** Functions */
+
+static uint64_t bench_now_ns(void) {
+    struct timespec Now;
+    clock_gettime(CLOCK_MONOTONIC, &Now);
+    return (((uint64_t)Now.tv_sec * 1000000000ULL) + Now.tv_nsec);
+}
+
+/**
+ * @brief Heap allocations: Counted while isCounting is set
+ */
+void * __wrap_malloc(size_t Size) {
+    Allocs += isCounting;
+    return (__real_malloc(Size));
+}
+
+void * __wrap_calloc(size_t Count, size_t Size) {
+    Allocs += isCounting;
+    return (__real_calloc(Count, Size));
+}
+
+void * __wrap_realloc(void * pData, size_t Size) {
+    Allocs += isCounting;
+    return (__real_realloc(pData, Size));
+}
+
+static void bench_count_start(void) {
+    Allocs = 0;
+    isCounting = true;
+}
+
+/**
+ * @brief Stop counting
+ *
+ * @return uint32_t Allocations since bench_count_start()
+ */
+static uint32_t bench_count_stop(void) {
+    isCounting = false;
+    return (Allocs);
+}
+
+static void bench_result(const char * Name, uint64_t Ns, uint32_t Ops, const char * Extra) {
+    printf("%-24s %9lu ops %10.1f ns/op  %s\n", Name, (unsigned long)Ops, (double)Ns / Ops, Extra);
+}
+
+/**
+ * @brief Connect mqtt.c to the broker stand-in, once
+ */
+static void bench_mqtt_start(void) {
+    static bool isStarted = false;
+    nvs_handle_t Handle;
+
+    if (isStarted) {
+        return;
+    }
+    nvs_open("SETTINGS", NVS_READWRITE, &Handle);
+    nvs_set_str(Handle, "MQTT_URL", "mqtt://127.0.0.1");
+    nvs_close(Handle);
+    ESP_ERROR_CHECK(Settings_Init());
+    ESP_ERROR_CHECK(esp_event_loop_create_default());
+
+    // No store-and-forward, bench_txlog() has the partition
+    esp_log_level_set("*", ESP_LOG_ERROR);
+    ESP_ERROR_CHECK(MQTT_Init());
+    esp_log_level_set("*", ESP_LOG_WARN);
+    ESP_ERROR_CHECK(MQTT_Start());
+    ESP_ERROR_CHECK(MQTT_WaitConnected(portMAX_DELAY));
+    isStarted = true;
+}
+
+/**
+ * @brief RX path: Fixed message copied through the queue vs. pool slot with a handle,
+ * then the whole path from the client event into a subscribed queue
+ */
+static void bench_rx(void) {
+    static uint8_t PoolBuffer[BENCH_RXPOOL] __attribute__((aligned(4)));
+    const uint32_t Count = 20000 * Scale;
+    const size_t TopicLen = strlen(BENCH_TOPIC) + 1;
+    const size_t PayloadLen = strlen(BENCH_COMMAND);
+    char Extra[64];
+    MsgPool Pool;
+
+    // Before: Stack buffer, topic copied twice, message cleared and copied through the queue
+    QueueHandle_t xOld = xQueueCreate(10, sizeof(OldRxMessage));
+    uint64_t Start = bench_now_ns();
+    for (uint32_t i = 0; i < Count; i++) {
+        char Buffer[250];
+        OldRxMessage Msg;
+        memset(Buffer, 0x00, sizeof(Buffer));
+        memcpy(Buffer, BENCH_TOPIC, TopicLen);
+        memset(&Msg, 0x00, sizeof(Msg));
+        memcpy(Msg.Topic, Buffer, TopicLen);
+        memcpy(Msg.Payload, BENCH_COMMAND, PayloadLen);
+        xQueueSend(xOld, &Msg, 0);
+        xQueueReceive(xOld, &Msg, 0);
+    }
+    snprintf(Extra, sizeof(Extra), "%u bytes moved/msg",
+             (unsigned)(250 + (2 * TopicLen) + PayloadLen + (3 * sizeof(OldRxMessage))));
+    bench_result("rx: fixed copy", bench_now_ns() - Start, Count, Extra);
+    vQueueDelete(xOld);
+
+    // After: One copy into a pool slot, the queue carries the pointer
+    QueueHandle_t xNew = xQueueCreate(10, sizeof(void*));
+    MsgPool_Init(&Pool, PoolBuffer, sizeof(PoolBuffer));
+    Start = bench_now_ns();
+    for (uint32_t i = 0; i < Count; i++) {
+        uint8_t * pSlot = MsgPool_Alloc(&Pool, TopicLen + PayloadLen);
+        memcpy(pSlot, BENCH_TOPIC, TopicLen);
+        memcpy(&pSlot[TopicLen], BENCH_COMMAND, PayloadLen);
+        xQueueSend(xNew, &pSlot, 0);
+        xQueueReceive(xNew, &pSlot, 0);
+        MsgPool_Release(&Pool, pSlot);
+    }
+    snprintf(Extra, sizeof(Extra), "%u bytes moved/msg", (unsigned)(TopicLen + PayloadLen + (2 * sizeof(void*))));
+    bench_result("rx: pool slot", bench_now_ns() - Start, Count, Extra);
+    vQueueDelete(xNew);
+
+    // Event of the client until the consumer has the message, one at a time
+    const uint32_t Events = 2000 * Scale;
+    HostMqtt_Stats Before, After;
+    MQTT_RXMessage * pMsg;
+    bench_mqtt_start();
+    QueueHandle_t xRx = MQTT_CreateRxQueue(BENCH_RXQUEUE);
+    MQTT_Subscribe("bench/rx", xRx);
+    HostMqtt_GetStats(&Before);
+    Start = bench_now_ns();
+    for (uint32_t i = 0; i < Events; i++) {
+        HostMqtt_Inject(BENCH_BASE "/bench/rx", BENCH_COMMAND, PayloadLen, 0);
+        xQueueReceive(xRx, &pMsg, portMAX_DELAY);
+        MQTT_RxRelease(pMsg);
+    }
+    const uint64_t Ns = bench_now_ns() - Start;
+    HostMqtt_GetStats(&After);
+    const uint32_t Handled = After.DataEvents - Before.DataEvents;
+    snprintf(Extra, sizeof(Extra), "%.0f ns in handler/msg, max %u ns",
+             (double)(After.HandlerNs - Before.HandlerNs) / ((0 != Handled) ? Handled : 1), After.HandlerMaxNs);
+    bench_result("rx: event to consumer", Ns, Events, Extra);
+    MQTT_Unsubscribe("bench/rx");
+}  // bench_rx
+
+/**
+ * @brief Reassembly of fragmented payloads of 1 KB to MAX_PAYLOAD in the RX pool
+ */
+static void bench_reassembly(void) {
+    static uint8_t Payload[MAX_PAYLOAD];
+    MQTT_RXMessage * pMsg;
+    char Name[32];
+    char Extra[64];
+
+    for (size_t i = 0; i < sizeof(Payload); i++) {
+        Payload[i] = (uint8_t)i;
+    }
+    bench_mqtt_start();
+    QueueHandle_t xRx = MQTT_CreateRxQueue(BENCH_RXQUEUE);
+    MQTT_Subscribe("bench/blob", xRx);
+
+    // Sizes ascend, so the pool peak is the one of the current size
+    for (size_t Size = 1024; Size <= MAX_PAYLOAD; Size *= 2) {
+        const uint32_t Count = (256 * 1024 * Scale) / Size;
+        uint32_t Bad = 0;
+        const uint64_t Start = bench_now_ns();
+        for (uint32_t i = 0; i < Count; i++) {
+            HostMqtt_Inject(BENCH_BASE "/bench/blob", Payload, Size, BENCH_FRAGMENT);
+            xQueueReceive(xRx, &pMsg, portMAX_DELAY);
+            Bad += (Size != pMsg->PayloadLen) || (0 != memcmp(pMsg->Payload, Payload, Size));
+            MQTT_RxRelease(pMsg);
+        }
+        const uint64_t Ns = bench_now_ns() - Start;
+        snprintf(Name, sizeof(Name), "rx: reassemble %u KB", (unsigned)(Size / 1024));
+        snprintf(Extra, sizeof(Extra), "%.1f MB/s, pool peak %u KB%s", (double)Size * Count * 1000 / Ns,
+                 (unsigned)(SysMem_GetPeak("mqtt_rxpool") / 1024), (0 != Bad) ? ", CORRUPT" : "");
+        bench_result(Name, Ns, Count, Extra);
+    }
+    MQTT_Unsubscribe("bench/blob");
+}  // bench_reassembly
+
+#ifdef BENCH_CJSON
+/**
+ * @brief Command decode as in TaskCommand before: Tree of cJSON, lookups, copies
+ */
+static void bench_cjson_command(const char * pJson, BenchCommand * pCmd) {
+    cJSON * pRoot = cJSON_Parse(pJson);
+
+    if (NULL == pRoot) {
+        return;
+    }
+    const cJSON * pItem = cJSON_GetObjectItemCaseSensitive(pRoot, "cmd");
+    if (cJSON_IsString(pItem)) {
+        strlcpy(pCmd->Cmd, pItem->valuestring, sizeof(pCmd->Cmd));
+    }
+    pItem = cJSON_GetObjectItemCaseSensitive(pRoot, "payload");
+    if (cJSON_IsString(pItem)) {
+        strlcpy(pCmd->Payload, pItem->valuestring, sizeof(pCmd->Payload));
+    }
+    pItem = cJSON_GetObjectItemCaseSensitive(pRoot, "sha256");
+    if (cJSON_IsString(pItem)) {
+        strlcpy(pCmd->Sha256, pItem->valuestring, sizeof(pCmd->Sha256));
+    }
+    cJSON_Delete(pRoot);
+}
+#endif
+
+/**
+ * @brief Command decode, JSON and CBOR, against cJSON
+ */
+static void bench_command(void) {
+    const uint32_t Count = 50000 * Scale;
+    uint8_t Cbor[128];
+    size_t CborLen = 0;
+    BenchCommand Cmd;
+    Codec_Writer Writer;
+    char Extra[64];
+
+    Codec_Begin(&Writer, CODEC_CBOR, Cbor, sizeof(Cbor));
+    Codec_AddString(&Writer, "cmd", "set");
+    Codec_AddString(&Writer, "payload", "TELEMETRY.PERIOD=30000");
+    Codec_End(&Writer, &CborLen);
+
+#ifdef BENCH_CJSON
+    bench_count_start();
+    uint64_t Start = bench_now_ns();
+    for (uint32_t i = 0; i < Count; i++) {
+        bench_cjson_command(BENCH_COMMAND, &Cmd);
+    }
+    uint64_t Ns = bench_now_ns() - Start;
+    snprintf(Extra, sizeof(Extra), "%u bytes, %.1f allocs/cmd", (unsigned)strlen(BENCH_COMMAND), (double)bench_count_stop() / Count);
+    bench_result("command: decode cjson", Ns, Count, Extra);
+#else
+    uint64_t Start, Ns;
+    printf("%-24s not built, no cJSON found\n", "command: decode cjson");
+#endif
+
+    bench_count_start();
+    Start = bench_now_ns();
+    for (uint32_t i = 0; i < Count; i++) {
+        Codec_DecodeObject(BENCH_COMMAND, strlen(BENCH_COMMAND), CommandFields, 3, &Cmd, NULL);
+    }
+    Ns = bench_now_ns() - Start;
+    snprintf(Extra, sizeof(Extra), "%u bytes, %.1f allocs/cmd", (unsigned)strlen(BENCH_COMMAND), (double)bench_count_stop() / Count);
+    bench_result("command: decode json", Ns, Count, Extra);
+
+    bench_count_start();
+    Start = bench_now_ns();
+    for (uint32_t i = 0; i < Count; i++) {
+        Codec_DecodeObject(Cbor, CborLen, CommandFields, 3, &Cmd, NULL);
+    }
+    Ns = bench_now_ns() - Start;
+    snprintf(Extra, sizeof(Extra), "%u bytes, %.1f allocs/cmd", (unsigned)CborLen, (double)bench_count_stop() / Count);
+    bench_result("command: decode cbor", Ns, Count, Extra);
+
+    NameHash Hash;
+    volatile int Found = 0;
+    NameHash_Build(&Hash, CommandNames, BENCH_COMMANDS, sizeof(CommandNames[0]));
+    Start = bench_now_ns();
+    for (uint32_t i = 0; i < Count; i++) {
+        Found += NameHash_Find(&Hash, CommandNames[i % BENCH_COMMANDS]);
+    }
+    snprintf(Extra, sizeof(Extra), "%u names", (unsigned)BENCH_COMMANDS);
+    bench_result("command: lookup", bench_now_ns() - Start, Count, Extra);
+}  // bench_command
+
+#ifdef BENCH_CJSON
+/**
+ * @brief Status encoding as in TaskSysStats before: Tree of cJSON, printed into a heap string
+ *
+ * @param isPretty cJSON_Print() as before, else cJSON_PrintUnformatted()
+ * @return size_t Bytes on the wire
+ */
+static size_t bench_cjson_status(uint32_t Uptime, bool isPretty) {
+    cJSON * pRoot = cJSON_CreateObject();
+
+    cJSON_AddNumberToObject(pRoot, "uptime", Uptime);
+    cJSON_AddNumberToObject(pRoot, "heap", 142336);
+    cJSON_AddNumberToObject(pRoot, "heapmin", 120112);
+    cJSON_AddNumberToObject(pRoot, "rssi", -67);
+    cJSON_AddNumberToObject(pRoot, "memres", 41216);
+    cJSON_AddNumberToObject(pRoot, "memused", 30117);
+    cJSON_AddNumberToObject(pRoot, "wifiout", 3);
+    cJSON_AddNumberToObject(pRoot, "wifioutms", 18250);
+    cJSON_AddNumberToObject(pRoot, "mqttout", 4);
+    cJSON_AddNumberToObject(pRoot, "mqttoutms", 21400);
+    cJSON_AddNumberToObject(pRoot, "txlog", 0);
+    cJSON_AddStringToObject(pRoot, "version", "1.4.2");
+    cJSON_AddBoolToObject(pRoot, "key", false);
+    char * pText = isPretty ? cJSON_Print(pRoot) : cJSON_PrintUnformatted(pRoot);
+    const size_t Length = (NULL != pText) ? strlen(pText) : 0;
+    cJSON_free(pText);
+    cJSON_Delete(pRoot);
+    return (Length);
+}
+#endif
+
+/**
+ * @brief Status encoding, the fields of the telemetry, against cJSON
+ */
+static void bench_status(void) {
+    static const Codec_Format Formats[] = { CODEC_JSON, CODEC_CBOR };
+    static const char * const Names[] = { "status: encode json", "status: encode cbor" };
+    const uint32_t Count = 50000 * Scale;
+    uint8_t Buffer[512];
+    size_t Length = 0;
+    char Extra[64];
+
+#ifdef BENCH_CJSON
+    static const char * const CjsonNames[] = { "status: encode cjson", "status: encode cjson min" };
+    for (int Pretty = 1; Pretty >= 0; Pretty--) {
+        bench_count_start();
+        const uint64_t Start = bench_now_ns();
+        for (uint32_t i = 0; i < Count; i++) {
+            Length = bench_cjson_status(86400 + i, Pretty);
+        }
+        const uint64_t Ns = bench_now_ns() - Start;
+        snprintf(Extra, sizeof(Extra), "%u bytes, %.1f allocs/status", (unsigned)Length, (double)bench_count_stop() / Count);
+        bench_result(CjsonNames[1 - Pretty], Ns, Count, Extra);
+    }
+#else
+    printf("%-24s not built, no cJSON found\n", "status: encode cjson");
+#endif
+
+    for (size_t f = 0; f < 2; f++) {
+        bench_count_start();
+        const uint64_t Start = bench_now_ns();
+        for (uint32_t i = 0; i < Count; i++) {
+            Codec_Writer Writer;
+            Codec_Begin(&Writer, Formats[f], Buffer, sizeof(Buffer));
+            Codec_AddInt(&Writer, "uptime", 86400 + i);
+            Codec_AddInt(&Writer, "heap", 142336);
+            Codec_AddInt(&Writer, "heapmin", 120112);
+            Codec_AddInt(&Writer, "rssi", -67);
+            Codec_AddInt(&Writer, "memres", 41216);
+            Codec_AddInt(&Writer, "memused", 30117);
+            Codec_AddInt(&Writer, "wifiout", 3);
+            Codec_AddInt(&Writer, "wifioutms", 18250);
+            Codec_AddInt(&Writer, "mqttout", 4);
+            Codec_AddInt(&Writer, "mqttoutms", 21400);
+            Codec_AddInt(&Writer, "txlog", 0);
+            Codec_AddString(&Writer, "version", "1.4.2");
+            Codec_AddBool(&Writer, "key", false);
+            Codec_End(&Writer, &Length);
+        }
+        const uint64_t Ns = bench_now_ns() - Start;
+        snprintf(Extra, sizeof(Extra), "%u bytes, %.1f allocs/status", (unsigned)Length, (double)bench_count_stop() / Count);
+        bench_result(Names[f], Ns, Count, Extra);
+    }
+}  // bench_status
+
+static void bench_match_cb(int Node, void * pArg) {
+    (*(uint32_t*)pArg)++;
+}
+
+/**
+ * @brief Routing of received topics through the trie
+ */
+static void bench_trie(void) {
+    static const char * const Filters[] = {
+        "iotbase/30aea4010203/cmd", "iotbase/30aea4010203/config/#", "iotbase/+/broadcast",
+        "iotbase/30aea4010203/ota/+", "iotbase/group/+/cmd", "iotbase/#",
+    };
+    static const char * const Topics[] = {
+        "iotbase/30aea4010203/cmd", "iotbase/30aea4010203/config/wifi/ssid", "iotbase/all/broadcast",
+        "iotbase/other/status",
+    };
+    const uint32_t Count = 100000 * Scale;
+    uint32_t Matches = 0;
+    TopicTrie Trie;
+    char Extra[64];
+
+    TopicTrie_Init(&Trie);
+    for (size_t i = 0; i < sizeof(Filters)/sizeof(Filters[0]); i++) {
+        TopicTrie_Insert(&Trie, Filters[i]);
+    }
+    const uint64_t Start = bench_now_ns();
+    for (uint32_t i = 0; i < Count; i++) {
+        TopicTrie_Match(&Trie, Topics[i % 4], bench_match_cb, &Matches);
+    }
+    snprintf(Extra, sizeof(Extra), "%.2f matches/topic", (double)Matches / Count);
+    bench_result("trie: match", bench_now_ns() - Start, Count, Extra);
+}  // bench_trie
+
+/**
+ * @brief Recording of command latencies
+ */
+static void bench_latency(void) {
+    const uint32_t Count = 200000 * Scale;
+    Latency_Hist Hist;
+    char Extra[64];
+
+    Latency_Reset(&Hist);
+    const uint64_t Start = bench_now_ns();
+    for (uint32_t i = 0; i < Count; i++) {
+        Latency_Record(&Hist, (i * 2654435761U) >> 12);
+    }
+    const uint64_t Ns = bench_now_ns() - Start;
+    snprintf(Extra, sizeof(Extra), "p99 %lu us", (unsigned long)Latency_Percentile(&Hist, 99));
+    bench_result("latency: record", Ns, Count, Extra);
+}
+
+/**
+ * @brief OTA output: Write the image to the partition, erasing ahead as esp_ota_write()
+ */
+static esp_err_t bench_ota_output(void * pArg, const uint8_t * pData, size_t Length) {
+    BenchOtaOutput * pOut = pArg;
+
+    if ((pOut->Offset + Length) > pOut->pPart->size) {
+        return (ESP_ERR_INVALID_SIZE);
+    }
+    const size_t First = (pOut->Offset + HOST_FLASH_SECTOR - 1) / HOST_FLASH_SECTOR;
+    const size_t Last = (pOut->Offset + Length + HOST_FLASH_SECTOR - 1) / HOST_FLASH_SECTOR;
+    if (Last > First) {
+        esp_partition_erase_range(pOut->pPart, First * HOST_FLASH_SECTOR, (Last - First) * HOST_FLASH_SECTOR);
+    }
+    esp_err_t ret = esp_partition_write(pOut->pPart, pOut->Offset, pData, Length);
+    pOut->Offset += Length;
+    return (ret);
+}  // bench_ota_output
+
+/**
+ * @brief Run one OTA image through the decoder into the partition
+ */
+static void bench_ota_run(const char * Name, const esp_partition_t * pPart, const uint8_t * pImage, size_t Length, size_t Decoded) {
+    const uint32_t Count = Scale;
+    char Extra[64];
+    OtaDec Dec;
+
+    const uint64_t Start = bench_now_ns();
+    for (uint32_t i = 0; i < Count; i++) {
+        BenchOtaOutput Out = { .pPart = pPart, .Offset = 0 };
+        esp_err_t ret = OtaDec_Init(&Dec, NULL, bench_ota_output, &Out);
+        for (size_t Offset = 0; (Offset < Length) && (ESP_OK == ret); Offset += BENCH_OTA_CHUNK) {
+            const size_t Chunk = ((Length - Offset) < BENCH_OTA_CHUNK) ? (Length - Offset) : BENCH_OTA_CHUNK;
+            ret = OtaDec_Write(&Dec, &pImage[Offset], Chunk);
+        }
+        if (ESP_OK == ret) {
+            ret = OtaDec_Finish(&Dec);
+        }
+        OtaDec_Free(&Dec);
+        if ((ESP_OK != ret) || (Out.Offset != Decoded)) {
+            printf("%s: Failed (%s)\n", Name, esp_err_to_name(ret));
+            exit(1);
+        }
+    }
+    const uint64_t Ns = bench_now_ns() - Start;
+    snprintf(Extra, sizeof(Extra), "%.1f MB/s, %u of %u bytes received", ((double)Decoded * Count * 1000.0) / Ns,
+             (unsigned)Length, (unsigned)Decoded);
+    bench_result(Name, Ns, Count, Extra);
+}  // bench_ota_run
+
+/**
+ * @brief OTA write path: Plain and compressed image
+ */
+static void bench_ota(void) {
+    const esp_partition_t * pPart = HostFlash_AddPartition("ota_0", ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_APP_OTA_0, NULL, 1536 * 1024);
+    uint8_t * pImage = malloc(BENCH_OTA_SIZE);
+    uint8_t * pContainer = malloc(OTADEC_HEADERSIZE + BENCH_OTA_SIZE + 1024);
+    z_stream Stream;
+
+    // Image with code-like redundancy: Repeated words with some noise
+    srand(1);
+    pImage[0] = 0xE9;
+    for (size_t i = 1; i < BENCH_OTA_SIZE; i++) {
+        pImage[i] = (0 == (rand() % 8)) ? (uint8_t)rand() : pImage[i - ((i > 64) ? 64 : 1)];
+    }
+    bench_ota_run("ota: plain", pPart, pImage, BENCH_OTA_SIZE, BENCH_OTA_SIZE);
+
+    // Container with a raw deflate stream, window as tools/otaimage.py
+    memset(pContainer, 0x00, OTADEC_HEADERSIZE);
+    memcpy(pContainer, "IOTU", 4);
+    pContainer[4] = OTADEC_VERSION;
+    pContainer[5] = OTADEC_FLAG_DEFLATE;
+    pContainer[6] = OTADEC_MAX_WINDOWBITS;
+    pContainer[8] = BENCH_OTA_SIZE & 0xFF;
+    pContainer[9] = (BENCH_OTA_SIZE >> 8) & 0xFF;
+    pContainer[10] = (BENCH_OTA_SIZE >> 16) & 0xFF;
+    pContainer[11] = (BENCH_OTA_SIZE >> 24) & 0xFF;
+    memset(&Stream, 0x00, sizeof(Stream));
+    deflateInit2(&Stream, 9, Z_DEFLATED, -OTADEC_MAX_WINDOWBITS, 9, Z_DEFAULT_STRATEGY);
+    Stream.next_in = pImage;
+    Stream.avail_in = BENCH_OTA_SIZE;
+    Stream.next_out = &pContainer[OTADEC_HEADERSIZE];
+    Stream.avail_out = BENCH_OTA_SIZE + 1024;
+    deflate(&Stream, Z_FINISH);
+    const size_t Length = OTADEC_HEADERSIZE + Stream.total_out;
+    deflateEnd(&Stream);
+    bench_ota_run("ota: deflate", pPart, pContainer, Length, BENCH_OTA_SIZE);
+
+    free(pContainer);
+    free(pImage);
+}  // bench_ota
+
+/**
+ * @brief Restart hook: The OTA job ends in esp_restart()
+ */
+static void bench_on_restart(void) {
+    xSemaphoreGive(xRestarted);
+}
+
+/**
+ * @brief OTA pipeline: OTA_Job downloads from the HTTP stand-in into the next partition
+ *
+ * The network reader and the flash writer overlap, the total time is below
+ * the sum of network and flash time. The wait times show the bottleneck.
+ */
+static void bench_ota_pipeline(void) {
+    const esp_partition_t * pOta0 = esp_partition_find_first(ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_APP_OTA_0, NULL);
+    const size_t Size = (Scale < 8) ? (Scale * BENCH_PIPE_SIZE) : (8 * BENCH_PIPE_SIZE);
+    uint8_t * pImage = malloc(Size);
+    esp_image_header_t Header = { .magic = ESP_IMAGE_HEADER_MAGIC, .segment_count = 1, .chip_id = CONFIG_IDF_FIRMWARE_CHIP_ID };
+    esp_image_segment_header_t Segment = { .load_addr = 0x3f400020, .data_len = Size - sizeof(Header) - sizeof(Segment) };
+    esp_app_desc_t Desc = { .magic_word = ESP_APP_DESC_MAGIC_WORD, .version = "bench", .project_name = "IoTBase" };
+    OTA_Request Request = { .hasSha256 = false };
+    OTA_Stats Stats;
+    char Extra[128];
+
+    HostFlash_AddPartition("ota_1", ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_APP_OTA_1, NULL, 1536 * 1024);
+    HostOta_SetRunning(pOta0, ESP_OTA_IMG_VALID);
+    for (size_t i = 0; i < Size; i++) {
+        pImage[i] = (uint8_t)(i * 7);
+    }
+    memcpy(pImage, &Header, sizeof(Header));
+    memcpy(pImage + sizeof(Header), &Segment, sizeof(Segment));
+    memcpy(pImage + sizeof(Header) + sizeof(Segment), &Desc, sizeof(Desc));
+
+    HostTimer_SetRealTime();            // OTA_Stats are taken with esp_timer_get_time()
+    bench_mqtt_start();                 // Progress of the jobs
+    Jobs_Init();
+    xRestarted = xSemaphoreCreateBinary();
+    HostSystem_SetRestartHook(bench_on_restart);
+
+    for (int i = 0; i < sizeof(Pipes)/sizeof(Pipes[0]); i++) {
+        const HostHttp_Options Options = { .RateKBs = Pipes[i].RateKBs };
+        const int Port = HostHttp_Serve(pImage, Size, &Options);
+        snprintf(Request.Url, sizeof(Request.Url), "http://127.0.0.1:%d/fw.bin", Port);
+        HostFlash_SetTiming(Pipes[i].EraseUs, Pipes[i].WriteUsKb);
+
+        const uint64_t Start = bench_now_ns();
+        if ((Port <= 0) || (0 == Jobs_Submit("ota", OTA_Job, &Request, sizeof(Request), OTA_STACKSIZE, OTA_READER_CORE))
+            || (pdTRUE != xSemaphoreTake(xRestarted, pdMS_TO_TICKS(BENCH_PIPE_MS)))) {
+            printf("%s: Failed\n", Pipes[i].Name);
+            exit(1);
+        }
+        const uint64_t Ns = bench_now_ns() - Start;
+        HostFlash_SetTiming(0, 0);
+        HostHttp_Stop();
+
+        OTA_GetStats(&Stats);
+        snprintf(Extra, sizeof(Extra), "%.2f MB/s, total %lu ms (network %lu, flash %lu), waiting on network %lu ms, on flash %lu ms",
+                 (double)Stats.Bytes / 1048.576 / MAX(Stats.TotalMs, 1), (unsigned long)Stats.TotalMs,
+                 (unsigned long)Stats.NetworkMs, (unsigned long)Stats.FlashMs,
+                 (unsigned long)Stats.NetworkWaitMs, (unsigned long)Stats.FlashWaitMs);
+        bench_result(Pipes[i].Name, Ns, 1, Extra);
+    }
+
+    HostSystem_SetRestartHook(NULL);
+    vSemaphoreDelete(xRestarted);
+    free(pImage);
+}  // bench_ota_pipeline
+
+/**
+ * @brief Store-and-forward log: Append while offline, replay after the reconnect
+ */
+static void bench_txlog(void) {
+    const esp_partition_t * pPart = HostFlash_AddPartition(TXLOG_PARTITION, ESP_PARTITION_TYPE_DATA, 0x40, NULL, BENCH_TXLOG_SIZE);
+    const uint32_t Count = 2000 * Scale;
+    char Payload[160];
+    char Buffer[TXLOG_MAX_RECORD];
+    const char * pSubTopic;
+    const char * pData;
+    size_t Length;
+    HostFlash_Stats Flash;
+    TxLog_Stats Stats;
+    char Extra[96];
+
+    if (ESP_OK != TxLog_Init()) {
+        printf("txlog: Init failed\n");
+        exit(1);
+    }
+    HostFlash_ResetStats(pPart);
+
+    uint64_t Start = bench_now_ns();
+    uint64_t Bytes = 0;
+    for (uint32_t i = 0; i < Count; i++) {
+        const int PayloadLen = snprintf(Payload, sizeof(Payload), "{\"uptime\":%lu,\"heap\":142336,\"rssi\":-67,\"memused\":30117}", (unsigned long)i);
+        TxLog_Append("status", Payload, PayloadLen);
+        Bytes += PayloadLen + sizeof("status");
+    }
+    HostFlash_GetStats(pPart, &Flash);
+    TxLog_GetStats(&Stats);
+    snprintf(Extra, sizeof(Extra), "%.1f erases/MB, max %lu per sector, %lu dropped",
+             (double)Flash.Erases * 1048576.0 / Bytes, (unsigned long)Flash.MaxSectorErases, (unsigned long)Stats.Dropped);
+    bench_result("txlog: append", bench_now_ns() - Start, Count, Extra);
+
+    uint32_t Replayed = 0;
+    Start = bench_now_ns();
+    while (ESP_OK == TxLog_Peek(Buffer, sizeof(Buffer), &pSubTopic, &pData, &Length)) {
+        TxLog_Pop();
+        Replayed++;
+    }
+    HostFlash_GetStats(pPart, &Flash);
+    snprintf(Extra, sizeof(Extra), "%.2f flash bytes written/byte", (double)Flash.BytesWritten / Bytes);
+    bench_result("txlog: replay", bench_now_ns() - Start, (0 != Replayed) ? Replayed : 1, Extra);
+}  // bench_txlog
+
+int main(int argc, char ** argv) {
+    if (argc > 1) {
+        Scale = strtoul(argv[1], NULL, 0);
+        Scale = (0 != Scale) ? Scale : 1;
+    }
+    esp_log_level_set("*", ESP_LOG_WARN);
+    HostRandom_Seed(1);
+#ifdef BENCH_CJSON
+    // Here malloc is the counting one, so a shared cJSON library is counted as well
+    cJSON_Hooks Hooks = { .malloc_fn = malloc, .free_fn = free };
+    cJSON_InitHooks(&Hooks);
+#endif
+
+    bench_rx();
+    bench_reassembly();
+    bench_command();
+    bench_status();
+    bench_trie();
+    bench_latency();
+    bench_ota();
+    bench_ota_pipeline();
+    bench_txlog();
+    return (0);
+}  // main
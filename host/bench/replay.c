@@ -0,0 +1,364 @@
+/**
+ ******************************************************************************
+ *  file           : replay.c
+ *  brief          : Host replay of captured MQTT traffic into mqtt_event_handler
+ *
+ *  Usage: replay [-s speed] [-x exclude] <file>
+ *
+ *  The file is written by tools/mqttreplay.py capture. The whole firmware
+ *  runs on the client mocks, every message is injected by the broker
+ *  stand-in at its recorded time divided by speed (0: unthrottled) and
+ *  passes mqtt_event_handler, the RX queue and the command task as on the
+ *  target. Commands in exclude (default restart,fwupdate,cancel) are
+ *  skipped. The report is the one of mqttreplay.py replay: dropped
+ *  commands, queue high water and the latency percentiles of the
+ *  "latency" command, plus the time in mqtt_event_handler and the CPU time
+ *  of the process per message.
+ ******************************************************************************
+ */
+
+/****************************** Includes  */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "esp_log.h"
+#include "nvs.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "host.h"
+#include "txlog.h"
+#include "jsondec.h"
+#include "mqtt.h"
+#include "commands.h"
+
+/****************************** Configuration */
+#define REPLAY_MAGIC    "MQRP\x01"      // Start of a capture file
+#define REPLAY_BASE     "IoT_240ac4123456"  // Base topic of the host MAC
+#define REPLAY_MAX_MESSAGES 100000      // Max messages of a capture
+#define REPLAY_MAX_PAYLOAD (1024 * 1024)    // Max payload of a message
+#define REPLAY_ANSWER_MS 20000          // Max wait for the boot report and the latency answers
+#define REPLAY_SETTLE_MS 2000           // Max wait for the commands after the last message
+#define REPLAY_MAX_ANSWER 2048          // Max size of a latency answer
+
+extern void app_main(void);
+
+typedef struct ReplayMessage {
+    uint64_t    DeltaUs;                // Since the previous message
+    char *      SubTopic;
+    uint8_t *   pPayload;
+    size_t      Length;
+} ReplayMessage;
+
+typedef struct ReplayCommand {
+    char    Cmd[16];
+} ReplayCommand;
+
+static const JsonDec_Field CommandFields[] = {
+    JSONDEC_FIELD_STRING(ReplayCommand, Cmd, "cmd"),
+};
+
+static const char * const Stages[] = { "rx", "queue", "exec", "total" };
+
+/****************************** Statics */
+static ReplayMessage * pMessages = NULL;
+static size_t MessageCount = 0;
+
+// Answers of the device
+static pthread_mutex_t AnswerLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t AnswerCond = PTHREAD_COND_INITIALIZER;
+static bool isBooted = false;
+static uint32_t Answers = 0;            // Latency answers
+static char Answer[REPLAY_MAX_ANSWER];  // The last one
+
+/****************************** Functions */
+
+static uint64_t replay_now_ns(uint32_t Clock) {
+    struct timespec Now;
+    clock_gettime(Clock, &Now);
+    return (((uint64_t)Now.tv_sec * 1000000000ULL) + Now.tv_nsec);
+}
+
+static bool replay_read_varint(FILE * pFile, uint64_t * pValue) {
+    int Shift = 0;
+    int Byte;
+
+    *pValue = 0;
+    do {
+        Byte = fgetc(pFile);
+        if ((EOF == Byte) || (Shift > 56)) {
+            return (false);
+        }
+        *pValue |= (uint64_t)(Byte & 0x7f) << Shift;
+        Shift += 7;
+    } while (0 != (Byte & 0x80));
+    return (true);
+}
+
+/**
+ * @brief Load a capture file
+ *
+ * @param Path The file
+ * @return esp_err_t ESP_ERR_INVALID_VERSION if it is no capture
+ */
+static esp_err_t replay_load(const char * Path) {
+    char Magic[sizeof(REPLAY_MAGIC) - 1];
+    uint64_t Delta, TopicLen, Length;
+    FILE * pFile = fopen(Path, "rb");
+
+    if (NULL == pFile) {
+        return (ESP_ERR_NOT_FOUND);
+    }
+    if ((1 != fread(Magic, sizeof(Magic), 1, pFile)) || (0 != memcmp(Magic, REPLAY_MAGIC, sizeof(Magic)))) {
+        fclose(pFile);
+        return (ESP_ERR_INVALID_VERSION);
+    }
+    pMessages = calloc(REPLAY_MAX_MESSAGES, sizeof(ReplayMessage));
+    while ((NULL != pMessages) && (MessageCount < REPLAY_MAX_MESSAGES) && replay_read_varint(pFile, &Delta)) {
+        ReplayMessage * pMsg = &pMessages[MessageCount];
+        if (!replay_read_varint(pFile, &TopicLen) || (TopicLen > MAX_TOPIC_LEN)) {
+            break;
+        }
+        pMsg->SubTopic = calloc(1, TopicLen + 1);
+        if ((NULL == pMsg->SubTopic) || ((TopicLen > 0) && (1 != fread(pMsg->SubTopic, TopicLen, 1, pFile)))
+         || !replay_read_varint(pFile, &Length) || (Length > REPLAY_MAX_PAYLOAD)) {
+            break;
+        }
+        pMsg->pPayload = malloc(Length + 1);
+        if ((NULL == pMsg->pPayload) || ((Length > 0) && (1 != fread(pMsg->pPayload, Length, 1, pFile)))) {
+            break;
+        }
+        pMsg->DeltaUs = Delta;
+        pMsg->Length = Length;
+        MessageCount++;
+    }
+    fclose(pFile);
+    return ((NULL != pMessages) ? ESP_OK : ESP_ERR_NO_MEM);
+}  // replay_load
+
+/**
+ * @brief Is the message a command in the exclude list?
+ */
+static bool replay_is_excluded(const ReplayMessage * pMsg, const char * Exclude) {
+    ReplayCommand Command = { "" };
+    char Name[sizeof(Command.Cmd) + 2];
+
+    if ((0 != strcmp(pMsg->SubTopic, "cmd"))
+     || (ESP_OK != JsonDec_Object((const char*)pMsg->pPayload, pMsg->Length, CommandFields, 1, &Command, NULL))) {
+        return (false);
+    }
+    snprintf(Name, sizeof(Name), ",%s,", Command.Cmd);
+    return ((NULL != strstr(Exclude, Name)) && ('\0' != Command.Cmd[0]));
+}
+
+/**
+ * @brief Publish hook: The boot report and the latency answers
+ */
+static void replay_on_publish(const char * Topic, const char * pData, int Length, int Qos, void * pArg) {
+    pthread_mutex_lock(&AnswerLock);
+    if (0 == strcmp(Topic, REPLAY_BASE "/boot")) {
+        isBooted = true;
+    } else if (0 == strcmp(Topic, REPLAY_BASE "/latency")) {
+        const int Copy = (Length < REPLAY_MAX_ANSWER) ? Length : REPLAY_MAX_ANSWER - 1;
+        memcpy(Answer, pData, Copy);
+        Answer[Copy] = '\0';
+        Answers++;
+    }
+    pthread_cond_broadcast(&AnswerCond);
+    pthread_mutex_unlock(&AnswerLock);
+}
+
+/**
+ * @brief Wait for the boot report or a further latency answer
+ *
+ * @param pCount Answers seen so far, NULL for the boot report
+ * @return true if it came in time
+ */
+static bool replay_wait_answer(uint32_t * pCount) {
+    struct timespec Deadline;
+    bool isDone;
+
+    clock_gettime(CLOCK_REALTIME, &Deadline);
+    Deadline.tv_sec += REPLAY_ANSWER_MS / 1000;
+    pthread_mutex_lock(&AnswerLock);
+    while (!(isDone = (NULL == pCount) ? isBooted : (Answers > *pCount))
+        && (ETIMEDOUT != pthread_cond_timedwait(&AnswerCond, &AnswerLock, &Deadline))) {
+    }
+    if (NULL != pCount) {
+        *pCount = Answers;
+    }
+    pthread_mutex_unlock(&AnswerLock);
+    return (isDone);
+}
+
+/**
+ * @brief Ask the device for its command latencies
+ *
+ * @param Payload "reset" to clear the histograms after the answer
+ * @param pCount Answers seen so far
+ */
+static bool replay_ask(const char * Payload, uint32_t * pCount) {
+    char Command[64];
+    const int Length = snprintf(Command, sizeof(Command), "{\"cmd\":\"latency\",\"payload\":\"%s\"}", Payload);
+
+    return ((ESP_OK == HostMqtt_Inject(REPLAY_BASE "/cmd", Command, Length, 0)) && replay_wait_answer(pCount));
+}
+
+/**
+ * @brief A number of the last latency answer, JSON as the default codec
+ */
+static long replay_value(const char * Key) {
+    char Pattern[32];
+
+    snprintf(Pattern, sizeof(Pattern), "\"%s\":", Key);
+    pthread_mutex_lock(&AnswerLock);
+    const char * pValue = strstr(Answer, Pattern);
+    const long Value = (NULL != pValue) ? strtol(pValue + strlen(Pattern), NULL, 10) : -1;
+    pthread_mutex_unlock(&AnswerLock);
+    return (Value);
+}
+
+/**
+ * @brief Wait until the command task has handled or dropped a number of commands
+ *
+ * @param Target Processed + dropped to reach
+ * @param pStats The counters
+ * @return true if reached in REPLAY_SETTLE_MS
+ */
+static bool replay_wait_commands(uint32_t Target, Comm_Stats * pStats) {
+    for (uint32_t Waited = 0; Waited < REPLAY_SETTLE_MS; Waited += 10) {
+        Comm_GetStats(pStats);
+        if (pStats->Processed + pStats->Dropped >= Target) {
+            return (true);
+        }
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    return (false);
+}
+
+static void app_task(void * pvParameters) {
+    app_main();
+}
+
+/**
+ * @brief Start the device: Flash layout, settings, then app_main() in its task
+ */
+static void replay_start_device(void) {
+    nvs_handle_t Handle;
+
+    HostTimer_SetRealTime();
+    HostMqtt_SetPublishHook(replay_on_publish, NULL);
+    HostFlash_AddPartition("ota_0", ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_APP_OTA_0, NULL, 256 * 1024);
+    HostFlash_AddPartition(TXLOG_PARTITION, ESP_PARTITION_TYPE_DATA, 0x40, NULL, 16 * HOST_FLASH_SECTOR);
+
+    nvs_open("SETTINGS", NVS_READWRITE, &Handle);
+    nvs_set_str(Handle, "WIFI_SSID", "HostAP");
+    nvs_set_str(Handle, "MQTT_URL", "mqtt://127.0.0.1");
+    nvs_close(Handle);
+    nvs_open("TELEMETRY", NVS_READWRITE, &Handle);
+    nvs_set_u32(Handle, "PERIOD", 1000);
+    nvs_close(Handle);
+
+    xTaskCreate(app_task, "main", 4096, NULL, 1, NULL);
+}
+
+int main(int argc, char ** argv) {
+    char Exclude[128] = ",restart,fwupdate,cancel,";
+    double Speed = 1.0;
+    char Topic[MAX_TOPIC_LEN + 1];
+    uint32_t Count = 0;
+    Comm_Stats Before, After;
+    HostMqtt_Stats MqttBefore, MqttAfter;
+    int Option;
+
+    while (-1 != (Option = getopt(argc, argv, "s:x:"))) {
+        if ('s' == Option) {
+            Speed = strtod(optarg, NULL);
+        } else if ('x' == Option) {
+            snprintf(Exclude, sizeof(Exclude), ",%s,", optarg);
+        } else {
+            break;
+        }
+    }
+    if (optind >= argc) {
+        fprintf(stderr, "Usage: %s [-s speed, 0 unthrottled] [-x restart,fwupdate,cancel] <capture>\n", argv[0]);
+        return (2);
+    }
+    const esp_err_t ret = replay_load(argv[optind]);
+    if (ESP_OK != ret) {
+        fprintf(stderr, "%s: Cannot load (%s)\n", argv[optind], esp_err_to_name(ret));
+        return (1);
+    }
+
+    esp_log_level_set("*", ESP_LOG_NONE);
+    replay_start_device();
+    if (!replay_wait_answer(NULL)) {
+        fprintf(stderr, "Device not ready\n");
+        return (1);
+    }
+    Comm_GetStats(&Before);
+    if (!replay_ask("reset", &Count) || !replay_wait_commands(Before.Processed + Before.Dropped + 1, &Before)) {
+        fprintf(stderr, "No latency answer\n");
+        return (1);
+    }
+    HostMqtt_GetStats(&MqttBefore);
+
+    // Send times are fixed in advance, a late injection does not shift the rest
+    uint32_t Sent = 0, Skipped = 0;
+    const uint64_t Start = replay_now_ns(CLOCK_MONOTONIC);
+    const uint64_t CpuStart = replay_now_ns(CLOCK_PROCESS_CPUTIME_ID);
+    uint64_t DueNs = 0;
+    for (size_t i = 0; i < MessageCount; i++) {
+        const ReplayMessage * pMsg = &pMessages[i];
+        if (Speed > 0) {
+            DueNs += (uint64_t)(pMsg->DeltaUs * 1000.0 / Speed);
+            const uint64_t Now = replay_now_ns(CLOCK_MONOTONIC) - Start;
+            if (DueNs > Now) {
+                usleep((DueNs - Now) / 1000);
+            }
+        }
+        if (replay_is_excluded(pMsg, Exclude)) {
+            Skipped++;
+            continue;
+        }
+        snprintf(Topic, sizeof(Topic), "%s/%s", REPLAY_BASE, pMsg->SubTopic);
+        if (ESP_OK == HostMqtt_Inject(Topic, pMsg->pPayload, pMsg->Length, 0)) {
+            Sent++;
+        }
+    }
+    const uint64_t DurationNs = replay_now_ns(CLOCK_MONOTONIC) - Start;
+
+    // Wait until the commands are handled or dropped
+    HostMqtt_Flush();
+    const bool isSettled = replay_wait_commands(Before.Processed + Before.Dropped + Sent, &After);
+    const uint64_t CpuNs = replay_now_ns(CLOCK_PROCESS_CPUTIME_ID) - CpuStart;
+    HostMqtt_GetStats(&MqttAfter);
+    if (!replay_ask("", &Count)) {
+        fprintf(stderr, "No latency answer\n");
+        return (1);
+    }
+
+    const uint32_t Processed = After.Processed - Before.Processed;
+    const uint32_t Events = MqttAfter.DataEvents - MqttBefore.DataEvents;
+    printf("%u messages in %.2f s (%.0f/s), %u skipped\n", Sent, DurationNs / 1e9, Sent / (DurationNs / 1e9 + 1e-9), Skipped);
+    printf("processed %u, dropped %u, lost %u, queue high water %u\n",
+           Processed, After.Dropped - Before.Dropped, Sent - Processed, After.HighWater);
+    printf("%-6s %8s %8s %8s %8s %8s\n", "stage", "n", "p50 us", "p95 us", "p99 us", "max us");
+    for (int i = 0; i < sizeof(Stages) / sizeof(Stages[0]); i++) {
+        char Key[24];
+        long Values[5];
+        static const char * const Names[] = { "n", "p50", "p95", "p99", "max" };
+        for (int j = 0; j < 5; j++) {
+            snprintf(Key, sizeof(Key), "%s.%s", Stages[i], Names[j]);
+            Values[j] = replay_value(Key);
+        }
+        printf("%-6s %8ld %8ld %8ld %8ld %8ld\n", Stages[i], Values[0], Values[1], Values[2], Values[3], Values[4]);
+    }
+    printf("mqtt_event_handler: %.0f ns/message, max %u ns\n",
+           (double)(MqttAfter.HandlerNs - MqttBefore.HandlerNs) / ((0 != Events) ? Events : 1), MqttAfter.HandlerMaxNs);
+    printf("CPU per message: %.0f us (process)\n", CpuNs / 1e3 / ((0 != Sent) ? Sent : 1));
+    return (isSettled ? 0 : 1);
+}  // main
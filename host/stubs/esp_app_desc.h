@@ -0,0 +1,23 @@
+/**
+ ******************************************************************************
+ *  file           : esp_app_desc.h
+ *  brief          : Host build: Description of the running app
+ ******************************************************************************
+ */
+
+#ifndef HOST_ESP_APP_DESC_H_
+#define HOST_ESP_APP_DESC_H_
+
+#include "esp_app_format.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+const esp_app_desc_t * esp_app_get_description(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // HOST_ESP_APP_DESC_H_
@@ -0,0 +1,40 @@
+/**
+ ******************************************************************************
+ *  file           : esp_chip_info.h
+ *  brief          : Host build: Chip model and features
+ ******************************************************************************
+ */
+
+#ifndef HOST_ESP_CHIP_INFO_H_
+#define HOST_ESP_CHIP_INFO_H_
+
+#include <stdint.h>
+#include "esp_bit_defs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CHIP_FEATURE_EMB_FLASH  BIT0
+#define CHIP_FEATURE_WIFI_BGN   BIT1
+#define CHIP_FEATURE_BLE        BIT4
+#define CHIP_FEATURE_BT         BIT5
+
+typedef enum {
+    CHIP_ESP32 = 1,
+} esp_chip_model_t;
+
+typedef struct {
+    esp_chip_model_t    model;
+    uint32_t            features;
+    uint16_t            revision;
+    uint8_t             cores;
+} esp_chip_info_t;
+
+void    esp_chip_info(esp_chip_info_t * out_info);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // HOST_ESP_CHIP_INFO_H_
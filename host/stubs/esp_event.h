@@ -0,0 +1,43 @@
+/**
+ ******************************************************************************
+ *  file           : esp_event.h
+ *  brief          : Host build: Default event loop, see host_event.c
+ ******************************************************************************
+ */
+
+#ifndef HOST_ESP_EVENT_H_
+#define HOST_ESP_EVENT_H_
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef const char * esp_event_base_t;
+typedef void *       esp_event_handler_instance_t;
+typedef void (*esp_event_handler_t)(void * event_handler_arg, esp_event_base_t event_base, int32_t event_id, void * event_data);
+
+#define ESP_EVENT_ANY_BASE  NULL
+#define ESP_EVENT_ANY_ID    -1
+
+#define ESP_EVENT_DECLARE_BASE(id) extern esp_event_base_t const id
+#define ESP_EVENT_DEFINE_BASE(id)  esp_event_base_t const id = #id
+
+esp_err_t   esp_event_loop_create_default(void);
+esp_err_t   esp_event_handler_register(esp_event_base_t event_base, int32_t event_id, esp_event_handler_t event_handler, void * event_handler_arg);
+esp_err_t   esp_event_handler_unregister(esp_event_base_t event_base, int32_t event_id, esp_event_handler_t event_handler);
+esp_err_t   esp_event_handler_instance_register(esp_event_base_t event_base, int32_t event_id, esp_event_handler_t event_handler, void * event_handler_arg, esp_event_handler_instance_t * instance);
+esp_err_t   esp_event_handler_instance_unregister(esp_event_base_t event_base, int32_t event_id, esp_event_handler_instance_t instance);
+esp_err_t   esp_event_post(esp_event_base_t event_base, int32_t event_id, const void * event_data, size_t event_data_size, TickType_t ticks_to_wait);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // HOST_ESP_EVENT_H_
@@ -0,0 +1,13 @@
+/**
+ ******************************************************************************
+ *  file           : esp_flash_partitions.h
+ *  brief          : Host build: Partition table, see esp_partition.h
+ ******************************************************************************
+ */
+
+#ifndef HOST_ESP_FLASH_PARTITIONS_H_
+#define HOST_ESP_FLASH_PARTITIONS_H_
+
+#include "esp_partition.h"
+
+#endif  // HOST_ESP_FLASH_PARTITIONS_H_
@@ -0,0 +1,49 @@
+/**
+ ******************************************************************************
+ *  file           : esp_heap_caps.h
+ *  brief          : Host build: Heap with capabilities, there is no PSRAM
+ ******************************************************************************
+ */
+
+#ifndef HOST_ESP_HEAP_CAPS_H_
+#define HOST_ESP_HEAP_CAPS_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MALLOC_CAP_EXEC     (1 << 0)
+#define MALLOC_CAP_32BIT    (1 << 1)
+#define MALLOC_CAP_8BIT     (1 << 2)
+#define MALLOC_CAP_DMA      (1 << 3)
+#define MALLOC_CAP_SPIRAM   (1 << 10)
+#define MALLOC_CAP_INTERNAL (1 << 11)
+#define MALLOC_CAP_DEFAULT  (1 << 12)
+
+typedef struct {
+    size_t  total_free_bytes;
+    size_t  total_allocated_bytes;
+    size_t  largest_free_block;
+    size_t  minimum_free_bytes;
+    size_t  allocated_blocks;
+    size_t  free_blocks;
+    size_t  total_blocks;
+} multi_heap_info_t;
+
+void *  heap_caps_malloc(size_t size, uint32_t caps);
+void *  heap_caps_calloc(size_t n, size_t size, uint32_t caps);
+void    heap_caps_free(void * ptr);
+size_t  heap_caps_get_free_size(uint32_t caps);
+size_t  heap_caps_get_minimum_free_size(uint32_t caps);
+size_t  heap_caps_get_largest_free_block(uint32_t caps);
+size_t  heap_caps_get_total_size(uint32_t caps);
+void    heap_caps_get_info(multi_heap_info_t * info, uint32_t caps);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // HOST_ESP_HEAP_CAPS_H_
@@ -0,0 +1,72 @@
+/**
+ ******************************************************************************
+ *  file           : esp_http_client.h
+ *  brief          : Host build: Plain HTTP/1.1 client on sockets, see host_http.c
+ ******************************************************************************
+ */
+
+#ifndef HOST_ESP_HTTP_CLIENT_H_
+#define HOST_ESP_HTTP_CLIENT_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ESP_ERR_HTTP_BASE       0x7000
+#define ESP_ERR_HTTP_MAX_REDIRECT   (ESP_ERR_HTTP_BASE + 1)
+#define ESP_ERR_HTTP_CONNECT    (ESP_ERR_HTTP_BASE + 2)
+#define ESP_ERR_HTTP_WRITE_DATA (ESP_ERR_HTTP_BASE + 3)
+#define ESP_ERR_HTTP_FETCH_HEADER (ESP_ERR_HTTP_BASE + 4)
+
+typedef struct esp_http_client * esp_http_client_handle_t;
+
+typedef enum {
+    HTTP_EVENT_ERROR = 0,
+    HTTP_EVENT_ON_CONNECTED,
+    HTTP_EVENT_HEADERS_SENT,
+    HTTP_EVENT_ON_HEADER,
+    HTTP_EVENT_ON_DATA,
+    HTTP_EVENT_ON_FINISH,
+    HTTP_EVENT_DISCONNECTED,
+} esp_http_client_event_id_t;
+
+typedef struct esp_http_client_event {
+    esp_http_client_event_id_t  event_id;
+    esp_http_client_handle_t    client;
+    void *                      data;
+    int                         data_len;
+    void *                      user_data;
+    char *                      header_key;
+    char *                      header_value;
+} esp_http_client_event_t;
+
+typedef esp_err_t (*http_event_handle_cb)(esp_http_client_event_t * evt);
+
+typedef struct {
+    const char *            url;                // http://host[:port]/path, no TLS
+    int                     timeout_ms;
+    bool                    keep_alive_enable;  // Ignored
+    int                     buffer_size;
+    http_event_handle_cb    event_handler;
+    void *                  user_data;
+} esp_http_client_config_t;
+
+esp_http_client_handle_t esp_http_client_init(const esp_http_client_config_t * config);
+esp_err_t   esp_http_client_set_header(esp_http_client_handle_t client, const char * key, const char * value);
+esp_err_t   esp_http_client_open(esp_http_client_handle_t client, int write_len);
+int64_t     esp_http_client_fetch_headers(esp_http_client_handle_t client);
+int         esp_http_client_get_status_code(esp_http_client_handle_t client);
+int         esp_http_client_read(esp_http_client_handle_t client, char * buffer, int len);
+bool        esp_http_client_is_complete_data_received(esp_http_client_handle_t client);
+esp_err_t   esp_http_client_close(esp_http_client_handle_t client);
+esp_err_t   esp_http_client_cleanup(esp_http_client_handle_t client);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // HOST_ESP_HTTP_CLIENT_H_
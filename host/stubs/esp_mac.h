@@ -0,0 +1,24 @@
+/**
+ ******************************************************************************
+ *  file           : esp_mac.h
+ *  brief          : Host build: MAC address of the device
+ ******************************************************************************
+ */
+
+#ifndef HOST_ESP_MAC_H_
+#define HOST_ESP_MAC_H_
+
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+esp_err_t   esp_efuse_mac_get_default(uint8_t * mac);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // HOST_ESP_MAC_H_
@@ -0,0 +1,18 @@
+/**
+ ******************************************************************************
+ *  file           : esp_memory_utils.h
+ *  brief          : Host build: Memory regions, there is no PSRAM
+ ******************************************************************************
+ */
+
+#ifndef HOST_ESP_MEMORY_UTILS_H_
+#define HOST_ESP_MEMORY_UTILS_H_
+
+#include <stdbool.h>
+
+static inline bool esp_ptr_external_ram(const void * p) {
+    (void)p;
+    return (false);
+}
+
+#endif  // HOST_ESP_MEMORY_UTILS_H_
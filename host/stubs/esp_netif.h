@@ -0,0 +1,84 @@
+/**
+ ******************************************************************************
+ *  file           : esp_netif.h
+ *  brief          : Host build: Station interface of the simulated WiFi, see host_wifi.c
+ ******************************************************************************
+ */
+
+#ifndef HOST_ESP_NETIF_H_
+#define HOST_ESP_NETIF_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "esp_event.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ESP_IPADDR_TYPE_V4  0
+
+#define IPSTR "%d.%d.%d.%d"
+#define IP2STR(ipaddr) (int)((ipaddr)->addr & 0xff), (int)(((ipaddr)->addr >> 8) & 0xff), \
+                       (int)(((ipaddr)->addr >> 16) & 0xff), (int)(((ipaddr)->addr >> 24) & 0xff)
+#define ESP_IP4TOADDR(a, b, c, d) ((uint32_t)(a) | ((uint32_t)(b) << 8) | ((uint32_t)(c) << 16) | ((uint32_t)(d) << 24))
+
+typedef struct esp_netif_obj esp_netif_t;
+
+typedef struct {
+    uint32_t addr;                      // Network byte order
+} esp_ip4_addr_t;
+
+typedef struct {
+    union {
+        esp_ip4_addr_t  ip4;
+    } u_addr;
+    uint8_t type;
+} esp_ip_addr_t;
+
+typedef struct {
+    esp_ip4_addr_t ip;
+    esp_ip4_addr_t netmask;
+    esp_ip4_addr_t gw;
+} esp_netif_ip_info_t;
+
+typedef struct {
+    esp_ip_addr_t ip;
+} esp_netif_dns_info_t;
+
+typedef enum {
+    ESP_NETIF_DNS_MAIN,
+    ESP_NETIF_DNS_BACKUP,
+    ESP_NETIF_DNS_FALLBACK,
+    ESP_NETIF_DNS_MAX,
+} esp_netif_dns_type_t;
+
+ESP_EVENT_DECLARE_BASE(IP_EVENT);
+
+typedef enum {
+    IP_EVENT_STA_GOT_IP,
+    IP_EVENT_STA_LOST_IP,
+} ip_event_t;
+
+typedef struct {
+    int                 if_index;
+    esp_netif_t *       esp_netif;
+    esp_netif_ip_info_t ip_info;
+    bool                ip_changed;
+} ip_event_got_ip_t;
+
+esp_err_t       esp_netif_init(void);
+esp_netif_t *   esp_netif_create_default_wifi_sta(void);
+esp_err_t       esp_netif_dhcpc_start(esp_netif_t * esp_netif);
+esp_err_t       esp_netif_dhcpc_stop(esp_netif_t * esp_netif);
+esp_err_t       esp_netif_set_ip_info(esp_netif_t * esp_netif, const esp_netif_ip_info_t * ip_info);
+esp_err_t       esp_netif_get_ip_info(esp_netif_t * esp_netif, esp_netif_ip_info_t * ip_info);
+esp_err_t       esp_netif_set_dns_info(esp_netif_t * esp_netif, esp_netif_dns_type_t type, esp_netif_dns_info_t * dns);
+esp_err_t       esp_netif_get_dns_info(esp_netif_t * esp_netif, esp_netif_dns_type_t type, esp_netif_dns_info_t * dns);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // HOST_ESP_NETIF_H_
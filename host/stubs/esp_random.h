@@ -0,0 +1,25 @@
+/**
+ ******************************************************************************
+ *  file           : esp_random.h
+ *  brief          : Host build: Random numbers, reproducible by a seed
+ ******************************************************************************
+ */
+
+#ifndef HOST_ESP_RANDOM_H_
+#define HOST_ESP_RANDOM_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+uint32_t    esp_random(void);
+void        esp_fill_random(void * buf, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // HOST_ESP_RANDOM_H_
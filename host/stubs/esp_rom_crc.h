@@ -0,0 +1,23 @@
+/**
+ ******************************************************************************
+ *  file           : esp_rom_crc.h
+ *  brief          : Host build: CRC functions of the ROM
+ ******************************************************************************
+ */
+
+#ifndef HOST_ESP_ROM_CRC_H_
+#define HOST_ESP_ROM_CRC_H_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+uint16_t    esp_rom_crc16_le(uint16_t crc, uint8_t const * buf, uint32_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // HOST_ESP_ROM_CRC_H_
@@ -0,0 +1,42 @@
+/**
+ ******************************************************************************
+ *  file           : esp_sntp.h
+ *  brief          : Host build: SNTP, the host clock is always in sync
+ ******************************************************************************
+ */
+
+#ifndef HOST_ESP_SNTP_H_
+#define HOST_ESP_SNTP_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>               // As from lwip, for setenv()
+#include <time.h>
+#include <sys/time.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SNTP_OPMODE_POLL 0
+
+typedef enum {
+    SNTP_SYNC_MODE_IMMED,
+    SNTP_SYNC_MODE_SMOOTH,
+} sntp_sync_mode_t;
+
+typedef void (*sntp_sync_time_cb_t)(struct timeval * tv);
+
+void    sntp_setoperatingmode(uint8_t operating_mode);
+void    sntp_setservername(uint8_t idx, const char * server);
+void    sntp_set_time_sync_notification_cb(sntp_sync_time_cb_t callback);
+void    sntp_set_sync_mode(sntp_sync_mode_t sync_mode);
+void    sntp_set_sync_interval(uint32_t interval_ms);
+void    sntp_init(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // HOST_ESP_SNTP_H_
@@ -0,0 +1,36 @@
+/**
+ ******************************************************************************
+ *  file           : esp_system.h
+ *  brief          : Host build: System functions
+ ******************************************************************************
+ */
+
+#ifndef HOST_ESP_SYSTEM_H_
+#define HOST_ESP_SYSTEM_H_
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_bit_defs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    ESP_RST_UNKNOWN,
+    ESP_RST_POWERON,
+    ESP_RST_EXT,
+    ESP_RST_SW,
+    ESP_RST_PANIC,
+} esp_reset_reason_t;
+
+uint32_t    esp_get_free_heap_size(void);
+uint32_t    esp_get_minimum_free_heap_size(void);
+void        esp_restart(void) __attribute__((noreturn));
+esp_reset_reason_t esp_reset_reason(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // HOST_ESP_SYSTEM_H_
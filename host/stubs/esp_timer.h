@@ -0,0 +1,48 @@
+/**
+ ******************************************************************************
+ *  file           : esp_timer.h
+ *  brief          : Host build: esp_timer on a simulated clock
+ *
+ *  The time only moves with HostTimer_Advance() (host.h), expired timers
+ *  are called from there. So timer driven code is tested step by step.
+ ******************************************************************************
+ */
+
+#ifndef HOST_ESP_TIMER_H_
+#define HOST_ESP_TIMER_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct esp_timer * esp_timer_handle_t;
+typedef void (*esp_timer_cb_t)(void * arg);
+
+typedef enum {
+    ESP_TIMER_TASK,
+} esp_timer_dispatch_t;
+
+typedef struct {
+    esp_timer_cb_t          callback;
+    void *                  arg;
+    esp_timer_dispatch_t    dispatch_method;
+    const char *            name;
+    bool                    skip_unhandled_events;
+} esp_timer_create_args_t;
+
+esp_err_t   esp_timer_create(const esp_timer_create_args_t * create_args, esp_timer_handle_t * out_handle);
+esp_err_t   esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us);
+esp_err_t   esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period);
+esp_err_t   esp_timer_stop(esp_timer_handle_t timer);
+esp_err_t   esp_timer_delete(esp_timer_handle_t timer);
+int64_t     esp_timer_get_time(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // HOST_ESP_TIMER_H_
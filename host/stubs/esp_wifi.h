@@ -0,0 +1,118 @@
+/**
+ ******************************************************************************
+ *  file           : esp_wifi.h
+ *  brief          : Host build: Simulated WiFi station, see HostWifi_SetAp()
+ ******************************************************************************
+ */
+
+#ifndef HOST_ESP_WIFI_H_
+#define HOST_ESP_WIFI_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "esp_event.h"
+#include "esp_netif.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ESP_ERR_WIFI_BASE       0x3000
+#define ESP_ERR_WIFI_NOT_INIT   (ESP_ERR_WIFI_BASE + 1)
+#define ESP_ERR_WIFI_NOT_STARTED (ESP_ERR_WIFI_BASE + 2)
+
+typedef enum {
+    WIFI_MODE_NULL,
+    WIFI_MODE_STA,
+} wifi_mode_t;
+
+typedef enum {
+    WIFI_IF_STA,
+} wifi_interface_t;
+#define ESP_IF_WIFI_STA WIFI_IF_STA
+
+typedef enum {
+    WIFI_AUTH_OPEN,
+    WIFI_AUTH_WEP,
+    WIFI_AUTH_WPA_PSK,
+    WIFI_AUTH_WPA2_PSK,
+} wifi_auth_mode_t;
+
+typedef enum {
+    WPA3_SAE_PWE_UNSPECIFIED,
+    WPA3_SAE_PWE_HUNT_AND_PECK,
+    WPA3_SAE_PWE_HASH_TO_ELEMENT,
+    WPA3_SAE_PWE_BOTH,
+} wifi_sae_pwe_method_t;
+
+typedef struct {
+    wifi_auth_mode_t authmode;
+} wifi_scan_threshold_t;
+
+typedef struct {
+    uint8_t                 ssid[32];
+    uint8_t                 password[64];
+    bool                    bssid_set;
+    uint8_t                 bssid[6];
+    uint8_t                 channel;
+    wifi_scan_threshold_t   threshold;
+    wifi_sae_pwe_method_t   sae_pwe_h2e;
+} wifi_sta_config_t;
+
+typedef union {
+    wifi_sta_config_t sta;
+} wifi_config_t;
+
+typedef struct {
+    int magic;
+} wifi_init_config_t;
+#define WIFI_INIT_CONFIG_DEFAULT() { .magic = 0x1F2F3F4F }
+
+ESP_EVENT_DECLARE_BASE(WIFI_EVENT);
+
+typedef enum {
+    WIFI_EVENT_WIFI_READY,
+    WIFI_EVENT_SCAN_DONE,
+    WIFI_EVENT_STA_START,
+    WIFI_EVENT_STA_STOP,
+    WIFI_EVENT_STA_CONNECTED,
+    WIFI_EVENT_STA_DISCONNECTED,
+} wifi_event_t;
+
+typedef enum {
+    WIFI_REASON_ASSOC_LEAVE = 8,
+    WIFI_REASON_BEACON_TIMEOUT = 200,
+    WIFI_REASON_NO_AP_FOUND = 201,
+} wifi_err_reason_t;
+
+typedef struct {
+    uint8_t             ssid[32];
+    uint8_t             ssid_len;
+    uint8_t             bssid[6];
+    uint8_t             channel;
+    wifi_auth_mode_t    authmode;
+    uint16_t            aid;
+} wifi_event_sta_connected_t;
+
+typedef struct {
+    uint8_t ssid[32];
+    uint8_t ssid_len;
+    uint8_t bssid[6];
+    uint8_t reason;
+    int8_t  rssi;
+} wifi_event_sta_disconnected_t;
+
+esp_err_t   esp_wifi_init(const wifi_init_config_t * config);
+esp_err_t   esp_wifi_set_mode(wifi_mode_t mode);
+esp_err_t   esp_wifi_set_config(wifi_interface_t interface, wifi_config_t * conf);
+esp_err_t   esp_wifi_get_config(wifi_interface_t interface, wifi_config_t * conf);
+esp_err_t   esp_wifi_start(void);
+esp_err_t   esp_wifi_connect(void);
+esp_err_t   esp_wifi_disconnect(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // HOST_ESP_WIFI_H_
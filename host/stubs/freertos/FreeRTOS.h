@@ -0,0 +1,64 @@
+/**
+ ******************************************************************************
+ *  file           : FreeRTOS.h
+ *  brief          : Host build: FreeRTOS on POSIX threads
+ *
+ *  Tasks are threads, ticks are real milliseconds. A critical section
+ *  is a mutex per portMUX_TYPE, as a spinlock on the target.
+ ******************************************************************************
+ */
+
+#ifndef HOST_FREERTOS_H_
+#define HOST_FREERTOS_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "sdkconfig.h"
+#include "esp_heap_caps.h"        // As from portmacro.h
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef uint32_t TickType_t;
+typedef int      BaseType_t;
+typedef unsigned UBaseType_t;
+typedef uint8_t  StackType_t;           // As on the ESP32, stack sizes are bytes
+
+#define pdFALSE             0
+#define pdTRUE              1
+#define pdFAIL              0
+#define pdPASS              1
+#define portMAX_DELAY       ((TickType_t)0xFFFFFFFF)
+#define configTICK_RATE_HZ  CONFIG_FREERTOS_HZ
+#define portTICK_PERIOD_MS  (1000 / configTICK_RATE_HZ)
+#define pdMS_TO_TICKS(ms)   ((TickType_t)(((uint64_t)(ms) * configTICK_RATE_HZ) / 1000))
+#define configMAX_TASK_NAME_LEN 16
+#define configMAX_PRIORITIES 25
+#define tskIDLE_PRIORITY    0
+#define tskNO_AFFINITY      0x7FFFFFFF
+
+// Sizes of the control blocks, as on the target
+typedef struct { uint8_t Dummy[352]; } StaticTask_t;
+typedef struct { uint8_t Dummy[80]; }  StaticQueue_t;
+typedef struct { uint8_t Dummy[80]; }  StaticSemaphore_t;
+typedef struct { uint8_t Dummy[32]; }  StaticEventGroup_t;
+
+typedef struct {
+    pthread_mutex_t Mutex;
+} portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED { PTHREAD_MUTEX_INITIALIZER }
+#define portMUX_INITIALIZE(pMux)     pthread_mutex_init(&(pMux)->Mutex, NULL)
+#define portENTER_CRITICAL(pMux)     pthread_mutex_lock(&(pMux)->Mutex)
+#define portEXIT_CRITICAL(pMux)      pthread_mutex_unlock(&(pMux)->Mutex)
+#define taskENTER_CRITICAL(pMux)     portENTER_CRITICAL(pMux)
+#define taskEXIT_CRITICAL(pMux)      portEXIT_CRITICAL(pMux)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // HOST_FREERTOS_H_
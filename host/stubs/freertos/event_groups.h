@@ -0,0 +1,32 @@
+/**
+ ******************************************************************************
+ *  file           : event_groups.h
+ *  brief          : Host build: Event groups
+ ******************************************************************************
+ */
+
+#ifndef HOST_FREERTOS_EVENT_GROUPS_H_
+#define HOST_FREERTOS_EVENT_GROUPS_H_
+
+#include "FreeRTOS.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct HostEventGroup * EventGroupHandle_t;
+typedef uint32_t EventBits_t;
+
+EventGroupHandle_t  xEventGroupCreate(void);
+EventGroupHandle_t  xEventGroupCreateStatic(StaticEventGroup_t * pxEventGroupBuffer);
+EventBits_t         xEventGroupSetBits(EventGroupHandle_t xEventGroup, const EventBits_t uxBitsToSet);
+EventBits_t         xEventGroupClearBits(EventGroupHandle_t xEventGroup, const EventBits_t uxBitsToClear);
+EventBits_t         xEventGroupGetBits(EventGroupHandle_t xEventGroup);
+EventBits_t         xEventGroupWaitBits(EventGroupHandle_t xEventGroup, const EventBits_t uxBitsToWaitFor, const BaseType_t xClearOnExit, const BaseType_t xWaitForAllBits, TickType_t xTicksToWait);
+void                vEventGroupDelete(EventGroupHandle_t xEventGroup);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // HOST_FREERTOS_EVENT_GROUPS_H_
@@ -0,0 +1,34 @@
+/**
+ ******************************************************************************
+ *  file           : queue.h
+ *  brief          : Host build: Queues
+ ******************************************************************************
+ */
+
+#ifndef HOST_FREERTOS_QUEUE_H_
+#define HOST_FREERTOS_QUEUE_H_
+
+#include "FreeRTOS.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct HostQueue * QueueHandle_t;
+
+QueueHandle_t   xQueueCreate(UBaseType_t uxQueueLength, UBaseType_t uxItemSize);
+QueueHandle_t   xQueueCreateStatic(UBaseType_t uxQueueLength, UBaseType_t uxItemSize, uint8_t * pucQueueStorage, StaticQueue_t * pxQueueBuffer);
+BaseType_t      xQueueSend(QueueHandle_t xQueue, const void * pvItemToQueue, TickType_t xTicksToWait);
+BaseType_t      xQueueSendToFront(QueueHandle_t xQueue, const void * pvItemToQueue, TickType_t xTicksToWait);
+BaseType_t      xQueueReceive(QueueHandle_t xQueue, void * pvBuffer, TickType_t xTicksToWait);
+UBaseType_t     uxQueueMessagesWaiting(QueueHandle_t xQueue);
+UBaseType_t     uxQueueSpacesAvailable(QueueHandle_t xQueue);
+void            vQueueDelete(QueueHandle_t xQueue);
+
+#define xQueueSendToBack(xQueue, pvItemToQueue, xTicksToWait) xQueueSend(xQueue, pvItemToQueue, xTicksToWait)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // HOST_FREERTOS_QUEUE_H_
@@ -0,0 +1,37 @@
+/**
+ ******************************************************************************
+ *  file           : semphr.h
+ *  brief          : Host build: Semaphores and mutexes
+ ******************************************************************************
+ */
+
+#ifndef HOST_FREERTOS_SEMPHR_H_
+#define HOST_FREERTOS_SEMPHR_H_
+
+#include "FreeRTOS.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct HostSemaphore * SemaphoreHandle_t;
+
+SemaphoreHandle_t   xSemaphoreCreateCounting(UBaseType_t uxMaxCount, UBaseType_t uxInitialCount);
+BaseType_t          xSemaphoreTake(SemaphoreHandle_t xSemaphore, TickType_t xBlockTime);
+BaseType_t          xSemaphoreGive(SemaphoreHandle_t xSemaphore);
+void                vSemaphoreDelete(SemaphoreHandle_t xSemaphore);
+SemaphoreHandle_t   xSemaphoreCreateRecursiveMutex(void);
+BaseType_t          xSemaphoreTakeRecursive(SemaphoreHandle_t xMutex, TickType_t xBlockTime);
+BaseType_t          xSemaphoreGiveRecursive(SemaphoreHandle_t xMutex);
+
+#define xSemaphoreCreateMutex()                 xSemaphoreCreateCounting(1, 1)
+#define xSemaphoreCreateBinary()                xSemaphoreCreateCounting(1, 0)
+#define xSemaphoreCreateMutexStatic(pBuffer)    ((void)(pBuffer), xSemaphoreCreateMutex())
+#define xSemaphoreCreateBinaryStatic(pBuffer)   ((void)(pBuffer), xSemaphoreCreateBinary())
+#define xSemaphoreCreateRecursiveMutexStatic(pBuffer) ((void)(pBuffer), xSemaphoreCreateRecursiveMutex())
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // HOST_FREERTOS_SEMPHR_H_
@@ -0,0 +1,40 @@
+/**
+ ******************************************************************************
+ *  file           : task.h
+ *  brief          : Host build: Tasks as threads, with notifications
+ ******************************************************************************
+ */
+
+#ifndef HOST_FREERTOS_TASK_H_
+#define HOST_FREERTOS_TASK_H_
+
+#include <sched.h>
+#include "FreeRTOS.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct HostTask * TaskHandle_t;
+typedef void (*TaskFunction_t)(void * pvParameters);
+
+BaseType_t      xTaskCreate(TaskFunction_t pxTaskCode, const char * pcName, uint32_t usStackDepth, void * pvParameters, UBaseType_t uxPriority, TaskHandle_t * pxCreatedTask);
+BaseType_t      xTaskCreatePinnedToCore(TaskFunction_t pxTaskCode, const char * pcName, uint32_t usStackDepth, void * pvParameters, UBaseType_t uxPriority, TaskHandle_t * pxCreatedTask, BaseType_t xCoreID);
+TaskHandle_t    xTaskCreateStatic(TaskFunction_t pxTaskCode, const char * pcName, uint32_t ulStackDepth, void * pvParameters, UBaseType_t uxPriority, StackType_t * puxStackBuffer, StaticTask_t * pxTaskBuffer);
+void            vTaskDelete(TaskHandle_t xTaskToDelete);
+void            vTaskDelay(TickType_t xTicksToDelay);
+BaseType_t      xTaskDelayUntil(TickType_t * pxPreviousWakeTime, const TickType_t xTimeIncrement);
+TickType_t      xTaskGetTickCount(void);
+TaskHandle_t    xTaskGetCurrentTaskHandle(void);
+char *          pcTaskGetName(TaskHandle_t xTaskToQuery);
+UBaseType_t     uxTaskGetStackHighWaterMark(TaskHandle_t xTask);
+BaseType_t      xTaskNotifyGive(TaskHandle_t xTaskToNotify);
+uint32_t        ulTaskNotifyTake(BaseType_t xClearCountOnExit, TickType_t xTicksToWait);
+
+#define taskYIELD() sched_yield()
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // HOST_FREERTOS_TASK_H_
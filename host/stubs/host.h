@@ -0,0 +1,105 @@
+/**
+ ******************************************************************************
+ *  file           : host.h
+ *  brief          : Host build: Control of the stand-ins by tests and benchmarks
+ ******************************************************************************
+ */
+
+#ifndef HOST_HOST_H_
+#define HOST_HOST_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "esp_partition.h"
+#include "esp_ota_ops.h"
+#include "esp_wifi.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define HOST_FLASH_SECTOR 4096          // Erase unit of the flash
+
+// Flash use of a partition
+typedef struct HostFlash_Stats {
+    uint64_t    BytesRead;
+    uint64_t    BytesWritten;
+    uint64_t    Erases;                 // Erased sectors
+    uint32_t    MaxSectorErases;        // Erases of the most worn sector
+} HostFlash_Stats;
+
+// Simulated WiFi station
+typedef struct HostWifi_Stats {
+    uint32_t    Connects;               // Calls of esp_wifi_connect()
+    uint32_t    Directed;               // ...with BSSID set
+    uint32_t    StaticIp;               // Connects with DHCP stopped
+    bool        isDhcp;                 // DHCP client running
+} HostWifi_Stats;
+
+// MQTT client and broker stand-in
+typedef struct HostMqtt_Stats {
+    uint32_t    Starts;                 // Calls of esp_mqtt_client_start()
+    uint32_t    Published;              // Publishes of the device
+    uint32_t    Delivered;              // ...looped back to a subscription
+    uint32_t    Injected;               // Messages of HostMqtt_Inject()
+    uint32_t    DataEvents;             // DATA events passed to the handler
+    uint64_t    HandlerNs;              // ...time spent in the handler
+    uint32_t    HandlerMaxNs;           // ...longest call
+    bool        isConnected;
+} HostMqtt_Stats;
+
+typedef void (*HostMqtt_PublishHook)(const char * Topic, const char * pData, int Length, int Qos, void * pArg);
+
+// In-process HTTP server
+typedef struct HostHttp_Options {
+    const char * ETag;                  // Strong validator, NULL for none
+    uint32_t    DropAt;                 // Close the connection once at this offset, 0 never
+    uint32_t    RateKBs;                // Throttle in kB/s, 0 unlimited
+    bool        NoRange;                // Ignore Range requests
+} HostHttp_Options;
+
+typedef struct HostHttp_Stats {
+    uint32_t    Requests;
+    uint32_t    Ranges;                 // Answered with 206
+    uint32_t    Drops;                  // Connections closed by DropAt
+    uint64_t    BytesSent;              // Body bytes
+} HostHttp_Stats;
+
+void    HostTimer_Advance(uint64_t Us);
+void    HostTimer_SetRealTime(void);
+
+const esp_partition_t * HostFlash_AddPartition(const char * Label, esp_partition_type_t Type, esp_partition_subtype_t Subtype, const char * Path, size_t Size);
+void    HostFlash_GetStats(const esp_partition_t * pPart, HostFlash_Stats * pStats);
+void    HostFlash_ResetStats(const esp_partition_t * pPart);
+void    HostFlash_SetTiming(uint32_t SectorEraseUs, uint32_t WriteUsKb);
+
+void    HostOta_SetRunning(const esp_partition_t * pPart, esp_ota_img_states_t State);
+const esp_partition_t * HostOta_GetBoot(void);
+
+void    HostNvs_Clear(void);
+void    HostRandom_Seed(uint32_t Seed);
+void    HostSystem_SetRestartHook(void (*Hook)(void));
+
+void    HostEvent_Flush(void);
+
+void    HostWifi_SetAp(const char * Ssid, const uint8_t * pBssid, uint8_t Channel, bool isReachable);
+void    HostWifi_Disconnect(uint8_t Reason);
+void    HostWifi_GetStats(HostWifi_Stats * pStats, wifi_config_t * pConfig);
+
+esp_err_t HostMqtt_Inject(const char * Topic, const void * pData, size_t Length, size_t Fragment);
+void    HostMqtt_SetReachable(bool Reachable);
+void    HostMqtt_Disconnect(void);
+void    HostMqtt_SetPublishHook(HostMqtt_PublishHook Hook, void * pArg);
+void    HostMqtt_GetStats(HostMqtt_Stats * pStats);
+void    HostMqtt_Flush(void);
+
+int     HostHttp_Serve(const void * pData, size_t Length, const HostHttp_Options * pOptions);
+void    HostHttp_GetStats(HostHttp_Stats * pStats);
+void    HostHttp_Stop(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // HOST_HOST_H_
@@ -0,0 +1,17 @@
+/**
+ ******************************************************************************
+ *  file           : host_compat.h
+ *  brief          : Host build: Functions of newlib missing in older C libraries
+ *
+ *  Included into every source if the C library has no strlcpy().
+ ******************************************************************************
+ */
+
+#ifndef HOST_COMPAT_H_
+#define HOST_COMPAT_H_
+
+#include <stddef.h>
+
+size_t strlcpy(char * dst, const char * src, size_t size);
+
+#endif  // HOST_COMPAT_H_
@@ -0,0 +1,244 @@
+/**
+ ******************************************************************************
+ *  file           : host_esp.c
+ *  brief          : Host build: Errors, logging, random, CRC, heap and system
+ ******************************************************************************
+ */
+
+/****************************** Includes  */
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_random.h"
+#include "esp_rom_crc.h"
+#include "esp_heap_caps.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "esp_mac.h"
+#include "esp_chip_info.h"
+#include "esp_app_desc.h"
+#include "esp_sntp.h"
+#include "esp_ota_ops.h"
+#include "esp_http_client.h"
+#include "nvs.h"
+#include "host.h"
+
+/****************************** Statics */
+static esp_log_level_t LogLevel = ESP_LOG_INFO;
+static uint32_t RandomState = 0x2545F491;
+static void (*RestartHook)(void) = NULL;
+static const uint8_t Mac[6] = { 0x24, 0x0a, 0xc4, 0x12, 0x34, 0x56 };
+static const esp_app_desc_t AppDesc = {
+    .magic_word = ESP_APP_DESC_MAGIC_WORD,
+    .version = "host",
+    .project_name = "IoTBase",
+    .idf_ver = "v5.0.1",
+};
+
+/****************************** Functions */
+
+/**
+ * @brief Name of an error code
+ */
+const char * esp_err_to_name(esp_err_t code) {
+    switch (code) {
+        case ESP_OK:                    return ("ESP_OK");
+        case ESP_FAIL:                  return ("ESP_FAIL");
+        case ESP_ERR_NO_MEM:            return ("ESP_ERR_NO_MEM");
+        case ESP_ERR_INVALID_ARG:       return ("ESP_ERR_INVALID_ARG");
+        case ESP_ERR_INVALID_STATE:     return ("ESP_ERR_INVALID_STATE");
+        case ESP_ERR_INVALID_SIZE:      return ("ESP_ERR_INVALID_SIZE");
+        case ESP_ERR_NOT_FOUND:         return ("ESP_ERR_NOT_FOUND");
+        case ESP_ERR_NOT_SUPPORTED:     return ("ESP_ERR_NOT_SUPPORTED");
+        case ESP_ERR_TIMEOUT:           return ("ESP_ERR_TIMEOUT");
+        case ESP_ERR_INVALID_RESPONSE:  return ("ESP_ERR_INVALID_RESPONSE");
+        case ESP_ERR_INVALID_CRC:       return ("ESP_ERR_INVALID_CRC");
+        case ESP_ERR_INVALID_VERSION:   return ("ESP_ERR_INVALID_VERSION");
+        case ESP_ERR_NOT_FINISHED:      return ("ESP_ERR_NOT_FINISHED");
+        case ESP_ERR_NOT_ALLOWED:       return ("ESP_ERR_NOT_ALLOWED");
+        case ESP_ERR_NVS_NOT_FOUND:     return ("ESP_ERR_NVS_NOT_FOUND");
+        case ESP_ERR_NVS_INVALID_LENGTH: return ("ESP_ERR_NVS_INVALID_LENGTH");
+        case ESP_ERR_OTA_VALIDATE_FAILED: return ("ESP_ERR_OTA_VALIDATE_FAILED");
+        case ESP_ERR_HTTP_CONNECT:      return ("ESP_ERR_HTTP_CONNECT");
+        default:                        return ("UNKNOWN ERROR");
+    }
+}  // esp_err_to_name
+
+/**
+ * @brief Set the log level, the host knows only one for all tags
+ */
+void esp_log_level_set(const char * tag, esp_log_level_t level) {
+    (void)tag;
+    LogLevel = level;
+}
+
+/**
+ * @brief Log a line with level and time, as on the target
+ */
+void esp_log_write(esp_log_level_t level, const char * tag, const char * format, ...) {
+    static const char Letters[] = "NEWIDV";
+    va_list Args;
+
+    if (level > LogLevel) {
+        return;
+    }
+    printf("%c (%lu) %s: ", Letters[level], (unsigned long)(esp_timer_get_time() / 1000), tag);
+    va_start(Args, format);
+    vprintf(format, Args);
+    va_end(Args);
+    printf("\n");
+}  // esp_log_write
+
+/**
+ * @brief Seed the random numbers, tests get the same sequence every run
+ */
+void HostRandom_Seed(uint32_t Seed) {
+    RandomState = (0 != Seed) ? Seed : 1;
+}
+
+/**
+ * @brief xorshift32, good enough for jitter
+ */
+uint32_t esp_random(void) {
+    RandomState ^= RandomState << 13;
+    RandomState ^= RandomState >> 17;
+    RandomState ^= RandomState << 5;
+    return (RandomState);
+}
+
+void esp_fill_random(void * buf, size_t len) {
+    uint8_t * pOut = buf;
+    for (size_t i = 0; i < len; i++) {
+        pOut[i] = esp_random();
+    }
+}
+
+/**
+ * @brief CRC16 little endian of the ROM: Poly 0x1021 reflected, inverted in and out
+ */
+uint16_t esp_rom_crc16_le(uint16_t crc, uint8_t const * buf, uint32_t len) {
+    crc = ~crc;
+    for (uint32_t i = 0; i < len; i++) {
+        crc ^= buf[i];
+        for (int Bit = 0; Bit < 8; Bit++) {
+            crc = (crc & 1) ? ((crc >> 1) ^ 0x8408) : (crc >> 1);
+        }
+    }
+    return (~crc);
+}  // esp_rom_crc16_le
+
+/**
+ * @brief Heap: No PSRAM, everything else is malloc
+ */
+void * heap_caps_malloc(size_t size, uint32_t caps) {
+    if (caps & MALLOC_CAP_SPIRAM) {
+        return (NULL);
+    }
+    return (malloc(size));
+}
+
+void * heap_caps_calloc(size_t n, size_t size, uint32_t caps) {
+    if (caps & MALLOC_CAP_SPIRAM) {
+        return (NULL);
+    }
+    return (calloc(n, size));
+}
+
+void heap_caps_free(void * ptr) {
+    free(ptr);
+}
+
+size_t heap_caps_get_free_size(uint32_t caps) {
+    return ((caps & MALLOC_CAP_SPIRAM) ? 0 : (256 * 1024));
+}
+
+size_t heap_caps_get_minimum_free_size(uint32_t caps) {
+    return (heap_caps_get_free_size(caps));
+}
+
+size_t heap_caps_get_largest_free_block(uint32_t caps) {
+    return (heap_caps_get_free_size(caps));
+}
+
+size_t heap_caps_get_total_size(uint32_t caps) {
+    return ((caps & MALLOC_CAP_SPIRAM) ? 0 : (320 * 1024));
+}
+
+void heap_caps_get_info(multi_heap_info_t * info, uint32_t caps) {
+    memset(info, 0x00, sizeof(multi_heap_info_t));
+    info->total_free_bytes = heap_caps_get_free_size(caps);
+    info->minimum_free_bytes = heap_caps_get_minimum_free_size(caps);
+    info->largest_free_block = heap_caps_get_largest_free_block(caps);
+    info->total_allocated_bytes = heap_caps_get_total_size(caps) - info->total_free_bytes;
+}
+
+uint32_t esp_get_free_heap_size(void) {
+    return (heap_caps_get_free_size(MALLOC_CAP_DEFAULT));
+}
+
+uint32_t esp_get_minimum_free_heap_size(void) {
+    return (heap_caps_get_free_size(MALLOC_CAP_DEFAULT));
+}
+
+/**
+ * @brief Catch restarts, e.g. after an update, instead of ending the process
+ *
+ * @param Hook Called by esp_restart(), then the calling task ends. NULL to exit
+ */
+void HostSystem_SetRestartHook(void (*Hook)(void)) {
+    RestartHook = Hook;
+}
+
+void esp_restart(void) {
+    fflush(stdout);
+    if (NULL != RestartHook) {
+        RestartHook();
+        pthread_exit(NULL);
+    }
+    exit(0);
+}
+
+esp_reset_reason_t esp_reset_reason(void) {
+    return (ESP_RST_POWERON);
+}
+
+esp_err_t esp_efuse_mac_get_default(uint8_t * mac) {
+    memcpy(mac, Mac, sizeof(Mac));
+    return (ESP_OK);
+}
+
+void esp_chip_info(esp_chip_info_t * out_info) {
+    memset(out_info, 0x00, sizeof(esp_chip_info_t));
+    out_info->model = CHIP_ESP32;
+    out_info->features = CHIP_FEATURE_WIFI_BGN | CHIP_FEATURE_BT | CHIP_FEATURE_BLE;
+    out_info->cores = 2;
+}
+
+const esp_app_desc_t * esp_app_get_description(void) {
+    return (&AppDesc);
+}
+
+// SNTP: The host clock is kept by the OS
+void sntp_setoperatingmode(uint8_t operating_mode) {}
+void sntp_setservername(uint8_t idx, const char * server) {}
+void sntp_set_time_sync_notification_cb(sntp_sync_time_cb_t callback) {}
+void sntp_set_sync_mode(sntp_sync_mode_t sync_mode) {}
+void sntp_set_sync_interval(uint32_t interval_ms) {}
+void sntp_init(void) {}
+
+#ifdef HOST_NEED_STRLCPY
+size_t strlcpy(char * dst, const char * src, size_t size) {
+    const size_t Length = strlen(src);
+
+    if (size > 0) {
+        const size_t Copy = (Length < size) ? Length : (size - 1);
+        memcpy(dst, src, Copy);
+        dst[Copy] = 0x00;
+    }
+    return (Length);
+}
+#endif
@@ -0,0 +1,203 @@
+/**
+ ******************************************************************************
+ *  file           : host_event.c
+ *  brief          : Host build: Default event loop
+ *
+ *  As on the target, posted events are copied and the handlers run in
+ *  the task of the loop, one event after the other.
+ ******************************************************************************
+ */
+
+/****************************** Includes  */
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "esp_event.h"
+#include "freertos/task.h"
+#include "host.h"
+
+/****************************** Configuration */
+#define EVENT_MAX_HANDLERS 32           // Max number of registered handlers
+
+/****************************** Statics */
+typedef struct HostEventHandler {
+    esp_event_base_t    Base;           // ESP_EVENT_ANY_BASE for all
+    int32_t             Id;             // ESP_EVENT_ANY_ID for all
+    esp_event_handler_t Handler;        // NULL if unused
+    void *              pArg;
+} HostEventHandler;
+
+typedef struct HostEvent {
+    struct HostEvent *  pNext;
+    esp_event_base_t    Base;
+    int32_t             Id;
+    size_t              Size;
+    uint8_t             Data[];
+} HostEvent;
+
+static pthread_mutex_t Lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t Cond = PTHREAD_COND_INITIALIZER;
+static HostEventHandler Handlers[EVENT_MAX_HANDLERS];
+static HostEvent * pHead = NULL;        // Oldest event
+static HostEvent * pTail = NULL;
+static bool isCreated = false;
+static bool isBusy = false;             // Handlers running
+
+/****************************** Functions */
+
+static bool event_matches(const HostEventHandler * pHandler, const HostEvent * pEvent) {
+    return ((NULL != pHandler->Handler)
+         && ((ESP_EVENT_ANY_BASE == pHandler->Base) || (pHandler->Base == pEvent->Base))
+         && ((ESP_EVENT_ANY_ID == pHandler->Id) || (pHandler->Id == pEvent->Id)));
+}
+
+/**
+ * @brief Task: Call the handlers of the posted events
+ */
+static void event_task(void * pvParameters) {
+    HostEventHandler Matching[EVENT_MAX_HANDLERS];
+
+    pthread_mutex_lock(&Lock);
+    while (1) {
+        if (NULL == pHead) {
+            isBusy = false;
+            pthread_cond_broadcast(&Cond);
+            pthread_cond_wait(&Cond, &Lock);
+            continue;
+        }
+        HostEvent * pEvent = pHead;
+        pHead = pEvent->pNext;
+        if (NULL == pHead) {
+            pTail = NULL;
+        }
+        isBusy = true;
+
+        // Handlers may (un)register others, call a snapshot
+        int Count = 0;
+        for (int i = 0; i < EVENT_MAX_HANDLERS; i++) {
+            if (event_matches(&Handlers[i], pEvent)) {
+                Matching[Count++] = Handlers[i];
+            }
+        }
+        pthread_mutex_unlock(&Lock);
+
+        for (int i = 0; i < Count; i++) {
+            Matching[i].Handler(Matching[i].pArg, pEvent->Base, pEvent->Id, (pEvent->Size > 0) ? pEvent->Data : NULL);
+        }
+        free(pEvent);
+
+        pthread_mutex_lock(&Lock);
+    }
+}  // event_task
+
+static esp_err_t event_register(esp_event_base_t event_base, int32_t event_id, esp_event_handler_t event_handler, void * event_handler_arg, esp_event_handler_instance_t * instance) {
+    esp_err_t ret = ESP_ERR_NO_MEM;
+
+    if (NULL == event_handler) {
+        return (ESP_ERR_INVALID_ARG);
+    }
+    pthread_mutex_lock(&Lock);
+    for (int i = 0; i < EVENT_MAX_HANDLERS; i++) {
+        if (NULL == Handlers[i].Handler) {
+            Handlers[i] = (HostEventHandler){ .Base = event_base, .Id = event_id, .Handler = event_handler, .pArg = event_handler_arg };
+            if (NULL != instance) {
+                *instance = &Handlers[i];
+            }
+            ret = ESP_OK;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&Lock);
+    return (ret);
+}  // event_register
+
+esp_err_t esp_event_loop_create_default(void) {
+    pthread_mutex_lock(&Lock);
+    if (isCreated) {
+        pthread_mutex_unlock(&Lock);
+        return (ESP_ERR_INVALID_STATE);
+    }
+    isCreated = true;
+    pthread_mutex_unlock(&Lock);
+
+    return ((pdPASS == xTaskCreate(event_task, "sys_evt", 2304, NULL, 20, NULL)) ? ESP_OK : ESP_ERR_NO_MEM);
+}
+
+esp_err_t esp_event_handler_register(esp_event_base_t event_base, int32_t event_id, esp_event_handler_t event_handler, void * event_handler_arg) {
+    return (event_register(event_base, event_id, event_handler, event_handler_arg, NULL));
+}
+
+esp_err_t esp_event_handler_instance_register(esp_event_base_t event_base, int32_t event_id, esp_event_handler_t event_handler, void * event_handler_arg, esp_event_handler_instance_t * instance) {
+    return (event_register(event_base, event_id, event_handler, event_handler_arg, instance));
+}
+
+esp_err_t esp_event_handler_unregister(esp_event_base_t event_base, int32_t event_id, esp_event_handler_t event_handler) {
+    esp_err_t ret = ESP_ERR_NOT_FOUND;
+
+    pthread_mutex_lock(&Lock);
+    for (int i = 0; i < EVENT_MAX_HANDLERS; i++) {
+        if ((Handlers[i].Handler == event_handler) && (Handlers[i].Base == event_base) && (Handlers[i].Id == event_id)) {
+            Handlers[i].Handler = NULL;
+            ret = ESP_OK;
+        }
+    }
+    pthread_mutex_unlock(&Lock);
+    return (ret);
+}
+
+esp_err_t esp_event_handler_instance_unregister(esp_event_base_t event_base, int32_t event_id, esp_event_handler_instance_t instance) {
+    HostEventHandler * pHandler = instance;
+
+    if (NULL == pHandler) {
+        return (ESP_ERR_INVALID_ARG);
+    }
+    pthread_mutex_lock(&Lock);
+    pHandler->Handler = NULL;
+    pthread_mutex_unlock(&Lock);
+    return (ESP_OK);
+}
+
+esp_err_t esp_event_post(esp_event_base_t event_base, int32_t event_id, const void * event_data, size_t event_data_size, TickType_t ticks_to_wait) {
+    HostEvent * pEvent = malloc(sizeof(HostEvent) + event_data_size);
+
+    if (NULL == pEvent) {
+        return (ESP_ERR_NO_MEM);
+    }
+    pEvent->pNext = NULL;
+    pEvent->Base = event_base;
+    pEvent->Id = event_id;
+    pEvent->Size = (NULL != event_data) ? event_data_size : 0;
+    if (pEvent->Size > 0) {
+        memcpy(pEvent->Data, event_data, pEvent->Size);
+    }
+
+    pthread_mutex_lock(&Lock);
+    if (!isCreated) {
+        pthread_mutex_unlock(&Lock);
+        free(pEvent);
+        return (ESP_ERR_INVALID_STATE);
+    }
+    if (NULL == pTail) {
+        pHead = pEvent;
+    } else {
+        pTail->pNext = pEvent;
+    }
+    pTail = pEvent;
+    isBusy = true;
+    pthread_cond_broadcast(&Cond);
+    pthread_mutex_unlock(&Lock);
+    return (ESP_OK);
+}  // esp_event_post
+
+/**
+ * @brief Wait until all posted events are handled
+ *
+ * Handlers posting new events are waited for as well.
+ */
+void HostEvent_Flush(void) {
+    pthread_mutex_lock(&Lock);
+    while (isCreated && isBusy) {
+        pthread_cond_wait(&Cond, &Lock);
+    }
+    pthread_mutex_unlock(&Lock);
+}
@@ -0,0 +1,220 @@
+/**
+ ******************************************************************************
+ *  file           : host_flash.c
+ *  brief          : Host build: Flash partitions in files, with wear counters
+ *
+ *  Writes behave as on NOR flash: They can only clear bits, erased
+ *  sectors read 0xFF. Every erase is counted per sector. With
+ *  HostFlash_SetTiming() erases and writes take as long as on a chip.
+ ******************************************************************************
+ */
+
+/****************************** Includes  */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "esp_partition.h"
+#include "esp_ota_ops.h"
+#include "host.h"
+
+/****************************** Configuration */
+#define HOST_MAX_PARTITIONS 8           // Max number of partitions
+
+/****************************** Statics */
+typedef struct HostPartition {
+    esp_partition_t Part;               // First member, the handle points here
+    FILE *          pFile;
+    uint32_t *      pErases;            // Erases per sector
+    HostFlash_Stats Stats;
+} HostPartition;
+
+static HostPartition Partitions[HOST_MAX_PARTITIONS];
+static size_t PartitionCount = 0;
+static pthread_mutex_t FlashLock = PTHREAD_MUTEX_INITIALIZER;
+static uint32_t EraseUs = 0;                    // Time of a sector erase
+static uint32_t WriteUsPerKb = 0;               // Time of writing 1 kB
+
+/****************************** Functions */
+
+/**
+ * @brief Add a partition
+ *
+ * A new file is filled with 0xFF (erased), an existing one is used as it
+ * is, so the content survives a simulated reboot.
+ *
+ * @param Label Label of the partition
+ * @param Type Type
+ * @param Subtype Subtype
+ * @param Path The file, NULL for a temporary one
+ * @param Size Bytes, a multiple of HOST_FLASH_SECTOR
+ * @return const esp_partition_t* NULL on errors
+ */
+const esp_partition_t * HostFlash_AddPartition(const char * Label, esp_partition_type_t Type, esp_partition_subtype_t Subtype, const char * Path, size_t Size) {
+    if ((PartitionCount >= HOST_MAX_PARTITIONS) || (0 != (Size % HOST_FLASH_SECTOR))) {
+        return (NULL);
+    }
+
+    FILE * pFile = (NULL != Path) ? fopen(Path, "r+b") : NULL;
+    if (NULL == pFile) {
+        pFile = (NULL != Path) ? fopen(Path, "w+b") : tmpfile();
+        if (NULL == pFile) {
+            return (NULL);
+        }
+        static const uint8_t Erased[HOST_FLASH_SECTOR] = { [0 ... HOST_FLASH_SECTOR-1] = 0xFF };
+        for (size_t Offset = 0; Offset < Size; Offset += sizeof(Erased)) {
+            fwrite(Erased, 1, sizeof(Erased), pFile);
+        }
+        fflush(pFile);
+    }
+
+    HostPartition * pPart = &Partitions[PartitionCount];
+    memset(pPart, 0x00, sizeof(HostPartition));
+    pPart->Part.type = Type;
+    pPart->Part.subtype = Subtype;
+    pPart->Part.address = 0x10000 * (PartitionCount + 1);
+    pPart->Part.size = Size;
+    pPart->Part.erase_size = HOST_FLASH_SECTOR;
+    strncpy(pPart->Part.label, Label, sizeof(pPart->Part.label) - 1);
+    pPart->pFile = pFile;
+    pPart->pErases = calloc(Size / HOST_FLASH_SECTOR, sizeof(uint32_t));
+    PartitionCount++;
+
+    return (&pPart->Part);
+}  // HostFlash_AddPartition
+
+/**
+ * @brief Get the flash use of a partition
+ */
+void HostFlash_GetStats(const esp_partition_t * pPart, HostFlash_Stats * pStats) {
+    pthread_mutex_lock(&FlashLock);
+    memcpy(pStats, &((const HostPartition*)pPart)->Stats, sizeof(HostFlash_Stats));
+    pthread_mutex_unlock(&FlashLock);
+}
+
+/**
+ * @brief Clear the flash use of a partition, the erase counts of the sectors stay
+ */
+void HostFlash_ResetStats(const esp_partition_t * pPart) {
+    HostPartition * pHost = (HostPartition*)pPart;
+
+    pthread_mutex_lock(&FlashLock);
+    memset(&pHost->Stats, 0x00, sizeof(HostFlash_Stats));
+    pthread_mutex_unlock(&FlashLock);
+}
+
+/**
+ * @brief Let erases and writes take time, as on the chip
+ *
+ * @param SectorEraseUs Time of a sector erase, 0 for none
+ * @param WriteUsKb Time of writing 1 kB, 0 for none
+ */
+void HostFlash_SetTiming(uint32_t SectorEraseUs, uint32_t WriteUsKb) {
+    EraseUs = SectorEraseUs;
+    WriteUsPerKb = WriteUsKb;
+}
+
+const esp_partition_t * esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype, const char * label) {
+    for (size_t i = 0; i < PartitionCount; i++) {
+        const esp_partition_t * pPart = &Partitions[i].Part;
+        if ((pPart->type == type)
+         && ((ESP_PARTITION_SUBTYPE_ANY == subtype) || (pPart->subtype == subtype))
+         && ((NULL == label) || (0 == strcmp(pPart->label, label)))) {
+            return (pPart);
+        }
+    }
+    return (NULL);
+}  // esp_partition_find_first
+
+esp_err_t esp_partition_read(const esp_partition_t * partition, size_t src_offset, void * dst, size_t size) {
+    HostPartition * pHost = (HostPartition*)partition;
+    esp_err_t ret = ESP_OK;
+
+    if ((src_offset + size) > partition->size) {
+        return (ESP_ERR_INVALID_SIZE);
+    }
+    pthread_mutex_lock(&FlashLock);
+    if ((0 != fseek(pHost->pFile, src_offset, SEEK_SET)) || (size != fread(dst, 1, size, pHost->pFile))) {
+        ret = ESP_FAIL;
+    }
+    pHost->Stats.BytesRead += size;
+    pthread_mutex_unlock(&FlashLock);
+    return (ret);
+}  // esp_partition_read
+
+esp_err_t esp_partition_write(const esp_partition_t * partition, size_t dst_offset, const void * src, size_t size) {
+    HostPartition * pHost = (HostPartition*)partition;
+    const uint8_t * pSrc = src;
+    uint8_t Buffer[256];
+    esp_err_t ret = ESP_OK;
+
+    if ((dst_offset + size) > partition->size) {
+        return (ESP_ERR_INVALID_SIZE);
+    }
+    pthread_mutex_lock(&FlashLock);
+    for (size_t Done = 0; (Done < size) && (ESP_OK == ret); ) {
+        const size_t Chunk = ((size - Done) < sizeof(Buffer)) ? (size - Done) : sizeof(Buffer);
+
+        // NOR flash: Bits can only be cleared
+        if ((0 != fseek(pHost->pFile, dst_offset + Done, SEEK_SET)) || (Chunk != fread(Buffer, 1, Chunk, pHost->pFile))) {
+            ret = ESP_FAIL;
+            break;
+        }
+        for (size_t i = 0; i < Chunk; i++) {
+            Buffer[i] &= pSrc[Done + i];
+        }
+        if ((0 != fseek(pHost->pFile, dst_offset + Done, SEEK_SET)) || (Chunk != fwrite(Buffer, 1, Chunk, pHost->pFile))) {
+            ret = ESP_FAIL;
+        }
+        Done += Chunk;
+    }
+    fflush(pHost->pFile);
+    pHost->Stats.BytesWritten += size;
+    if (0 != WriteUsPerKb) {
+        usleep(((uint64_t)size * WriteUsPerKb) / 1024);
+    }
+    pthread_mutex_unlock(&FlashLock);
+    return (ret);
+}  // esp_partition_write
+
+esp_err_t esp_partition_erase_range(const esp_partition_t * partition, size_t offset, size_t size) {
+    static const uint8_t Erased[HOST_FLASH_SECTOR] = { [0 ... HOST_FLASH_SECTOR-1] = 0xFF };
+    HostPartition * pHost = (HostPartition*)partition;
+    esp_err_t ret = ESP_OK;
+
+    if ((0 != (offset % HOST_FLASH_SECTOR)) || (0 != (size % HOST_FLASH_SECTOR)) || ((offset + size) > partition->size)) {
+        return (ESP_ERR_INVALID_ARG);
+    }
+    pthread_mutex_lock(&FlashLock);
+    for (size_t Sector = offset / HOST_FLASH_SECTOR; Sector < ((offset + size) / HOST_FLASH_SECTOR); Sector++) {
+        if ((0 != fseek(pHost->pFile, Sector * HOST_FLASH_SECTOR, SEEK_SET)) || (sizeof(Erased) != fwrite(Erased, 1, sizeof(Erased), pHost->pFile))) {
+            ret = ESP_FAIL;
+        }
+        pHost->pErases[Sector]++;
+        pHost->Stats.Erases++;
+        if (pHost->pErases[Sector] > pHost->Stats.MaxSectorErases) {
+            pHost->Stats.MaxSectorErases = pHost->pErases[Sector];
+        }
+        if (0 != EraseUs) {
+            usleep(EraseUs);
+        }
+    }
+    fflush(pHost->pFile);
+    pthread_mutex_unlock(&FlashLock);
+    return (ret);
+}  // esp_partition_erase_range
+
+/**
+ * @brief App description of an image in a partition, behind the first segment header
+ */
+esp_err_t esp_ota_get_partition_description(const esp_partition_t * partition, esp_app_desc_t * app_desc) {
+    if ((NULL == partition) || (NULL == app_desc)) {
+        return (ESP_ERR_INVALID_ARG);
+    }
+    esp_err_t ret = esp_partition_read(partition, sizeof(esp_image_header_t) + sizeof(esp_image_segment_header_t), app_desc, sizeof(esp_app_desc_t));
+    if ((ESP_OK == ret) && (ESP_APP_DESC_MAGIC_WORD != app_desc->magic_word)) {
+        ret = ESP_ERR_NOT_FOUND;
+    }
+    return (ret);
+}  // esp_ota_get_partition_description
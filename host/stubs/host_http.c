@@ -0,0 +1,475 @@
+/**
+ ******************************************************************************
+ *  file           : host_http.c
+ *  brief          : Host build: HTTP client and an in-process image server
+ *
+ *  The client speaks plain HTTP/1.1 with Content-Length, one request per
+ *  connection. Headers are passed to the event handler as ON_HEADER.
+ *  HostHttp_Serve() serves one image on localhost with Range, If-Range
+ *  and ETag, optionally throttled or dropping a connection once, so
+ *  tests and benchmarks need no external server.
+ ******************************************************************************
+ */
+
+/****************************** Includes  */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <time.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include "esp_http_client.h"
+#include "host.h"
+
+/****************************** Configuration */
+#define HTTP_MAX_URL 256                // Max length of the URL
+#define HTTP_MAX_HEADERS 512            // Request headers set by the user
+#define HTTP_MAX_HEAD 4096              // Max size of the response head
+#define HTTP_SERVE_PIECE 4096           // Sent at once by the server
+
+/****************************** Statics */
+struct esp_http_client {
+    esp_http_client_config_t Config;
+    char        Host[128];
+    char        Port[8];
+    char        Path[HTTP_MAX_URL];
+    char        Headers[HTTP_MAX_HEADERS];  // "Key: Value\r\n"...
+    int         Socket;                 // -1 if closed
+    int         Status;
+    int64_t     ContentLength;          // -1 if unknown
+    int64_t     Received;               // Body bytes
+    bool        isEof;                  // Server closed the connection
+    char        Head[HTTP_MAX_HEAD];    // Response head, then body bytes read with it
+    size_t      HeadLen;
+    size_t      BodyStart;              // Body bytes in Head...
+    size_t      BodyEnd;
+};
+
+typedef struct HostHttp_Server {
+    int             Socket;             // Listening, -1 if stopped
+    pthread_t       Thread;
+    const uint8_t * pData;
+    size_t          Length;
+    HostHttp_Options Options;
+    bool            isDropped;          // DropAt was applied
+    HostHttp_Stats  Stats;
+} HostHttp_Server;
+
+static HostHttp_Server Server = { .Socket = -1 };
+static pthread_mutex_t ServerLock = PTHREAD_MUTEX_INITIALIZER;
+
+/****************************** Functions */
+
+/**
+ * @brief Split "http://host[:port]/path"
+ */
+static bool http_parse_url(esp_http_client_handle_t client, const char * Url) {
+    const char * pHost;
+    const char * pPath;
+
+    if (0 != strncmp(Url, "http://", 7)) {
+        return (false);
+    }
+    pHost = Url + 7;
+    pPath = strchr(pHost, '/');
+    if (NULL == pPath) {
+        pPath = "/";
+    }
+    const size_t HostLen = (pPath > pHost) ? (size_t)(pPath - pHost) : strlen(pHost);
+    if ((HostLen >= sizeof(client->Host)) || (strlen(pPath) >= sizeof(client->Path))) {
+        return (false);
+    }
+    memcpy(client->Host, pHost, HostLen);
+    client->Host[HostLen] = '\0';
+    strcpy(client->Path, pPath);
+
+    char * pPort = strchr(client->Host, ':');
+    if (NULL != pPort) {
+        *pPort++ = '\0';
+        strlcpy(client->Port, pPort, sizeof(client->Port));
+    } else {
+        strcpy(client->Port, "80");
+    }
+    return (true);
+}  // http_parse_url
+
+static bool http_send_all(int Socket, const void * pData, size_t Length) {
+    const uint8_t * p = pData;
+
+    while (Length > 0) {
+        const ssize_t Sent = send(Socket, p, Length, MSG_NOSIGNAL);
+        if (Sent <= 0) {
+            return (false);
+        }
+        p += Sent;
+        Length -= Sent;
+    }
+    return (true);
+}
+
+esp_http_client_handle_t esp_http_client_init(const esp_http_client_config_t * config) {
+    esp_http_client_handle_t client = calloc(1, sizeof(struct esp_http_client));
+
+    if (NULL == client) {
+        return (NULL);
+    }
+    if ((NULL == config->url) || !http_parse_url(client, config->url)) {
+        free(client);
+        return (NULL);
+    }
+    client->Config = *config;
+    client->Socket = -1;
+    client->ContentLength = -1;
+    return (client);
+}
+
+esp_err_t esp_http_client_set_header(esp_http_client_handle_t client, const char * key, const char * value) {
+    const size_t Used = strlen(client->Headers);
+    const int Length = snprintf(client->Headers + Used, sizeof(client->Headers) - Used, "%s: %s\r\n", key, value);
+
+    if ((Length < 0) || ((size_t)Length >= sizeof(client->Headers) - Used)) {
+        client->Headers[Used] = '\0';
+        return (ESP_ERR_NO_MEM);
+    }
+    return (ESP_OK);
+}
+
+esp_err_t esp_http_client_open(esp_http_client_handle_t client, int write_len) {
+    struct addrinfo Hints = { .ai_family = AF_INET, .ai_socktype = SOCK_STREAM };
+    struct addrinfo * pAddr = NULL;
+    char Request[HTTP_MAX_URL + HTTP_MAX_HEADERS + 256];
+
+    if ((0 != getaddrinfo(client->Host, client->Port, &Hints, &pAddr)) || (NULL == pAddr)) {
+        return (ESP_ERR_HTTP_CONNECT);
+    }
+    client->Socket = socket(pAddr->ai_family, pAddr->ai_socktype, pAddr->ai_protocol);
+    if (client->Socket >= 0) {
+        const int Ms = (client->Config.timeout_ms > 0) ? client->Config.timeout_ms : 5000;
+        const struct timeval Timeout = { .tv_sec = Ms / 1000, .tv_usec = (Ms % 1000) * 1000 };
+        setsockopt(client->Socket, SOL_SOCKET, SO_RCVTIMEO, &Timeout, sizeof(Timeout));
+        setsockopt(client->Socket, SOL_SOCKET, SO_SNDTIMEO, &Timeout, sizeof(Timeout));
+        if (0 != connect(client->Socket, pAddr->ai_addr, pAddr->ai_addrlen)) {
+            close(client->Socket);
+            client->Socket = -1;
+        }
+    }
+    freeaddrinfo(pAddr);
+    if (client->Socket < 0) {
+        return (ESP_ERR_HTTP_CONNECT);
+    }
+
+    const int Length = snprintf(Request, sizeof(Request), "GET %s HTTP/1.1\r\nHost: %s\r\n%sConnection: close\r\n\r\n",
+                                client->Path, client->Host, client->Headers);
+    if (!http_send_all(client->Socket, Request, Length)) {
+        esp_http_client_close(client);
+        return (ESP_ERR_HTTP_WRITE_DATA);
+    }
+    client->Status = 0;
+    client->ContentLength = -1;
+    client->Received = 0;
+    client->isEof = false;
+    client->HeadLen = 0;
+    client->BodyStart = 0;
+    client->BodyEnd = 0;
+    return (ESP_OK);
+}  // esp_http_client_open
+
+int64_t esp_http_client_fetch_headers(esp_http_client_handle_t client) {
+    char * pEnd = NULL;
+
+    // Read until the end of the head, the rest is body
+    while (NULL == pEnd) {
+        if (client->HeadLen >= sizeof(client->Head) - 1) {
+            return (-1);
+        }
+        const ssize_t Got = recv(client->Socket, client->Head + client->HeadLen, sizeof(client->Head) - 1 - client->HeadLen, 0);
+        if (Got <= 0) {
+            return (-1);
+        }
+        client->HeadLen += Got;
+        client->Head[client->HeadLen] = '\0';
+        pEnd = strstr(client->Head, "\r\n\r\n");
+    }
+    client->BodyStart = (pEnd - client->Head) + 4;
+    client->BodyEnd = client->HeadLen;
+    *pEnd = '\0';
+
+    // Status line, then "Key: Value" lines
+    char * pSave = NULL;
+    char * pLine = strtok_r(client->Head, "\r\n", &pSave);
+    if ((NULL == pLine) || (1 != sscanf(pLine, "HTTP/%*d.%*d %d", &client->Status))) {
+        return (-1);
+    }
+    while (NULL != (pLine = strtok_r(NULL, "\r\n", &pSave))) {
+        char * pValue = strchr(pLine, ':');
+        if (NULL == pValue) {
+            continue;
+        }
+        *pValue++ = '\0';
+        while (' ' == *pValue) {
+            pValue++;
+        }
+        if (0 == strcasecmp(pLine, "Content-Length")) {
+            client->ContentLength = strtoll(pValue, NULL, 10);
+        }
+        if (NULL != client->Config.event_handler) {
+            esp_http_client_event_t Event = {
+                .event_id = HTTP_EVENT_ON_HEADER,
+                .client = client,
+                .user_data = client->Config.user_data,
+                .header_key = pLine,
+                .header_value = pValue,
+            };
+            client->Config.event_handler(&Event);
+        }
+    }
+    return ((client->ContentLength >= 0) ? client->ContentLength : 0);
+}  // esp_http_client_fetch_headers
+
+int esp_http_client_get_status_code(esp_http_client_handle_t client) {
+    return (client->Status);
+}
+
+int esp_http_client_read(esp_http_client_handle_t client, char * buffer, int len) {
+    if ((NULL == client) || (client->Socket < 0)) {
+        errno = ENOTCONN;
+        return (-1);
+    }
+    if ((client->ContentLength >= 0) && (len > client->ContentLength - client->Received)) {
+        len = client->ContentLength - client->Received;
+    }
+    if (len <= 0) {
+        return (0);
+    }
+
+    // Body bytes read with the head first
+    if (client->BodyStart < client->BodyEnd) {
+        const size_t Count = ((size_t)len < (client->BodyEnd - client->BodyStart)) ? (size_t)len : (client->BodyEnd - client->BodyStart);
+        memcpy(buffer, client->Head + client->BodyStart, Count);
+        client->BodyStart += Count;
+        client->Received += Count;
+        return (Count);
+    }
+
+    const ssize_t Got = recv(client->Socket, buffer, len, 0);
+    if (0 == Got) {
+        client->isEof = true;
+        if ((client->ContentLength >= 0) && (client->Received < client->ContentLength)) {
+            errno = ECONNRESET;
+            return (-1);
+        }
+        return (0);
+    }
+    if (Got < 0) {
+        return (-1);
+    }
+    client->Received += Got;
+    return (Got);
+}  // esp_http_client_read
+
+bool esp_http_client_is_complete_data_received(esp_http_client_handle_t client) {
+    if (client->ContentLength >= 0) {
+        return (client->Received >= client->ContentLength);
+    }
+    return (client->isEof);
+}
+
+esp_err_t esp_http_client_close(esp_http_client_handle_t client) {
+    if (client->Socket >= 0) {
+        close(client->Socket);
+        client->Socket = -1;
+    }
+    return (ESP_OK);
+}
+
+esp_err_t esp_http_client_cleanup(esp_http_client_handle_t client) {
+    esp_http_client_close(client);
+    free(client);
+    return (ESP_OK);
+}
+
+/**
+ * @brief Value of a request header, or NULL
+ */
+static const char * http_header(char * pRequest, const char * Key, char * pValue, size_t Size) {
+    const size_t KeyLen = strlen(Key);
+
+    for (char * pLine = strstr(pRequest, "\r\n"); NULL != pLine; pLine = strstr(pLine, "\r\n")) {
+        pLine += 2;
+        if ((0 == strncasecmp(pLine, Key, KeyLen)) && (':' == pLine[KeyLen])) {
+            const char * pStart = pLine + KeyLen + 1;
+            while (' ' == *pStart) {
+                pStart++;
+            }
+            const size_t Length = strcspn(pStart, "\r\n");
+            snprintf(pValue, Size, "%.*s", (int)Length, pStart);
+            return (pValue);
+        }
+    }
+    return (NULL);
+}  // http_header
+
+/**
+ * @brief Answer one request of a connection
+ */
+static void http_serve_one(int Socket) {
+    char Request[2048] = "";
+    size_t Length = 0;
+    char Value[128];
+    char Head[512];
+    size_t Start = 0;
+    struct timespec Begin;
+
+    while ((Length < sizeof(Request) - 1) && (NULL == strstr(Request, "\r\n\r\n"))) {
+        const ssize_t Got = recv(Socket, Request + Length, sizeof(Request) - 1 - Length, 0);
+        if (Got <= 0) {
+            return;
+        }
+        Length += Got;
+        Request[Length] = '\0';
+    }
+
+    pthread_mutex_lock(&ServerLock);
+    const HostHttp_Options Options = Server.Options;
+    Server.Stats.Requests++;
+    pthread_mutex_unlock(&ServerLock);
+
+    // Ranges are served if the image is unchanged
+    unsigned long long From;
+    if (!Options.NoRange && (NULL != http_header(Request, "Range", Value, sizeof(Value)))
+     && (1 == sscanf(Value, "bytes=%llu-", &From)) && (From < Server.Length)
+     && ((NULL == http_header(Request, "If-Range", Value, sizeof(Value)))
+      || ((NULL != Options.ETag) && (0 == strcmp(Value, Options.ETag))))) {
+        Start = From;
+        snprintf(Head, sizeof(Head), "HTTP/1.1 206 Partial Content\r\nContent-Range: bytes %zu-%zu/%zu\r\n",
+                 Start, Server.Length - 1, Server.Length);
+        pthread_mutex_lock(&ServerLock);
+        Server.Stats.Ranges++;
+        pthread_mutex_unlock(&ServerLock);
+    } else {
+        strcpy(Head, "HTTP/1.1 200 OK\r\n");
+    }
+    if (NULL != Options.ETag) {
+        snprintf(Head + strlen(Head), sizeof(Head) - strlen(Head), "ETag: %s\r\n", Options.ETag);
+    }
+    snprintf(Head + strlen(Head), sizeof(Head) - strlen(Head), "Content-Length: %zu\r\nConnection: close\r\n\r\n", Server.Length - Start);
+    if (!http_send_all(Socket, Head, strlen(Head))) {
+        return;
+    }
+
+    // The body, throttled to the rate
+    clock_gettime(CLOCK_MONOTONIC, &Begin);
+    for (size_t Offset = Start; Offset < Server.Length; ) {
+        size_t Piece = ((Server.Length - Offset) < HTTP_SERVE_PIECE) ? (Server.Length - Offset) : HTTP_SERVE_PIECE;
+
+        pthread_mutex_lock(&ServerLock);
+        const bool isDrop = (Options.DropAt > 0) && !Server.isDropped && (Offset + Piece > Options.DropAt);
+        if (isDrop) {
+            Server.isDropped = true;
+            Server.Stats.Drops++;
+            Piece = (Options.DropAt > Offset) ? (Options.DropAt - Offset) : 0;
+        }
+        pthread_mutex_unlock(&ServerLock);
+
+        if ((Piece > 0) && !http_send_all(Socket, Server.pData + Offset, Piece)) {
+            return;
+        }
+        Offset += Piece;
+        pthread_mutex_lock(&ServerLock);
+        Server.Stats.BytesSent += Piece;
+        pthread_mutex_unlock(&ServerLock);
+        if (isDrop) {
+            return;
+        }
+
+        if (Options.RateKBs > 0) {
+            struct timespec Now;
+            clock_gettime(CLOCK_MONOTONIC, &Now);
+            const int64_t ElapsedUs = (Now.tv_sec - Begin.tv_sec) * 1000000LL + (Now.tv_nsec - Begin.tv_nsec) / 1000;
+            const int64_t DueUs = (int64_t)(Offset - Start) * 1000 / Options.RateKBs;
+            if (DueUs > ElapsedUs) {
+                usleep(DueUs - ElapsedUs);
+            }
+        }
+    }
+}  // http_serve_one
+
+static void * http_server_thread(void * pArg) {
+    while (1) {
+        const int Socket = accept(Server.Socket, NULL, NULL);
+        if (Socket < 0) {
+            return (NULL);
+        }
+        http_serve_one(Socket);
+        close(Socket);
+    }
+}
+
+/**
+ * @brief Serve an image on localhost, every path gives the image
+ *
+ * @param pData The image, must stay valid until HostHttp_Stop()
+ * @param Length Length of the image
+ * @param pOptions ETag, throttle and drop, NULL for none
+ * @return int The port, -1 on errors
+ */
+int HostHttp_Serve(const void * pData, size_t Length, const HostHttp_Options * pOptions) {
+    struct sockaddr_in Addr = { .sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+    socklen_t AddrLen = sizeof(Addr);
+
+    HostHttp_Stop();
+    Server.Socket = socket(AF_INET, SOCK_STREAM, 0);
+    if (Server.Socket < 0) {
+        return (-1);
+    }
+    if ((0 != bind(Server.Socket, (struct sockaddr*)&Addr, sizeof(Addr))) || (0 != listen(Server.Socket, 4))
+     || (0 != getsockname(Server.Socket, (struct sockaddr*)&Addr, &AddrLen))) {
+        close(Server.Socket);
+        Server.Socket = -1;
+        return (-1);
+    }
+    Server.pData = pData;
+    Server.Length = Length;
+    memset(&Server.Options, 0x00, sizeof(Server.Options));
+    if (NULL != pOptions) {
+        Server.Options = *pOptions;
+    }
+    Server.isDropped = false;
+    memset(&Server.Stats, 0x00, sizeof(Server.Stats));
+    if (0 != pthread_create(&Server.Thread, NULL, http_server_thread, NULL)) {
+        close(Server.Socket);
+        Server.Socket = -1;
+        return (-1);
+    }
+    return (ntohs(Addr.sin_port));
+}  // HostHttp_Serve
+
+/**
+ * @brief Get the counters of the server
+ */
+void HostHttp_GetStats(HostHttp_Stats * pStats) {
+    pthread_mutex_lock(&ServerLock);
+    *pStats = Server.Stats;
+    pthread_mutex_unlock(&ServerLock);
+}
+
+/**
+ * @brief Stop the server, waits for the running response
+ */
+void HostHttp_Stop(void) {
+    if (Server.Socket < 0) {
+        return;
+    }
+    shutdown(Server.Socket, SHUT_RDWR);
+    close(Server.Socket);
+    pthread_join(Server.Thread, NULL);
+    Server.Socket = -1;
+}
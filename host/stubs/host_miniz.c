@@ -0,0 +1,79 @@
+/**
+ ******************************************************************************
+ *  file           : host_miniz.c
+ *  brief          : Host build: tinfl of the ROM, on zlib
+ ******************************************************************************
+ */
+
+/****************************** Includes  */
+#include <string.h>
+#include "rom/miniz.h"
+
+/****************************** Functions */
+
+/**
+ * @brief zlib allocator on the heap inside the decompressor
+ */
+static voidpf tinfl_alloc(voidpf opaque, uInt items, uInt size) {
+    tinfl_decompressor * r = opaque;
+    const size_t Bytes = (((size_t)items * size) + 15) & ~(size_t)15;
+
+    if (Bytes > (sizeof(r->Heap) - r->HeapUsed)) {
+        return (Z_NULL);
+    }
+    void * p = &r->Heap[r->HeapUsed];
+    r->HeapUsed += Bytes;
+    return (p);
+}
+
+static void tinfl_free(voidpf opaque, voidpf address) {
+    (void)opaque;
+    (void)address;
+}
+
+/**
+ * @brief Start a new raw deflate stream
+ */
+void host_tinfl_init(tinfl_decompressor * r) {
+    memset(&r->Stream, 0x00, sizeof(r->Stream));
+    r->HeapUsed = 0;
+    r->Stream.zalloc = tinfl_alloc;
+    r->Stream.zfree = tinfl_free;
+    r->Stream.opaque = r;
+    r->Error = inflateInit2(&r->Stream, -15);
+}
+
+/**
+ * @brief Inflate into the output buffer, sizes are updated to the bytes used
+ */
+tinfl_status tinfl_decompress(tinfl_decompressor * r, const mz_uint8 * pIn_buf_next, size_t * pIn_buf_size,
+                              mz_uint8 * pOut_buf_start, mz_uint8 * pOut_buf_next, size_t * pOut_buf_size,
+                              const mz_uint32 decomp_flags) {
+    (void)pOut_buf_start;
+    (void)decomp_flags;
+
+    if (Z_OK != r->Error) {
+        *pIn_buf_size = 0;
+        *pOut_buf_size = 0;
+        return (TINFL_STATUS_FAILED);
+    }
+
+    r->Stream.next_in = (Bytef*)pIn_buf_next;
+    r->Stream.avail_in = *pIn_buf_size;
+    r->Stream.next_out = pOut_buf_next;
+    r->Stream.avail_out = *pOut_buf_size;
+
+    const int ret = inflate(&r->Stream, Z_NO_FLUSH);
+
+    *pIn_buf_size -= r->Stream.avail_in;
+    *pOut_buf_size -= r->Stream.avail_out;
+
+    if (Z_STREAM_END == ret) {
+        return (TINFL_STATUS_DONE);
+    }
+    if ((Z_OK != ret) && (Z_BUF_ERROR != ret)) {
+        r->Error = ret;
+        return (TINFL_STATUS_FAILED);
+    }
+    return ((0 == r->Stream.avail_out) ? TINFL_STATUS_HAS_MORE_OUTPUT : TINFL_STATUS_NEEDS_MORE_INPUT);
+}  // tinfl_decompress
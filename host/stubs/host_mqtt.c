@@ -0,0 +1,433 @@
+/**
+ ******************************************************************************
+ *  file           : host_mqtt.c
+ *  brief          : Host build: MQTT client with a broker stand-in
+ *
+ *  Events are passed to the registered handler by the task of the client,
+ *  as on the target. The broker is in process: A connect succeeds while
+ *  it is reachable, QoS 1/2 publishes are acknowledged at once and
+ *  publishes on a subscribed topic come back as DATA. Tests and benches
+ *  send to the device with HostMqtt_Inject(). After a disconnect the
+ *  client task ends, it is started again by esp_mqtt_client_start().
+ ******************************************************************************
+ */
+
+/****************************** Includes  */
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include "mqtt_client.h"
+#include "freertos/task.h"
+#include "host.h"
+
+/****************************** Configuration */
+#define HOST_MQTT_MAX_FILTERS 32        // Max number of subscribed filters
+#define HOST_MQTT_MAX_FILTERLEN 128     // Max length of a filter
+
+/****************************** Statics */
+typedef struct HostMqttEvent {
+    struct HostMqttEvent *  pNext;
+    esp_mqtt_event_t        Event;
+    uint8_t                 Data[];     // Topic and payload
+} HostMqttEvent;
+
+struct esp_mqtt_client {
+    esp_event_handler_t     Handler;
+    void *                  pArg;
+    bool                    isRunning;  // Client task active
+    bool                    isConnected;
+    int                     MsgId;      // Last message ID
+};
+
+static pthread_mutex_t Lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t Cond = PTHREAD_COND_INITIALIZER;
+static struct esp_mqtt_client Client;
+static bool isInit = false;
+static bool isBusy = false;             // Handler running
+static bool isReachable = true;         // Broker
+static HostMqttEvent * pHead = NULL;
+static HostMqttEvent * pTail = NULL;
+static char Filters[HOST_MQTT_MAX_FILTERS][HOST_MQTT_MAX_FILTERLEN];
+static HostMqtt_PublishHook PublishHook = NULL;
+static void * pHookArg = NULL;
+static HostMqtt_Stats Stats;
+
+/****************************** Functions */
+
+/**
+ * @brief Match a topic against a filter with the wildcards '+' and '#'
+ */
+static bool mqtt_match(const char * pFilter, const char * pTopic, size_t TopicLen) {
+    const char * pEnd = pTopic + TopicLen;
+
+    while ('\0' != *pFilter) {
+        if ('#' == *pFilter) {
+            return (true);
+        }
+        if ('+' == *pFilter) {
+            while ((pTopic < pEnd) && ('/' != *pTopic)) {
+                pTopic++;
+            }
+            pFilter++;
+            continue;
+        }
+        if ((pTopic >= pEnd) || (*pFilter != *pTopic)) {
+            // "a/#" matches "a" too
+            return ((pTopic >= pEnd) && (0 == strcmp(pFilter, "/#")));
+        }
+        pFilter++;
+        pTopic++;
+    }
+    return (pTopic >= pEnd);
+}  // mqtt_match
+
+/**
+ * @brief Is the topic subscribed? Lock must be held
+ */
+static bool mqtt_is_subscribed(const char * pTopic, size_t TopicLen) {
+    for (int i = 0; i < HOST_MQTT_MAX_FILTERS; i++) {
+        if (('\0' != Filters[i][0]) && mqtt_match(Filters[i], pTopic, TopicLen)) {
+            return (true);
+        }
+    }
+    return (false);
+}
+
+/**
+ * @brief Queue an event for the client task, lock must be held
+ *
+ * @param Id The event
+ * @param MsgId Message ID
+ * @param pTopic Topic, NULL if none
+ * @param TopicLen Length of the topic
+ * @param pData Data of the fragment
+ * @param DataLen Length of the fragment
+ * @param Offset Offset of the fragment
+ * @param TotalLen Length of the whole message
+ */
+static void mqtt_post(esp_mqtt_event_id_t Id, int MsgId, const char * pTopic, size_t TopicLen,
+                      const char * pData, size_t DataLen, size_t Offset, size_t TotalLen) {
+    HostMqttEvent * pEvent = calloc(1, sizeof(HostMqttEvent) + TopicLen + DataLen + 2);
+
+    if (NULL == pEvent) {
+        return;
+    }
+    esp_mqtt_event_t * pMqtt = &pEvent->Event;
+    pMqtt->event_id = Id;
+    pMqtt->client = &Client;
+    pMqtt->msg_id = MsgId;
+    if (NULL != pTopic) {
+        pMqtt->topic = (char*)pEvent->Data;
+        pMqtt->topic_len = TopicLen;
+        memcpy(pMqtt->topic, pTopic, TopicLen);
+    }
+    if (NULL != pData) {
+        pMqtt->data = (char*)pEvent->Data + TopicLen + 1;
+        pMqtt->data_len = DataLen;
+        memcpy(pMqtt->data, pData, DataLen);
+    }
+    pMqtt->current_data_offset = Offset;
+    pMqtt->total_data_len = TotalLen;
+
+    if (NULL == pTail) {
+        pHead = pEvent;
+    } else {
+        pTail->pNext = pEvent;
+    }
+    pTail = pEvent;
+    isBusy = true;
+    pthread_cond_broadcast(&Cond);
+}  // mqtt_post
+
+/**
+ * @brief Connection lost, lock must be held
+ */
+static void mqtt_drop(void) {
+    if (Client.isConnected) {
+        Client.isConnected = false;
+        Client.isRunning = false;
+        mqtt_post(MQTT_EVENT_DISCONNECTED, 0, NULL, 0, NULL, 0, 0, 0);
+    }
+}
+
+static uint64_t mqtt_now_ns(void) {
+    struct timespec Now;
+    clock_gettime(CLOCK_MONOTONIC, &Now);
+    return (((uint64_t)Now.tv_sec * 1000000000ULL) + Now.tv_nsec);
+}
+
+/**
+ * @brief Task: Pass the queued events to the handler, DATA events are timed
+ */
+static void mqtt_task(void * pvParameters) {
+    pthread_mutex_lock(&Lock);
+    while (1) {
+        if (NULL == pHead) {
+            isBusy = false;
+            pthread_cond_broadcast(&Cond);
+            pthread_cond_wait(&Cond, &Lock);
+            continue;
+        }
+        HostMqttEvent * pEvent = pHead;
+        pHead = pEvent->pNext;
+        if (NULL == pHead) {
+            pTail = NULL;
+        }
+        const esp_event_handler_t Handler = Client.Handler;
+        void * pArg = Client.pArg;
+        pthread_mutex_unlock(&Lock);
+
+        const uint64_t Start = mqtt_now_ns();
+        if (NULL != Handler) {
+            Handler(pArg, "MQTT_EVENTS", pEvent->Event.event_id, &pEvent->Event);
+        }
+        const uint32_t Ns = mqtt_now_ns() - Start;
+        const bool isData = (MQTT_EVENT_DATA == pEvent->Event.event_id);
+        free(pEvent);
+
+        pthread_mutex_lock(&Lock);
+        if (isData) {
+            Stats.DataEvents++;
+            Stats.HandlerNs += Ns;
+            Stats.HandlerMaxNs = (Ns > Stats.HandlerMaxNs) ? Ns : Stats.HandlerMaxNs;
+        }
+    }
+}  // mqtt_task
+
+esp_mqtt_client_handle_t esp_mqtt_client_init(const esp_mqtt_client_config_t * config) {
+    pthread_mutex_lock(&Lock);
+    if (isInit) {
+        pthread_mutex_unlock(&Lock);
+        return (NULL);
+    }
+    isInit = true;
+    pthread_mutex_unlock(&Lock);
+
+    if (pdPASS != xTaskCreate(mqtt_task, "mqtt_task", 6144, NULL, 5, NULL)) {
+        return (NULL);
+    }
+    return (&Client);
+}
+
+esp_err_t esp_mqtt_client_register_event(esp_mqtt_client_handle_t client, esp_mqtt_event_id_t event, esp_event_handler_t event_handler, void * event_handler_arg) {
+    if (NULL == client) {
+        return (ESP_ERR_INVALID_ARG);
+    }
+    pthread_mutex_lock(&Lock);
+    client->Handler = event_handler;
+    client->pArg = event_handler_arg;
+    pthread_mutex_unlock(&Lock);
+    return (ESP_OK);
+}
+
+esp_err_t esp_mqtt_client_start(esp_mqtt_client_handle_t client) {
+    if (NULL == client) {
+        return (ESP_ERR_INVALID_ARG);
+    }
+    pthread_mutex_lock(&Lock);
+    if (client->isRunning) {
+        pthread_mutex_unlock(&Lock);
+        return (ESP_FAIL);
+    }
+    Stats.Starts++;
+    mqtt_post(MQTT_EVENT_BEFORE_CONNECT, 0, NULL, 0, NULL, 0, 0, 0);
+    if (isReachable) {
+        client->isRunning = true;
+        client->isConnected = true;
+        mqtt_post(MQTT_EVENT_CONNECTED, 0, NULL, 0, NULL, 0, 0, 0);
+    } else {
+        // No auto reconnect: The task ends after the failed connect
+        mqtt_post(MQTT_EVENT_ERROR, 0, NULL, 0, NULL, 0, 0, 0);
+        mqtt_post(MQTT_EVENT_DISCONNECTED, 0, NULL, 0, NULL, 0, 0, 0);
+    }
+    pthread_mutex_unlock(&Lock);
+    return (ESP_OK);
+}  // esp_mqtt_client_start
+
+esp_err_t esp_mqtt_client_stop(esp_mqtt_client_handle_t client) {
+    pthread_mutex_lock(&Lock);
+    const bool wasRunning = client->isRunning;
+    client->isRunning = false;
+    client->isConnected = false;
+    pthread_mutex_unlock(&Lock);
+    return (wasRunning ? ESP_OK : ESP_FAIL);
+}
+
+int esp_mqtt_client_publish(esp_mqtt_client_handle_t client, const char * topic, const char * data, int len, int qos, int retain) {
+    if ((NULL == client) || (NULL == topic)) {
+        return (-1);
+    }
+    if ((0 == len) && (NULL != data)) {
+        len = strlen(data);
+    }
+
+    pthread_mutex_lock(&Lock);
+    if (!client->isConnected) {
+        pthread_mutex_unlock(&Lock);
+        return (-1);
+    }
+    const int MsgId = (qos > 0) ? ++client->MsgId : 0;
+    const HostMqtt_PublishHook Hook = PublishHook;
+    void * pArg = pHookArg;
+    Stats.Published++;
+    if (mqtt_is_subscribed(topic, strlen(topic))) {
+        Stats.Delivered++;
+        mqtt_post(MQTT_EVENT_DATA, 0, topic, strlen(topic), data, len, 0, len);
+    }
+    if (qos > 0) {
+        mqtt_post(MQTT_EVENT_PUBLISHED, MsgId, NULL, 0, NULL, 0, 0, 0);
+    }
+    pthread_mutex_unlock(&Lock);
+
+    if (NULL != Hook) {
+        Hook(topic, data, len, qos, pArg);
+    }
+    return (MsgId);
+}  // esp_mqtt_client_publish
+
+int esp_mqtt_client_subscribe(esp_mqtt_client_handle_t client, const char * topic, int qos) {
+    int Free = -1;
+
+    if ((NULL == client) || (NULL == topic) || (strlen(topic) >= HOST_MQTT_MAX_FILTERLEN)) {
+        return (-1);
+    }
+    pthread_mutex_lock(&Lock);
+    if (!client->isConnected) {
+        pthread_mutex_unlock(&Lock);
+        return (-1);
+    }
+    for (int i = 0; i < HOST_MQTT_MAX_FILTERS; i++) {
+        if (0 == strcmp(Filters[i], topic)) {
+            Free = i;
+            break;
+        }
+        if ((Free < 0) && ('\0' == Filters[i][0])) {
+            Free = i;
+        }
+    }
+    if (Free < 0) {
+        pthread_mutex_unlock(&Lock);
+        return (-1);
+    }
+    strcpy(Filters[Free], topic);
+    const int MsgId = ++client->MsgId;
+    mqtt_post(MQTT_EVENT_SUBSCRIBED, MsgId, NULL, 0, NULL, 0, 0, 0);
+    pthread_mutex_unlock(&Lock);
+    return (MsgId);
+}  // esp_mqtt_client_subscribe
+
+int esp_mqtt_client_unsubscribe(esp_mqtt_client_handle_t client, const char * topic) {
+    if ((NULL == client) || (NULL == topic)) {
+        return (-1);
+    }
+    pthread_mutex_lock(&Lock);
+    if (!client->isConnected) {
+        pthread_mutex_unlock(&Lock);
+        return (-1);
+    }
+    for (int i = 0; i < HOST_MQTT_MAX_FILTERS; i++) {
+        if (0 == strcmp(Filters[i], topic)) {
+            Filters[i][0] = '\0';
+        }
+    }
+    const int MsgId = ++client->MsgId;
+    mqtt_post(MQTT_EVENT_UNSUBSCRIBED, MsgId, NULL, 0, NULL, 0, 0, 0);
+    pthread_mutex_unlock(&Lock);
+    return (MsgId);
+}  // esp_mqtt_client_unsubscribe
+
+/**
+ * @brief Send a message from the broker to the device
+ *
+ * The message is passed in DATA events of at most Fragment bytes, as the
+ * client does for messages larger than its buffer.
+ *
+ * @param Topic Full topic
+ * @param pData Payload
+ * @param Length Length of the payload
+ * @param Fragment Max data per event, 0 for one event
+ * @return esp_err_t ESP_ERR_INVALID_STATE if not connected, ESP_ERR_NOT_FOUND if not subscribed
+ */
+esp_err_t HostMqtt_Inject(const char * Topic, const void * pData, size_t Length, size_t Fragment) {
+    size_t Offset = 0;
+
+    pthread_mutex_lock(&Lock);
+    if (!Client.isConnected) {
+        pthread_mutex_unlock(&Lock);
+        return (ESP_ERR_INVALID_STATE);
+    }
+    if (!mqtt_is_subscribed(Topic, strlen(Topic))) {
+        pthread_mutex_unlock(&Lock);
+        return (ESP_ERR_NOT_FOUND);
+    }
+    if ((0 == Fragment) || (Fragment > Length)) {
+        Fragment = (Length > 0) ? Length : 1;
+    }
+    Stats.Injected++;
+    do {
+        const size_t Size = (Length - Offset < Fragment) ? (Length - Offset) : Fragment;
+        mqtt_post(MQTT_EVENT_DATA, 0, (0 == Offset) ? Topic : NULL, (0 == Offset) ? strlen(Topic) : 0,
+                  (const char*)pData + Offset, Size, Offset, Length);
+        Offset += Size;
+    } while (Offset < Length);
+    pthread_mutex_unlock(&Lock);
+    return (ESP_OK);
+}  // HostMqtt_Inject
+
+/**
+ * @brief Make the broker (un)reachable, unreachable drops the connection
+ */
+void HostMqtt_SetReachable(bool Reachable) {
+    pthread_mutex_lock(&Lock);
+    isReachable = Reachable;
+    if (!Reachable) {
+        mqtt_drop();
+    }
+    pthread_mutex_unlock(&Lock);
+}
+
+/**
+ * @brief Drop the connection, the broker stays reachable
+ */
+void HostMqtt_Disconnect(void) {
+    pthread_mutex_lock(&Lock);
+    mqtt_drop();
+    pthread_mutex_unlock(&Lock);
+}
+
+/**
+ * @brief Call a function for every publish of the device
+ *
+ * Runs in the publishing task, outside of the client lock.
+ *
+ * @param Hook The function, NULL to remove
+ * @param pArg Passed to the function
+ */
+void HostMqtt_SetPublishHook(HostMqtt_PublishHook Hook, void * pArg) {
+    pthread_mutex_lock(&Lock);
+    PublishHook = Hook;
+    pHookArg = pArg;
+    pthread_mutex_unlock(&Lock);
+}
+
+/**
+ * @brief Get the counters of the client
+ */
+void HostMqtt_GetStats(HostMqtt_Stats * pStats) {
+    pthread_mutex_lock(&Lock);
+    *pStats = Stats;
+    pStats->isConnected = Client.isConnected;
+    pthread_mutex_unlock(&Lock);
+}
+
+/**
+ * @brief Wait until all queued events are handled
+ */
+void HostMqtt_Flush(void) {
+    pthread_mutex_lock(&Lock);
+    while (isInit && isBusy) {
+        pthread_cond_wait(&Cond, &Lock);
+    }
+    pthread_mutex_unlock(&Lock);
+}
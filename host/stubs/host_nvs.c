@@ -0,0 +1,281 @@
+/**
+ ******************************************************************************
+ *  file           : host_nvs.c
+ *  brief          : Host build: NVS in RAM
+ *
+ *  Values are visible at once, nvs_commit() does nothing. The content
+ *  survives a simulated reboot (new init of the modules) until
+ *  HostNvs_Clear().
+ ******************************************************************************
+ */
+
+/****************************** Includes  */
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "nvs_flash.h"
+#include "host.h"
+
+/****************************** Configuration */
+#define HOST_NVS_MAX_ENTRIES 64         // Max number of keys
+#define HOST_NVS_MAX_HANDLES 16         // Max number of open handles
+#define HOST_NVS_KEYLEN 16              // Max length of names incl. terminator, as NVS
+
+/****************************** Statics */
+typedef enum HostNvs_Type {
+    NVS_TYPE_FREE = 0,
+    NVS_TYPE_U8,
+    NVS_TYPE_U32,
+    NVS_TYPE_STR,
+    NVS_TYPE_BLOB,
+} HostNvs_Type;
+
+typedef struct HostNvs_Entry {
+    char            Namespace[HOST_NVS_KEYLEN];
+    char            Key[HOST_NVS_KEYLEN];
+    HostNvs_Type    Type;
+    uint32_t        Number;             // The number or the size of the data
+    char *          pData;              // String or blob
+} HostNvs_Entry;
+
+typedef struct HostNvs_Handle {
+    char            Namespace[HOST_NVS_KEYLEN];
+    nvs_open_mode_t Mode;
+    bool            isOpen;
+} HostNvs_Handle;
+
+static HostNvs_Entry Entries[HOST_NVS_MAX_ENTRIES];
+static HostNvs_Handle Handles[HOST_NVS_MAX_HANDLES];
+static pthread_mutex_t NvsLock = PTHREAD_MUTEX_INITIALIZER;
+
+/****************************** Functions */
+
+/**
+ * @brief Delete all keys
+ */
+void HostNvs_Clear(void) {
+    pthread_mutex_lock(&NvsLock);
+    for (size_t i = 0; i < HOST_NVS_MAX_ENTRIES; i++) {
+        free(Entries[i].pData);
+    }
+    memset(Entries, 0x00, sizeof(Entries));
+    pthread_mutex_unlock(&NvsLock);
+}
+
+esp_err_t nvs_flash_init(void) {
+    return (ESP_OK);
+}
+
+esp_err_t nvs_flash_erase(void) {
+    HostNvs_Clear();
+    return (ESP_OK);
+}
+
+/**
+ * @brief Find an entry, lock must be held
+ *
+ * @param isCreate Get a free entry if the key does not exist
+ */
+static HostNvs_Entry * nvs_find(const HostNvs_Handle * pHandle, const char * Key, bool isCreate) {
+    HostNvs_Entry * pFree = NULL;
+
+    for (size_t i = 0; i < HOST_NVS_MAX_ENTRIES; i++) {
+        if (NVS_TYPE_FREE == Entries[i].Type) {
+            pFree = (NULL == pFree) ? &Entries[i] : pFree;
+        } else if ((0 == strcmp(Entries[i].Namespace, pHandle->Namespace)) && (0 == strcmp(Entries[i].Key, Key))) {
+            return (&Entries[i]);
+        }
+    }
+    if (isCreate && (NULL != pFree)) {
+        strcpy(pFree->Namespace, pHandle->Namespace);
+        strcpy(pFree->Key, Key);
+        return (pFree);
+    }
+    return (NULL);
+}  // nvs_find
+
+static HostNvs_Handle * nvs_handle(nvs_handle_t handle) {
+    if ((0 == handle) || (handle > HOST_NVS_MAX_HANDLES) || !Handles[handle - 1].isOpen) {
+        return (NULL);
+    }
+    return (&Handles[handle - 1]);
+}
+
+esp_err_t nvs_open(const char * namespace_name, nvs_open_mode_t open_mode, nvs_handle_t * out_handle) {
+    esp_err_t ret = ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+
+    if (strlen(namespace_name) >= HOST_NVS_KEYLEN) {
+        return (ESP_ERR_INVALID_ARG);
+    }
+    pthread_mutex_lock(&NvsLock);
+
+    // As NVS: A namespace only exists after a write to it
+    bool isFound = (NVS_READWRITE == open_mode);
+    for (size_t i = 0; (i < HOST_NVS_MAX_ENTRIES) && !isFound; i++) {
+        isFound = (NVS_TYPE_FREE != Entries[i].Type) && (0 == strcmp(Entries[i].Namespace, namespace_name));
+    }
+    if (!isFound) {
+        ret = ESP_ERR_NVS_NOT_FOUND;
+    } else {
+        for (size_t i = 0; i < HOST_NVS_MAX_HANDLES; i++) {
+            if (!Handles[i].isOpen) {
+                strcpy(Handles[i].Namespace, namespace_name);
+                Handles[i].Mode = open_mode;
+                Handles[i].isOpen = true;
+                *out_handle = i + 1;
+                ret = ESP_OK;
+                break;
+            }
+        }
+    }
+    pthread_mutex_unlock(&NvsLock);
+    return (ret);
+}  // nvs_open
+
+void nvs_close(nvs_handle_t handle) {
+    pthread_mutex_lock(&NvsLock);
+    HostNvs_Handle * pHandle = nvs_handle(handle);
+    if (NULL != pHandle) {
+        pHandle->isOpen = false;
+    }
+    pthread_mutex_unlock(&NvsLock);
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle) {
+    return ((NULL != nvs_handle(handle)) ? ESP_OK : ESP_ERR_NVS_INVALID_HANDLE);
+}
+
+/**
+ * @brief Read a number of a type
+ */
+static esp_err_t nvs_get_number(nvs_handle_t handle, const char * key, HostNvs_Type Type, uint32_t * pValue) {
+    esp_err_t ret = ESP_ERR_NVS_NOT_FOUND;
+
+    pthread_mutex_lock(&NvsLock);
+    HostNvs_Handle * pHandle = nvs_handle(handle);
+    if (NULL == pHandle) {
+        ret = ESP_ERR_NVS_INVALID_HANDLE;
+    } else {
+        const HostNvs_Entry * pEntry = nvs_find(pHandle, key, false);
+        if ((NULL != pEntry) && (Type == pEntry->Type)) {
+            *pValue = pEntry->Number;
+            ret = ESP_OK;
+        }
+    }
+    pthread_mutex_unlock(&NvsLock);
+    return (ret);
+}  // nvs_get_number
+
+/**
+ * @brief Write a value of a type, pData NULL for numbers
+ */
+static esp_err_t nvs_set_value(nvs_handle_t handle, const char * key, HostNvs_Type Type, uint32_t Number, const void * pData) {
+    esp_err_t ret = ESP_OK;
+    char * pCopy = NULL;
+
+    if (strlen(key) >= HOST_NVS_KEYLEN) {
+        return (ESP_ERR_INVALID_ARG);
+    }
+    pthread_mutex_lock(&NvsLock);
+    HostNvs_Handle * pHandle = nvs_handle(handle);
+    HostNvs_Entry * pEntry = (NULL != pHandle) ? nvs_find(pHandle, key, true) : NULL;
+    if (NULL == pHandle) {
+        ret = ESP_ERR_NVS_INVALID_HANDLE;
+    } else if (NVS_READONLY == pHandle->Mode) {
+        ret = ESP_ERR_NVS_READ_ONLY;
+    } else if (NULL == pEntry) {
+        ret = ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+    } else if ((NULL != pData) && (NULL == (pCopy = malloc(Number)))) {
+        ret = ESP_ERR_NO_MEM;
+    } else {
+        free(pEntry->pData);
+        if (NULL != pCopy) {
+            memcpy(pCopy, pData, Number);
+        }
+        pEntry->pData = pCopy;
+        pEntry->Number = Number;
+        pEntry->Type = Type;
+    }
+    pthread_mutex_unlock(&NvsLock);
+    return (ret);
+}  // nvs_set_value
+
+esp_err_t nvs_get_u8(nvs_handle_t handle, const char * key, uint8_t * out_value) {
+    uint32_t Value;
+    const esp_err_t ret = nvs_get_number(handle, key, NVS_TYPE_U8, &Value);
+
+    if (ESP_OK == ret) {
+        *out_value = Value;
+    }
+    return (ret);
+}
+
+esp_err_t nvs_get_u32(nvs_handle_t handle, const char * key, uint32_t * out_value) {
+    return (nvs_get_number(handle, key, NVS_TYPE_U32, out_value));
+}
+
+/**
+ * @brief Read a string or blob, out_value NULL for the length
+ */
+static esp_err_t nvs_get_data(nvs_handle_t handle, const char * key, HostNvs_Type Type, void * out_value, size_t * length) {
+    esp_err_t ret = ESP_ERR_NVS_NOT_FOUND;
+
+    pthread_mutex_lock(&NvsLock);
+    HostNvs_Handle * pHandle = nvs_handle(handle);
+    const HostNvs_Entry * pEntry = (NULL != pHandle) ? nvs_find(pHandle, key, false) : NULL;
+    if (NULL == pHandle) {
+        ret = ESP_ERR_NVS_INVALID_HANDLE;
+    } else if ((NULL != pEntry) && (Type == pEntry->Type)) {
+        const size_t Needed = pEntry->Number;
+        if (NULL == out_value) {
+            ret = ESP_OK;
+        } else if (*length < Needed) {
+            ret = ESP_ERR_NVS_INVALID_LENGTH;
+        } else {
+            memcpy(out_value, pEntry->pData, Needed);
+            ret = ESP_OK;
+        }
+        *length = Needed;
+    }
+    pthread_mutex_unlock(&NvsLock);
+    return (ret);
+}  // nvs_get_data
+
+esp_err_t nvs_get_str(nvs_handle_t handle, const char * key, char * out_value, size_t * length) {
+    return (nvs_get_data(handle, key, NVS_TYPE_STR, out_value, length));
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char * key, void * out_value, size_t * length) {
+    return (nvs_get_data(handle, key, NVS_TYPE_BLOB, out_value, length));
+}
+
+esp_err_t nvs_set_u8(nvs_handle_t handle, const char * key, uint8_t value) {
+    return (nvs_set_value(handle, key, NVS_TYPE_U8, value, NULL));
+}
+
+esp_err_t nvs_set_u32(nvs_handle_t handle, const char * key, uint32_t value) {
+    return (nvs_set_value(handle, key, NVS_TYPE_U32, value, NULL));
+}
+
+esp_err_t nvs_set_str(nvs_handle_t handle, const char * key, const char * value) {
+    return (nvs_set_value(handle, key, NVS_TYPE_STR, strlen(value) + 1, value));
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char * key, const void * value, size_t length) {
+    return (nvs_set_value(handle, key, NVS_TYPE_BLOB, length, value));
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char * key) {
+    esp_err_t ret = ESP_ERR_NVS_NOT_FOUND;
+
+    pthread_mutex_lock(&NvsLock);
+    HostNvs_Handle * pHandle = nvs_handle(handle);
+    HostNvs_Entry * pEntry = (NULL != pHandle) ? nvs_find(pHandle, key, false) : NULL;
+    if (NULL != pEntry) {
+        free(pEntry->pData);
+        memset(pEntry, 0x00, sizeof(HostNvs_Entry));
+        ret = ESP_OK;
+    }
+    pthread_mutex_unlock(&NvsLock);
+    return (ret);
+}  // nvs_erase_key
@@ -0,0 +1,239 @@
+/**
+ ******************************************************************************
+ *  file           : host_ota.c
+ *  brief          : Host build: OTA updates and app state on the file partitions
+ *
+ *  The running app is the first app partition unless set with
+ *  HostOta_SetRunning(). Updates go to the next OTA partition, sectors
+ *  are erased as the sequential writes reach them, as on the target.
+ *  Setting the boot partition is only recorded, HostOta_GetBoot().
+ ******************************************************************************
+ */
+
+/****************************** Includes  */
+#include <string.h>
+#include <pthread.h>
+#include "esp_ota_ops.h"
+#include "esp_system.h"
+#include "host.h"
+
+/****************************** Configuration */
+#define HOST_OTA_HANDLE 1               // One update at a time
+#define HOST_OTA_SLOTS  16              // OTA_0..OTA_15
+
+/****************************** Statics */
+static pthread_mutex_t OtaLock = PTHREAD_MUTEX_INITIALIZER;
+static const esp_partition_t * pRunning = NULL;
+static const esp_partition_t * pBoot = NULL;
+static const esp_partition_t * pLastInvalid = NULL;
+static esp_ota_img_states_t RunningState = ESP_OTA_IMG_VALID;
+
+static struct {
+    const esp_partition_t * pPart;      // NULL if no update is running
+    size_t                  Written;    // Bytes written
+    size_t                  Erased;     // Bytes erased from the start
+} Update;
+
+/****************************** Functions */
+
+/**
+ * @brief Set the running app, e.g. a new image waiting for its health check
+ *
+ * @param pPart The app partition
+ * @param State ESP_OTA_IMG_VALID or ESP_OTA_IMG_PENDING_VERIFY
+ */
+void HostOta_SetRunning(const esp_partition_t * pPart, esp_ota_img_states_t State) {
+    pthread_mutex_lock(&OtaLock);
+    pRunning = pPart;
+    pBoot = pPart;
+    RunningState = State;
+    pthread_mutex_unlock(&OtaLock);
+}
+
+/**
+ * @brief The partition set by esp_ota_set_boot_partition(), the running one if not set
+ */
+const esp_partition_t * HostOta_GetBoot(void) {
+    return (esp_ota_get_boot_partition());
+}
+
+const esp_partition_t * esp_ota_get_running_partition(void) {
+    pthread_mutex_lock(&OtaLock);
+    if (NULL == pRunning) {
+        pRunning = esp_partition_find_first(ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_ANY, NULL);
+    }
+    const esp_partition_t * pPart = pRunning;
+    pthread_mutex_unlock(&OtaLock);
+    return (pPart);
+}
+
+const esp_partition_t * esp_ota_get_boot_partition(void) {
+    const esp_partition_t * pRun = esp_ota_get_running_partition();
+
+    pthread_mutex_lock(&OtaLock);
+    const esp_partition_t * pPart = (NULL != pBoot) ? pBoot : pRun;
+    pthread_mutex_unlock(&OtaLock);
+    return (pPart);
+}
+
+/**
+ * @brief The OTA partition behind start_from, wrapping around, OTA_0 after the factory app
+ */
+const esp_partition_t * esp_ota_get_next_update_partition(const esp_partition_t * start_from) {
+    if (NULL == start_from) {
+        start_from = esp_ota_get_running_partition();
+    }
+    int Slot = -1;
+    if ((NULL != start_from) && (start_from->subtype >= ESP_PARTITION_SUBTYPE_APP_OTA_0)
+     && (start_from->subtype < (ESP_PARTITION_SUBTYPE_APP_OTA_0 + HOST_OTA_SLOTS))) {
+        Slot = start_from->subtype - ESP_PARTITION_SUBTYPE_APP_OTA_0;
+    }
+
+    for (int i = 1; i <= HOST_OTA_SLOTS; i++) {
+        const int Next = (Slot + i) % HOST_OTA_SLOTS;
+        const esp_partition_t * pPart = esp_partition_find_first(ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_APP_OTA_0 + Next, NULL);
+        if ((NULL != pPart) && (pPart != start_from)) {
+            return (pPart);
+        }
+    }
+    return (NULL);
+}  // esp_ota_get_next_update_partition
+
+const esp_partition_t * esp_ota_get_last_invalid_partition(void) {
+    pthread_mutex_lock(&OtaLock);
+    const esp_partition_t * pPart = pLastInvalid;
+    pthread_mutex_unlock(&OtaLock);
+    return (pPart);
+}
+
+esp_err_t esp_ota_get_state_partition(const esp_partition_t * partition, esp_ota_img_states_t * ota_state) {
+    esp_err_t ret = ESP_OK;
+
+    if ((NULL == partition) || (NULL == ota_state)) {
+        return (ESP_ERR_INVALID_ARG);
+    }
+    const esp_partition_t * pRun = esp_ota_get_running_partition();
+
+    pthread_mutex_lock(&OtaLock);
+    if (ESP_PARTITION_SUBTYPE_APP_FACTORY == partition->subtype) {
+        ret = ESP_ERR_NOT_SUPPORTED;
+    } else if (partition == pRun) {
+        *ota_state = RunningState;
+    } else if (partition == pLastInvalid) {
+        *ota_state = ESP_OTA_IMG_INVALID;
+    } else if (partition == pBoot) {
+        *ota_state = ESP_OTA_IMG_NEW;
+    } else {
+        ret = ESP_ERR_NOT_FOUND;
+    }
+    pthread_mutex_unlock(&OtaLock);
+    return (ret);
+}  // esp_ota_get_state_partition
+
+esp_err_t esp_ota_mark_app_valid_cancel_rollback(void) {
+    pthread_mutex_lock(&OtaLock);
+    RunningState = ESP_OTA_IMG_VALID;
+    pthread_mutex_unlock(&OtaLock);
+    return (ESP_OK);
+}
+
+esp_err_t esp_ota_mark_app_invalid_rollback_and_reboot(void) {
+    const esp_partition_t * pRun = esp_ota_get_running_partition();
+
+    pthread_mutex_lock(&OtaLock);
+    pLastInvalid = pRun;
+    RunningState = ESP_OTA_IMG_INVALID;
+    pthread_mutex_unlock(&OtaLock);
+    esp_restart();
+}
+
+esp_err_t esp_ota_begin(const esp_partition_t * partition, size_t image_size, esp_ota_handle_t * out_handle) {
+    esp_err_t ret = ESP_OK;
+
+    if ((NULL == partition) || (NULL == out_handle) || (ESP_PARTITION_TYPE_APP != partition->type)) {
+        return (ESP_ERR_INVALID_ARG);
+    }
+    if (partition == esp_ota_get_running_partition()) {
+        return (ESP_ERR_OTA_PARTITION_CONFLICT);
+    }
+
+    pthread_mutex_lock(&OtaLock);
+    if (NULL != Update.pPart) {
+        ret = ESP_ERR_INVALID_STATE;
+    } else {
+        Update.pPart = partition;
+        Update.Written = 0;
+        Update.Erased = 0;
+        *out_handle = HOST_OTA_HANDLE;
+    }
+    pthread_mutex_unlock(&OtaLock);
+
+    // A known size is erased at once, sequential writes on the way
+    if ((ESP_OK == ret) && (OTA_WITH_SEQUENTIAL_WRITES != image_size)) {
+        const size_t Size = (OTA_SIZE_UNKNOWN == image_size) ? partition->size
+                          : (((image_size + HOST_FLASH_SECTOR - 1) / HOST_FLASH_SECTOR) * HOST_FLASH_SECTOR);
+        ret = esp_partition_erase_range(partition, 0, Size);
+        Update.Erased = Size;
+    }
+    return (ret);
+}  // esp_ota_begin
+
+esp_err_t esp_ota_write(esp_ota_handle_t handle, const void * data, size_t size) {
+    if ((HOST_OTA_HANDLE != handle) || (NULL == Update.pPart)) {
+        return (ESP_ERR_INVALID_ARG);
+    }
+    if ((Update.Written + size) > Update.pPart->size) {
+        return (ESP_ERR_INVALID_SIZE);
+    }
+
+    while (Update.Erased < (Update.Written + size)) {
+        const esp_err_t ret = esp_partition_erase_range(Update.pPart, Update.Erased, HOST_FLASH_SECTOR);
+        if (ESP_OK != ret) {
+            return (ret);
+        }
+        Update.Erased += HOST_FLASH_SECTOR;
+    }
+    const esp_err_t ret = esp_partition_write(Update.pPart, Update.Written, data, size);
+    Update.Written += size;
+    return (ret);
+}  // esp_ota_write
+
+/**
+ * @brief Finish the update, the image must start with an image header
+ */
+esp_err_t esp_ota_end(esp_ota_handle_t handle) {
+    uint8_t Magic = 0;
+
+    if ((HOST_OTA_HANDLE != handle) || (NULL == Update.pPart)) {
+        return (ESP_ERR_NOT_FOUND);
+    }
+    esp_err_t ret = esp_partition_read(Update.pPart, 0, &Magic, sizeof(Magic));
+    if ((ESP_OK == ret) && ((0 == Update.Written) || (ESP_IMAGE_HEADER_MAGIC != Magic))) {
+        ret = ESP_ERR_OTA_VALIDATE_FAILED;
+    }
+    Update.pPart = NULL;
+    return (ret);
+}  // esp_ota_end
+
+esp_err_t esp_ota_abort(esp_ota_handle_t handle) {
+    if ((HOST_OTA_HANDLE != handle) || (NULL == Update.pPart)) {
+        return (ESP_ERR_NOT_FOUND);
+    }
+    Update.pPart = NULL;
+    return (ESP_OK);
+}
+
+esp_err_t esp_ota_set_boot_partition(const esp_partition_t * partition) {
+    uint8_t Magic = 0;
+
+    if ((NULL == partition) || (ESP_PARTITION_TYPE_APP != partition->type)) {
+        return (ESP_ERR_INVALID_ARG);
+    }
+    if ((ESP_OK != esp_partition_read(partition, 0, &Magic, sizeof(Magic))) || (ESP_IMAGE_HEADER_MAGIC != Magic)) {
+        return (ESP_ERR_OTA_VALIDATE_FAILED);
+    }
+    pthread_mutex_lock(&OtaLock);
+    pBoot = partition;
+    pthread_mutex_unlock(&OtaLock);
+    return (ESP_OK);
+}  // esp_ota_set_boot_partition
@@ -0,0 +1,498 @@
+/**
+ ******************************************************************************
+ *  file           : host_rtos.c
+ *  brief          : Host build: FreeRTOS tasks, queues, semaphores and event groups on POSIX threads
+ *
+ *  Priorities and stack sizes are ignored. A deleted task ends its
+ *  thread, its control block is kept, so handles stay valid.
+ ******************************************************************************
+ */
+
+/****************************** Includes  */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/event_groups.h"
+
+/****************************** Statics */
+struct HostTask {
+    TaskFunction_t  Function;
+    void *          pArg;
+    char            Name[configMAX_TASK_NAME_LEN];
+    uint32_t        StackSize;
+    pthread_mutex_t Lock;
+    pthread_cond_t  Cond;
+    uint32_t        Notify;             // Notification value
+};
+
+struct HostQueue {
+    pthread_mutex_t Lock;
+    pthread_cond_t  Cond;
+    uint8_t *       pStorage;
+    UBaseType_t     Length;
+    UBaseType_t     ItemSize;
+    UBaseType_t     Head;               // Oldest item
+    UBaseType_t     Count;
+};
+
+struct HostSemaphore {
+    pthread_mutex_t Lock;
+    pthread_cond_t  Cond;
+    UBaseType_t     Count;
+    UBaseType_t     MaxCount;
+    struct HostTask * pOwner;           // Recursive mutex: Holder
+    UBaseType_t     Depth;              // Recursive mutex: Takes of the holder
+};
+
+struct HostEventGroup {
+    pthread_mutex_t Lock;
+    pthread_cond_t  Cond;
+    EventBits_t     Bits;
+};
+
+static __thread struct HostTask * pCurrentTask = NULL;
+static pthread_once_t StartOnce = PTHREAD_ONCE_INIT;
+static struct timespec Start;
+
+/****************************** Functions */
+
+/**
+ * @brief Init a mutex and a condition on the monotonic clock
+ */
+static void host_sync_init(pthread_mutex_t * pLock, pthread_cond_t * pCond) {
+    pthread_condattr_t Attr;
+
+    pthread_mutex_init(pLock, NULL);
+    pthread_condattr_init(&Attr);
+    pthread_condattr_setclock(&Attr, CLOCK_MONOTONIC);
+    pthread_cond_init(pCond, &Attr);
+    pthread_condattr_destroy(&Attr);
+}
+
+/**
+ * @brief Wait on a condition for some ticks
+ *
+ * @return false on timeout
+ */
+static bool host_wait(pthread_cond_t * pCond, pthread_mutex_t * pLock, TickType_t Ticks) {
+    struct timespec Deadline;
+
+    if (0 == Ticks) {
+        return (false);
+    }
+    if (portMAX_DELAY == Ticks) {
+        pthread_cond_wait(pCond, pLock);
+        return (true);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &Deadline);
+    const uint64_t Ns = (uint64_t)Ticks * portTICK_PERIOD_MS * 1000000ULL + Deadline.tv_nsec;
+    Deadline.tv_sec += Ns / 1000000000ULL;
+    Deadline.tv_nsec = Ns % 1000000000ULL;
+    return (0 == pthread_cond_timedwait(pCond, pLock, &Deadline));
+}  // host_wait
+
+/**
+ * @brief Ticks left of a wait, for waits woken without success
+ */
+static TickType_t host_remaining(TickType_t Ticks, TickType_t Since) {
+    const TickType_t Elapsed = xTaskGetTickCount() - Since;
+
+    if (portMAX_DELAY == Ticks) {
+        return (portMAX_DELAY);
+    }
+    return ((Elapsed >= Ticks) ? 0 : (Ticks - Elapsed));
+}
+
+static void host_start(void) {
+    clock_gettime(CLOCK_MONOTONIC, &Start);
+}
+
+/**
+ * @brief Control block of the calling thread, made for threads not created as task
+ */
+static struct HostTask * host_current(void) {
+    if (NULL == pCurrentTask) {
+        pCurrentTask = calloc(1, sizeof(struct HostTask));
+        strcpy(pCurrentTask->Name, "main");
+        host_sync_init(&pCurrentTask->Lock, &pCurrentTask->Cond);
+    }
+    return (pCurrentTask);
+}
+
+static void * host_task_entry(void * pArg) {
+    pCurrentTask = pArg;
+    pCurrentTask->Function(pCurrentTask->pArg);
+    return (NULL);
+}
+
+BaseType_t xTaskCreate(TaskFunction_t pxTaskCode, const char * pcName, uint32_t usStackDepth, void * pvParameters, UBaseType_t uxPriority, TaskHandle_t * pxCreatedTask) {
+    struct HostTask * pTask = calloc(1, sizeof(struct HostTask));
+    pthread_attr_t Attr;
+    pthread_t Thread;
+
+    (void)uxPriority;
+    if (NULL == pTask) {
+        return (pdFAIL);
+    }
+    pTask->Function = pxTaskCode;
+    pTask->pArg = pvParameters;
+    pTask->StackSize = usStackDepth;
+    strncpy(pTask->Name, pcName, sizeof(pTask->Name) - 1);
+    host_sync_init(&pTask->Lock, &pTask->Cond);
+
+    pthread_attr_init(&Attr);
+    pthread_attr_setdetachstate(&Attr, PTHREAD_CREATE_DETACHED);
+    const int ret = pthread_create(&Thread, &Attr, host_task_entry, pTask);
+    pthread_attr_destroy(&Attr);
+    if (0 != ret) {
+        free(pTask);
+        return (pdFAIL);
+    }
+
+    if (NULL != pxCreatedTask) {
+        *pxCreatedTask = pTask;
+    }
+    return (pdPASS);
+}  // xTaskCreate
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t pxTaskCode, const char * pcName, uint32_t usStackDepth, void * pvParameters, UBaseType_t uxPriority, TaskHandle_t * pxCreatedTask, BaseType_t xCoreID) {
+    (void)xCoreID;
+    return (xTaskCreate(pxTaskCode, pcName, usStackDepth, pvParameters, uxPriority, pxCreatedTask));
+}
+
+TaskHandle_t xTaskCreateStatic(TaskFunction_t pxTaskCode, const char * pcName, uint32_t ulStackDepth, void * pvParameters, UBaseType_t uxPriority, StackType_t * puxStackBuffer, StaticTask_t * pxTaskBuffer) {
+    TaskHandle_t xTask = NULL;
+
+    (void)puxStackBuffer;
+    (void)pxTaskBuffer;
+    xTaskCreate(pxTaskCode, pcName, ulStackDepth, pvParameters, uxPriority, &xTask);
+    return (xTask);
+}
+
+void vTaskDelete(TaskHandle_t xTaskToDelete) {
+    if ((NULL == xTaskToDelete) || (xTaskToDelete == pCurrentTask)) {
+        pthread_exit(NULL);
+    }
+    // Other tasks can't be stopped safely, not used by the firmware
+    abort();
+}
+
+void vTaskDelay(TickType_t xTicksToDelay) {
+    usleep((useconds_t)xTicksToDelay * portTICK_PERIOD_MS * 1000);
+}
+
+/**
+ * @brief Delay until a fixed time, for periodic tasks
+ *
+ * Aborts on a zero increment, as configASSERT() on the target.
+ */
+BaseType_t xTaskDelayUntil(TickType_t * pxPreviousWakeTime, const TickType_t xTimeIncrement) {
+    if (0 == xTimeIncrement) {
+        fprintf(stderr, "xTaskDelayUntil: Zero increment\n");
+        abort();
+    }
+    *pxPreviousWakeTime += xTimeIncrement;
+    const TickType_t Left = *pxPreviousWakeTime - xTaskGetTickCount();
+    if ((Left > 0) && (Left <= xTimeIncrement)) {
+        vTaskDelay(Left);
+        return (pdTRUE);
+    }
+    return (pdFALSE);   // Late, the next period starts at once
+}  // xTaskDelayUntil
+
+TickType_t xTaskGetTickCount(void) {
+    struct timespec Now;
+
+    pthread_once(&StartOnce, host_start);
+    clock_gettime(CLOCK_MONOTONIC, &Now);
+    const int64_t Ms = ((int64_t)(Now.tv_sec - Start.tv_sec) * 1000) + ((Now.tv_nsec - Start.tv_nsec) / 1000000);
+    return ((TickType_t)(Ms / portTICK_PERIOD_MS));
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void) {
+    return (host_current());
+}
+
+char * pcTaskGetName(TaskHandle_t xTaskToQuery) {
+    return ((NULL != xTaskToQuery) ? xTaskToQuery->Name : host_current()->Name);
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t xTask) {
+    // Unknown on the host: Report the stack as half used
+    return ((NULL != xTask) ? (xTask->StackSize / 2) : 0);
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t xTaskToNotify) {
+    pthread_mutex_lock(&xTaskToNotify->Lock);
+    xTaskToNotify->Notify++;
+    pthread_cond_broadcast(&xTaskToNotify->Cond);
+    pthread_mutex_unlock(&xTaskToNotify->Lock);
+    return (pdPASS);
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t xClearCountOnExit, TickType_t xTicksToWait) {
+    struct HostTask * pTask = host_current();
+    const TickType_t Since = xTaskGetTickCount();
+    uint32_t Value;
+
+    pthread_mutex_lock(&pTask->Lock);
+    while ((0 == pTask->Notify) && host_wait(&pTask->Cond, &pTask->Lock, host_remaining(xTicksToWait, Since))) {}
+    Value = pTask->Notify;
+    if (Value > 0) {
+        pTask->Notify = xClearCountOnExit ? 0 : (Value - 1);
+    }
+    pthread_mutex_unlock(&pTask->Lock);
+    return (Value);
+}  // ulTaskNotifyTake
+
+QueueHandle_t xQueueCreate(UBaseType_t uxQueueLength, UBaseType_t uxItemSize) {
+    struct HostQueue * pQueue = calloc(1, sizeof(struct HostQueue));
+
+    if (NULL == pQueue) {
+        return (NULL);
+    }
+    pQueue->pStorage = malloc((size_t)uxQueueLength * uxItemSize);
+    if (NULL == pQueue->pStorage) {
+        free(pQueue);
+        return (NULL);
+    }
+    pQueue->Length = uxQueueLength;
+    pQueue->ItemSize = uxItemSize;
+    host_sync_init(&pQueue->Lock, &pQueue->Cond);
+    return (pQueue);
+}  // xQueueCreate
+
+QueueHandle_t xQueueCreateStatic(UBaseType_t uxQueueLength, UBaseType_t uxItemSize, uint8_t * pucQueueStorage, StaticQueue_t * pxQueueBuffer) {
+    (void)pucQueueStorage;
+    (void)pxQueueBuffer;
+    return (xQueueCreate(uxQueueLength, uxItemSize));
+}
+
+/**
+ * @brief Add an item at the back or, isFront, at the front
+ */
+static BaseType_t host_queue_send(QueueHandle_t xQueue, const void * pvItemToQueue, TickType_t xTicksToWait, bool isFront) {
+    const TickType_t Since = xTaskGetTickCount();
+    BaseType_t ret = pdFAIL;
+
+    pthread_mutex_lock(&xQueue->Lock);
+    while ((xQueue->Count >= xQueue->Length) && host_wait(&xQueue->Cond, &xQueue->Lock, host_remaining(xTicksToWait, Since))) {}
+    if (xQueue->Count < xQueue->Length) {
+        if (isFront) {
+            xQueue->Head = (xQueue->Head + xQueue->Length - 1) % xQueue->Length;
+        }
+        const UBaseType_t Slot = isFront ? xQueue->Head : ((xQueue->Head + xQueue->Count) % xQueue->Length);
+        memcpy(&xQueue->pStorage[Slot * xQueue->ItemSize], pvItemToQueue, xQueue->ItemSize);
+        xQueue->Count++;
+        pthread_cond_broadcast(&xQueue->Cond);
+        ret = pdPASS;
+    }
+    pthread_mutex_unlock(&xQueue->Lock);
+    return (ret);
+}  // host_queue_send
+
+BaseType_t xQueueSend(QueueHandle_t xQueue, const void * pvItemToQueue, TickType_t xTicksToWait) {
+    return (host_queue_send(xQueue, pvItemToQueue, xTicksToWait, false));
+}
+
+BaseType_t xQueueSendToFront(QueueHandle_t xQueue, const void * pvItemToQueue, TickType_t xTicksToWait) {
+    return (host_queue_send(xQueue, pvItemToQueue, xTicksToWait, true));
+}
+
+BaseType_t xQueueReceive(QueueHandle_t xQueue, void * pvBuffer, TickType_t xTicksToWait) {
+    const TickType_t Since = xTaskGetTickCount();
+    BaseType_t ret = pdFAIL;
+
+    pthread_mutex_lock(&xQueue->Lock);
+    while ((0 == xQueue->Count) && host_wait(&xQueue->Cond, &xQueue->Lock, host_remaining(xTicksToWait, Since))) {}
+    if (xQueue->Count > 0) {
+        memcpy(pvBuffer, &xQueue->pStorage[xQueue->Head * xQueue->ItemSize], xQueue->ItemSize);
+        xQueue->Head = (xQueue->Head + 1) % xQueue->Length;
+        xQueue->Count--;
+        pthread_cond_broadcast(&xQueue->Cond);
+        ret = pdPASS;
+    }
+    pthread_mutex_unlock(&xQueue->Lock);
+    return (ret);
+}  // xQueueReceive
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t xQueue) {
+    pthread_mutex_lock(&xQueue->Lock);
+    const UBaseType_t Count = xQueue->Count;
+    pthread_mutex_unlock(&xQueue->Lock);
+    return (Count);
+}
+
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t xQueue) {
+    pthread_mutex_lock(&xQueue->Lock);
+    const UBaseType_t Spaces = xQueue->Length - xQueue->Count;
+    pthread_mutex_unlock(&xQueue->Lock);
+    return (Spaces);
+}
+
+void vQueueDelete(QueueHandle_t xQueue) {
+    free(xQueue->pStorage);
+    free(xQueue);
+}
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t uxMaxCount, UBaseType_t uxInitialCount) {
+    struct HostSemaphore * pSemaphore = calloc(1, sizeof(struct HostSemaphore));
+
+    if (NULL == pSemaphore) {
+        return (NULL);
+    }
+    pSemaphore->Count = uxInitialCount;
+    pSemaphore->MaxCount = uxMaxCount;
+    host_sync_init(&pSemaphore->Lock, &pSemaphore->Cond);
+    return (pSemaphore);
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t xSemaphore, TickType_t xBlockTime) {
+    const TickType_t Since = xTaskGetTickCount();
+    BaseType_t ret = pdFAIL;
+
+    pthread_mutex_lock(&xSemaphore->Lock);
+    while ((0 == xSemaphore->Count) && host_wait(&xSemaphore->Cond, &xSemaphore->Lock, host_remaining(xBlockTime, Since))) {}
+    if (xSemaphore->Count > 0) {
+        xSemaphore->Count--;
+        ret = pdPASS;
+    }
+    pthread_mutex_unlock(&xSemaphore->Lock);
+    return (ret);
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t xSemaphore) {
+    BaseType_t ret = pdFAIL;
+
+    pthread_mutex_lock(&xSemaphore->Lock);
+    if (xSemaphore->Count < xSemaphore->MaxCount) {
+        xSemaphore->Count++;
+        pthread_cond_broadcast(&xSemaphore->Cond);
+        ret = pdPASS;
+    }
+    pthread_mutex_unlock(&xSemaphore->Lock);
+    return (ret);
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t xSemaphore) {
+    free(xSemaphore);
+}
+
+SemaphoreHandle_t xSemaphoreCreateRecursiveMutex(void) {
+    return (xSemaphoreCreateCounting(1, 1));
+}
+
+BaseType_t xSemaphoreTakeRecursive(SemaphoreHandle_t xMutex, TickType_t xBlockTime) {
+    struct HostTask * pTask = host_current();
+
+    pthread_mutex_lock(&xMutex->Lock);
+    const bool isOwner = (xMutex->pOwner == pTask);
+    if (isOwner) {
+        xMutex->Depth++;
+    }
+    pthread_mutex_unlock(&xMutex->Lock);
+    if (isOwner) {
+        return (pdPASS);
+    }
+
+    if (pdPASS != xSemaphoreTake(xMutex, xBlockTime)) {
+        return (pdFAIL);
+    }
+    pthread_mutex_lock(&xMutex->Lock);
+    xMutex->pOwner = pTask;
+    xMutex->Depth = 1;
+    pthread_mutex_unlock(&xMutex->Lock);
+    return (pdPASS);
+}  // xSemaphoreTakeRecursive
+
+BaseType_t xSemaphoreGiveRecursive(SemaphoreHandle_t xMutex) {
+    pthread_mutex_lock(&xMutex->Lock);
+    if ((xMutex->pOwner != host_current()) || (0 == xMutex->Depth)) {
+        pthread_mutex_unlock(&xMutex->Lock);
+        return (pdFAIL);
+    }
+    const bool isReleased = (0 == --xMutex->Depth);
+    if (isReleased) {
+        xMutex->pOwner = NULL;
+    }
+    pthread_mutex_unlock(&xMutex->Lock);
+
+    return (isReleased ? xSemaphoreGive(xMutex) : pdPASS);
+}  // xSemaphoreGiveRecursive
+
+EventGroupHandle_t xEventGroupCreate(void) {
+    struct HostEventGroup * pGroup = calloc(1, sizeof(struct HostEventGroup));
+
+    if (NULL != pGroup) {
+        host_sync_init(&pGroup->Lock, &pGroup->Cond);
+    }
+    return (pGroup);
+}
+
+EventGroupHandle_t xEventGroupCreateStatic(StaticEventGroup_t * pxEventGroupBuffer) {
+    (void)pxEventGroupBuffer;
+    return (xEventGroupCreate());
+}
+
+EventBits_t xEventGroupSetBits(EventGroupHandle_t xEventGroup, const EventBits_t uxBitsToSet) {
+    pthread_mutex_lock(&xEventGroup->Lock);
+    xEventGroup->Bits |= uxBitsToSet;
+    const EventBits_t Bits = xEventGroup->Bits;
+    pthread_cond_broadcast(&xEventGroup->Cond);
+    pthread_mutex_unlock(&xEventGroup->Lock);
+    return (Bits);
+}
+
+EventBits_t xEventGroupClearBits(EventGroupHandle_t xEventGroup, const EventBits_t uxBitsToClear) {
+    pthread_mutex_lock(&xEventGroup->Lock);
+    const EventBits_t Bits = xEventGroup->Bits;
+    xEventGroup->Bits &= ~uxBitsToClear;
+    pthread_mutex_unlock(&xEventGroup->Lock);
+    return (Bits);
+}
+
+EventBits_t xEventGroupGetBits(EventGroupHandle_t xEventGroup) {
+    pthread_mutex_lock(&xEventGroup->Lock);
+    const EventBits_t Bits = xEventGroup->Bits;
+    pthread_mutex_unlock(&xEventGroup->Lock);
+    return (Bits);
+}
+
+/**
+ * @brief Wait for bits
+ *
+ * @return EventBits_t The bits when the wait ended, before clearing
+ */
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t xEventGroup, const EventBits_t uxBitsToWaitFor, const BaseType_t xClearOnExit, const BaseType_t xWaitForAllBits, TickType_t xTicksToWait) {
+    const TickType_t Since = xTaskGetTickCount();
+    bool isMet;
+
+    pthread_mutex_lock(&xEventGroup->Lock);
+    for (;;) {
+        const EventBits_t Set = xEventGroup->Bits & uxBitsToWaitFor;
+        isMet = xWaitForAllBits ? (Set == uxBitsToWaitFor) : (0 != Set);
+        if (isMet || !host_wait(&xEventGroup->Cond, &xEventGroup->Lock, host_remaining(xTicksToWait, Since))) {
+            break;
+        }
+    }
+    if (!isMet) {
+        const EventBits_t Set = xEventGroup->Bits & uxBitsToWaitFor;
+        isMet = xWaitForAllBits ? (Set == uxBitsToWaitFor) : (0 != Set);
+    }
+    const EventBits_t Bits = xEventGroup->Bits;
+    if (isMet && xClearOnExit) {
+        xEventGroup->Bits &= ~uxBitsToWaitFor;
+    }
+    pthread_mutex_unlock(&xEventGroup->Lock);
+    return (Bits);
+}  // xEventGroupWaitBits
+
+void vEventGroupDelete(EventGroupHandle_t xEventGroup) {
+    free(xEventGroup);
+}
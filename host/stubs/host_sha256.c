@@ -0,0 +1,132 @@
+/**
+ ******************************************************************************
+ *  file           : host_sha256.c
+ *  brief          : Host build: SHA-256 (FIPS 180-4), SHA-224 is not supported
+ ******************************************************************************
+ */
+
+/****************************** Includes  */
+#include <string.h>
+#include "mbedtls/sha256.h"
+
+/****************************** Statics */
+static const uint32_t K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+/****************************** Functions */
+
+#define ROR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+/**
+ * @brief Hash one block of 64 bytes
+ */
+static void sha256_block(mbedtls_sha256_context * ctx, const uint8_t * pBlock) {
+    uint32_t W[64];
+    uint32_t S[8];
+
+    for (int i = 0; i < 16; i++) {
+        W[i] = ((uint32_t)pBlock[4 * i] << 24) | ((uint32_t)pBlock[4 * i + 1] << 16) | ((uint32_t)pBlock[4 * i + 2] << 8) | pBlock[4 * i + 3];
+    }
+    for (int i = 16; i < 64; i++) {
+        const uint32_t s0 = ROR(W[i - 15], 7) ^ ROR(W[i - 15], 18) ^ (W[i - 15] >> 3);
+        const uint32_t s1 = ROR(W[i - 2], 17) ^ ROR(W[i - 2], 19) ^ (W[i - 2] >> 10);
+        W[i] = W[i - 16] + s0 + W[i - 7] + s1;
+    }
+
+    memcpy(S, ctx->State, sizeof(S));
+    for (int i = 0; i < 64; i++) {
+        const uint32_t S1 = ROR(S[4], 6) ^ ROR(S[4], 11) ^ ROR(S[4], 25);
+        const uint32_t Ch = (S[4] & S[5]) ^ (~S[4] & S[6]);
+        const uint32_t T1 = S[7] + S1 + Ch + K[i] + W[i];
+        const uint32_t S0 = ROR(S[0], 2) ^ ROR(S[0], 13) ^ ROR(S[0], 22);
+        const uint32_t Maj = (S[0] & S[1]) ^ (S[0] & S[2]) ^ (S[1] & S[2]);
+        const uint32_t T2 = S0 + Maj;
+
+        memmove(&S[1], &S[0], 7 * sizeof(uint32_t));
+        S[4] += T1;
+        S[0] = T1 + T2;
+    }
+    for (int i = 0; i < 8; i++) {
+        ctx->State[i] += S[i];
+    }
+}  // sha256_block
+
+void mbedtls_sha256_init(mbedtls_sha256_context * ctx) {
+    memset(ctx, 0x00, sizeof(mbedtls_sha256_context));
+}
+
+void mbedtls_sha256_free(mbedtls_sha256_context * ctx) {
+    memset(ctx, 0x00, sizeof(mbedtls_sha256_context));
+}
+
+int mbedtls_sha256_starts(mbedtls_sha256_context * ctx, int is224) {
+    static const uint32_t Initial[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+    };
+
+    if (0 != is224) {
+        return (-1);
+    }
+    memcpy(ctx->State, Initial, sizeof(Initial));
+    ctx->Length = 0;
+    ctx->BlockLen = 0;
+    return (0);
+}
+
+int mbedtls_sha256_update(mbedtls_sha256_context * ctx, const unsigned char * input, size_t ilen) {
+    ctx->Length += ilen;
+    while (ilen > 0) {
+        const size_t Part = ((64 - ctx->BlockLen) < ilen) ? (64 - ctx->BlockLen) : ilen;
+
+        memcpy(&ctx->Block[ctx->BlockLen], input, Part);
+        ctx->BlockLen += Part;
+        input += Part;
+        ilen -= Part;
+        if (64 == ctx->BlockLen) {
+            sha256_block(ctx, ctx->Block);
+            ctx->BlockLen = 0;
+        }
+    }
+    return (0);
+}  // mbedtls_sha256_update
+
+int mbedtls_sha256_finish(mbedtls_sha256_context * ctx, unsigned char * output) {
+    const uint64_t Bits = ctx->Length * 8;
+    uint8_t Pad[72] = { 0x80 };
+
+    // 0x80, zeros up to 56 mod 64, then the length in bits, big endian
+    const size_t PadLen = (ctx->BlockLen < 56) ? (56 - ctx->BlockLen) : (120 - ctx->BlockLen);
+    for (int i = 0; i < 8; i++) {
+        Pad[PadLen + i] = Bits >> (56 - (8 * i));
+    }
+    mbedtls_sha256_update(ctx, Pad, PadLen + 8);
+
+    for (int i = 0; i < 8; i++) {
+        output[4 * i] = ctx->State[i] >> 24;
+        output[4 * i + 1] = ctx->State[i] >> 16;
+        output[4 * i + 2] = ctx->State[i] >> 8;
+        output[4 * i + 3] = ctx->State[i];
+    }
+    return (0);
+}  // mbedtls_sha256_finish
+
+int mbedtls_sha256(const unsigned char * input, size_t ilen, unsigned char * output, int is224) {
+    mbedtls_sha256_context Ctx;
+
+    mbedtls_sha256_init(&Ctx);
+    int ret = mbedtls_sha256_starts(&Ctx, is224);
+    if (0 == ret) {
+        mbedtls_sha256_update(&Ctx, input, ilen);
+        mbedtls_sha256_finish(&Ctx, output);
+    }
+    mbedtls_sha256_free(&Ctx);
+    return (ret);
+}
@@ -0,0 +1,239 @@
+/**
+ ******************************************************************************
+ *  file           : host_timer.c
+ *  brief          : Host build: esp_timer on a simulated clock
+ *
+ *  The clock starts at 0 and only moves with HostTimer_Advance(). Timers
+ *  which expire on the way are called in order of their deadline, from
+ *  the thread calling HostTimer_Advance(), as from the esp_timer task on
+ *  the target.
+ *
+ *  After HostTimer_SetRealTime() the clock follows the monotonic clock
+ *  and a timer thread calls the expired timers, for benchmarks and
+ *  whole-device runs.
+ ******************************************************************************
+ */
+
+/****************************** Includes  */
+#include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
+#include "esp_timer.h"
+#include "host.h"
+
+/****************************** Statics */
+struct esp_timer {
+    esp_timer_create_args_t Args;
+    int64_t             Deadline;       // Time of the next call
+    uint64_t            Period;         // 0 for one-shot timers
+    bool                isArmed;
+    struct esp_timer *  pNext;          // List of all timers
+};
+
+static pthread_mutex_t TimerLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t TimerCond;                // Real time: Wakes the timer thread
+static struct esp_timer * pTimers = NULL;
+static int64_t NowUs = 0;
+static bool isRealTime = false;
+static int64_t RealOffsetUs = 0;                // Real time: Clock minus monotonic time
+
+/****************************** Functions */
+
+/**
+ * @brief Monotonic time in us
+ */
+static int64_t timer_monotonic(void) {
+    struct timespec Now;
+
+    clock_gettime(CLOCK_MONOTONIC, &Now);
+    return (((int64_t)Now.tv_sec * 1000000) + (Now.tv_nsec / 1000));
+}
+
+/**
+ * @brief Current time, with the lock
+ */
+static int64_t timer_now(void) {
+    if (isRealTime) {
+        NowUs = RealOffsetUs + timer_monotonic();
+    }
+    return (NowUs);
+}
+
+/**
+ * @brief The armed timer expiring first, with the lock
+ */
+static struct esp_timer * timer_next(void) {
+    struct esp_timer * pNext = NULL;
+
+    for (struct esp_timer * pTimer = pTimers; NULL != pTimer; pTimer = pTimer->pNext) {
+        if (pTimer->isArmed && ((NULL == pNext) || (pTimer->Deadline < pNext->Deadline))) {
+            pNext = pTimer;
+        }
+    }
+    return (pNext);
+}
+
+/**
+ * @brief Take an expired timer out and call it, with the lock
+ */
+static void timer_fire(struct esp_timer * pTimer) {
+    if (0 != pTimer->Period) {
+        pTimer->Deadline += pTimer->Period;
+    } else {
+        pTimer->isArmed = false;
+    }
+
+    // The callback may restart or stop timers
+    pthread_mutex_unlock(&TimerLock);
+    pTimer->Args.callback(pTimer->Args.arg);
+    pthread_mutex_lock(&TimerLock);
+}
+
+/**
+ * @brief Real time: The esp_timer task
+ */
+static void * timer_thread(void * pArg) {
+    (void)pArg;
+
+    pthread_mutex_lock(&TimerLock);
+    for (;;) {
+        struct esp_timer * pNext = timer_next();
+
+        if (NULL == pNext) {
+            pthread_cond_wait(&TimerCond, &TimerLock);
+        } else if (pNext->Deadline <= timer_now()) {
+            timer_fire(pNext);
+        } else {
+            const int64_t Until = pNext->Deadline - RealOffsetUs;
+            const struct timespec Deadline = { .tv_sec = Until / 1000000, .tv_nsec = (Until % 1000000) * 1000 };
+            pthread_cond_timedwait(&TimerCond, &TimerLock, &Deadline);
+        }
+    }
+    return (NULL);
+}  // timer_thread
+
+/**
+ * @brief Let the clock follow the real time from now on
+ *
+ * The simulated time continues from its current value. Can't be undone,
+ * HostTimer_Advance() must not be used any more.
+ */
+void HostTimer_SetRealTime(void) {
+    pthread_condattr_t Attr;
+    pthread_t Thread;
+
+    pthread_mutex_lock(&TimerLock);
+    if (!isRealTime) {
+        pthread_condattr_init(&Attr);
+        pthread_condattr_setclock(&Attr, CLOCK_MONOTONIC);
+        pthread_cond_init(&TimerCond, &Attr);
+        pthread_condattr_destroy(&Attr);
+
+        RealOffsetUs = NowUs - timer_monotonic();
+        isRealTime = true;
+        pthread_create(&Thread, NULL, timer_thread, NULL);
+        pthread_detach(Thread);
+    }
+    pthread_mutex_unlock(&TimerLock);
+}  // HostTimer_SetRealTime
+
+/**
+ * @brief Move the clock, calling all timers expiring on the way
+ *
+ * @param Us Microseconds to advance
+ */
+void HostTimer_Advance(uint64_t Us) {
+    pthread_mutex_lock(&TimerLock);
+    if (isRealTime) {
+        pthread_mutex_unlock(&TimerLock);
+        return;
+    }
+    const int64_t Target = NowUs + Us;
+
+    for (;;) {
+        struct esp_timer * pNext = timer_next();
+
+        if ((NULL == pNext) || (pNext->Deadline > Target)) {
+            break;
+        }
+        NowUs = pNext->Deadline;
+        timer_fire(pNext);
+    }
+
+    NowUs = Target;
+    pthread_mutex_unlock(&TimerLock);
+}  // HostTimer_Advance
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t * create_args, esp_timer_handle_t * out_handle) {
+    struct esp_timer * pTimer = calloc(1, sizeof(struct esp_timer));
+
+    if (NULL == pTimer) {
+        return (ESP_ERR_NO_MEM);
+    }
+    pTimer->Args = *create_args;
+
+    pthread_mutex_lock(&TimerLock);
+    pTimer->pNext = pTimers;
+    pTimers = pTimer;
+    pthread_mutex_unlock(&TimerLock);
+
+    *out_handle = pTimer;
+    return (ESP_OK);
+}  // esp_timer_create
+
+static esp_err_t timer_start(esp_timer_handle_t timer, uint64_t timeout_us, uint64_t period) {
+    esp_err_t ret = ESP_ERR_INVALID_STATE;
+
+    pthread_mutex_lock(&TimerLock);
+    if (!timer->isArmed) {
+        timer->Deadline = timer_now() + timeout_us;
+        timer->Period = period;
+        timer->isArmed = true;
+        ret = ESP_OK;
+        if (isRealTime) {
+            pthread_cond_signal(&TimerCond);
+        }
+    }
+    pthread_mutex_unlock(&TimerLock);
+    return (ret);
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us) {
+    return (timer_start(timer, timeout_us, 0));
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period) {
+    return (timer_start(timer, period, period));
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer) {
+    esp_err_t ret = ESP_ERR_INVALID_STATE;
+
+    pthread_mutex_lock(&TimerLock);
+    if (timer->isArmed) {
+        timer->isArmed = false;
+        ret = ESP_OK;
+    }
+    pthread_mutex_unlock(&TimerLock);
+    return (ret);
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer) {
+    pthread_mutex_lock(&TimerLock);
+    for (struct esp_timer ** ppTimer = &pTimers; NULL != *ppTimer; ppTimer = &(*ppTimer)->pNext) {
+        if (*ppTimer == timer) {
+            *ppTimer = timer->pNext;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&TimerLock);
+    free(timer);
+    return (ESP_OK);
+}  // esp_timer_delete
+
+int64_t esp_timer_get_time(void) {
+    pthread_mutex_lock(&TimerLock);
+    const int64_t Now = timer_now();
+    pthread_mutex_unlock(&TimerLock);
+    return (Now);
+}
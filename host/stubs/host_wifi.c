@@ -0,0 +1,246 @@
+/**
+ ******************************************************************************
+ *  file           : host_wifi.c
+ *  brief          : Host build: Simulated WiFi station and its network interface
+ *
+ *  One AP, see HostWifi_SetAp(). A connect posts CONNECTED and GOT_IP to
+ *  the default event loop if the AP is reachable and matches the BSSID
+ *  and channel of a directed connect, else DISCONNECTED. The lease comes
+ *  from the AP unless a static IP is set with DHCP stopped.
+ ******************************************************************************
+ */
+
+/****************************** Includes  */
+#include <string.h>
+#include <pthread.h>
+#include "esp_wifi.h"
+#include "esp_netif.h"
+#include "host.h"
+
+/****************************** Statics */
+ESP_EVENT_DEFINE_BASE(WIFI_EVENT);
+ESP_EVENT_DEFINE_BASE(IP_EVENT);
+
+struct esp_netif_obj {
+    bool                isDhcp;         // Client running, else static
+    esp_netif_ip_info_t IpInfo;         // Current or static address
+    esp_netif_dns_info_t Dns;
+};
+
+static pthread_mutex_t Lock = PTHREAD_MUTEX_INITIALIZER;
+static struct esp_netif_obj NetIf = { .isDhcp = true };
+static wifi_config_t Config;
+static bool isInit = false;
+static bool isStarted = false;
+static bool isConnected = false;
+static HostWifi_Stats Stats;
+
+// The simulated AP
+static char    ApSsid[33] = "";         // Empty: Any SSID
+static uint8_t ApBssid[6] = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x01 };
+static uint8_t ApChannel = 6;
+static bool    isApReachable = true;
+
+/****************************** Functions */
+
+/**
+ * @brief Set the AP
+ *
+ * @param Ssid Network name, NULL or empty for any
+ * @param pBssid Address of the AP, NULL to keep
+ * @param Channel Channel of the AP, 0 to keep
+ * @param isReachable false: Connects fail, a connection is lost
+ */
+void HostWifi_SetAp(const char * Ssid, const uint8_t * pBssid, uint8_t Channel, bool isReachable) {
+    bool isLost;
+
+    pthread_mutex_lock(&Lock);
+    strlcpy(ApSsid, (NULL != Ssid) ? Ssid : "", sizeof(ApSsid));
+    if (NULL != pBssid) {
+        memcpy(ApBssid, pBssid, sizeof(ApBssid));
+    }
+    if (0 != Channel) {
+        ApChannel = Channel;
+    }
+    isApReachable = isReachable;
+    isLost = isConnected && !isReachable;
+    pthread_mutex_unlock(&Lock);
+
+    if (isLost) {
+        HostWifi_Disconnect(WIFI_REASON_BEACON_TIMEOUT);
+    }
+}  // HostWifi_SetAp
+
+/**
+ * @brief Drop the connection, the station does not reconnect by itself
+ *
+ * @param Reason Reason of the DISCONNECTED event
+ */
+void HostWifi_Disconnect(uint8_t Reason) {
+    wifi_event_sta_disconnected_t Event = { .reason = Reason };
+
+    pthread_mutex_lock(&Lock);
+    const bool wasConnected = isConnected;
+    isConnected = false;
+    memcpy(Event.bssid, ApBssid, sizeof(Event.bssid));
+    pthread_mutex_unlock(&Lock);
+
+    if (wasConnected) {
+        esp_event_post(WIFI_EVENT, WIFI_EVENT_STA_DISCONNECTED, &Event, sizeof(Event), portMAX_DELAY);
+    }
+}  // HostWifi_Disconnect
+
+/**
+ * @brief Get the counters and the config of the station
+ *
+ * @param pStats The counters
+ * @param pConfig The config, may be NULL
+ */
+void HostWifi_GetStats(HostWifi_Stats * pStats, wifi_config_t * pConfig) {
+    pthread_mutex_lock(&Lock);
+    *pStats = Stats;
+    pStats->isDhcp = NetIf.isDhcp;
+    if (NULL != pConfig) {
+        *pConfig = Config;
+    }
+    pthread_mutex_unlock(&Lock);
+}
+
+esp_err_t esp_netif_init(void) {
+    return (ESP_OK);
+}
+
+esp_netif_t * esp_netif_create_default_wifi_sta(void) {
+    return (&NetIf);
+}
+
+esp_err_t esp_netif_dhcpc_start(esp_netif_t * esp_netif) {
+    pthread_mutex_lock(&Lock);
+    esp_netif->isDhcp = true;
+    pthread_mutex_unlock(&Lock);
+    return (ESP_OK);
+}
+
+esp_err_t esp_netif_dhcpc_stop(esp_netif_t * esp_netif) {
+    pthread_mutex_lock(&Lock);
+    esp_netif->isDhcp = false;
+    pthread_mutex_unlock(&Lock);
+    return (ESP_OK);
+}
+
+esp_err_t esp_netif_set_ip_info(esp_netif_t * esp_netif, const esp_netif_ip_info_t * ip_info) {
+    pthread_mutex_lock(&Lock);
+    esp_netif->IpInfo = *ip_info;
+    pthread_mutex_unlock(&Lock);
+    return (ESP_OK);
+}
+
+esp_err_t esp_netif_get_ip_info(esp_netif_t * esp_netif, esp_netif_ip_info_t * ip_info) {
+    pthread_mutex_lock(&Lock);
+    *ip_info = esp_netif->IpInfo;
+    pthread_mutex_unlock(&Lock);
+    return (ESP_OK);
+}
+
+esp_err_t esp_netif_set_dns_info(esp_netif_t * esp_netif, esp_netif_dns_type_t type, esp_netif_dns_info_t * dns) {
+    if (ESP_NETIF_DNS_MAIN != type) {
+        return (ESP_ERR_INVALID_ARG);
+    }
+    pthread_mutex_lock(&Lock);
+    esp_netif->Dns = *dns;
+    pthread_mutex_unlock(&Lock);
+    return (ESP_OK);
+}
+
+esp_err_t esp_netif_get_dns_info(esp_netif_t * esp_netif, esp_netif_dns_type_t type, esp_netif_dns_info_t * dns) {
+    if (ESP_NETIF_DNS_MAIN != type) {
+        return (ESP_ERR_INVALID_ARG);
+    }
+    pthread_mutex_lock(&Lock);
+    *dns = esp_netif->Dns;
+    pthread_mutex_unlock(&Lock);
+    return (ESP_OK);
+}
+
+esp_err_t esp_wifi_init(const wifi_init_config_t * config) {
+    isInit = true;
+    return (ESP_OK);
+}
+
+esp_err_t esp_wifi_set_mode(wifi_mode_t mode) {
+    return (isInit ? ESP_OK : ESP_ERR_WIFI_NOT_INIT);
+}
+
+esp_err_t esp_wifi_set_config(wifi_interface_t interface, wifi_config_t * conf) {
+    if (!isInit) {
+        return (ESP_ERR_WIFI_NOT_INIT);
+    }
+    pthread_mutex_lock(&Lock);
+    Config = *conf;
+    pthread_mutex_unlock(&Lock);
+    return (ESP_OK);
+}
+
+esp_err_t esp_wifi_get_config(wifi_interface_t interface, wifi_config_t * conf) {
+    pthread_mutex_lock(&Lock);
+    *conf = Config;
+    pthread_mutex_unlock(&Lock);
+    return (ESP_OK);
+}
+
+esp_err_t esp_wifi_start(void) {
+    if (!isInit) {
+        return (ESP_ERR_WIFI_NOT_INIT);
+    }
+    isStarted = true;
+    return (esp_event_post(WIFI_EVENT, WIFI_EVENT_STA_START, NULL, 0, portMAX_DELAY));
+}
+
+esp_err_t esp_wifi_connect(void) {
+    wifi_event_sta_connected_t Connected = { 0 };
+    wifi_event_sta_disconnected_t Disconnected = { .reason = WIFI_REASON_NO_AP_FOUND };
+    ip_event_got_ip_t GotIp = { .esp_netif = &NetIf };
+
+    if (!isStarted) {
+        return (ESP_ERR_WIFI_NOT_STARTED);
+    }
+
+    pthread_mutex_lock(&Lock);
+    const wifi_sta_config_t * pSta = &Config.sta;
+    const bool isFound = isApReachable
+                      && (('\0' == ApSsid[0]) || (0 == strncmp(ApSsid, (const char*)pSta->ssid, sizeof(pSta->ssid))))
+                      && (!pSta->bssid_set || (0 == memcmp(pSta->bssid, ApBssid, sizeof(ApBssid))))
+                      && ((0 == pSta->channel) || (pSta->channel == ApChannel));
+    Stats.Connects++;
+    if (pSta->bssid_set) {
+        Stats.Directed++;
+    }
+    if (isFound) {
+        isConnected = true;
+        memcpy(Connected.bssid, ApBssid, sizeof(Connected.bssid));
+        Connected.channel = ApChannel;
+        if (NetIf.isDhcp) {
+            // The lease of the AP
+            NetIf.IpInfo.ip.addr = ESP_IP4TOADDR(192, 168, 4, 100);
+            NetIf.IpInfo.netmask.addr = ESP_IP4TOADDR(255, 255, 255, 0);
+            NetIf.IpInfo.gw.addr = ESP_IP4TOADDR(192, 168, 4, 1);
+            NetIf.Dns.ip.type = ESP_IPADDR_TYPE_V4;
+            NetIf.Dns.ip.u_addr.ip4.addr = ESP_IP4TOADDR(192, 168, 4, 1);
+        } else {
+            Stats.StaticIp++;
+        }
+        GotIp.ip_info = NetIf.IpInfo;
+    }
+    pthread_mutex_unlock(&Lock);
+
+    if (!isFound) {
+        return (esp_event_post(WIFI_EVENT, WIFI_EVENT_STA_DISCONNECTED, &Disconnected, sizeof(Disconnected), portMAX_DELAY));
+    }
+    esp_event_post(WIFI_EVENT, WIFI_EVENT_STA_CONNECTED, &Connected, sizeof(Connected), portMAX_DELAY);
+    return (esp_event_post(IP_EVENT, IP_EVENT_STA_GOT_IP, &GotIp, sizeof(GotIp), portMAX_DELAY));
+}  // esp_wifi_connect
+
+esp_err_t esp_wifi_disconnect(void) {
+    HostWifi_Disconnect(WIFI_REASON_ASSOC_LEAVE);
+    return (ESP_OK);
+}
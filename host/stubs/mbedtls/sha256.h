@@ -0,0 +1,36 @@
+/**
+ ******************************************************************************
+ *  file           : sha256.h
+ *  brief          : Host build: SHA-256 with the API of mbedtls
+ ******************************************************************************
+ */
+
+#ifndef HOST_MBEDTLS_SHA256_H_
+#define HOST_MBEDTLS_SHA256_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct mbedtls_sha256_context {
+    uint32_t    State[8];
+    uint64_t    Length;                 // Bytes so far
+    uint8_t     Block[64];
+    size_t      BlockLen;               // Bytes in Block
+} mbedtls_sha256_context;
+
+void    mbedtls_sha256_init(mbedtls_sha256_context * ctx);
+void    mbedtls_sha256_free(mbedtls_sha256_context * ctx);
+int     mbedtls_sha256_starts(mbedtls_sha256_context * ctx, int is224);
+int     mbedtls_sha256_update(mbedtls_sha256_context * ctx, const unsigned char * input, size_t ilen);
+int     mbedtls_sha256_finish(mbedtls_sha256_context * ctx, unsigned char * output);
+int     mbedtls_sha256(const unsigned char * input, size_t ilen, unsigned char * output, int is224);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // HOST_MBEDTLS_SHA256_H_
@@ -0,0 +1,24 @@
+/**
+ ******************************************************************************
+ *  file           : nvs_flash.h
+ *  brief          : Host build: NVS in RAM
+ ******************************************************************************
+ */
+
+#ifndef HOST_NVS_FLASH_H_
+#define HOST_NVS_FLASH_H_
+
+#include "nvs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+esp_err_t   nvs_flash_init(void);
+esp_err_t   nvs_flash_erase(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // HOST_NVS_FLASH_H_
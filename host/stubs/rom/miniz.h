@@ -0,0 +1,62 @@
+/**
+ ******************************************************************************
+ *  file           : miniz.h
+ *  brief          : Host build: tinfl of the ROM, on zlib
+ *
+ *  Only raw deflate streams into a ring window, as used by otadec.c. zlib
+ *  keeps its own history, the state and all its allocations live in the
+ *  tinfl_decompressor, so a decoder is freed with its memory.
+ ******************************************************************************
+ */
+
+#ifndef HOST_ROM_MINIZ_H_
+#define HOST_ROM_MINIZ_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <zlib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TINFL_HEAP_SIZE (48 * 1024)     // zlib state and a 32K window
+
+typedef uint8_t  mz_uint8;
+typedef uint32_t mz_uint32;
+
+typedef enum {
+    TINFL_STATUS_BAD_PARAM = -3,
+    TINFL_STATUS_ADLER32_MISMATCH = -2,
+    TINFL_STATUS_FAILED = -1,
+    TINFL_STATUS_DONE = 0,
+    TINFL_STATUS_NEEDS_MORE_INPUT = 1,
+    TINFL_STATUS_HAS_MORE_OUTPUT = 2,
+} tinfl_status;
+
+enum {
+    TINFL_FLAG_PARSE_ZLIB_HEADER = 1,
+    TINFL_FLAG_HAS_MORE_INPUT = 2,
+    TINFL_FLAG_USING_NON_WRAPPING_OUTPUT_BUF = 4,
+    TINFL_FLAG_COMPUTE_ADLER32 = 8,
+};
+
+typedef struct tinfl_decompressor {
+    z_stream    Stream;
+    int         Error;                  // zlib error of the init
+    size_t      HeapUsed;
+    uint8_t     Heap[TINFL_HEAP_SIZE] __attribute__((aligned(16)));
+} tinfl_decompressor;
+
+void            host_tinfl_init(tinfl_decompressor * r);
+tinfl_status    tinfl_decompress(tinfl_decompressor * r, const mz_uint8 * pIn_buf_next, size_t * pIn_buf_size,
+                                 mz_uint8 * pOut_buf_start, mz_uint8 * pOut_buf_next, size_t * pOut_buf_size,
+                                 const mz_uint32 decomp_flags);
+
+#define tinfl_init(r) host_tinfl_init(r)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // HOST_ROM_MINIZ_H_
@@ -0,0 +1,17 @@
+/**
+ ******************************************************************************
+ *  file           : sdkconfig.h
+ *  brief          : Host build: Configuration, defaults of sdkconfig.defaults
+ ******************************************************************************
+ */
+
+#ifndef HOST_SDKCONFIG_H_
+#define HOST_SDKCONFIG_H_
+
+#define CONFIG_IOTBASE_STATIC_ALLOC 0
+#define CONFIG_IOTBASE_MQTT_MAX_PAYLOAD 65536   // Upper bound of menuconfig, for the 64 KB bench
+#define CONFIG_FREERTOS_HZ 1000
+#define CONFIG_IDF_TARGET "esp32"
+#define CONFIG_IDF_FIRMWARE_CHIP_ID 0x0000
+
+#endif  // HOST_SDKCONFIG_H_
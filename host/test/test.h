@@ -0,0 +1,60 @@
+/**
+ ******************************************************************************
+ *  file           : test.h
+ *  brief          : Host build: Minimal unit test helpers
+ *
+ *  A test is a void function using the TEST_ASSERT macros, a failed
+ *  assertion ends it. main() runs all tests with RUN_TEST() and returns
+ *  TEST_RESULT(), non-zero if a test failed.
+ ******************************************************************************
+ */
+
+#ifndef HOST_TEST_H_
+#define HOST_TEST_H_
+
+#include <stdio.h>
+#include <string.h>
+
+static int TestFailures = 0;
+static int TestCount = 0;
+
+#define TEST_ASSERT(cond) do { \
+        if (!(cond)) { \
+            printf("%s:%d: Assertion failed: %s\n", __FILE__, __LINE__, #cond); \
+            TestFailures++; \
+            return; \
+        } \
+    } while (0)
+
+#define TEST_ASSERT_EQUAL(expected, actual) do { \
+        const long long Expected_ = (long long)(expected); \
+        const long long Actual_ = (long long)(actual); \
+        if (Expected_ != Actual_) { \
+            printf("%s:%d: %s is %lld, expected %lld\n", __FILE__, __LINE__, #actual, Actual_, Expected_); \
+            TestFailures++; \
+            return; \
+        } \
+    } while (0)
+
+#define TEST_ASSERT_EQUAL_STRING(expected, actual) do { \
+        const char * Expected_ = (expected); \
+        const char * Actual_ = (actual); \
+        if (0 != strcmp(Expected_, Actual_)) { \
+            printf("%s:%d: %s is \"%s\", expected \"%s\"\n", __FILE__, __LINE__, #actual, Actual_, Expected_); \
+            TestFailures++; \
+            return; \
+        } \
+    } while (0)
+
+#define RUN_TEST(test) do { \
+        const int Failures_ = TestFailures; \
+        TestCount++; \
+        test(); \
+        printf("%-40s %s\n", #test, (Failures_ == TestFailures) ? "OK" : "FAILED"); \
+    } while (0)
+
+#define TEST_RESULT() ({ \
+        printf("%d tests, %d failed\n", TestCount, TestFailures); \
+        (0 != TestFailures) ? 1 : 0; })
+
+#endif  // HOST_TEST_H_
@@ -0,0 +1,148 @@
+/**
+ ******************************************************************************
+ *  file           : test_boot.c
+ *  brief          : Host tests of the startup orchestrator
+ ******************************************************************************
+ */
+
+/****************************** Includes  */
+#include <pthread.h>
+#include "esp_bit_defs.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "host.h"
+#include "boot.h"
+#include "test.h"
+
+/****************************** Statics */
+#define TEST_TIMEOUT (2000 / portTICK_PERIOD_MS)
+
+#define BOOT_NVS      BIT0
+#define BOOT_WIFI     BIT1
+#define BOOT_MQTT     BIT2
+#define BOOT_APPS     BIT3
+#define BOOT_LEFT     BIT4              // Started marks of the parallel stages
+#define BOOT_RIGHT    BIT5
+#define BOOT_BROKEN   BIT6
+#define BOOT_BEHIND   BIT7
+
+static pthread_mutex_t OrderLock = PTHREAD_MUTEX_INITIALIZER;
+static const char * Order[8];           // Stages in order of their run
+static int OrderCount = 0;
+
+/****************************** Functions */
+
+static void test_record(const char * Name) {
+    pthread_mutex_lock(&OrderLock);
+    Order[OrderCount++] = Name;
+    pthread_mutex_unlock(&OrderLock);
+}
+
+static int test_position(const char * Name) {
+    for (int i = 0; i < OrderCount; i++) {
+        if (0 == strcmp(Order[i], Name)) {
+            return (i);
+        }
+    }
+    return (-1);
+}
+
+static esp_err_t stage_nvs(void)  { test_record("nvs"); return (ESP_OK); }
+static esp_err_t stage_wifi(void) { test_record("wifi"); return (ESP_OK); }
+static esp_err_t stage_mqtt(void) { test_record("mqtt"); return (ESP_OK); }
+static esp_err_t stage_apps(void) { test_record("apps"); return (ESP_OK); }
+static esp_err_t stage_broken(void) { test_record("broken"); return (ESP_FAIL); }
+static esp_err_t stage_behind(void) { test_record("behind"); return (ESP_OK); }
+
+// Each waits for the other to start, only works if they run in parallel
+static esp_err_t stage_left(void) {
+    Boot_SetReady(BOOT_LEFT);
+    return (Boot_Wait(BOOT_RIGHT, TEST_TIMEOUT));
+}
+
+static esp_err_t stage_right(void) {
+    Boot_SetReady(BOOT_RIGHT);
+    return (Boot_Wait(BOOT_LEFT, TEST_TIMEOUT));
+}
+
+/****************************** Tests */
+
+static void test_order(void) {
+    // Listed against the dependencies
+    static const BootStage Stages[] = {
+        { "apps", BOOT_MQTT | BOOT_NVS, BOOT_APPS, stage_apps, 2048 },
+        { "mqtt", BOOT_WIFI, BOOT_MQTT, stage_mqtt, 2048 },
+        { "wifi", BOOT_NVS, BOOT_WIFI, stage_wifi, 2048 },
+        { "nvs",  0, BOOT_NVS, stage_nvs, 2048 },
+    };
+
+    OrderCount = 0;
+    TEST_ASSERT_EQUAL(ESP_OK, Boot_Start(Stages, 4));
+    TEST_ASSERT_EQUAL(ESP_OK, Boot_Wait(BOOT_APPS, TEST_TIMEOUT));
+    TEST_ASSERT_EQUAL(4, OrderCount);
+    TEST_ASSERT_EQUAL(0, test_position("nvs"));
+    TEST_ASSERT_EQUAL(1, test_position("wifi"));
+    TEST_ASSERT_EQUAL(2, test_position("mqtt"));
+    TEST_ASSERT_EQUAL(3, test_position("apps"));
+}
+
+static void test_parallel(void) {
+    static const BootStage Stages[] = {
+        { "left",  0, BOOT_NVS, stage_left, 2048 },
+        { "right", 0, BOOT_WIFI, stage_right, 2048 },
+    };
+
+    TEST_ASSERT_EQUAL(ESP_OK, Boot_Start(Stages, 2));
+    TEST_ASSERT_EQUAL(ESP_OK, Boot_Wait(BOOT_NVS | BOOT_WIFI, TEST_TIMEOUT));
+}
+
+static void test_failed_stage(void) {
+    static const BootStage Stages[] = {
+        { "nvs",    0, BOOT_NVS, stage_nvs, 2048 },
+        { "broken", BOOT_NVS, BOOT_BROKEN, stage_broken, 2048 },
+        { "behind", BOOT_BROKEN, BOOT_BEHIND, stage_behind, 2048 },
+    };
+
+    OrderCount = 0;
+    TEST_ASSERT_EQUAL(ESP_OK, Boot_Start(Stages, 3));
+    TEST_ASSERT_EQUAL(ESP_OK, Boot_Wait(BOOT_NVS, TEST_TIMEOUT));
+
+    // The bit of a failed stage is never set, its dependents don't run
+    TEST_ASSERT_EQUAL(ESP_ERR_TIMEOUT, Boot_Wait(BOOT_BEHIND, 200 / portTICK_PERIOD_MS));
+    TEST_ASSERT_EQUAL(ESP_ERR_TIMEOUT, Boot_Wait(BOOT_NVS | BOOT_BROKEN, 0));
+    TEST_ASSERT(test_position("broken") > 0);
+    TEST_ASSERT_EQUAL(-1, test_position("behind"));
+    TEST_ASSERT_EQUAL(-1, Boot_GetReadyMs(BOOT_BROKEN));
+    TEST_ASSERT_EQUAL(-1, Boot_GetReadyMs(BOOT_BEHIND));
+}
+
+static void test_ready_time(void) {
+    TEST_ASSERT_EQUAL(ESP_OK, Boot_Start(NULL, 0));
+    const int32_t Now = esp_timer_get_time() / 1000;
+
+    TEST_ASSERT_EQUAL(-1, Boot_GetReadyMs(BOOT_APPS));
+    HostTimer_Advance(250 * 1000);
+    Boot_SetReady(BOOT_APPS);
+    TEST_ASSERT_EQUAL(Now + 250, Boot_GetReadyMs(BOOT_APPS));
+
+    // The first time is kept
+    HostTimer_Advance(100 * 1000);
+    Boot_SetReady(BOOT_APPS | BOOT_MQTT);
+    TEST_ASSERT_EQUAL(Now + 250, Boot_GetReadyMs(BOOT_APPS));
+    TEST_ASSERT_EQUAL(Now + 350, Boot_GetReadyMs(BOOT_MQTT));
+
+    // Only single bits have a time
+    TEST_ASSERT_EQUAL(-1, Boot_GetReadyMs(BOOT_APPS | BOOT_MQTT));
+    TEST_ASSERT_EQUAL(-1, Boot_GetReadyMs(1UL << BOOT_MAX_BITS));
+    TEST_ASSERT_EQUAL(ESP_OK, Boot_Wait(BOOT_APPS | BOOT_MQTT, 0));
+}
+
+int main(void) {
+    esp_log_level_set("*", ESP_LOG_NONE);
+
+    RUN_TEST(test_order);
+    RUN_TEST(test_parallel);
+    RUN_TEST(test_failed_stage);
+    RUN_TEST(test_ready_time);
+    return (TEST_RESULT());
+}
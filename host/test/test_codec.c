@@ -0,0 +1,188 @@
+/**
+ ******************************************************************************
+ *  file           : test_codec.c
+ *  brief          : Host tests of the JSON and CBOR payload codec
+ ******************************************************************************
+ */
+
+/****************************** Includes  */
+#include <stdbool.h>
+#include "codec.h"
+#include "test.h"
+
+/****************************** Statics */
+
+typedef struct TestStatus {
+    char    Name[32];
+    int32_t Value;
+    int32_t Negative;
+    bool    isOn;
+} TestStatus;
+
+static const JsonDec_Field Fields[] = {
+    JSONDEC_FIELD_STRING(TestStatus, Name, "name"),
+    JSONDEC_FIELD_INT(TestStatus, Value, "value"),
+    JSONDEC_FIELD_INT(TestStatus, Negative, "neg"),
+    JSONDEC_FIELD_BOOL(TestStatus, isOn, "on"),
+};
+#define FIELDS (sizeof(Fields)/sizeof(Fields[0]))
+
+static uint8_t Buffer[128];
+static TestStatus Status;
+static uint32_t Found;
+
+/****************************** Functions */
+
+/**
+ * @brief Encode a status object, returns its length, 0 on overflow
+ */
+static size_t test_encode(Codec_Format Format, size_t Size, const char * Name, int64_t Value) {
+    Codec_Writer Writer;
+    size_t Length;
+
+    memset(Buffer, 0xEE, sizeof(Buffer));
+    Codec_Begin(&Writer, Format, Buffer, Size);
+    Codec_AddString(&Writer, "name", Name);
+    Codec_AddInt(&Writer, "value", Value);
+    Codec_AddInt(&Writer, "neg", -Value);
+    Codec_AddBool(&Writer, "on", true);
+    Codec_AddString(&Writer, "unknown", "skipped");
+    Codec_End(&Writer, &Length);
+    return (Length);
+}
+
+static esp_err_t test_decode(size_t Length) {
+    memset(&Status, 0x00, sizeof(Status));
+    Found = 0;
+    return (Codec_DecodeObject(Buffer, Length, Fields, FIELDS, &Status, &Found));
+}
+
+/****************************** Tests */
+
+static void test_json(void) {
+    const size_t Length = test_encode(CODEC_JSON, sizeof(Buffer), "dev", 1234);
+
+    TEST_ASSERT_EQUAL_STRING("{\"name\":\"dev\",\"value\":1234,\"neg\":-1234,\"on\":true,\"unknown\":\"skipped\"}", (char*)Buffer);
+    TEST_ASSERT_EQUAL(strlen((char*)Buffer), Length);
+    TEST_ASSERT_EQUAL(CODEC_JSON, Codec_Detect(Buffer, Length));
+}
+
+static void test_cbor(void) {
+    static const uint8_t Expected[] = {
+        0xBF, 0x64, 'n', 'a', 'm', 'e', 0x63, 'd', 'e', 'v',
+        0x65, 'v', 'a', 'l', 'u', 'e', 0x19, 0x04, 0xD2,
+        0x63, 'n', 'e', 'g', 0x39, 0x04, 0xD1,
+        0x62, 'o', 'n', 0xF5,
+        0x67, 'u', 'n', 'k', 'n', 'o', 'w', 'n', 0x67, 's', 'k', 'i', 'p', 'p', 'e', 'd',
+        0xFF,
+    };
+    const size_t Length = test_encode(CODEC_CBOR, sizeof(Buffer), "dev", 1234);
+
+    TEST_ASSERT_EQUAL(sizeof(Expected), Length);
+    TEST_ASSERT(0 == memcmp(Expected, Buffer, sizeof(Expected)));
+    TEST_ASSERT_EQUAL(CODEC_CBOR, Codec_Detect(Buffer, Length));
+    TEST_ASSERT_EQUAL(CODEC_JSON, Codec_Detect(Buffer, 0));
+}
+
+static void test_round_trip(void) {
+    static const int64_t Values[] = { 0, 1, 23, 24, 255, 256, 65535, 65536, INT32_MAX };
+
+    for (int Format = CODEC_JSON; Format <= CODEC_CBOR; Format++) {
+        for (int i = 0; i < sizeof(Values)/sizeof(Values[0]); i++) {
+            const size_t Length = test_encode(Format, sizeof(Buffer), "a \"quoted\" \\name\t", Values[i]);
+            TEST_ASSERT(Length > 0);
+            TEST_ASSERT_EQUAL(ESP_OK, test_decode(Length));
+            TEST_ASSERT_EQUAL_STRING("a \"quoted\" \\name\t", Status.Name);
+            TEST_ASSERT_EQUAL(Values[i], Status.Value);
+            TEST_ASSERT_EQUAL(-Values[i], Status.Negative);
+            TEST_ASSERT(Status.isOn);
+            TEST_ASSERT_EQUAL(0x0F, Found);
+        }
+    }
+}
+
+static void test_json_escapes(void) {
+    test_encode(CODEC_JSON, sizeof(Buffer), "\"\\\n\x01/", 0);
+    TEST_ASSERT(NULL != strstr((char*)Buffer, "\"name\":\"\\\"\\\\\\u000a\\u0001/\""));
+}
+
+static void test_overflow(void) {
+    const size_t Full[2] = {
+        test_encode(CODEC_JSON, sizeof(Buffer), "dev", 1234),
+        test_encode(CODEC_CBOR, sizeof(Buffer), "dev", 1234),
+    };
+
+    // JSON needs one byte more for the terminator
+    for (int Format = CODEC_JSON; Format <= CODEC_CBOR; Format++) {
+        const size_t Needed = Full[Format] + ((CODEC_JSON == Format) ? 1 : 0);
+        for (size_t Size = 0; Size < Needed; Size++) {
+            TEST_ASSERT_EQUAL(0, test_encode(Format, Size, "dev", 1234));
+            TEST_ASSERT_EQUAL(0xEE, Buffer[Size]);
+        }
+        TEST_ASSERT_EQUAL(Full[Format], test_encode(Format, Needed, "dev", 1234));
+    }
+}
+
+static void test_cbor_decode_errors(void) {
+    // Too large for int32, too long for the string, wrong type
+    static const uint8_t Large[] = { 0xA1, 0x65, 'v', 'a', 'l', 'u', 'e', 0x1A, 0x80, 0x00, 0x00, 0x00 };
+    static const uint8_t Type[] = { 0xA1, 0x62, 'o', 'n', 0x01 };
+    static const uint8_t Cut[] = { 0xBF, 0x62, 'o', 'n', 0xF5 };
+    uint8_t Long[64] = { 0xA1, 0x64, 'n', 'a', 'm', 'e', 0x78, 40 };
+
+    memcpy(Buffer, Large, sizeof(Large));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_SIZE, test_decode(sizeof(Large)));
+    memcpy(Buffer, Type, sizeof(Type));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, test_decode(sizeof(Type)));
+    memcpy(Buffer, Cut, sizeof(Cut));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, test_decode(sizeof(Cut)));
+    memset(&Long[8], 'x', 40);
+    memcpy(Buffer, Long, 48);
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_SIZE, test_decode(48));
+}
+
+static void test_cbor_skip(void) {
+    // Long and non-text keys, nested values, then a known member
+    static const uint8_t Map[] = {
+        0xA4,
+        0x78, 40, 'k', 'k', 'k', 'k', 'k', 'k', 'k', 'k', 'k', 'k', 'k', 'k', 'k', 'k', 'k', 'k', 'k', 'k', 'k', 'k',
+                  'k', 'k', 'k', 'k', 'k', 'k', 'k', 'k', 'k', 'k', 'k', 'k', 'k', 'k', 'k', 'k', 'k', 'k', 'k', 'k', 0x01,
+        0x05, 0x82, 0x01, 0xA1, 0x61, 'a', 0xF6,
+        0x61, 'x', 0x5F, 0x41, 0x00, 0xFF,
+        0x62, 'o', 'n', 0xF5,
+    };
+
+    memcpy(Buffer, Map, sizeof(Map));
+    TEST_ASSERT_EQUAL(ESP_OK, test_decode(sizeof(Map)));
+    TEST_ASSERT(Status.isOn);
+    TEST_ASSERT_EQUAL(0x08, Found);
+}
+
+static void test_formats(void) {
+    TEST_ASSERT_EQUAL(ESP_OK, Codec_SetFormat(NULL, CODEC_JSON));
+    TEST_ASSERT_EQUAL(CODEC_JSON, Codec_GetFormat("status"));
+
+    TEST_ASSERT_EQUAL(ESP_OK, Codec_SetFormat("status", CODEC_CBOR));
+    TEST_ASSERT_EQUAL(CODEC_CBOR, Codec_GetFormat("status"));
+    TEST_ASSERT_EQUAL(CODEC_JSON, Codec_GetFormat("job"));
+
+    // The device default does not change per topic formats
+    TEST_ASSERT_EQUAL(ESP_OK, Codec_SetFormat(NULL, CODEC_CBOR));
+    TEST_ASSERT_EQUAL(CODEC_CBOR, Codec_GetFormat("job"));
+    TEST_ASSERT_EQUAL(ESP_OK, Codec_SetFormat("status", CODEC_JSON));
+    TEST_ASSERT_EQUAL(CODEC_JSON, Codec_GetFormat("status"));
+
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, Codec_SetFormat("0123456789012345678901234567890123456789", CODEC_JSON));
+}
+
+int main(void) {
+    RUN_TEST(test_json);
+    RUN_TEST(test_cbor);
+    RUN_TEST(test_round_trip);
+    RUN_TEST(test_json_escapes);
+    RUN_TEST(test_overflow);
+    RUN_TEST(test_cbor_decode_errors);
+    RUN_TEST(test_cbor_skip);
+    RUN_TEST(test_formats);
+    return (TEST_RESULT());
+}
@@ -0,0 +1,179 @@
+/**
+ ******************************************************************************
+ *  file           : test_connlink.c
+ *  brief          : Host tests of the reconnect backoff and outage statistics
+ ******************************************************************************
+ */
+
+/****************************** Includes  */
+#include "esp_log.h"
+#include "host.h"
+#include "connlink.h"
+#include "test.h"
+
+/****************************** Statics */
+#define TEST_BASE_MS 100                // First backoff
+#define TEST_MAX_MS  3000               // Max backoff
+
+static ConnLink Link;
+static uint32_t Reconnects = 0;         // Calls of the reconnect function
+static int64_t  ReconnectUs = 0;        // Time of the last call
+
+/****************************** Functions */
+
+static void test_reconnect(void) {
+    Reconnects++;
+    ReconnectUs = esp_timer_get_time();
+}
+
+/**
+ * @brief Retry and wait for the reconnect, returns the delay in ms, -1 if none
+ */
+static int32_t test_retry_delay(void) {
+    const uint32_t Before = Reconnects;
+    const int64_t Start = esp_timer_get_time();
+
+    ConnLink_Retry(&Link);
+    for (int Ms = 0; (Ms <= TEST_MAX_MS) && (Before == Reconnects); Ms++) {
+        HostTimer_Advance(1000);
+    }
+    return ((Before == Reconnects) ? -1 : (int32_t)((ReconnectUs - Start) / 1000));
+}
+
+/****************************** Tests */
+
+static void test_backoff(void) {
+    int32_t Min[8], Max[8];
+
+    TEST_ASSERT_EQUAL(ESP_OK, ConnLink_Init(&Link, "test", test_reconnect, TEST_BASE_MS, TEST_MAX_MS));
+    HostRandom_Seed(1);
+    for (int i = 0; i < 8; i++) {
+        Min[i] = INT32_MAX;
+        Max[i] = 0;
+    }
+
+    // Doubles up to the max, jittered between half and the full delay
+    for (int Run = 0; Run < 50; Run++) {
+        ConnLink_Up(&Link);
+        ConnLink_Down(&Link);
+        for (int Attempt = 0; Attempt < 8; Attempt++) {
+            const uint32_t DelayMs = ((TEST_BASE_MS << Attempt) < TEST_MAX_MS) ? (TEST_BASE_MS << Attempt) : TEST_MAX_MS;
+            const int32_t Delay = test_retry_delay();
+
+            TEST_ASSERT((Delay >= (DelayMs / 2)) && (Delay <= DelayMs));
+            Min[Attempt] = (Delay < Min[Attempt]) ? Delay : Min[Attempt];
+            Max[Attempt] = (Delay > Max[Attempt]) ? Delay : Max[Attempt];
+        }
+    }
+    for (int i = 2; i < 8; i++) {
+        TEST_ASSERT(Max[i] > Min[i]);
+    }
+    TEST_ASSERT(Min[7] < (TEST_MAX_MS * 3 / 4));
+    TEST_ASSERT(Max[7] > (TEST_MAX_MS * 3 / 4));
+}
+
+static void test_never_gives_up(void) {
+    ConnLink_Stats Stats;
+
+    ConnLink_Init(&Link, "test", test_reconnect, TEST_BASE_MS, TEST_MAX_MS);
+    for (int Attempt = 0; Attempt < 40; Attempt++) {
+        const int32_t Delay = test_retry_delay();
+        TEST_ASSERT(Delay <= TEST_MAX_MS);
+        TEST_ASSERT((Attempt < 5) || (Delay >= (TEST_MAX_MS / 2)));
+    }
+    ConnLink_GetStats(&Link, &Stats);
+    TEST_ASSERT_EQUAL(40, Stats.Attempts);
+}
+
+static void test_outages(void) {
+    ConnLink_Stats Stats;
+
+    ConnLink_Init(&Link, "test", test_reconnect, TEST_BASE_MS, TEST_MAX_MS);
+
+    // Not up yet, so no outage
+    ConnLink_Down(&Link);
+    ConnLink_GetStats(&Link, &Stats);
+    TEST_ASSERT_EQUAL(0, Stats.Outages);
+
+    ConnLink_Up(&Link);
+    ConnLink_Down(&Link);
+    HostTimer_Advance(1500 * 1000);
+    ConnLink_Down(&Link);
+
+    // A running outage is included
+    ConnLink_GetStats(&Link, &Stats);
+    TEST_ASSERT_EQUAL(1, Stats.Outages);
+    TEST_ASSERT_EQUAL(1500, Stats.MaxOutageMs);
+    TEST_ASSERT_EQUAL(1500, Stats.TotalOutageMs);
+    TEST_ASSERT_EQUAL(0, Stats.LastOutageMs);
+    TEST_ASSERT(!Stats.isUp);
+
+    HostTimer_Advance(500 * 1000);
+    ConnLink_Up(&Link);
+    ConnLink_Down(&Link);
+    HostTimer_Advance(700 * 1000);
+    ConnLink_Up(&Link);
+    ConnLink_Up(&Link);
+
+    ConnLink_GetStats(&Link, &Stats);
+    TEST_ASSERT_EQUAL(2, Stats.Outages);
+    TEST_ASSERT_EQUAL(700, Stats.LastOutageMs);
+    TEST_ASSERT_EQUAL(2000, Stats.MaxOutageMs);
+    TEST_ASSERT_EQUAL(2700, Stats.TotalOutageMs);
+    TEST_ASSERT(Stats.isUp);
+}
+
+static void test_kick(void) {
+    ConnLink_Stats Stats;
+
+    ConnLink_Init(&Link, "test", test_reconnect, TEST_BASE_MS, TEST_MAX_MS);
+    for (int i = 0; i < 5; i++) {
+        test_retry_delay();
+    }
+
+    // Reconnects at once, cancels the pending retry and resets the backoff
+    ConnLink_Retry(&Link);
+    const uint32_t Before = Reconnects;
+    ConnLink_Kick(&Link);
+    TEST_ASSERT_EQUAL(Before + 1, Reconnects);
+    TEST_ASSERT_EQUAL(esp_timer_get_time(), ReconnectUs);
+    HostTimer_Advance(2 * TEST_MAX_MS * 1000);
+    TEST_ASSERT_EQUAL(Before + 1, Reconnects);
+
+    const int32_t Delay = test_retry_delay();
+    TEST_ASSERT((Delay >= (TEST_BASE_MS / 2)) && (Delay <= TEST_BASE_MS));
+
+    ConnLink_GetStats(&Link, &Stats);
+    TEST_ASSERT_EQUAL(8, Stats.Attempts);
+}
+
+static void test_up_stops_retry(void) {
+    ConnLink_Init(&Link, "test", test_reconnect, TEST_BASE_MS, TEST_MAX_MS);
+    ConnLink_Up(&Link);
+    ConnLink_Down(&Link);
+    for (int i = 0; i < 3; i++) {
+        test_retry_delay();
+    }
+
+    const uint32_t Before = Reconnects;
+    ConnLink_Retry(&Link);
+    ConnLink_Up(&Link);
+    HostTimer_Advance(2 * TEST_MAX_MS * 1000);
+    TEST_ASSERT_EQUAL(Before, Reconnects);
+
+    // The backoff starts over
+    ConnLink_Down(&Link);
+    const int32_t Delay = test_retry_delay();
+    TEST_ASSERT((Delay >= (TEST_BASE_MS / 2)) && (Delay <= TEST_BASE_MS));
+}
+
+int main(void) {
+    esp_log_level_set("*", ESP_LOG_NONE);
+
+    RUN_TEST(test_backoff);
+    RUN_TEST(test_never_gives_up);
+    RUN_TEST(test_outages);
+    RUN_TEST(test_kick);
+    RUN_TEST(test_up_stops_retry);
+    return (TEST_RESULT());
+}
@@ -0,0 +1,351 @@
+/**
+ ******************************************************************************
+ *  file           : test_device.c
+ *  brief          : Host tests of the whole firmware on the client mocks
+ *
+ *  app_main() runs as on the target: WiFi, MQTT and OTA talk to the
+ *  stand-ins of host_wifi.c, host_mqtt.c and host_http.c. The tests
+ *  watch the publishes of the device and inject commands. The load test
+ *  prints the loss rate and the p99 of the command latency histograms.
+ ******************************************************************************
+ */
+
+/****************************** Includes  */
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/param.h>
+#include "esp_log.h"
+#include "esp_app_format.h"
+#include "nvs.h"
+#include "mbedtls/sha256.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "host.h"
+#include "txlog.h"
+#include "ota.h"
+#include "commands.h"
+#include "test.h"
+
+/****************************** Statics */
+#define TEST_BASE       "IoT_240ac4123456"  // Base topic of the host MAC
+#define TEST_MAX_PUBS   256             // Recorded publishes, the last ones
+#define TEST_MAX_PAYLOAD 512            // ...and their payloads
+#define TEST_BOOT_MS    20000           // Boot report: Phase + margin of main.c
+#define TEST_REPLY_MS   5000            // Other answers
+#define TEST_IMAGE_SIZE (96 * 1024)     // FW update image
+#define TEST_DROP_AT    (40 * 1024)     // Connection loss during the download
+#define TEST_LOAD_COMMANDS 1000         // Pings of the load test
+#define TEST_LOAD_BURST 16              // ...sent at once, half the command queue
+#define TEST_LOAD_GAP_US 5000           // ...between the bursts
+
+extern void app_main(void);
+
+typedef struct TestPublish {
+    char    Topic[64];
+    char    Payload[TEST_MAX_PAYLOAD];
+} TestPublish;
+
+static pthread_mutex_t PubLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t PubCond = PTHREAD_COND_INITIALIZER;
+static TestPublish Pubs[TEST_MAX_PUBS];
+static int PubCount = 0;                // All publishes, Pubs[] is a ring
+static uint32_t PongCount = 0;
+
+static pthread_mutex_t RestartLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t RestartCond = PTHREAD_COND_INITIALIZER;
+static bool isRestarted = false;
+
+static const esp_partition_t * pOta0;
+static const esp_partition_t * pOta1;
+static uint8_t Image[TEST_IMAGE_SIZE];
+
+/****************************** Functions */
+
+/**
+ * @brief Publish hook: Record the publishes of the device
+ */
+static void test_on_publish(const char * Topic, const char * pData, int Length, int Qos, void * pArg) {
+    pthread_mutex_lock(&PubLock);
+    if (0 == strcmp(Topic, TEST_BASE "/pong")) {
+        PongCount++;
+    }
+    TestPublish * pPub = &Pubs[PubCount++ % TEST_MAX_PUBS];
+    strlcpy(pPub->Topic, Topic, sizeof(pPub->Topic));
+    const int Copy = MIN(Length, TEST_MAX_PAYLOAD - 1);
+    memcpy(pPub->Payload, pData, Copy);
+    pPub->Payload[Copy] = '\0';
+    pthread_cond_broadcast(&PubCond);
+    pthread_mutex_unlock(&PubLock);
+}
+
+static void test_deadline(struct timespec * pDeadline, uint32_t TimeoutMs) {
+    clock_gettime(CLOCK_REALTIME, pDeadline);
+    pDeadline->tv_sec += TimeoutMs / 1000;
+    pDeadline->tv_nsec += (TimeoutMs % 1000) * 1000000L;
+    if (pDeadline->tv_nsec >= 1000000000L) {
+        pDeadline->tv_sec++;
+        pDeadline->tv_nsec -= 1000000000L;
+    }
+}
+
+/**
+ * @brief Wait for a publish on a subtopic
+ *
+ * @param SubTopic Below the base topic
+ * @param Since Index of the first publish to look at, older ones of the ring are gone
+ * @param pPayload The payload, may be NULL
+ * @return true if published in time
+ */
+static bool test_wait_publish(const char * SubTopic, int Since, char * pPayload, uint32_t TimeoutMs) {
+    char Topic[64];
+    struct timespec Deadline;
+    bool isFound = false;
+
+    snprintf(Topic, sizeof(Topic), "%s/%s", TEST_BASE, SubTopic);
+    test_deadline(&Deadline, TimeoutMs);
+    pthread_mutex_lock(&PubLock);
+    while (!isFound) {
+        for (int i = MAX(Since, PubCount - TEST_MAX_PUBS); i < PubCount; i++) {
+            const TestPublish * pPub = &Pubs[i % TEST_MAX_PUBS];
+            if (0 == strcmp(pPub->Topic, Topic)) {
+                if (NULL != pPayload) {
+                    strcpy(pPayload, pPub->Payload);
+                }
+                isFound = true;
+                break;
+            }
+        }
+        if (!isFound && (ETIMEDOUT == pthread_cond_timedwait(&PubCond, &PubLock, &Deadline))) {
+            break;
+        }
+    }
+    pthread_mutex_unlock(&PubLock);
+    return (isFound);
+}  // test_wait_publish
+
+static int test_publish_mark(void) {
+    pthread_mutex_lock(&PubLock);
+    const int Mark = PubCount;
+    pthread_mutex_unlock(&PubLock);
+    return (Mark);
+}
+
+/**
+ * @brief A number of a JSON payload
+ *
+ * @return long -1 if missing
+ */
+static long test_value(const char * Payload, const char * Key) {
+    char Pattern[32];
+
+    snprintf(Pattern, sizeof(Pattern), "\"%s\":", Key);
+    const char * pValue = strstr(Payload, Pattern);
+    return ((NULL != pValue) ? strtol(pValue + strlen(Pattern), NULL, 10) : -1);
+}
+
+/**
+ * @brief Wait until the command task has handled or dropped a number of commands
+ */
+static bool test_wait_commands(uint32_t Target, Comm_Stats * pStats) {
+    for (uint32_t Waited = 0; Waited < TEST_REPLY_MS; Waited += 10) {
+        Comm_GetStats(pStats);
+        if (pStats->Processed + pStats->Dropped >= Target) {
+            return (true);
+        }
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    return (false);
+}
+
+/**
+ * @brief Restart hook: The OTA job ends in esp_restart()
+ */
+static void test_on_restart(void) {
+    pthread_mutex_lock(&RestartLock);
+    isRestarted = true;
+    pthread_cond_broadcast(&RestartCond);
+    pthread_mutex_unlock(&RestartLock);
+}
+
+static bool test_wait_restart(uint32_t TimeoutMs) {
+    struct timespec Deadline;
+
+    test_deadline(&Deadline, TimeoutMs);
+    pthread_mutex_lock(&RestartLock);
+    while (!isRestarted && (ETIMEDOUT != pthread_cond_timedwait(&RestartCond, &RestartLock, &Deadline))) {
+    }
+    const bool isDone = isRestarted;
+    pthread_mutex_unlock(&RestartLock);
+    return (isDone);
+}
+
+/**
+ * @brief Build an app image: One segment with the app description
+ */
+static void test_make_image(uint8_t * pImage, size_t Size, const char * Version) {
+    esp_image_header_t Header = { .magic = ESP_IMAGE_HEADER_MAGIC, .segment_count = 1, .chip_id = CONFIG_IDF_FIRMWARE_CHIP_ID };
+    esp_image_segment_header_t Segment = { .load_addr = 0x3f400020, .data_len = Size - sizeof(Header) - sizeof(Segment) };
+    esp_app_desc_t Desc = { .magic_word = ESP_APP_DESC_MAGIC_WORD };
+
+    for (size_t i = 0; i < Size; i++) {
+        pImage[i] = (uint8_t)(i * 7);
+    }
+    strlcpy(Desc.version, Version, sizeof(Desc.version));
+    strlcpy(Desc.project_name, "IoTBase", sizeof(Desc.project_name));
+    memcpy(pImage, &Header, sizeof(Header));
+    memcpy(pImage + sizeof(Header), &Segment, sizeof(Segment));
+    memcpy(pImage + sizeof(Header) + sizeof(Segment), &Desc, sizeof(Desc));
+}
+
+static void app_task(void * pvParameters) {
+    app_main();
+}
+
+/**
+ * @brief Start the device: Flash layout, settings, then app_main() in its task
+ */
+static void test_start_device(void) {
+    HostTimer_SetRealTime();
+    HostSystem_SetRestartHook(test_on_restart);
+    HostMqtt_SetPublishHook(test_on_publish, NULL);
+
+    pOta0 = HostFlash_AddPartition("ota_0", ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_APP_OTA_0, NULL, 256 * 1024);
+    pOta1 = HostFlash_AddPartition("ota_1", ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_APP_OTA_1, NULL, 256 * 1024);
+    HostFlash_AddPartition(TXLOG_PARTITION, ESP_PARTITION_TYPE_DATA, 0x40, NULL, 16 * HOST_FLASH_SECTOR);
+    HostOta_SetRunning(pOta0, ESP_OTA_IMG_PENDING_VERIFY);
+
+    // Provisioned AP and broker, the shortest status period
+    nvs_handle_t Handle;
+    nvs_open("SETTINGS", NVS_READWRITE, &Handle);
+    nvs_set_str(Handle, "WIFI_SSID", "HostAP");
+    nvs_set_str(Handle, "MQTT_URL", "mqtt://127.0.0.1");
+    nvs_close(Handle);
+    nvs_open("TELEMETRY", NVS_READWRITE, &Handle);
+    nvs_set_u32(Handle, "PERIOD", 1000);
+    nvs_close(Handle);
+
+    xTaskCreate(app_task, "main", 4096, NULL, 1, NULL);
+}
+
+/****************************** Tests */
+
+// Boot: All stages come up, the new app is confirmed and the report is out
+static void test_boot_report(void) {
+    char Payload[TEST_MAX_PAYLOAD];
+    esp_ota_img_states_t State;
+    HostMqtt_Stats MqttStats;
+
+    TEST_ASSERT(test_wait_publish("boot", 0, Payload, TEST_BOOT_MS));
+    TEST_ASSERT(NULL != strstr(Payload, "\"published\":"));
+    TEST_ASSERT(NULL == strstr(Payload, "\"published\":-1"));
+
+    TEST_ASSERT_EQUAL(ESP_OK, esp_ota_get_state_partition(pOta0, &State));
+    TEST_ASSERT_EQUAL(ESP_OTA_IMG_VALID, State);
+    HostMqtt_GetStats(&MqttStats);
+    TEST_ASSERT(MqttStats.isConnected);
+    TEST_ASSERT_EQUAL(1, MqttStats.Starts);
+}
+
+// A command from the broker is answered
+static void test_ping(void) {
+    static const char Command[] = "{\"cmd\":\"ping\",\"payload\":\"42\"}";
+    char Payload[TEST_MAX_PAYLOAD];
+    const int Mark = test_publish_mark();
+
+    TEST_ASSERT_EQUAL(ESP_OK, HostMqtt_Inject(TEST_BASE "/cmd", Command, sizeof(Command) - 1, 0));
+    TEST_ASSERT(test_wait_publish("pong", Mark, Payload, TEST_REPLY_MS));
+    TEST_ASSERT(NULL != strstr(Payload, "\"payload\":\"42\""));
+}
+
+// 1000 pings in bursts through the broker stand-in: Loss rate and p99 of the histograms
+static void test_load(void) {
+    static const char Reset[] = "{\"cmd\":\"latency\",\"payload\":\"reset\"}";
+    static const char Query[] = "{\"cmd\":\"latency\"}";
+    char Payload[TEST_MAX_PAYLOAD];
+    char ResetPayload[TEST_MAX_PAYLOAD];
+    char Command[64];
+    Comm_Stats Before, After;
+
+    // Clear the histograms, the reset command itself is recorded afterwards
+    int Mark = test_publish_mark();
+    Comm_GetStats(&Before);
+    TEST_ASSERT_EQUAL(ESP_OK, HostMqtt_Inject(TEST_BASE "/cmd", Reset, sizeof(Reset) - 1, 0));
+    TEST_ASSERT(test_wait_publish("latency", Mark, ResetPayload, TEST_REPLY_MS));
+    TEST_ASSERT(test_wait_commands(Before.Processed + Before.Dropped + 1, &Before));
+    pthread_mutex_lock(&PubLock);
+    const uint32_t PongsBefore = PongCount;
+    pthread_mutex_unlock(&PubLock);
+
+    for (int i = 0; i < TEST_LOAD_COMMANDS; i++) {
+        const int Length = snprintf(Command, sizeof(Command), "{\"cmd\":\"ping\",\"payload\":\"%d\"}", i);
+        TEST_ASSERT_EQUAL(ESP_OK, HostMqtt_Inject(TEST_BASE "/cmd", Command, Length, 0));
+        if (0 == ((i + 1) % TEST_LOAD_BURST)) {
+            usleep(TEST_LOAD_GAP_US);
+        }
+    }
+    TEST_ASSERT(test_wait_commands(Before.Processed + Before.Dropped + TEST_LOAD_COMMANDS, &After));
+    vTaskDelay(pdMS_TO_TICKS(100));     // Last pongs through the publisher
+
+    Mark = test_publish_mark();
+    TEST_ASSERT_EQUAL(ESP_OK, HostMqtt_Inject(TEST_BASE "/cmd", Query, sizeof(Query) - 1, 0));
+    TEST_ASSERT(test_wait_publish("latency", Mark, Payload, TEST_REPLY_MS));
+
+    pthread_mutex_lock(&PubLock);
+    const uint32_t Pongs = PongCount - PongsBefore;
+    pthread_mutex_unlock(&PubLock);
+    printf("load: %d commands, %u dropped, %u answered, loss %.1f %%, total p50 %ld us, p99 %ld us, max %ld us\n",
+           TEST_LOAD_COMMANDS, After.Dropped - Before.Dropped, Pongs, 100.0 * (TEST_LOAD_COMMANDS - Pongs) / TEST_LOAD_COMMANDS,
+           test_value(Payload, "total.p50"), test_value(Payload, "total.p99"), test_value(Payload, "total.max"));
+
+    // Every command handled since the reset (and the reset itself) is in the histograms,
+    // bursts within the queue are not dropped
+    TEST_ASSERT_EQUAL(test_value(Payload, "cmd.proc") - test_value(ResetPayload, "cmd.proc"), test_value(Payload, "total.n"));
+    TEST_ASSERT_EQUAL(0, After.Dropped - Before.Dropped);
+    TEST_ASSERT_EQUAL(TEST_LOAD_COMMANDS, Pongs);
+    TEST_ASSERT(test_value(Payload, "total.p99") >= test_value(Payload, "total.p50"));
+}
+
+// A FW update survives a connection loss and boots the other partition
+static void test_fwupdate(void) {
+    static const HostHttp_Options Options = { .ETag = "\"v2\"", .DropAt = TEST_DROP_AT };
+    uint8_t Digest[32];
+    char Command[256];
+    OTA_Stats Stats;
+    HostHttp_Stats HttpStats;
+
+    test_make_image(Image, sizeof(Image), "v2");
+    mbedtls_sha256(Image, sizeof(Image), Digest, 0);
+    const int Port = HostHttp_Serve(Image, sizeof(Image), &Options);
+    TEST_ASSERT(Port > 0);
+
+    int Length = snprintf(Command, sizeof(Command), "{\"cmd\":\"fwupdate\",\"payload\":\"http://127.0.0.1:%d/fw.bin\",\"sha256\":\"", Port);
+    for (int i = 0; i < 32; i++) {
+        Length += snprintf(&Command[Length], sizeof(Command) - Length, "%02x", Digest[i]);
+    }
+    Length += snprintf(&Command[Length], sizeof(Command) - Length, "\"}");
+
+    TEST_ASSERT_EQUAL(ESP_OK, HostMqtt_Inject(TEST_BASE "/cmd", Command, Length, 0));
+    TEST_ASSERT(test_wait_restart(TEST_BOOT_MS));
+    TEST_ASSERT(pOta1 == HostOta_GetBoot());
+
+    OTA_GetStats(&Stats);
+    TEST_ASSERT_EQUAL(sizeof(Image), Stats.Bytes);
+    TEST_ASSERT_EQUAL(1, Stats.Resumes);
+    HostHttp_GetStats(&HttpStats);
+    TEST_ASSERT_EQUAL(1, HttpStats.Drops);
+    TEST_ASSERT_EQUAL(1, HttpStats.Ranges);
+    HostHttp_Stop();
+}
+
+int main(void) {
+    esp_log_level_set("*", ESP_LOG_NONE);
+    test_start_device();
+
+    RUN_TEST(test_boot_report);
+    RUN_TEST(test_ping);
+    RUN_TEST(test_load);
+    RUN_TEST(test_fwupdate);
+    return (TEST_RESULT());
+}
@@ -0,0 +1,125 @@
+/**
+ ******************************************************************************
+ *  file           : test_jsondec.c
+ *  brief          : Host tests of the flat JSON object decoder
+ ******************************************************************************
+ */
+
+/****************************** Includes  */
+#include <stdbool.h>
+#include "jsondec.h"
+#include "test.h"
+
+/****************************** Statics */
+
+typedef struct TestRequest {
+    char    Cmd[16];
+    char    Payload[32];
+    int32_t Period;
+    bool    isOn;
+} TestRequest;
+
+static const JsonDec_Field Fields[] = {
+    JSONDEC_FIELD_STRING(TestRequest, Cmd, "cmd"),
+    JSONDEC_FIELD_STRING(TestRequest, Payload, "payload"),
+    JSONDEC_FIELD_INT(TestRequest, Period, "period"),
+    JSONDEC_FIELD_BOOL(TestRequest, isOn, "on"),
+};
+#define FIELDS (sizeof(Fields)/sizeof(Fields[0]))
+
+static TestRequest Request;
+static uint32_t Found;
+
+/****************************** Functions */
+
+static esp_err_t test_decode(const char * pJson) {
+    memset(&Request, 0x00, sizeof(Request));
+    Found = 0;
+    return (JsonDec_Object(pJson, strlen(pJson), Fields, FIELDS, &Request, &Found));
+}
+
+/****************************** Tests */
+
+static void test_types(void) {
+    TEST_ASSERT_EQUAL(ESP_OK, test_decode(" { \"cmd\" : \"perf\", \"period\":-42,\n\"on\":true } "));
+    TEST_ASSERT_EQUAL_STRING("perf", Request.Cmd);
+    TEST_ASSERT_EQUAL(-42, Request.Period);
+    TEST_ASSERT(Request.isOn);
+    TEST_ASSERT_EQUAL(0x0D, Found);
+
+    TEST_ASSERT_EQUAL(ESP_OK, test_decode("{}"));
+    TEST_ASSERT_EQUAL(0, Found);
+
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, test_decode("{\"on\":1}"));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, test_decode("{\"period\":\"1\"}"));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, test_decode("{\"period\":1.5}"));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, test_decode("{\"cmd\":\"ping\""));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, test_decode("{\"cmd\" \"ping\"}"));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, test_decode("[]"));
+}
+
+static void test_int_range(void) {
+    TEST_ASSERT_EQUAL(ESP_OK, test_decode("{\"period\":2147483647}"));
+    TEST_ASSERT_EQUAL(INT32_MAX, Request.Period);
+    TEST_ASSERT_EQUAL(ESP_OK, test_decode("{\"period\":-2147483648}"));
+    TEST_ASSERT_EQUAL(INT32_MIN, Request.Period);
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_SIZE, test_decode("{\"period\":2147483648}"));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_SIZE, test_decode("{\"period\":99999999999999999999}"));
+}
+
+static void test_escapes(void) {
+    TEST_ASSERT_EQUAL(ESP_OK, test_decode("{\"payload\":\"a\\\"b\\\\c\\/d\\n\\t\"}"));
+    TEST_ASSERT_EQUAL_STRING("a\"b\\c/d\n\t", Request.Payload);
+
+    // \u as UTF-8, surrogates are replaced
+    TEST_ASSERT_EQUAL(ESP_OK, test_decode("{\"payload\":\"\\u0041\\u00e9\\u20AC\\ud83d\"}"));
+    TEST_ASSERT_EQUAL_STRING("A\xC3\xA9\xE2\x82\xAC?", Request.Payload);
+
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, test_decode("{\"payload\":\"\\x\"}"));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, test_decode("{\"payload\":\"\\u12\"}"));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, test_decode("{\"payload\":\"a\nb\"}"));
+}
+
+static void test_sizes(void) {
+    // 15 characters fit into Cmd[16], 16 don't
+    TEST_ASSERT_EQUAL(ESP_OK, test_decode("{\"cmd\":\"123456789012345\"}"));
+    TEST_ASSERT_EQUAL_STRING("123456789012345", Request.Cmd);
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_SIZE, test_decode("{\"cmd\":\"1234567890123456\"}"));
+
+    // A multi byte character is not split
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_SIZE, test_decode("{\"cmd\":\"12345678901234\\u00e9\"}"));
+}
+
+static void test_skip_unknown(void) {
+    TEST_ASSERT_EQUAL(ESP_OK, test_decode(
+        "{\"x\":{\"a\":[1,2,{\"b\":null}],\"c\":\"}\"},\"y\":[],\"z\":-1.5e3,\"w\":false,\"cmd\":\"ping\"}"));
+    TEST_ASSERT_EQUAL_STRING("ping", Request.Cmd);
+    TEST_ASSERT_EQUAL(0x01, Found);
+
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, test_decode("{\"x\":[1,2}"));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_SIZE, test_decode("{\"x\":[[[[[[[[[[[[[[[[[1]]]]]]]]]]]]]]]]]}"));
+}
+
+static void test_long_unknown_key(void) {
+    // Member names longer than the key buffer are skipped with their value
+    TEST_ASSERT_EQUAL(ESP_OK, test_decode(
+        "{\"an_unknown_member_name_longer_than_32_characters\":{\"cmd\":\"x\"},\"cmd\":\"ping\"}"));
+    TEST_ASSERT_EQUAL_STRING("ping", Request.Cmd);
+    TEST_ASSERT_EQUAL(0x01, Found);
+
+    TEST_ASSERT_EQUAL(ESP_OK, test_decode("{\"cmd\":\"ping\",\"0123456789012345678901234567890123456789\":1}"));
+    TEST_ASSERT_EQUAL(0x01, Found);
+
+    // The rest of the name is still checked
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, test_decode("{\"0123456789012345678901234567890123456789\\q\":1}"));
+}
+
+int main(void) {
+    RUN_TEST(test_types);
+    RUN_TEST(test_int_range);
+    RUN_TEST(test_escapes);
+    RUN_TEST(test_sizes);
+    RUN_TEST(test_skip_unknown);
+    RUN_TEST(test_long_unknown_key);
+    return (TEST_RESULT());
+}
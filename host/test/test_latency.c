@@ -0,0 +1,129 @@
+/**
+ ******************************************************************************
+ *  file           : test_latency.c
+ *  brief          : Host tests of the latency histograms
+ ******************************************************************************
+ */
+
+/****************************** Includes  */
+#include <pthread.h>
+#include "latency.h"
+#include "test.h"
+
+/****************************** Statics */
+static Latency_Hist Hist;
+
+/****************************** Functions */
+
+/**
+ * @brief Bucket a single value is counted in, -1 if none or several
+ */
+static int test_bucket(uint32_t Us) {
+    int Bucket = -1;
+
+    Latency_Reset(&Hist);
+    Latency_Record(&Hist, Us);
+    for (int i = 0; i < LATENCY_BUCKETS; i++) {
+        if (0 != Hist.Buckets[i]) {
+            Bucket = ((-1 == Bucket) && (1 == Hist.Buckets[i])) ? i : -2;
+        }
+    }
+    return ((Bucket < 0) ? -1 : Bucket);
+}
+
+static void * test_worker(void * pArg) {
+    const uint32_t Offset = (uintptr_t)pArg;
+
+    for (uint32_t i = 0; i < 100000; i++) {
+        Latency_Record(&Hist, (i % 5000) + Offset);
+    }
+    return (NULL);
+}
+
+/****************************** Tests */
+
+static void test_buckets(void) {
+    for (uint32_t Us = 0; Us < 8; Us++) {
+        TEST_ASSERT_EQUAL(Us, test_bucket(Us));
+    }
+    TEST_ASSERT_EQUAL(8, test_bucket(8));
+    TEST_ASSERT_EQUAL(8, test_bucket(9));
+    TEST_ASSERT_EQUAL(9, test_bucket(10));
+    TEST_ASSERT_EQUAL(11, test_bucket(15));
+    TEST_ASSERT_EQUAL(12, test_bucket(16));
+}
+
+static void test_top_buckets(void) {
+    TEST_ASSERT_EQUAL(95, test_bucket((1UL << 25) - 1));
+    TEST_ASSERT_EQUAL(96, test_bucket(1UL << 25));
+    TEST_ASSERT_EQUAL(99, test_bucket((1UL << 26) - 1));
+
+    // Larger values count in the last bucket, percentiles end there, the max is exact
+    TEST_ASSERT_EQUAL(LATENCY_BUCKETS - 1, test_bucket(1UL << 26));
+    TEST_ASSERT_EQUAL(LATENCY_BUCKETS - 1, test_bucket(UINT32_MAX));
+    TEST_ASSERT_EQUAL(UINT32_MAX, Hist.MaxUs);
+    TEST_ASSERT_EQUAL((1UL << 26) - 1, Latency_Percentile(&Hist, 100));
+}
+
+static void test_relative_error(void) {
+    int Last = 0;
+
+    // Buckets grow with the value, a percentile is at most 25% above it
+    for (uint32_t Us = 1; Us < (1UL << 26); Us += 1 + (Us / 7)) {
+        const int Bucket = test_bucket(Us);
+        TEST_ASSERT(Bucket >= Last);
+        Last = Bucket;
+
+        Latency_Record(&Hist, UINT32_MAX);
+        const uint32_t Percentile = Latency_Percentile(&Hist, 50);
+        TEST_ASSERT(Percentile >= Us);
+        TEST_ASSERT((Percentile - Us) <= (Us / 4));
+    }
+}
+
+static void test_percentiles(void) {
+    Latency_Reset(&Hist);
+    TEST_ASSERT_EQUAL(0, Latency_Count(&Hist));
+    TEST_ASSERT_EQUAL(0, Latency_Percentile(&Hist, 50));
+
+    for (uint32_t Us = 1; Us <= 1000; Us++) {
+        Latency_Record(&Hist, Us);
+    }
+    TEST_ASSERT_EQUAL(1000, Latency_Count(&Hist));
+    TEST_ASSERT_EQUAL(1000, Hist.MaxUs);
+
+    const uint32_t P1 = Latency_Percentile(&Hist, 1);
+    const uint32_t P50 = Latency_Percentile(&Hist, 50);
+    const uint32_t P99 = Latency_Percentile(&Hist, 99);
+    TEST_ASSERT((P1 >= 10) && (P1 <= 12));
+    TEST_ASSERT((P50 >= 500) && (P50 <= 625));
+    TEST_ASSERT((P99 >= 990) && (P99 <= 1000));
+    TEST_ASSERT_EQUAL(1000, Latency_Percentile(&Hist, 100));
+
+    Latency_Reset(&Hist);
+    TEST_ASSERT_EQUAL(0, Latency_Count(&Hist));
+    TEST_ASSERT_EQUAL(0, Hist.MaxUs);
+}
+
+static void test_concurrent(void) {
+    pthread_t Threads[4];
+
+    Latency_Reset(&Hist);
+    for (uintptr_t i = 0; i < 4; i++) {
+        pthread_create(&Threads[i], NULL, test_worker, (void*)(i * 1000));
+    }
+    for (int i = 0; i < 4; i++) {
+        pthread_join(Threads[i], NULL);
+    }
+    TEST_ASSERT_EQUAL(400000, Latency_Count(&Hist));
+    TEST_ASSERT_EQUAL(4999 + 3000, Hist.MaxUs);
+}
+
+int main(void) {
+    RUN_TEST(test_buckets);
+    RUN_TEST(test_top_buckets);
+    RUN_TEST(test_relative_error);
+    RUN_TEST(test_percentiles);
+    RUN_TEST(test_concurrent);
+    return (TEST_RESULT());
+}
@@ -0,0 +1,145 @@
+/**
+ ******************************************************************************
+ *  file           : test_msgpool.c
+ *  brief          : Host tests of the RX message pool
+ ******************************************************************************
+ */
+
+/****************************** Includes  */
+#include <pthread.h>
+#include "esp_log.h"
+#include "msgpool.h"
+#include "test.h"
+
+/****************************** Statics */
+#define SLOT(Length) ((8 + (Length) + 3) & ~3)  // Pool bytes of a slot, header is 8 bytes
+
+static uint8_t Buffer[256] __attribute__((aligned(4)));
+static MsgPool Pool;
+
+/****************************** Tests */
+
+static void test_alloc_release(void) {
+    MsgPool_Init(&Pool, Buffer, sizeof(Buffer));
+
+    uint8_t * pData = MsgPool_Alloc(&Pool, 21);
+    TEST_ASSERT(NULL != pData);
+    TEST_ASSERT_EQUAL(0, (uintptr_t)pData % 4);
+    TEST_ASSERT_EQUAL(1, Pool.Slots);
+    TEST_ASSERT_EQUAL(SLOT(21), Pool.Used);
+    memset(pData, 0xAA, 21);
+
+    MsgPool_Release(&Pool, pData);
+    TEST_ASSERT_EQUAL(0, Pool.Slots);
+    TEST_ASSERT_EQUAL(0, Pool.Used);
+    TEST_ASSERT_EQUAL(SLOT(21), Pool.Peak);
+}
+
+static void test_out_of_order_release(void) {
+    MsgPool_Init(&Pool, Buffer, sizeof(Buffer));
+
+    void * pA = MsgPool_Alloc(&Pool, 40);
+    void * pB = MsgPool_Alloc(&Pool, 40);
+    void * pC = MsgPool_Alloc(&Pool, 40);
+    TEST_ASSERT((NULL != pA) && (NULL != pB) && (NULL != pC));
+
+    // B is free, but the space is only reclaimed with A
+    MsgPool_Release(&Pool, pB);
+    TEST_ASSERT_EQUAL(3, Pool.Slots);
+    TEST_ASSERT_EQUAL(2 * SLOT(40), Pool.Used);
+
+    MsgPool_Release(&Pool, pA);
+    TEST_ASSERT_EQUAL(1, Pool.Slots);
+    TEST_ASSERT_EQUAL(2 * SLOT(40), Pool.Tail);
+
+    MsgPool_Release(&Pool, pC);
+    TEST_ASSERT_EQUAL(0, Pool.Slots);
+    TEST_ASSERT_EQUAL(0, Pool.Used);
+}
+
+static void test_exhaust_and_wrap(void) {
+    void * pSlots[4];
+
+    MsgPool_Init(&Pool, Buffer, sizeof(Buffer));
+    for (int i = 0; i < 4; i++) {
+        pSlots[i] = MsgPool_Alloc(&Pool, 56);
+        TEST_ASSERT(NULL != pSlots[i]);
+    }
+    TEST_ASSERT(NULL == MsgPool_Alloc(&Pool, 1));
+    TEST_ASSERT_EQUAL(1, Pool.Fails);
+
+    // Space before the tail is used once the end is full
+    MsgPool_Release(&Pool, pSlots[0]);
+    MsgPool_Release(&Pool, pSlots[1]);
+    void * pWrapped = MsgPool_Alloc(&Pool, 100);
+    TEST_ASSERT(pWrapped == pSlots[0]);
+    TEST_ASSERT(NULL == MsgPool_Alloc(&Pool, 16));
+
+    MsgPool_Release(&Pool, pSlots[2]);
+    MsgPool_Release(&Pool, pSlots[3]);
+    TEST_ASSERT_EQUAL(1, Pool.Slots);
+    TEST_ASSERT_EQUAL(0, Pool.Tail);
+
+    MsgPool_Release(&Pool, pWrapped);
+    TEST_ASSERT_EQUAL(0, Pool.Slots);
+    TEST_ASSERT_EQUAL(0, Pool.Used);
+    TEST_ASSERT(NULL != MsgPool_Alloc(&Pool, sizeof(Buffer) - 8));
+}
+
+static void test_double_release(void) {
+    MsgPool_Init(&Pool, Buffer, sizeof(Buffer));
+
+    void * pA = MsgPool_Alloc(&Pool, 10);
+    void * pB = MsgPool_Alloc(&Pool, 10);
+    MsgPool_Release(&Pool, pB);
+    MsgPool_Release(&Pool, pB);
+    TEST_ASSERT_EQUAL(SLOT(10), Pool.Used);
+    TEST_ASSERT_EQUAL(2, Pool.Slots);
+
+    MsgPool_Release(&Pool, pA);
+    MsgPool_Release(&Pool, NULL);
+    TEST_ASSERT_EQUAL(0, Pool.Used);
+    TEST_ASSERT_EQUAL(0, Pool.Slots);
+}
+
+static void * test_worker(void * pArg) {
+    uint32_t * pFails = pArg;
+
+    for (int i = 0; i < 100000; i++) {
+        uint8_t * pData = MsgPool_Alloc(&Pool, 1 + (i % 48));
+        if (NULL == pData) {
+            (*pFails)++;
+            continue;
+        }
+        pData[0] = i;
+        MsgPool_Release(&Pool, pData);
+    }
+    return (NULL);
+}
+
+static void test_concurrent(void) {
+    uint32_t Fails[2] = { 0, 0 };
+    pthread_t Threads[2];
+
+    MsgPool_Init(&Pool, Buffer, sizeof(Buffer));
+    for (int i = 0; i < 2; i++) {
+        pthread_create(&Threads[i], NULL, test_worker, &Fails[i]);
+    }
+    for (int i = 0; i < 2; i++) {
+        pthread_join(Threads[i], NULL);
+    }
+    TEST_ASSERT_EQUAL(0, Pool.Slots);
+    TEST_ASSERT_EQUAL(0, Pool.Used);
+    TEST_ASSERT_EQUAL(Fails[0] + Fails[1], Pool.Fails);
+}
+
+int main(void) {
+    esp_log_level_set("*", ESP_LOG_NONE);
+
+    RUN_TEST(test_alloc_release);
+    RUN_TEST(test_out_of_order_release);
+    RUN_TEST(test_exhaust_and_wrap);
+    RUN_TEST(test_double_release);
+    RUN_TEST(test_concurrent);
+    return (TEST_RESULT());
+}
@@ -0,0 +1,96 @@
+/**
+ ******************************************************************************
+ *  file           : test_namehash.c
+ *  brief          : Host tests of the perfect hash of the command names
+ ******************************************************************************
+ */
+
+/****************************** Includes  */
+#include "esp_log.h"
+#include "namehash.h"
+#include "test.h"
+
+/****************************** Statics */
+
+// Same layout and names as the command table
+typedef struct TestEntry {
+    const char *    Name;
+    int             Value;
+} TestEntry;
+
+static const TestEntry Commands[] = {
+    { "fwupdate", 0 }, { "restart", 1 }, { "cancel", 2 }, { "selftest", 3 },
+    { "perf", 4 }, { "latency", 5 }, { "ping", 6 }, { "set", 7 },
+};
+#define COMMANDS (sizeof(Commands)/sizeof(Commands[0]))
+
+#define TEST_NAMES 12                   // Names a table of NAMEHASH_SIZE slots still takes
+
+static NameHash Hash;
+
+/****************************** Tests */
+
+static void test_commands(void) {
+    int Used = 0;
+
+    TEST_ASSERT_EQUAL(ESP_OK, NameHash_Build(&Hash, Commands, COMMANDS, sizeof(TestEntry)));
+    for (int i = 0; i < COMMANDS; i++) {
+        TEST_ASSERT_EQUAL(i, NameHash_Find(&Hash, Commands[i].Name));
+    }
+    for (int i = 0; i < NAMEHASH_SIZE; i++) {
+        Used += (Hash.Slots[i] >= 0);
+    }
+    TEST_ASSERT_EQUAL(COMMANDS, Used);
+}
+
+static void test_unknown(void) {
+    TEST_ASSERT_EQUAL(ESP_OK, NameHash_Build(&Hash, Commands, COMMANDS, sizeof(TestEntry)));
+
+    TEST_ASSERT_EQUAL(-1, NameHash_Find(&Hash, ""));
+    TEST_ASSERT_EQUAL(-1, NameHash_Find(&Hash, "pin"));
+    TEST_ASSERT_EQUAL(-1, NameHash_Find(&Hash, "pings"));
+    TEST_ASSERT_EQUAL(-1, NameHash_Find(&Hash, "PING"));
+    TEST_ASSERT_EQUAL(-1, NameHash_Find(&Hash, "restart "));
+    TEST_ASSERT_EQUAL(-1, NameHash_Find(&Hash, "fwupdatefwupdate"));
+}
+
+static void test_more_names(void) {
+    static char Names[TEST_NAMES][4];
+    TestEntry Table[TEST_NAMES];
+
+    for (int i = 0; i < TEST_NAMES; i++) {
+        snprintf(Names[i], sizeof(Names[i]), "c%d", i);
+        Table[i].Name = Names[i];
+    }
+
+    // Room for more commands before NAMEHASH_SIZE has to grow
+    TEST_ASSERT_EQUAL(ESP_OK, NameHash_Build(&Hash, Table, TEST_NAMES, sizeof(TestEntry)));
+    for (int i = 0; i < TEST_NAMES; i++) {
+        TEST_ASSERT_EQUAL(i, NameHash_Find(&Hash, Names[i]));
+    }
+}
+
+static void test_collisions(void) {
+    static const TestEntry Twice[] = { { "ping", 0 }, { "set", 1 }, { "ping", 2 } };
+    TestEntry Many[NAMEHASH_SIZE + 1];
+
+    // Equal names collide for every seed
+    TEST_ASSERT_EQUAL(ESP_FAIL, NameHash_Build(&Hash, Twice, 3, sizeof(TestEntry)));
+    TEST_ASSERT_EQUAL(-1, NameHash_Find(&Hash, "ping"));
+    TEST_ASSERT_EQUAL(-1, NameHash_Find(&Hash, "set"));
+
+    for (int i = 0; i <= NAMEHASH_SIZE; i++) {
+        Many[i].Name = "x";
+    }
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, NameHash_Build(&Hash, Many, NAMEHASH_SIZE + 1, sizeof(TestEntry)));
+}
+
+int main(void) {
+    esp_log_level_set("*", ESP_LOG_NONE);
+
+    RUN_TEST(test_commands);
+    RUN_TEST(test_unknown);
+    RUN_TEST(test_more_names);
+    RUN_TEST(test_collisions);
+    return (TEST_RESULT());
+}
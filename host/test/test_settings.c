@@ -0,0 +1,195 @@
+/**
+ ******************************************************************************
+ *  file           : test_settings.c
+ *  brief          : Host tests of the settings and their remote changes
+ ******************************************************************************
+ */
+
+/****************************** Includes  */
+#include "esp_log.h"
+#include "host.h"
+#include "nvs_flash.h"
+#include "settings.h"
+#include "test.h"
+
+/****************************** Statics */
+static char Value[160];
+static uint32_t Changes[SETTING_COUNT];
+
+/****************************** Functions */
+
+static void test_on_change(Settings_Id Id, void * pArg) {
+    (void)pArg;
+    Changes[Id]++;
+}
+
+/**
+ * @brief Start with an empty NVS
+ */
+static void test_fresh(void) {
+    HostNvs_Clear();
+    TEST_ASSERT_EQUAL(ESP_OK, Settings_Init());
+}
+
+/****************************** Tests */
+
+static void test_defaults(void) {
+    test_fresh();
+
+    TEST_ASSERT_EQUAL(10000, Settings_GetU32(SETTING_TELEMETRY_PERIOD));
+    TEST_ASSERT_EQUAL(300000, Settings_GetU32(SETTING_TELEMETRY_KEYFRAME));
+    TEST_ASSERT_EQUAL(0, Settings_GetU32(SETTING_CODEC));
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND, Settings_GetStr(SETTING_WIFI_SSID, Value, sizeof(Value)));
+    TEST_ASSERT_EQUAL(0, Settings_GetU32(SETTING_WIFI_SSID));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, Settings_GetStr(SETTING_CODEC, Value, sizeof(Value)));
+}
+
+static void test_local_only(void) {
+    test_fresh();
+    TEST_ASSERT_EQUAL(ESP_OK, Settings_SetStr(SETTING_MQTT_URL, "mqtt://broker"));
+
+    // Connection settings can't be changed remotely
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_ALLOWED, Settings_SetFromString("SETTINGS.WIFI_SSID", "evil"));
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_ALLOWED, Settings_SetFromString("SETTINGS.WIFI_PASS", "evil"));
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_ALLOWED, Settings_SetFromString("SETTINGS.MQTT_URL", "mqtt://evil"));
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND, Settings_GetStr(SETTING_WIFI_SSID, Value, sizeof(Value)));
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND, Settings_GetStr(SETTING_WIFI_PASS, Value, sizeof(Value)));
+    TEST_ASSERT_EQUAL(ESP_OK, Settings_GetStr(SETTING_MQTT_URL, Value, sizeof(Value)));
+    TEST_ASSERT_EQUAL_STRING("mqtt://broker", Value);
+    TEST_ASSERT_EQUAL(0, Changes[SETTING_WIFI_PASS]);
+}
+
+static void test_remote(void) {
+    test_fresh();
+
+    TEST_ASSERT_EQUAL(ESP_OK, Settings_SetFromString("TELEMETRY.PERIOD", "30000"));
+    TEST_ASSERT_EQUAL(30000, Settings_GetU32(SETTING_TELEMETRY_PERIOD));
+    TEST_ASSERT_EQUAL(ESP_OK, Settings_SetFromString("TELEMETRY.KEYFRAME", "0x10000"));
+    TEST_ASSERT_EQUAL(65536, Settings_GetU32(SETTING_TELEMETRY_KEYFRAME));
+    TEST_ASSERT_EQUAL(ESP_OK, Settings_SetFromString("SETTINGS.CODEC", "1"));
+    TEST_ASSERT_EQUAL(1, Settings_GetU32(SETTING_CODEC));
+
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, Settings_SetFromString("TELEMETRY.PERIOD", "abc"));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, Settings_SetFromString("TELEMETRY.PERIOD", "12x"));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, Settings_SetFromString("TELEMETRY.PERIOD", ""));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, Settings_SetFromString("SETTINGS.CODEC", "256"));
+    TEST_ASSERT_EQUAL(30000, Settings_GetU32(SETTING_TELEMETRY_PERIOD));
+    TEST_ASSERT_EQUAL(1, Settings_GetU32(SETTING_CODEC));
+}
+
+static void test_range(void) {
+    test_fresh();
+
+    // Negative numbers are not wrapped to 0xFFFFFFFF
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, Settings_SetFromString("TELEMETRY.PERIOD", "-1"));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, Settings_SetFromString("TELEMETRY.PERIOD", "-0"));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, Settings_SetFromString("TELEMETRY.PERIOD", " 5000"));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, Settings_SetFromString("TELEMETRY.PERIOD", "+5000"));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, Settings_SetFromString("SETTINGS.CODEC", "-1"));
+
+    // Below a tick or beyond a day
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, Settings_SetFromString("TELEMETRY.PERIOD", "5"));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, Settings_SetFromString("TELEMETRY.PERIOD", "0"));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, Settings_SetFromString("TELEMETRY.PERIOD", "86400001"));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, Settings_SetFromString("TELEMETRY.PERIOD", "4294967296"));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, Settings_SetFromString("TELEMETRY.KEYFRAME", "999"));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, Settings_SetFromString("SETTINGS.CODEC", "2"));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, Settings_SetFromString("SETTINGS.WIFI_FASTIP", "2"));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, Settings_SetU32(SETTING_TELEMETRY_PERIOD, 999));
+    TEST_ASSERT_EQUAL(10000, Settings_GetU32(SETTING_TELEMETRY_PERIOD));
+    TEST_ASSERT_EQUAL(300000, Settings_GetU32(SETTING_TELEMETRY_KEYFRAME));
+    TEST_ASSERT_EQUAL(0, Settings_GetU32(SETTING_CODEC));
+
+    // The limits themselves are valid
+    TEST_ASSERT_EQUAL(ESP_OK, Settings_SetFromString("TELEMETRY.PERIOD", "1000"));
+    TEST_ASSERT_EQUAL(ESP_OK, Settings_SetFromString("TELEMETRY.KEYFRAME", "86400000"));
+    TEST_ASSERT_EQUAL(1000, Settings_GetU32(SETTING_TELEMETRY_PERIOD));
+    TEST_ASSERT_EQUAL(86400000, Settings_GetU32(SETTING_TELEMETRY_KEYFRAME));
+}
+
+static void test_range_stored(void) {
+    nvs_handle_t handle;
+
+    // Stored by an older firmware without the range check
+    HostNvs_Clear();
+    TEST_ASSERT_EQUAL(ESP_OK, nvs_open("TELEMETRY", NVS_READWRITE, &handle));
+    TEST_ASSERT_EQUAL(ESP_OK, nvs_set_u32(handle, "PERIOD", 5));
+    TEST_ASSERT_EQUAL(ESP_OK, nvs_set_u32(handle, "KEYFRAME", 60000));
+    TEST_ASSERT_EQUAL(ESP_OK, nvs_commit(handle));
+    nvs_close(handle);
+
+    TEST_ASSERT_EQUAL(ESP_OK, Settings_Init());
+    TEST_ASSERT_EQUAL(10000, Settings_GetU32(SETTING_TELEMETRY_PERIOD));
+    TEST_ASSERT_EQUAL(60000, Settings_GetU32(SETTING_TELEMETRY_KEYFRAME));
+
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, Settings_SetFromString("PERIOD", "1"));
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND, Settings_SetFromString("TELEMETRY.NOPE", "1"));
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND, Settings_SetFromString("SETTINGS.PERIOD", "1"));
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND, Settings_SetFromString("TELEMETR.PERIOD", "1"));
+}
+
+static void test_callbacks(void) {
+    test_fresh();
+    memset(Changes, 0x00, sizeof(Changes));
+
+    // Only real changes are reported
+    TEST_ASSERT_EQUAL(ESP_OK, Settings_SetFromString("TELEMETRY.PERIOD", "20000"));
+    TEST_ASSERT_EQUAL(ESP_OK, Settings_SetFromString("TELEMETRY.PERIOD", "20000"));
+    TEST_ASSERT_EQUAL(ESP_OK, Settings_SetU32(SETTING_TELEMETRY_PERIOD, 25000));
+    TEST_ASSERT_EQUAL(2, Changes[SETTING_TELEMETRY_PERIOD]);
+
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, Settings_SetFromString("TELEMETRY.PERIOD", "x"));
+    TEST_ASSERT_EQUAL(2, Changes[SETTING_TELEMETRY_PERIOD]);
+}
+
+static void test_sizes(void) {
+    char Small[4];
+
+    // 32 characters plus the terminator
+    test_fresh();
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_SIZE, Settings_SetStr(SETTING_WIFI_SSID, "012345678901234567890123456789012"));
+    TEST_ASSERT_EQUAL(ESP_OK, Settings_SetStr(SETTING_WIFI_SSID, "01234567890123456789012345678901"));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_SIZE, Settings_GetStr(SETTING_WIFI_SSID, Small, sizeof(Small)));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, Settings_SetU32(SETTING_WIFI_FASTIP, 256));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, Settings_SetU32(SETTING_WIFI_SSID, 1));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, Settings_SetStr(SETTING_TELEMETRY_PERIOD, "1"));
+}
+
+static void test_persist(void) {
+    test_fresh();
+    TEST_ASSERT_EQUAL(ESP_OK, Settings_SetStr(SETTING_WIFI_SSID, "home"));
+    TEST_ASSERT_EQUAL(ESP_OK, Settings_SetU32(SETTING_WIFI_FASTIP, 1));
+    TEST_ASSERT_EQUAL(ESP_OK, Settings_SetFromString("TELEMETRY.PERIOD", "60000"));
+    TEST_ASSERT_EQUAL(ESP_OK, Settings_Flush());
+
+    // Not flushed, lost with the reboot
+    TEST_ASSERT_EQUAL(ESP_OK, Settings_SetU32(SETTING_TELEMETRY_KEYFRAME, 1000));
+
+    TEST_ASSERT_EQUAL(ESP_OK, Settings_Init());
+    TEST_ASSERT_EQUAL(ESP_OK, Settings_GetStr(SETTING_WIFI_SSID, Value, sizeof(Value)));
+    TEST_ASSERT_EQUAL_STRING("home", Value);
+    TEST_ASSERT_EQUAL(1, Settings_GetU32(SETTING_WIFI_FASTIP));
+    TEST_ASSERT_EQUAL(60000, Settings_GetU32(SETTING_TELEMETRY_PERIOD));
+    TEST_ASSERT_EQUAL(300000, Settings_GetU32(SETTING_TELEMETRY_KEYFRAME));
+
+    HostNvs_Clear();
+    TEST_ASSERT_EQUAL(ESP_OK, Settings_Init());
+    TEST_ASSERT_EQUAL(10000, Settings_GetU32(SETTING_TELEMETRY_PERIOD));
+}
+
+int main(void) {
+    esp_log_level_set("*", ESP_LOG_NONE);
+    for (int i = 0; i < SETTING_COUNT; i++) {
+        Settings_OnChange(i, test_on_change, NULL);
+    }
+
+    RUN_TEST(test_defaults);
+    RUN_TEST(test_local_only);
+    RUN_TEST(test_remote);
+    RUN_TEST(test_range);
+    RUN_TEST(test_range_stored);
+    RUN_TEST(test_callbacks);
+    RUN_TEST(test_sizes);
+    RUN_TEST(test_persist);
+    return (TEST_RESULT());
+}
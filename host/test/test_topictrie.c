@@ -0,0 +1,113 @@
+/**
+ ******************************************************************************
+ *  file           : test_topictrie.c
+ *  brief          : Host tests of the topic trie and its wildcards
+ ******************************************************************************
+ */
+
+/****************************** Includes  */
+#include <stdbool.h>
+#include "topictrie.h"
+#include "test.h"
+
+/****************************** Statics */
+static TopicTrie Trie;
+static bool Matched[TRIE_MAX_NODES];
+
+/****************************** Functions */
+
+static void test_collect(int Node, void * pArg) {
+    (void)pArg;
+    Matched[Node] = true;
+}
+
+static void test_match(const char * Topic) {
+    memset(Matched, 0x00, sizeof(Matched));
+    TopicTrie_Match(&Trie, Topic, test_collect, NULL);
+}
+
+/****************************** Tests */
+
+static void test_insert_find(void) {
+    TopicTrie_Init(&Trie);
+
+    const int Node = TopicTrie_Insert(&Trie, "a/b/c");
+    TEST_ASSERT(Node > 0);
+    TEST_ASSERT_EQUAL(4, Trie.Count);
+
+    // Levels are shared, inserting twice gives the same node
+    TEST_ASSERT(TopicTrie_Insert(&Trie, "a/b/d") > 0);
+    TEST_ASSERT_EQUAL(5, Trie.Count);
+    TEST_ASSERT_EQUAL(Node, TopicTrie_Insert(&Trie, "a/b/c"));
+    TEST_ASSERT_EQUAL(5, Trie.Count);
+
+    TEST_ASSERT_EQUAL(Node, TopicTrie_Find(&Trie, "a/b/c"));
+    TEST_ASSERT_EQUAL(-1, TopicTrie_Find(&Trie, "a/b/e"));
+    TEST_ASSERT_EQUAL(-1, TopicTrie_Find(&Trie, "a/b/c/d"));
+    TEST_ASSERT_EQUAL(5, Trie.Count);
+}
+
+static void test_invalid_filters(void) {
+    TopicTrie_Init(&Trie);
+
+    TEST_ASSERT_EQUAL(-1, TopicTrie_Insert(&Trie, "a/b+/c"));
+    TEST_ASSERT_EQUAL(-1, TopicTrie_Insert(&Trie, "a/#/c"));
+    TEST_ASSERT_EQUAL(-1, TopicTrie_Insert(&Trie, "a/b#"));
+    TEST_ASSERT_EQUAL(-1, TopicTrie_Insert(&Trie, "a/abcdefghijklmnopqrstuvwx"));
+    TEST_ASSERT_EQUAL(1, Trie.Count);
+    TEST_ASSERT(TopicTrie_Insert(&Trie, "a/abcdefghijklmnopqrstuvw") > 0);
+}
+
+static void test_wildcards(void) {
+    TopicTrie_Init(&Trie);
+    const int Exact = TopicTrie_Insert(&Trie, "dev/1/cmd");
+    const int Plus = TopicTrie_Insert(&Trie, "dev/+/cmd");
+    const int Sub = TopicTrie_Insert(&Trie, "dev/#");
+    const int All = TopicTrie_Insert(&Trie, "#");
+    const int TwoPlus = TopicTrie_Insert(&Trie, "dev/+/+");
+    const int Other = TopicTrie_Insert(&Trie, "dev/2/cmd");
+
+    test_match("dev/1/cmd");
+    TEST_ASSERT(Matched[Exact] && Matched[Plus] && Matched[Sub] && Matched[All] && Matched[TwoPlus]);
+    TEST_ASSERT(!Matched[Other]);
+
+    // "#" includes the parent level
+    test_match("dev");
+    TEST_ASSERT(Matched[Sub] && Matched[All]);
+    TEST_ASSERT(!Matched[Exact] && !Matched[Plus] && !Matched[TwoPlus]);
+
+    test_match("dev/1/cmd/x");
+    TEST_ASSERT(Matched[Sub] && Matched[All]);
+    TEST_ASSERT(!Matched[Exact] && !Matched[Plus] && !Matched[TwoPlus]);
+
+    test_match("other/1/cmd");
+    TEST_ASSERT(Matched[All]);
+    TEST_ASSERT(!Matched[Exact] && !Matched[Plus] && !Matched[Sub] && !Matched[TwoPlus]);
+
+    // "+" matches an empty level
+    test_match("dev//cmd");
+    TEST_ASSERT(Matched[Plus] && Matched[TwoPlus] && Matched[Sub]);
+    TEST_ASSERT(!Matched[Exact] && !Matched[Other]);
+}
+
+static void test_full(void) {
+    char Filter[16];
+    int Node = 0;
+
+    TopicTrie_Init(&Trie);
+    for (int i = 0; (i < TRIE_MAX_NODES) && (Node >= 0); i++) {
+        snprintf(Filter, sizeof(Filter), "t%d", i);
+        Node = TopicTrie_Insert(&Trie, Filter);
+    }
+    TEST_ASSERT_EQUAL(-1, Node);
+    TEST_ASSERT_EQUAL(TRIE_MAX_NODES, Trie.Count);
+    TEST_ASSERT_EQUAL(1, TopicTrie_Find(&Trie, "t0"));
+}
+
+int main(void) {
+    RUN_TEST(test_insert_find);
+    RUN_TEST(test_invalid_filters);
+    RUN_TEST(test_wildcards);
+    RUN_TEST(test_full);
+    return (TEST_RESULT());
+}
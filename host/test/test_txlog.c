@@ -0,0 +1,269 @@
+/**
+ ******************************************************************************
+ *  file           : test_txlog.c
+ *  brief          : Host tests of the store-and-forward log on a file backed partition
+ ******************************************************************************
+ */
+
+/****************************** Includes  */
+#include <stdio.h>
+#include "esp_log.h"
+#include "esp_partition.h"
+#include "host.h"
+#include "txlog.h"
+#include "test.h"
+
+/****************************** Statics */
+#define TEST_SECTORS 4                  // Size of the partition
+#define TEST_PAYLOAD 6                  // Payload of the small records
+#define TEST_RECORD  16                 // Flash size of a small record, subtopic "t"
+#define TEST_FIRST   8                  // First record behind the sector header
+
+static const esp_partition_t * pPart = NULL;
+static char Buffer[TXLOG_MAX_RECORD];
+static uint8_t Payload[TXLOG_MAX_RECORD];
+
+/****************************** Functions */
+
+/**
+ * @brief Erase the partition and start an empty log
+ */
+static void test_fresh(void) {
+    esp_partition_erase_range(pPart, 0, pPart->size);
+    TEST_ASSERT_EQUAL(ESP_OK, TxLog_Init());
+}
+
+/**
+ * @brief Append a message whose payload starts with its number
+ */
+static esp_err_t test_append(int Number, size_t Length) {
+    memset(Payload, 'a' + (Number % 26), Length);
+    memcpy(Payload, &Number, sizeof(Number));
+    return (TxLog_Append("t", Payload, Length));
+}
+
+/**
+ * @brief Peek and pop the next message, returns its number, -1 if none, -2 if not as appended
+ */
+static int test_forward(size_t Length) {
+    const char * pSubTopic;
+    const char * pData;
+    size_t DataLen;
+    int Number;
+
+    if (ESP_OK != TxLog_Peek(Buffer, sizeof(Buffer), &pSubTopic, &pData, &DataLen)) {
+        return (-1);
+    }
+    if ((0 != strcmp("t", pSubTopic)) || (Length != DataLen)) {
+        return (-2);
+    }
+    memcpy(&Number, pData, sizeof(Number));
+    if ((('a' + (Number % 26)) != pData[DataLen - 1]) || (ESP_OK != TxLog_Pop())) {
+        return (-2);
+    }
+    return (Number);
+}
+
+/****************************** Tests */
+
+static void test_no_partition(void) {
+    TxLog_Stats Stats;
+    const char * pSubTopic;
+    const char * pData;
+    size_t DataLen;
+
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND, TxLog_Init());
+    TEST_ASSERT(TxLog_isEmpty());
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, TxLog_Append("t", "x", 1));
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND, TxLog_Peek(Buffer, sizeof(Buffer), &pSubTopic, &pData, &DataLen));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, TxLog_Pop());
+    TxLog_GetStats(&Stats);
+    TEST_ASSERT_EQUAL(0, Stats.Pending);
+}
+
+static void test_fifo(void) {
+    TxLog_Stats Stats;
+    const char * pSubTopic;
+    const char * pData;
+    size_t DataLen;
+
+    test_fresh();
+    TEST_ASSERT(TxLog_isEmpty());
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, TxLog_Pop());
+
+    for (int i = 0; i < 10; i++) {
+        TEST_ASSERT_EQUAL(ESP_OK, test_append(i, 20 + i));
+    }
+    TEST_ASSERT(!TxLog_isEmpty());
+
+    // Peek does not remove
+    TEST_ASSERT_EQUAL(ESP_OK, TxLog_Peek(Buffer, sizeof(Buffer), &pSubTopic, &pData, &DataLen));
+    TEST_ASSERT_EQUAL(20, DataLen);
+    for (int i = 0; i < 10; i++) {
+        TEST_ASSERT_EQUAL(i, test_forward(20 + i));
+    }
+    TEST_ASSERT_EQUAL(-1, test_forward(0));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, TxLog_Pop());
+    TEST_ASSERT(TxLog_isEmpty());
+
+    TxLog_GetStats(&Stats);
+    TEST_ASSERT_EQUAL(10, Stats.Stored);
+    TEST_ASSERT_EQUAL(10, Stats.Forwarded);
+    TEST_ASSERT_EQUAL(0, Stats.Pending);
+    TEST_ASSERT_EQUAL(0, Stats.Dropped);
+}
+
+static void test_reboot(void) {
+    TxLog_Stats Stats;
+
+    test_fresh();
+    for (int i = 0; i < 30; i++) {
+        TEST_ASSERT_EQUAL(ESP_OK, test_append(i, 200));
+    }
+    TEST_ASSERT_EQUAL(0, test_forward(200));
+    TEST_ASSERT_EQUAL(1, test_forward(200));
+
+    // Pending messages span two sectors and survive
+    TEST_ASSERT_EQUAL(ESP_OK, TxLog_Init());
+    TxLog_GetStats(&Stats);
+    TEST_ASSERT_EQUAL(28, Stats.Pending);
+    TEST_ASSERT_EQUAL(ESP_OK, test_append(30, 200));
+    TxLog_GetStats(&Stats);
+    TEST_ASSERT_EQUAL(0, Stats.Erases);
+
+    for (int i = 2; i <= 30; i++) {
+        TEST_ASSERT_EQUAL(i, test_forward(200));
+    }
+    TEST_ASSERT(TxLog_isEmpty());
+
+    // Forwarded ones stay forwarded
+    TEST_ASSERT_EQUAL(ESP_OK, TxLog_Init());
+    TEST_ASSERT(TxLog_isEmpty());
+}
+
+static void test_wrap_drops_oldest(void) {
+    TxLog_Stats Stats;
+
+    // Four 1000 byte messages per sector
+    test_fresh();
+    for (int i = 0; i < 40; i++) {
+        TEST_ASSERT_EQUAL(ESP_OK, test_append(i, 1000));
+    }
+    TxLog_GetStats(&Stats);
+    TEST_ASSERT_EQUAL(40, Stats.Stored);
+    TEST_ASSERT(Stats.Dropped >= 24);
+    TEST_ASSERT_EQUAL(40, Stats.Pending + Stats.Dropped);
+    TEST_ASSERT_EQUAL(0, Stats.Dropped % 4);
+    const int Next = Stats.Dropped;
+
+    // The newest are left, in order, also after a reboot
+    TEST_ASSERT_EQUAL(ESP_OK, TxLog_Init());
+    TxLog_GetStats(&Stats);
+    TEST_ASSERT_EQUAL(40 - Next, Stats.Pending);
+    for (int i = Next; i < 40; i++) {
+        TEST_ASSERT_EQUAL(i, test_forward(1000));
+    }
+    TEST_ASSERT(TxLog_isEmpty());
+}
+
+static void test_wear(void) {
+    HostFlash_Stats Before, After;
+    TxLog_Stats Stats;
+
+    test_fresh();
+    HostFlash_GetStats(pPart, &Before);
+    for (int i = 0; i < 2000; i++) {
+        TEST_ASSERT_EQUAL(ESP_OK, test_append(i, 500));
+        TEST_ASSERT_EQUAL(i, test_forward(500));
+    }
+    TxLog_GetStats(&Stats);
+    TEST_ASSERT(Stats.Erases > 100);
+
+    // The ring erases all sectors in turn
+    HostFlash_GetStats(pPart, &After);
+    TEST_ASSERT((After.MaxSectorErases - Before.MaxSectorErases) <= (((After.Erases - Before.Erases) / TEST_SECTORS) + 1));
+}
+
+static void test_corrupt_record(void) {
+    TxLog_Stats Stats;
+    const uint8_t Zero = 0x00;
+
+    test_fresh();
+    for (int i = 0; i < 3; i++) {
+        TEST_ASSERT_EQUAL(ESP_OK, test_append(i + 1, TEST_PAYLOAD));
+    }
+
+    // Clear a payload bit of the second record
+    esp_partition_write(pPart, TEST_FIRST + TEST_RECORD + 8 + 2, &Zero, 1);
+
+    TEST_ASSERT_EQUAL(1, test_forward(TEST_PAYLOAD));
+    TEST_ASSERT_EQUAL(3, test_forward(TEST_PAYLOAD));
+    TxLog_GetStats(&Stats);
+    TEST_ASSERT_EQUAL(1, Stats.Dropped);
+    TEST_ASSERT_EQUAL(2, Stats.Forwarded);
+    TEST_ASSERT(TxLog_isEmpty());
+}
+
+static void test_interrupted_write(void) {
+    TxLog_Stats Stats;
+    const uint8_t Data[4] = { 0x12, 0x34, 0x56, 0x78 };
+
+    test_fresh();
+    for (int i = 0; i < 3; i++) {
+        TEST_ASSERT_EQUAL(ESP_OK, test_append(i, TEST_PAYLOAD));
+    }
+
+    // Power lost after the data, before the record header
+    esp_partition_write(pPart, TEST_FIRST + (3 * TEST_RECORD) + 8, Data, sizeof(Data));
+
+    // The rest of the sector is skipped, nothing is lost
+    TEST_ASSERT_EQUAL(ESP_OK, TxLog_Init());
+    TEST_ASSERT_EQUAL(ESP_OK, test_append(3, TEST_PAYLOAD));
+    TxLog_GetStats(&Stats);
+    TEST_ASSERT_EQUAL(1, Stats.Erases);
+    TEST_ASSERT_EQUAL(4, Stats.Pending);
+    for (int i = 0; i < 4; i++) {
+        TEST_ASSERT_EQUAL(i, test_forward(TEST_PAYLOAD));
+    }
+}
+
+static void test_sizes(void) {
+    TxLog_Stats Stats;
+    const char * pSubTopic;
+    const char * pData;
+    size_t DataLen;
+
+    test_fresh();
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_SIZE, test_append(0, TXLOG_MAX_RECORD - 1));
+
+    // The largest record fills a sector
+    TEST_ASSERT_EQUAL(ESP_OK, test_append(1, TXLOG_MAX_RECORD - 2));
+    TEST_ASSERT_EQUAL(ESP_OK, test_append(2, TXLOG_MAX_RECORD - 2));
+    TEST_ASSERT_EQUAL(1, test_forward(TXLOG_MAX_RECORD - 2));
+
+    // A record too large for the buffer is dropped
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND, TxLog_Peek(Buffer, 100, &pSubTopic, &pData, &DataLen));
+    TxLog_GetStats(&Stats);
+    TEST_ASSERT_EQUAL(1, Stats.Dropped);
+    TEST_ASSERT(TxLog_isEmpty());
+}
+
+int main(void) {
+    esp_log_level_set("*", ESP_LOG_NONE);
+
+    RUN_TEST(test_no_partition);
+    pPart = HostFlash_AddPartition(TXLOG_PARTITION, ESP_PARTITION_TYPE_DATA, 0x40, NULL, TEST_SECTORS * HOST_FLASH_SECTOR);
+    if (NULL == pPart) {
+        printf("Cannot create the partition\n");
+        return (1);
+    }
+
+    RUN_TEST(test_fifo);
+    RUN_TEST(test_reboot);
+    RUN_TEST(test_wrap_drops_oldest);
+    RUN_TEST(test_wear);
+    RUN_TEST(test_corrupt_record);
+    RUN_TEST(test_interrupted_write);
+    RUN_TEST(test_sizes);
+    return (TEST_RESULT());
+}
@@ -0,0 +1,240 @@
+/**
+ ******************************************************************************
+ *  file           : test_wifi.c
+ *  brief          : Host tests of the cached AP and its fallback, wifi.c on
+ *                   the simulated station and the MQTT reconnect behind it
+ ******************************************************************************
+ */
+
+/****************************** Includes  */
+#include "esp_log.h"
+#include "esp_wifi.h"
+#include "nvs.h"
+#include "host.h"
+#include "settings.h"
+#include "apcache.h"
+#include "wifi.h"
+#include "mqtt.h"
+#include "test.h"
+
+/****************************** Statics */
+#define TEST_TRIES      2               // Directed connects before the scan, WIFI_CACHE_TRIES of wifi.c
+#define TEST_STEP_MS    10              // Clock step while waiting
+#define TEST_WAIT_MS    5000            // Max time to connect
+#define TEST_OUTAGE_MS  120000          // WiFi outage, longer than all MQTT backoffs
+
+static const uint8_t Bssid1[6] = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x01 };
+static const uint8_t Bssid2[6] = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x02 };
+
+/****************************** Functions */
+
+/**
+ * @brief Run the events and the backoff timers until connected
+ *
+ * @return true Connected within TEST_WAIT_MS
+ */
+static bool test_wait_connected(void) {
+    for (int Ms = 0; Ms <= TEST_WAIT_MS; Ms += TEST_STEP_MS) {
+        HostEvent_Flush();
+        if (WiFi_isConnected()) {
+            return (true);
+        }
+        HostTimer_Advance(TEST_STEP_MS * 1000);
+    }
+    return (false);
+}
+
+/**
+ * @brief Run the events of WiFi and MQTT for a while
+ *
+ * @param Ms Time to advance the clock
+ */
+static void test_run(uint32_t Ms) {
+    for (uint32_t i = 0; i < Ms; i += TEST_STEP_MS) {
+        HostTimer_Advance(TEST_STEP_MS * 1000);
+        HostEvent_Flush();
+        HostMqtt_Flush();
+    }
+}
+
+/**
+ * @brief Drop the connection and handle the DISCONNECTED event
+ */
+static void test_drop(void) {
+    HostWifi_Disconnect(WIFI_REASON_BEACON_TIMEOUT);
+    HostEvent_Flush();
+}
+
+/****************************** Tests */
+
+static void test_fallback(void) {
+    ApCache Cache;
+
+    // Falls back at the last try, later failures retry
+    ApCache_Init(&Cache, TEST_TRIES, true, false);
+    TEST_ASSERT_EQUAL(APCACHE_RETRY, ApCache_Disconnected(&Cache));
+    TEST_ASSERT_EQUAL(APCACHE_SCAN, ApCache_Disconnected(&Cache));
+    TEST_ASSERT(!Cache.isCached);
+    TEST_ASSERT_EQUAL(APCACHE_RETRY, ApCache_Disconnected(&Cache));
+    TEST_ASSERT_EQUAL(APCACHE_RETRY, ApCache_Disconnected(&Cache));
+
+    // Nothing to fall back from
+    ApCache_Init(&Cache, TEST_TRIES, false, true);
+    TEST_ASSERT(!Cache.isStaticIp);
+    for (int i = 0; i < (2 * TEST_TRIES); i++) {
+        TEST_ASSERT_EQUAL(APCACHE_RETRY, ApCache_Disconnected(&Cache));
+    }
+}
+
+static void test_fallback_dhcp(void) {
+    ApCache Cache;
+
+    ApCache_Init(&Cache, TEST_TRIES, true, true);
+    TEST_ASSERT_EQUAL(APCACHE_RETRY, ApCache_Disconnected(&Cache));
+    TEST_ASSERT(Cache.isStaticIp);
+    TEST_ASSERT_EQUAL(APCACHE_SCAN_DHCP, ApCache_Disconnected(&Cache));
+    TEST_ASSERT(!Cache.isCached);
+    TEST_ASSERT(!Cache.isStaticIp);
+}
+
+static void test_fails_reset(void) {
+    ApCache Cache;
+
+    // Only an IP ends a run of failures
+    ApCache_Init(&Cache, TEST_TRIES, true, false);
+    for (int i = 0; i < 3; i++) {
+        TEST_ASSERT_EQUAL(APCACHE_RETRY, ApCache_Disconnected(&Cache));
+        ApCache_GotIp(&Cache);
+    }
+    TEST_ASSERT_EQUAL(0, Cache.Fails);
+    TEST_ASSERT_EQUAL(APCACHE_RETRY, ApCache_Disconnected(&Cache));
+    TEST_ASSERT_EQUAL(APCACHE_SCAN, ApCache_Disconnected(&Cache));
+}
+
+// wifi.c on the events of the simulated station: Cached AP with static IP, then the AP moves
+static void test_station(void) {
+    ApCache_Entry Entry = { .Ssid = "HostAP", .Channel = 6 };
+    ApCache_Entry Saved;
+    size_t Length = sizeof(Saved);
+    HostWifi_Stats Stats;
+    wifi_config_t Config;
+    nvs_handle_t Handle;
+
+    memcpy(Entry.Bssid, Bssid1, sizeof(Entry.Bssid));
+    Entry.IpInfo.ip.addr = ESP_IP4TOADDR(192, 168, 4, 50);
+    Entry.IpInfo.netmask.addr = ESP_IP4TOADDR(255, 255, 255, 0);
+    Entry.IpInfo.gw.addr = ESP_IP4TOADDR(192, 168, 4, 1);
+    Entry.Dns = ESP_IP4TOADDR(192, 168, 4, 1);
+    HostNvs_Clear();
+    TEST_ASSERT_EQUAL(ESP_OK, nvs_open("SETTINGS", NVS_READWRITE, &Handle));
+    nvs_set_str(Handle, "WIFI_SSID", "HostAP");
+    nvs_set_u8(Handle, "WIFI_FASTIP", 1);
+    nvs_set_str(Handle, "MQTT_URL", "mqtt://127.0.0.1");      // Broker of test_mqtt_kick
+    nvs_set_blob(Handle, "WIFI_CACHE", &Entry, sizeof(Entry));
+    nvs_close(Handle);
+    TEST_ASSERT_EQUAL(ESP_OK, Settings_Init());
+    HostWifi_SetAp("HostAP", Bssid1, 6, true);
+
+    // Directed connect with the cached lease
+    TEST_ASSERT_EQUAL(ESP_OK, WiFi_Init());
+    TEST_ASSERT(test_wait_connected());
+    HostWifi_GetStats(&Stats, NULL);
+    TEST_ASSERT_EQUAL(1, Stats.Directed);
+    TEST_ASSERT_EQUAL(1, Stats.StaticIp);
+    TEST_ASSERT(!Stats.isDhcp);
+
+    // Single drops: The reconnect gets an IP, which resets the failures, no fallback
+    for (int i = 0; i < 3; i++) {
+        test_drop();
+        TEST_ASSERT(test_wait_connected());
+    }
+    HostWifi_GetStats(&Stats, NULL);
+    TEST_ASSERT_EQUAL(4, Stats.Connects);
+    TEST_ASSERT_EQUAL(4, Stats.Directed);
+    TEST_ASSERT_EQUAL(4, Stats.StaticIp);
+
+    // The AP moves: TEST_TRIES failures, then a scan with DHCP
+    HostWifi_SetAp("HostAP", Bssid2, 11, true);
+    test_drop();
+    TEST_ASSERT(test_wait_connected());
+    HostWifi_GetStats(&Stats, &Config);
+    TEST_ASSERT_EQUAL(4 + TEST_TRIES, Stats.Connects);
+    TEST_ASSERT_EQUAL(4 + TEST_TRIES - 1, Stats.Directed);
+    TEST_ASSERT_EQUAL(4, Stats.StaticIp);
+    TEST_ASSERT(Stats.isDhcp);
+    TEST_ASSERT(!Config.sta.bssid_set);
+
+    // The new AP and its lease are cached
+    TEST_ASSERT_EQUAL(ESP_OK, nvs_open("SETTINGS", NVS_READONLY, &Handle));
+    TEST_ASSERT_EQUAL(ESP_OK, nvs_get_blob(Handle, "WIFI_CACHE", &Saved, &Length));
+    nvs_close(Handle);
+    TEST_ASSERT(0 == memcmp(Saved.Bssid, Bssid2, sizeof(Bssid2)));
+    TEST_ASSERT_EQUAL(11, Saved.Channel);
+    TEST_ASSERT_EQUAL(ESP_IP4TOADDR(192, 168, 4, 100), Saved.IpInfo.ip.addr);
+
+    // Not cached any more: Failures retry with the backoff
+    HostWifi_SetAp("HostAP", NULL, 0, false);
+    HostEvent_Flush();
+    for (int Ms = 0; Ms < TEST_WAIT_MS; Ms += TEST_STEP_MS) {
+        HostTimer_Advance(TEST_STEP_MS * 1000);
+        HostEvent_Flush();
+    }
+    HostWifi_GetStats(&Stats, &Config);
+    TEST_ASSERT(Stats.Connects > (4 + TEST_TRIES));
+    TEST_ASSERT_EQUAL(4 + TEST_TRIES - 1, Stats.Directed);
+    TEST_ASSERT(Stats.isDhcp);
+}
+
+// MQTT does not retry while WiFi is down, the IP of the reconnect starts it at once
+static void test_mqtt_kick(void) {
+    ConnLink_Stats Link;
+    HostMqtt_Stats Stats;
+
+    HostWifi_SetAp("HostAP", NULL, 0, true);
+    TEST_ASSERT(test_wait_connected());
+    TEST_ASSERT_EQUAL(ESP_OK, MQTT_Init());
+    TEST_ASSERT_EQUAL(ESP_OK, MQTT_Start());
+    test_run(TEST_STEP_MS);
+    MQTT_GetLinkStats(&Link);
+    TEST_ASSERT(Link.isUp);
+
+    // WiFi goes first, then the broker connection
+    HostWifi_SetAp("HostAP", NULL, 0, false);
+    HostEvent_Flush();
+    TEST_ASSERT(!WiFi_isConnected());
+    HostMqtt_GetStats(&Stats);
+    const uint32_t Starts = Stats.Starts;
+    MQTT_GetLinkStats(&Link);
+    const uint32_t Attempts = Link.Attempts;
+    HostMqtt_Disconnect();
+    HostMqtt_Flush();
+
+    // No backoff runs and no start, however long it takes
+    test_run(TEST_OUTAGE_MS);
+    HostMqtt_GetStats(&Stats);
+    MQTT_GetLinkStats(&Link);
+    TEST_ASSERT_EQUAL(Starts, Stats.Starts);
+    TEST_ASSERT_EQUAL(Attempts, Link.Attempts);
+    TEST_ASSERT(!Link.isUp);
+
+    // WiFi back: GOT_IP kicks the client, without a backoff
+    HostWifi_SetAp("HostAP", NULL, 0, true);
+    TEST_ASSERT(test_wait_connected());
+    HostMqtt_Flush();
+    HostMqtt_GetStats(&Stats);
+    MQTT_GetLinkStats(&Link);
+    TEST_ASSERT_EQUAL(Starts + 1, Stats.Starts);
+    TEST_ASSERT_EQUAL(Attempts + 1, Link.Attempts);
+    TEST_ASSERT(Link.isUp);
+}
+
+int main(void) {
+    esp_log_level_set("*", ESP_LOG_NONE);
+
+    RUN_TEST(test_fallback);
+    RUN_TEST(test_fallback_dhcp);
+    RUN_TEST(test_fails_reset);
+    RUN_TEST(test_station);
+    RUN_TEST(test_mqtt_kick);
+    return (TEST_RESULT());
+}
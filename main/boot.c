@@ -0,0 +1,136 @@
+/**
+ ******************************************************************************
+ *  file           : boot.c
+ *  brief          : Startup orchestrator
+ *
+ *  Every stage runs in its own short living task. It waits for the ready
+ *  bits of the stages it depends on, runs its init function and sets its
+ *  own ready bit. Independent stages run in parallel, a stage waiting for
+ *  the network does not block the others. The time of every ready bit is
+ *  recorded for the boot report.
+ ******************************************************************************
+ */
+
+/****************************** Includes  */
+#include <stdio.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/event_groups.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "../components/drivers/sysmem.h"
+#include "boot.h"
+
+/****************************** Configuration */
+#define BOOT_PRIORITY (tskIDLE_PRIORITY + 1)
+
+/****************************** Statics */
+static const char *TAG = "BOOT";
+static EventGroupHandle_t xBootEvents = NULL;
+static int32_t ReadyMs[BOOT_MAX_BITS];  // Time of the ready bits, -1 if not set
+static portMUX_TYPE BootLock = portMUX_INITIALIZER_UNLOCKED;
+
+/****************************** Functions */
+
+/**
+ * @brief Task running one stage
+ *
+ * @param pvParameters The BootStage
+ */
+static void TaskBootStage(void* pvParameters) {
+    const BootStage * pStage = pvParameters;
+
+    if (0 != pStage->Requires) {
+        xEventGroupWaitBits(xBootEvents, pStage->Requires, pdFALSE, pdTRUE, portMAX_DELAY);
+    }
+
+    const int64_t Start = esp_timer_get_time();
+    const esp_err_t ret = pStage->Function();
+    const int64_t End = esp_timer_get_time();
+
+    if (ESP_OK == ret) {
+        Boot_SetReady(pStage->Provides);
+        ESP_LOGI(TAG, "Stage '%s' ready at %lu ms, took %lu ms", pStage->Name,
+                 (unsigned long)(End / 1000), (unsigned long)((End - Start) / 1000));
+    } else {
+        ESP_LOGE(TAG, "Stage '%s' failed (%s)", pStage->Name, esp_err_to_name(ret));
+    }
+
+    vTaskDelete(NULL);
+}  // TaskBootStage
+
+/**
+ * @brief Start all stages
+ *
+ * Returns immediately, use Boot_Wait() to wait for stages.
+ *
+ * @param pStages The stages, must stay valid
+ * @param Count Number of stages
+ * @return esp_err_t
+ */
+esp_err_t Boot_Start(const BootStage * pStages, size_t Count) {
+    xBootEvents = SYSMEM_EVENTGROUP("boot");
+    if (NULL == xBootEvents) {
+        return (ESP_ERR_NO_MEM);
+    }
+    for (int i = 0; i < BOOT_MAX_BITS; i++) {
+        ReadyMs[i] = -1;
+    }
+
+    for (size_t i = 0; i < Count; i++) {
+        if (pdPASS != xTaskCreate(TaskBootStage, pStages[i].Name, pStages[i].StackSize, (void*)&pStages[i], BOOT_PRIORITY, NULL)) {
+            ESP_LOGE(TAG, "Cannot start stage '%s'", pStages[i].Name);
+            return (ESP_ERR_NO_MEM);
+        }
+    }
+    return (ESP_OK);
+}  // Boot_Start
+
+/**
+ * @brief Signal ready bits, also usable outside of stages
+ *
+ * @param Bits The bits
+ */
+void Boot_SetReady(EventBits_t Bits) {
+    const int32_t Now = esp_timer_get_time() / 1000;
+
+    taskENTER_CRITICAL(&BootLock);
+    for (int i = 0; i < BOOT_MAX_BITS; i++) {
+        if ((Bits & (1UL << i)) && (ReadyMs[i] < 0)) {
+            ReadyMs[i] = Now;
+        }
+    }
+    taskEXIT_CRITICAL(&BootLock);
+
+    xEventGroupSetBits(xBootEvents, Bits);
+}  // Boot_SetReady
+
+/**
+ * @brief Wait for ready bits
+ *
+ * @param Bits All these bits must be set
+ * @param Timeout Max time to wait
+ * @return esp_err_t ESP_ERR_TIMEOUT
+ */
+esp_err_t Boot_Wait(EventBits_t Bits, TickType_t Timeout) {
+    const EventBits_t Ready = xEventGroupWaitBits(xBootEvents, Bits, pdFALSE, pdTRUE, Timeout);
+    return (((Ready & Bits) == Bits) ? ESP_OK : ESP_ERR_TIMEOUT);
+}
+
+/**
+ * @brief Time when a bit got ready
+ *
+ * @param Bit The bit
+ * @return int32_t ms since start, -1 if not ready
+ */
+int32_t Boot_GetReadyMs(EventBits_t Bit) {
+    for (int i = 0; i < BOOT_MAX_BITS; i++) {
+        if (Bit == (1UL << i)) {
+            return (ReadyMs[i]);
+        }
+    }
+    return (-1);
+}
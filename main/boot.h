@@ -0,0 +1,43 @@
+/**
+ ******************************************************************************
+ *  file           : boot.h
+ *  brief          : Startup orchestrator
+ ******************************************************************************
+ */
+
+#ifndef MAIN_BOOT_H_
+#define MAIN_BOOT_H_
+
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BOOT_MAX_BITS 24                // Usable bits of an event group
+
+// Init function of a stage, returns when the stage is ready
+typedef esp_err_t (*BootFunction)(void);
+
+// One subsystem of the startup
+typedef struct BootStage {
+    const char *    Name;               // Name for logging
+    EventBits_t     Requires;           // Ready bits to wait for before the start
+    EventBits_t     Provides;           // Ready bit set when Function succeeded
+    BootFunction    Function;           // The init function
+    uint32_t        StackSize;          // Stack of the stage task
+} BootStage;
+
+esp_err_t   Boot_Start(const BootStage * pStages, size_t Count);
+void        Boot_SetReady(EventBits_t Bits);
+esp_err_t   Boot_Wait(EventBits_t Bits, TickType_t Timeout);
+int32_t     Boot_GetReadyMs(EventBits_t Bit);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // MAIN_BOOT_H_
@@ -7,7 +7,6 @@
 /****************************** Includes  */
 #include <stdio.h>
 #include <string.h>
-#include <cJSON.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "esp_system.h"
@@ -23,8 +22,33 @@
 #include "../components/drivers/wifi.h"
 #include "../components/drivers/ntp.h"
 #include "../components/drivers/mqtt.h"
+#include "../components/drivers/txlog.h"
+#include "../components/drivers/codec.h"
+#include "../components/drivers/settings.h"
+#include "../components/drivers/sysmem.h"
 
 #include "../components/apps/commands.h"
+#include "../components/apps/ota.h"
+#include "../components/apps/telemetry.h"
+#include "../components/apps/perf.h"
+
+#include "boot.h"
+
+/****************************** Configuration */
+#define BOOT_NVS        BIT0            // NVS initialized
+#define BOOT_WIFI       BIT1            // Got an IP
+#define BOOT_NTP        BIT2            // NTP started
+#define BOOT_MQTT       BIT3            // MQTT initialized, subscriptions possible
+#define BOOT_BROKER     BIT4            // Connected to the broker
+#define BOOT_APPS       BIT5            // Apps initialized
+#define BOOT_HEALTHY    BIT6            // Command round-trip passed
+#define BOOT_PUBLISHED  BIT7            // First status published
+
+#define BOOT_HEALTH_TIMEOUT 120000      // Max time in ms until the health check must pass
+#define BOOT_SELFTEST_TIMEOUT 5000      // Max time in ms for one command round-trip
+#define BOOT_PUBLISH_MARGIN 10000       // Max time in ms after the telemetry phase for the first status
+
+#define STATS_SUBTOPIC "status"         // Subtopic of the system statistics
 
 /****************************** Statics */
 
@@ -37,79 +61,105 @@ static esp_ota_img_states_t ota_state;
 /**
  * @brief Task to send system statistics to mqtt
  *
+ * Values are sampled every period, only changed ones are published,
+ * see telemetry.c.
+ *
  * @param pvParameters
  */
 void TaskSysStats(void* pvParameters) {
     TickType_t  xLastRun;
 
+    // Fields which change all the time are only sent in keyframes
+    Telemetry_Init(STATS_SUBTOPIC);
+    Telemetry_Define("unixtime", TELEMETRY_KEYFRAME_ONLY);
+    Telemetry_Define("uptime", TELEMETRY_KEYFRAME_ONLY);
+    Telemetry_Define("heap8", 4096);
+    Telemetry_Define("heapi", 4096);
+    Telemetry_Define("wifioutms", TELEMETRY_KEYFRAME_ONLY);
+    Telemetry_Define("mqttoutms", TELEMETRY_KEYFRAME_ONLY);
+    Telemetry_Define("publat", 10000);
+    Telemetry_Define("publatmax", 10000);
+    Telemetry_Define("memres", TELEMETRY_KEYFRAME_ONLY);
+    Telemetry_Define("memused", 1024);
+
+    // Publish when the broker is there, at the phase of this device
+    Boot_Wait(BOOT_BROKER | BOOT_APPS, portMAX_DELAY);
+    vTaskDelay(pdMS_TO_TICKS(Telemetry_GetPhaseMs()));
+
     xLastRun = xTaskGetTickCount();
     while (1) {
-        cJSON * Payload;
-        char * pPayloadString = NULL;
-        uint32_t DelayTime;
         time_t now;
 
-        Payload = cJSON_CreateObject();
-
-        time(&now);                                                             // Current time
-        cJSON_AddNumberToObject(Payload, "unixtime", now);
-        cJSON_AddStringToObject(Payload, "partition", part_info->label);        // Current partition
-        cJSON_AddNumberToObject(Payload, "otastate", ota_state);                // OTA State
-        cJSON_AddNumberToObject(Payload, "uptime", esp_timer_get_time()/1000000); // Uptime in seconds
+        time(&now);                                                 // Current time
+        Telemetry_SetInt("unixtime", now);
+        Telemetry_SetString("partition", part_info->label);         // Current partition
+        Telemetry_SetInt("otastate", ota_state);                    // OTA State
+        Telemetry_SetInt("uptime", esp_timer_get_time()/1000000);   // Uptime in seconds
 
         // Free memory
-        cJSON_AddNumberToObject(Payload, "heap8", heap_caps_get_free_size(MALLOC_CAP_8BIT));
-        cJSON_AddNumberToObject(Payload, "heapi", heap_caps_get_free_size(MALLOC_CAP_INTERNAL));
-
-        pPayloadString = cJSON_Print(Payload);
-        if (ESP_OK != MQTT_Transmit("status", pPayloadString)) {
-            DelayTime = 5000; // retry in 5 secs
-        } else {
-            // DelayTime = 1*60*1000; // 1 Minute
-            DelayTime = 10*1000; // 10 secs for testing
+        Telemetry_SetInt("heap8", heap_caps_get_free_size(MALLOC_CAP_8BIT));
+        Telemetry_SetInt("heapi", heap_caps_get_free_size(MALLOC_CAP_INTERNAL));
+
+        // RAM of the long living tasks, queues and pools
+        SysMem_Stats MemStats;
+        SysMem_GetStats(&MemStats);
+        Telemetry_SetInt("memres", MemStats.Reserved);
+        Telemetry_SetInt("memused", MemStats.Used);
+
+        // Command interpreter
+        Comm_Stats CmdStats;
+        if (ESP_OK == Comm_GetStats(&CmdStats)) {
+            Telemetry_SetInt("cmdproc", CmdStats.Processed);
+            Telemetry_SetInt("cmddrop", CmdStats.Dropped);
+            Telemetry_SetInt("cmdhwm", CmdStats.HighWater);
         }
 
-        cJSON_Delete(Payload);
-        free(pPayloadString);
-        xTaskDelayUntil(&xLastRun, DelayTime/portTICK_PERIOD_MS);
+        // Connectivity: Outages and their durations
+        ConnLink_Stats LinkStats;
+        WiFi_GetStats(&LinkStats);
+        Telemetry_SetInt("wifiout", LinkStats.Outages);
+        Telemetry_SetInt("wifioutms", LinkStats.TotalOutageMs);
+        Telemetry_SetInt("wifilastms", LinkStats.LastOutageMs);
+        MQTT_GetLinkStats(&LinkStats);
+        Telemetry_SetInt("mqttout", LinkStats.Outages);
+        Telemetry_SetInt("mqttoutms", LinkStats.TotalOutageMs);
+        Telemetry_SetInt("mqttlastms", LinkStats.LastOutageMs);
 
-    }  // while 1
-} // TaskSysStats
+        // Async publishes
+        MQTT_TxStats PubStats;
+        MQTT_GetTxStats(&PubStats);
+        Telemetry_SetInt("publat", PubStats.LatencyAvgUs);
+        Telemetry_SetInt("publatmax", PubStats.LatencyMaxUs);
+        Telemetry_SetInt("pubretx", PubStats.Retransmits);
+        Telemetry_SetInt("pubqmax", PubStats.QueueHighWater);
 
-/**
- * @brief App Main / entry point
- */
-void app_main(void) {
-    esp_err_t ret = ESP_OK;
+        // Store-and-forward of messages sent while offline
+        TxLog_Stats LogStats;
+        TxLog_GetStats(&LogStats);
+        Telemetry_SetInt("txpend", LogStats.Pending);
+        Telemetry_SetInt("txdrop", LogStats.Dropped);
+        Telemetry_SetInt("txerase", LogStats.Erases);
 
-    // Print some system statistics
-    esp_chip_info_t chip_info;
-    esp_chip_info(&chip_info);
+        // Firmware updates
+        OTA_Stats UpdateStats;
+        OTA_GetStats(&UpdateStats);
+        Telemetry_SetInt("otawaste", UpdateStats.WastedBytes);
 
-    // Core info
-    ESP_LOGW(TAG, "-------------------------------------");
-    ESP_LOGW(TAG, "System Info:");
-    ESP_LOGW(TAG, "%s chip with %d CPU cores, WiFi%s%s, ",
-           CONFIG_IDF_TARGET,
-           chip_info.cores,
-           (chip_info.features & CHIP_FEATURE_BT) ? "/BT" : "",
-           (chip_info.features & CHIP_FEATURE_BLE) ? "/BLE" : "");
-    ESP_LOGW(TAG, "Heap: %lu", esp_get_free_heap_size());
-    ESP_LOGW(TAG, "Reset reason: %d", esp_reset_reason());
-    ESP_LOGW(TAG, "-------------------------------------");
+        // Stored messages are forwarded later, unsent fields are sent with the next period
+        if (ESP_OK == Telemetry_Flush()) {
+            Boot_SetReady(BOOT_PUBLISHED);
+        }
 
-    // Partition info
-    part_info = (esp_partition_t*)esp_ota_get_boot_partition();
-    esp_ota_get_state_partition(part_info, &ota_state);
-    if (NULL != part_info) {
-        ESP_LOGW(TAG, "Current partition:");
-        ESP_LOGW(TAG, "    Label = %s, state = %d", part_info->label, ota_state);
-        ESP_LOGW(TAG, "    Address=0x%lx, size=0x%lx", part_info->address, part_info->size);
-    }
-    ESP_LOGW(TAG, "-------------------------------------");
+        xTaskDelayUntil(&xLastRun, pdMS_TO_TICKS(Telemetry_GetPeriodMs()));
 
-    // Initialize NVS, format it if necessary
-    ret = nvs_flash_init();
+    }  // while 1
+} // TaskSysStats
+
+/**
+ * @brief Boot stage: Initialize NVS, format it if necessary
+ */
+static esp_err_t boot_nvs(void) {
+    esp_err_t ret = nvs_flash_init();
     if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND) {
         ESP_LOGW(TAG, "Erasing NVS!");
         ESP_ERROR_CHECK(nvs_flash_erase());
@@ -117,6 +167,8 @@ void app_main(void) {
     }
     ESP_ERROR_CHECK(ret);
     ESP_LOGI(TAG, "NVS init returned %d", ret);
+    ESP_ERROR_CHECK(Settings_Init());
+    Codec_Init();
 
 #if 0
     // Print out NVS statistics
@@ -142,35 +194,155 @@ void app_main(void) {
 
 #if 0
     // Write initial settings to NVS
-    nvs_handle_t handle;
-    nvs_open("SETTINGS", NVS_READWRITE, &handle);
-    nvs_set_str(handle, "WIFI_SSID", "My cool SSID");
-    nvs_set_str(handle, "WIFI_PASS", "SupaSecret");
-    nvs_set_str(handle, "MQTT_URL", "mqtt://IP:Address");
-    nvs_close(handle);
+    Settings_SetStr(SETTING_WIFI_SSID, "My cool SSID");
+    Settings_SetStr(SETTING_WIFI_PASS, "SupaSecret");
+    Settings_SetStr(SETTING_MQTT_URL, "mqtt://IP:Address");
+    Settings_Flush();
 #endif
 
-    ESP_ERROR_CHECK(WiFi_Init());       // Initialize WiFi
-    ESP_ERROR_CHECK(NTP_Init());        // Initialize NTP
-    ESP_ERROR_CHECK(MQTT_Init());       // Initialize MQTT
+    return (ESP_OK);
+}  // boot_nvs
+
+/**
+ * @brief Boot stage: Start WiFi and wait for the connection
+ *
+ * An AP which is down at boot is retried in the background, the stage
+ * only completes when connected. The health timeout decides on rollback.
+ */
+static esp_err_t boot_wifi(void) {
+    ESP_ERROR_CHECK(WiFi_Init());
+    return (WiFi_WaitConnected(portMAX_DELAY));
+}
+
+/**
+ * @brief Boot stage: Connect to the broker
+ */
+static esp_err_t boot_broker(void) {
+    ESP_ERROR_CHECK(MQTT_Start());
+    return (MQTT_WaitConnected(portMAX_DELAY));
+}
 
+/**
+ * @brief Boot stage: Init the apps
+ */
+static esp_err_t boot_apps(void) {
     // Task for sending system status
-    xTaskCreate(TaskSysStats, "MQTT Sys Stats", 4096, NULL, tskIDLE_PRIORITY, NULL);
+    ESP_ERROR_CHECK(SYSMEM_TASK(TaskSysStats, "MQTT Sys Stats", SYSMEM_STACK_SYSSTATS, NULL, tskIDLE_PRIORITY, NULL));
+
+    // Perf telemetry, switched on by command
+    ESP_ERROR_CHECK(Perf_Init());
 
     // Setup command interpreter
-    ESP_ERROR_CHECK(Comm_Init());
+    return (Comm_Init());
+}
+
+/**
+ * @brief Boot stage: Health check, a command round-trip over the broker
+ */
+static esp_err_t boot_health(void) {
+    esp_err_t ret = ESP_ERR_TIMEOUT;
+
+    for (int Try = 0; (Try < (BOOT_HEALTH_TIMEOUT / BOOT_SELFTEST_TIMEOUT)) && (ESP_OK != ret); Try++) {
+        ret = Comm_SelfTest(BOOT_SELFTEST_TIMEOUT / portTICK_PERIOD_MS);
+        if ((ESP_OK != ret) && (ESP_ERR_TIMEOUT != ret)) {
+            vTaskDelay(BOOT_SELFTEST_TIMEOUT / portTICK_PERIOD_MS);
+        }
+    }
+    return (ret);
+}  // boot_health
+
+// The startup: Stages with their dependencies
+static const BootStage BootStages[] = {
+    { "nvs",    0,                          BOOT_NVS,       boot_nvs,       4096 },
+    { "wifi",   BOOT_NVS,                   BOOT_WIFI,      boot_wifi,      4096 },
+    { "ntp",    BOOT_WIFI,                  BOOT_NTP,       NTP_Init,       2048 },
+    { "mqtt",   BOOT_NVS,                   BOOT_MQTT,      MQTT_Init,      4096 },
+    { "broker", BOOT_WIFI | BOOT_MQTT,      BOOT_BROKER,    boot_broker,    2048 },
+    { "apps",   BOOT_MQTT,                  BOOT_APPS,      boot_apps,      4096 },
+    { "health", BOOT_BROKER | BOOT_APPS,    BOOT_HEALTHY,   boot_health,    3072 },
+};
+#define BOOT_STAGES (sizeof(BootStages)/sizeof(BootStages[0]))
+
+/**
+ * @brief Publish the times of the boot phases
+ *
+ * Called after the first status, "published" is -1 only if it failed.
+ */
+static void boot_report(void) {
+    uint8_t Buffer[256];
+    Codec_Writer Payload;
+    size_t Length;
+
+    Codec_Begin(&Payload, Codec_GetFormat("boot"), Buffer, sizeof(Buffer));
+    Codec_AddString(&Payload, "version", esp_app_get_description()->version);
+    for (int i = 0; i < BOOT_STAGES; i++) {
+        Codec_AddInt(&Payload, BootStages[i].Name, Boot_GetReadyMs(BootStages[i].Provides));
+    }
+    Codec_AddInt(&Payload, "published", Boot_GetReadyMs(BOOT_PUBLISHED));
+
+    if (ESP_OK == Codec_End(&Payload, &Length)) {
+        MQTT_TransmitData("boot", Buffer, Length);
+    }
+}  // boot_report
+
+/**
+ * @brief App Main / entry point
+ */
+void app_main(void) {
+    esp_err_t ret = ESP_OK;
+
+    // Print some system statistics
+    esp_chip_info_t chip_info;
+    esp_chip_info(&chip_info);
+
+    // Core info
+    ESP_LOGW(TAG, "-------------------------------------");
+    ESP_LOGW(TAG, "System Info:");
+    ESP_LOGW(TAG, "%s chip with %d CPU cores, WiFi%s%s, ",
+           CONFIG_IDF_TARGET,
+           chip_info.cores,
+           (chip_info.features & CHIP_FEATURE_BT) ? "/BT" : "",
+           (chip_info.features & CHIP_FEATURE_BLE) ? "/BLE" : "");
+    ESP_LOGW(TAG, "Heap: %lu", esp_get_free_heap_size());
+    ESP_LOGW(TAG, "Reset reason: %d", esp_reset_reason());
+    ESP_LOGW(TAG, "-------------------------------------");
 
-    // 5 sec delay, then mark fw as valid to avoid rollback
-    vTaskDelay(5000 / portTICK_PERIOD_MS);
+    // Partition info
+    part_info = (esp_partition_t*)esp_ota_get_boot_partition();
+    esp_ota_get_state_partition(part_info, &ota_state);
+    if (NULL != part_info) {
+        ESP_LOGW(TAG, "Current partition:");
+        ESP_LOGW(TAG, "    Label = %s, state = %d", part_info->label, ota_state);
+        ESP_LOGW(TAG, "    Address=0x%lx, size=0x%lx", part_info->address, part_info->size);
+    }
+    ESP_LOGW(TAG, "-------------------------------------");
+
+    // Start all subsystems, independent ones in parallel
+    ESP_ERROR_CHECK(Boot_Start(BootStages, BOOT_STAGES));
+
+    // Mark fw as valid when healthy to avoid rollback
+    ret = Boot_Wait(BOOT_HEALTHY, BOOT_HEALTH_TIMEOUT / portTICK_PERIOD_MS);
     const esp_partition_t *running = esp_ota_get_running_partition();
     esp_ota_img_states_t ota_state;
     if (esp_ota_get_state_partition(running, &ota_state) == ESP_OK) {
         if (ota_state == ESP_OTA_IMG_PENDING_VERIFY) {
-            ESP_LOGI(TAG, "Current partition marked as valid!");
-            esp_ota_mark_app_valid_cancel_rollback();
+            if (ESP_OK == ret) {
+                ESP_LOGI(TAG, "Current partition marked as valid!");
+                esp_ota_mark_app_valid_cancel_rollback();
+            } else {
+                ESP_LOGE(TAG, "Health check failed, rolling back!");
+                esp_ota_mark_app_invalid_rollback_and_reboot();
+            }
         }
     }
 
+    // Report once the first status is out, it starts at the telemetry phase
+    if (ESP_OK != Boot_Wait(BOOT_PUBLISHED, pdMS_TO_TICKS(Telemetry_GetPhaseMs() + BOOT_PUBLISH_MARGIN))) {
+        ESP_LOGW(TAG, "No status published yet");
+    }
+    boot_report();
+    SysMem_Report();
+
     // Idle loop
     ESP_LOGI(TAG, "Starting idling");
     while (1) {
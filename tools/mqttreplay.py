@@ -0,0 +1,286 @@
+#!/usr/bin/env python3
+"""
+Capture and replay of the MQTT traffic of a device
+
+  mqttreplay.py capture --base <base> [--topic cmd] <file>
+  mqttreplay.py replay  --base <base> [--speed 1] [--exclude restart,fwupdate,cancel] <file>
+  common: [--host localhost] [--port 1883]
+
+capture subscribes at the broker to <base>/<topic> (default: cmd, may be
+given more than once, wildcards allowed) and writes subtopic, payload and
+the time since the previous message into <file> until Ctrl-C.
+
+replay publishes the file to <base>, which may be another device, with
+the recorded inter-arrival times divided by --speed (0: as fast as
+possible). Send times are fixed in advance, so a slow publish does not
+shift the rest of the schedule. Commands in --exclude are skipped. Before
+and after the replay the device is asked for {"cmd":"latency"} and the
+difference is printed: processed and dropped commands, queue high water,
+p50/p95/p99/max per stage and, with run time stats, CPU per command.
+
+The same file replays on the host into mqtt_event_handler of the firmware
+running on the client mocks, see host/bench/replay.c.
+
+File: "MQRP" 0x01, then per message varint delta us, varint subtopic
+length, subtopic, varint payload length, payload.
+"""
+
+import argparse
+import json
+import os
+import socket
+import struct
+import sys
+import threading
+import time
+
+MAGIC = b"MQRP\x01"
+KEEPALIVE = 60
+STAGES = ("rx", "queue", "exec", "total")
+
+
+def varint(value):
+    out = bytearray()
+    while True:
+        byte = value & 0x7F
+        value >>= 7
+        out.append(byte | (0x80 if value else 0))
+        if not value:
+            return bytes(out)
+
+
+def read_varint(f):
+    value = shift = 0
+    while True:
+        byte = f.read(1)
+        if not byte:
+            raise EOFError
+        value |= (byte[0] & 0x7F) << shift
+        shift += 7
+        if not byte[0] & 0x80:
+            return value
+
+
+def mqtt_string(text):
+    data = text.encode()
+    return struct.pack(">H", len(data)) + data
+
+
+class Client:
+    """Minimal MQTT 3.1.1 client, QoS 0 only"""
+
+    def __init__(self, host, port, on_message):
+        self.on_message = on_message
+        self.sock = socket.create_connection((host, port))
+        self.lock = threading.Lock()
+        body = mqtt_string("MQTT") + bytes([4, 0x02]) + struct.pack(">H", KEEPALIVE)
+        body += mqtt_string("mqttreplay-%d" % os.getpid())
+        self.send(0x10, body)
+        kind, data = self.read_packet()
+        if kind != 0x20 or data[1] != 0:
+            raise ConnectionError("Connect refused (%s)" % data.hex())
+        threading.Thread(target=self.reader, daemon=True).start()
+        threading.Thread(target=self.pinger, daemon=True).start()
+
+    def send(self, header, body):
+        with self.lock:
+            self.sock.sendall(bytes([header]) + varint(len(body)) + body)
+
+    def read_exact(self, length):
+        data = b""
+        while len(data) < length:
+            chunk = self.sock.recv(length - len(data))
+            if not chunk:
+                raise ConnectionError("Connection closed")
+            data += chunk
+        return data
+
+    def read_packet(self):
+        header = self.read_exact(1)[0]
+        length = shift = 0
+        while True:
+            byte = self.read_exact(1)[0]
+            length |= (byte & 0x7F) << shift
+            shift += 7
+            if not byte & 0x80:
+                break
+        return header & 0xF0, self.read_exact(length)
+
+    def reader(self):
+        while True:
+            kind, data = self.read_packet()
+            if kind == 0x30:
+                topic_len = struct.unpack(">H", data[:2])[0]
+                self.on_message(data[2:2 + topic_len].decode(), data[2 + topic_len:])
+
+    def pinger(self):
+        while True:
+            time.sleep(KEEPALIVE / 2)
+            self.send(0xC0, b"")
+
+    def subscribe(self, topic):
+        self.send(0x82, struct.pack(">H", 1) + mqtt_string(topic) + b"\x00")
+
+    def publish(self, topic, payload):
+        self.send(0x30, mqtt_string(topic) + payload)
+
+
+def cbor_decode(data, pos=0):
+    """Decoder for what the device codec writes: ints, strings, bools, indefinite map"""
+    major, info = data[pos] >> 5, data[pos] & 0x1F
+    pos += 1
+    if info == 31:
+        result = {}
+        while data[pos] != 0xFF:
+            key, pos = cbor_decode(data, pos)
+            result[key], pos = cbor_decode(data, pos)
+        return result, pos + 1
+    if major == 7:
+        return info == 21, pos
+    if info < 24:
+        value = info
+    else:
+        size = 1 << (info - 24)
+        value = int.from_bytes(data[pos:pos + size], "big")
+        pos += size
+    if major == 0:
+        return value, pos
+    if major == 1:
+        return -1 - value, pos
+    return data[pos:pos + value].decode(), pos + value
+
+
+def decode(payload):
+    if payload[:1] == b"{":
+        return json.loads(payload)
+    return cbor_decode(payload)[0]
+
+
+def capture(args):
+    prefix = args.base + "/"
+    last = [None]
+    count = [0]
+    lock = threading.Lock()
+    out = open(args.file, "wb")
+    out.write(MAGIC)
+
+    def on_message(topic, payload):
+        now = time.monotonic_ns() // 1000
+        with lock:
+            delta = 0 if last[0] is None else now - last[0]
+            last[0] = now
+            sub = topic[len(prefix):].encode()
+            out.write(varint(delta) + varint(len(sub)) + sub + varint(len(payload)) + payload)
+            count[0] += 1
+
+    client = Client(args.host, args.port, on_message)
+    for topic in args.topic or ["cmd"]:
+        client.subscribe(prefix + topic)
+    print("Capturing %s, Ctrl-C to stop" % ", ".join(prefix + t for t in args.topic or ["cmd"]))
+    try:
+        while True:
+            time.sleep(1)
+    except KeyboardInterrupt:
+        pass
+    with lock:
+        out.close()
+    print("%d messages, %d bytes" % (count[0], os.path.getsize(args.file)))
+
+
+def load(path):
+    messages = []
+    with open(path, "rb") as f:
+        if f.read(len(MAGIC)) != MAGIC:
+            sys.exit("%s: Not a capture file" % path)
+        while True:
+            try:
+                delta = read_varint(f)
+            except EOFError:
+                return messages
+            topic = f.read(read_varint(f)).decode()
+            messages.append((delta, topic, f.read(read_varint(f))))
+
+
+def is_excluded(topic, payload, exclude):
+    if topic != "cmd":
+        return False
+    try:
+        return decode(payload).get("cmd") in exclude
+    except (ValueError, IndexError, AttributeError):
+        return False
+
+
+def replay(args):
+    prefix = args.base + "/"
+    reports = []
+    answered = threading.Event()
+
+    def on_message(topic, payload):
+        reports.append(decode(payload))
+        answered.set()
+
+    def ask(payload):
+        answered.clear()
+        client.publish(prefix + "cmd", json.dumps({"cmd": "latency", "payload": payload}).encode())
+        if not answered.wait(args.timeout):
+            sys.exit("No answer on %slatency" % prefix)
+
+    messages = load(args.file)
+    exclude = set(filter(None, args.exclude.split(",")))
+    client = Client(args.host, args.port, on_message)
+    client.subscribe(prefix + "latency")
+    time.sleep(0.5)
+    ask("reset")
+
+    sent = skipped = 0
+    start = time.monotonic()
+    due = 0.0
+    for delta, topic, payload in messages:
+        if args.speed > 0:
+            due += delta / 1e6 / args.speed
+            wait = start + due - time.monotonic()
+            if wait > 0:
+                time.sleep(wait)
+        if is_excluded(topic, payload, exclude):
+            skipped += 1
+            continue
+        client.publish(prefix + topic, payload)
+        sent += 1
+    duration = time.monotonic() - start
+
+    time.sleep(args.settle)
+    ask("")
+    before, after = reports[0], reports[-1]
+
+    print("%d messages in %.2f s (%.0f/s), %d skipped" % (sent, duration, sent / max(duration, 1e-6), skipped))
+    processed = after["cmd.proc"] - before["cmd.proc"] - 1     # Without the reset
+    print("processed %d, dropped %d, queue high water %d" % (processed, after["cmd.drop"] - before["cmd.drop"], after["cmd.hwm"]))
+    print("%-6s %8s %8s %8s %8s %8s" % ("stage", "n", "p50 us", "p95 us", "p99 us", "max us"))
+    for stage in STAGES:
+        print("%-6s %8d %8d %8d %8d %8d" % ((stage,) + tuple(after["%s.%s" % (stage, k)] for k in ("n", "p50", "p95", "p99", "max"))))
+    if "cmd.cpu" in after and processed > 0:
+        print("CPU per command: %.0f us" % ((after["cmd.cpu"] - before["cmd.cpu"]) / processed))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("mode", choices=("capture", "replay"))
+    parser.add_argument("file")
+    parser.add_argument("--host", default="localhost")
+    parser.add_argument("--port", type=int, default=1883)
+    parser.add_argument("--base", required=True, help="base topic of the device")
+    parser.add_argument("--topic", action="append", help="capture: subtopic filter")
+    parser.add_argument("--speed", type=float, default=1.0, help="replay: 1, 10, ..., 0 = unthrottled")
+    parser.add_argument("--exclude", default="restart,fwupdate,cancel", help="replay: skipped commands")
+    parser.add_argument("--settle", type=float, default=2.0, help="replay: seconds to wait before the report")
+    parser.add_argument("--timeout", type=float, default=10.0, help="replay: seconds to wait for the device")
+    args = parser.parse_args()
+
+    if args.mode == "capture":
+        capture(args)
+    else:
+        replay(args)
+
+
+if __name__ == "__main__":
+    main()
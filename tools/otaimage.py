@@ -0,0 +1,131 @@
+#!/usr/bin/env python3
+"""
+Create compressed and delta OTA images for IoT-Base
+
+  otaimage.py compress <app.bin> <out.iotu>
+  otaimage.py delta <base.bin> <app.bin> <out.iotu> [--no-compress]
+
+The base of a delta image must be the app that is running on the device,
+the device checks this by the app_elf_sha256 in the app description.
+Plain app images are still accepted by the device. See otadec.h for the
+format.
+"""
+
+import argparse
+import struct
+import sys
+import zlib
+
+MAGIC = b"IOTU"
+VERSION = 1
+FLAG_DEFLATE = 0x01
+FLAG_DELTA = 0x02
+WINDOW_BITS = 13            # Must be <= OTADEC_MAX_WINDOWBITS
+IMAGE_MAGIC = 0xE9
+ELF_SHA256_OFFSET = 24 + 8 + 144  # Image header, segment header, offset in esp_app_desc_t
+BLOCK = 32                  # Min length of a copy
+OP_END = 0x00
+OP_COPY = 0x01
+OP_ADD = 0x02
+
+
+def varint(value):
+    out = bytearray()
+    while True:
+        byte = value & 0x7F
+        value >>= 7
+        if value:
+            out.append(byte | 0x80)
+        else:
+            out.append(byte)
+            return bytes(out)
+
+
+def read_image(path):
+    with open(path, "rb") as f:
+        data = f.read()
+    if len(data) < ELF_SHA256_OFFSET + 32 or data[0] != IMAGE_MAGIC:
+        sys.exit("%s: Not an app image" % path)
+    return data
+
+
+def delta(base, new):
+    """Greedy delta: Copies of >= BLOCK bytes from base, literals otherwise"""
+    index = {}
+    for offset in range(0, len(base) - BLOCK + 1, BLOCK):
+        index.setdefault(base[offset:offset + BLOCK], offset)
+
+    ops = bytearray()
+    literal = bytearray()
+
+    def flush_literal():
+        if literal:
+            ops.extend(bytes([OP_ADD]) + varint(len(literal)) + literal)
+            literal.clear()
+
+    pos = 0
+    while pos < len(new):
+        src = index.get(new[pos:pos + BLOCK])
+        if src is None:
+            literal.append(new[pos])
+            pos += 1
+            continue
+
+        # Extend the match backwards into the literal and forwards
+        start = src
+        while literal and start > 0 and base[start - 1] == literal[-1]:
+            literal.pop()
+            start -= 1
+            pos -= 1
+        end = src + BLOCK
+        pos_end = pos + (end - start)
+        while end < len(base) and pos_end < len(new) and base[end] == new[pos_end]:
+            end += 1
+            pos_end += 1
+
+        flush_literal()
+        ops.extend(bytes([OP_COPY]) + varint(start) + varint(end - start))
+        pos = pos_end
+
+    flush_literal()
+    ops.append(OP_END)
+    return bytes(ops)
+
+
+def container(flags, image_size, base_sha, payload):
+    header = MAGIC + struct.pack("<BBBBI", VERSION, flags, WINDOW_BITS, 0, image_size) + base_sha
+    if flags & FLAG_DEFLATE:
+        compressor = zlib.compressobj(9, zlib.DEFLATED, -WINDOW_BITS)
+        payload = compressor.compress(payload) + compressor.flush()
+    return header + payload
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Create compressed and delta OTA images")
+    sub = parser.add_subparsers(dest="mode", required=True)
+    p = sub.add_parser("compress", help="Compressed full image")
+    p.add_argument("image")
+    p.add_argument("output")
+    p = sub.add_parser("delta", help="Delta against the running image")
+    p.add_argument("base")
+    p.add_argument("image")
+    p.add_argument("output")
+    p.add_argument("--no-compress", action="store_true", help="Don't compress the delta")
+    args = parser.parse_args()
+
+    image = read_image(args.image)
+    if args.mode == "compress":
+        out = container(FLAG_DEFLATE, len(image), bytes(32), image)
+    else:
+        base = read_image(args.base)
+        flags = FLAG_DELTA | (0 if args.no_compress else FLAG_DEFLATE)
+        base_sha = base[ELF_SHA256_OFFSET:ELF_SHA256_OFFSET + 32]
+        out = container(flags, len(image), base_sha, delta(base, image))
+
+    with open(args.output, "wb") as f:
+        f.write(out)
+    print("%s: %d -> %d bytes (%.1f%%)" % (args.output, len(image), len(out), 100.0 * len(out) / len(image)))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,80 @@
+#!/usr/bin/env python3
+"""
+HTTP server for testing OTA updates on flaky links
+
+  otaserver.py [--port 8070] [--drop 0.3] <directory>
+
+Serves the files in <directory> with support for range requests (Range,
+If-Range, ETag). With --drop, each response is cut off at a random offset
+with this probability. The bytes sent per file are printed, for resumed
+downloads the total should stay close to the image size.
+"""
+
+import argparse
+import hashlib
+import http.server
+import os
+import random
+import re
+
+sent = {}
+
+
+class Handler(http.server.BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"
+
+    def do_GET(self):
+        path = os.path.join(self.server.root, os.path.basename(self.path.split("?")[0]))
+        if not os.path.isfile(path):
+            self.send_error(404)
+            return
+        with open(path, "rb") as f:
+            data = f.read()
+        etag = '"%s"' % hashlib.sha1(data).hexdigest()[:16]
+
+        start = 0
+        status = 200
+        match = re.match(r"bytes=(\d+)-$", self.headers.get("Range", ""))
+        if match and self.headers.get("If-Range", etag) == etag:
+            start = int(match.group(1))
+            if start >= len(data):
+                self.send_error(416)
+                return
+            status = 206
+
+        self.send_response(status)
+        self.send_header("Content-Type", "application/octet-stream")
+        self.send_header("Content-Length", str(len(data) - start))
+        self.send_header("ETag", etag)
+        self.send_header("Accept-Ranges", "bytes")
+        if status == 206:
+            self.send_header("Content-Range", "bytes %d-%d/%d" % (start, len(data) - 1, len(data)))
+        self.end_headers()
+
+        end = len(data)
+        if random.random() < self.server.drop:
+            end = random.randint(start, len(data) - 1)
+        self.wfile.write(data[start:end])
+        sent[path] = sent.get(path, 0) + (end - start)
+        print("%s: bytes %d-%d of %d%s, sent in total %d" % (os.path.basename(path), start, end, len(data),
+              " (dropped)" if end < len(data) else "", sent[path]))
+        if end < len(data):
+            self.close_connection = True
+
+
+def main():
+    parser = argparse.ArgumentParser(description="HTTP server for OTA tests")
+    parser.add_argument("--port", type=int, default=8070)
+    parser.add_argument("--drop", type=float, default=0.0, help="Probability to cut off a response")
+    parser.add_argument("directory")
+    args = parser.parse_args()
+
+    server = http.server.ThreadingHTTPServer(("", args.port), Handler)
+    server.root = args.directory
+    server.drop = args.drop
+    print("Serving %s on port %d" % (args.directory, args.port))
+    server.serve_forever()
+
+
+if __name__ == "__main__":
+    main()
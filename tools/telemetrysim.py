@@ -0,0 +1,81 @@
+#!/usr/bin/env python3
+"""
+Simulation of the broker load caused by the status telemetry of a fleet
+
+  telemetrysim.py [--devices 5000] [--duration 900] [--period 10]
+                  [--keyframe 300] [--change 0.1]
+
+All devices power up at the same time, like after a power outage, and
+need a few seconds for WiFi and broker. Compared are the old scheme (full
+status every period, starting at boot) and the new one (phase from the
+MAC, only changed fields, full keyframe every --keyframe seconds).
+--change is the probability that a field changes beyond its threshold
+within one period. Printed are messages and bytes per second.
+"""
+
+import argparse
+import random
+import struct
+import zlib
+
+FIELDS = 26                 # Members of the status
+FULL_BYTES = 277            # Size of a full status (CBOR)
+FIELD_BYTES = 10            # Average size of one member (CBOR)
+KEYFRAME_ONLY = 6           # Members only sent in keyframes
+
+
+def fnv1a(data):
+    h = 2166136261
+    for b in data:
+        h = ((h ^ b) * 16777619) & 0xFFFFFFFF
+    return h
+
+
+def simulate(args, new):
+    buckets = [0] * args.duration
+    volume = [0] * args.duration
+    rnd = random.Random(1)
+
+    for dev in range(args.devices):
+        mac = struct.pack(">HI", 0x2462, zlib.crc32(dev.to_bytes(4, "little")))
+        t = 3.0 + rnd.random() * 2.0            # WiFi and broker
+        if new:
+            t += (fnv1a(mac) % (args.period * 1000)) / 1000.0
+        next_keyframe = t
+
+        while t < args.duration:
+            if not new:
+                size = FULL_BYTES
+            elif t >= next_keyframe:
+                size = FULL_BYTES
+                next_keyframe = t + args.keyframe
+            else:
+                changed = sum(rnd.random() < args.change for _ in range(FIELDS - KEYFRAME_ONLY))
+                size = (changed * FIELD_BYTES + 2) if changed else 0
+            if size:
+                buckets[int(t)] += 1
+                volume[int(t)] += size
+            t += args.period
+
+    return buckets, volume
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--devices", type=int, default=5000)
+    parser.add_argument("--duration", type=int, default=900, help="seconds")
+    parser.add_argument("--period", type=int, default=10, help="seconds")
+    parser.add_argument("--keyframe", type=int, default=300, help="seconds")
+    parser.add_argument("--change", type=float, default=0.1)
+    args = parser.parse_args()
+
+    print(f"{args.devices} devices, {args.duration} s")
+    print(f"{'':8} {'msg/s avg':>10} {'msg/s peak':>11} {'kB/s avg':>9} {'kB/s peak':>10}")
+    for name, new in (("before", False), ("after", True)):
+        buckets, volume = simulate(args, new)
+        print(f"{name:8} {sum(buckets) / args.duration:10.1f} {max(buckets):11d}"
+              f" {sum(volume) / args.duration / 1024:9.1f} {max(volume) / 1024:10.1f}")
+
+
+if __name__ == "__main__":
+    main()